@@ -2572,7 +2572,7 @@ void EndpointAppPBX::process_dialing(int timeout)
 			goto process_action;
 		}
 
-		gettimeofday(&current_time, NULL);
+		get_monotonic(&current_time);
 		if (e_match_to_action && TIME_SMALLER(&e_match_timeout.timeout, &current_time)) {
 			/* return timeout rule */
 			PDEBUG(DEBUG_EPOINT, "EPOINT(%d): terminal '%s' dialing: '%s', timeout in ruleset '%s'\n", ea_endpoint->ep_serial, e_ext.number, e_dialinginfo.id, e_ruleset->name);
@@ -83,6 +83,7 @@ EndpointAppPBX::EndpointAppPBX(class Endpoint *epoint, int origin) : EndpointApp
 	e_rule_nesting = 0;
         e_action = NULL;
 	e_match_to_action = NULL;
+	e_route_state = NULL;
         e_select = 0;
         e_extdialing = e_dialinginfo.id;
 //        e_knocking = 0;
@@ -148,6 +149,8 @@ EndpointAppPBX::~EndpointAppPBX(void)
 	del_timer(&e_callback_timeout);
 	del_timer(&e_password_timeout);
 
+	route_state_free(e_route_state);
+
 	/* detach */
 	temp =apppbx_first;
 	tempp = &apppbx_first;
@@ -1558,7 +1561,7 @@ void EndpointAppPBX::port_information(struct port_list *portlist, int message_ty
 	if (e_state == EPOINT_STATE_CONNECT || e_state == EPOINT_STATE_IN_ALERTING) {
 		if (e_enablekeypad) {
 			message = message_create(ea_endpoint->ep_serial, ea_endpoint->ep_join_id, EPOINT_TO_JOIN, message_type);
-			memcpy(&message->param, param, sizeof(union parameter));
+			memcpy(&message->param, param, message_param_size(message->type));
 			message_put(message);
 			return;
 		}
@@ -1642,7 +1645,7 @@ NOTE: vbox is now handled due to overlap state
 	if (e_state == EPOINT_STATE_CONNECT || e_state == EPOINT_STATE_IN_ALERTING) {
 		if (e_enablekeypad) {
 			message = message_create(ea_endpoint->ep_serial, ea_endpoint->ep_join_id, EPOINT_TO_JOIN, message_type);
-			memcpy(&message->param, param, sizeof(union parameter));
+			memcpy(&message->param, param, message_param_size(message->type));
 			message_put(message);
 			return;
 		}
@@ -1773,7 +1776,7 @@ void EndpointAppPBX::port_overlap(struct port_list *portlist, int message_type,
 	/* if we are in a join */
 	if (ea_endpoint->ep_join_id) { 
 		message = message_create(ea_endpoint->ep_serial, ea_endpoint->ep_join_id, EPOINT_TO_JOIN, message_type);
-		memcpy(&message->param, param, sizeof(union parameter));
+		memcpy(&message->param, param, message_param_size(message->type));
 		message_put(message);
 	}
 }
@@ -1812,7 +1815,7 @@ void EndpointAppPBX::port_proceeding(struct port_list *portlist, int message_typ
 	/* if we are in a call */
 	if (ea_endpoint->ep_join_id) { 
 		message = message_create(ea_endpoint->ep_serial, ea_endpoint->ep_join_id, EPOINT_TO_JOIN, message_type);
-		memcpy(&message->param, param, sizeof(union parameter));
+		memcpy(&message->param, param, message_param_size(message->type));
 		message_put(message);
 	}
 }
@@ -1854,7 +1857,7 @@ void EndpointAppPBX::port_alerting(struct port_list *portlist, int message_type,
 	/* if we are in a call */
 	if (ea_endpoint->ep_join_id) { 
 		message = message_create(ea_endpoint->ep_serial, ea_endpoint->ep_join_id, EPOINT_TO_JOIN, message_type);
-		memcpy(&message->param, param, sizeof(union parameter));
+		memcpy(&message->param, param, message_param_size(message->type));
 		message_put(message);
 	}
 }
@@ -2141,7 +2144,7 @@ void EndpointAppPBX::port_disconnect_release(struct port_list *portlist, int mes
 			message_put(message);
 			/* send disconnect */
 			message = message_create(ea_endpoint->ep_serial, ea_endpoint->ep_join_id, EPOINT_TO_JOIN, message_type);
-			memcpy(&message->param, param, sizeof(union parameter));
+			memcpy(&message->param, param, message_param_size(message->type));
 			message_put(message);
 			/* disable encryption if disconnected */
 //PERROR("REMOVE ME: state =%d, %d\n", e_crypt_state, e_crypt);
@@ -2412,7 +2415,7 @@ void EndpointAppPBX::port_enablekeypad(struct port_list *portlist, int message_t
 	logmessage(message_type, param, portlist->port_id, DIRECTION_IN);
 
 	message = message_create(ea_endpoint->ep_serial, ea_endpoint->ep_join_id, EPOINT_TO_JOIN, MESSAGE_ENABLEKEYPAD);
-	memcpy(&message->param, param, sizeof(union parameter));
+	memcpy(&message->param, param, message_param_size(message->type));
 	message_put(message);
 }
 
@@ -2425,7 +2428,7 @@ void EndpointAppPBX::port_disable_dejitter(struct port_list *portlist, int messa
 	logmessage(message_type, param, portlist->port_id, DIRECTION_IN);
 
 	message = message_create(ea_endpoint->ep_serial, ea_endpoint->ep_join_id, EPOINT_TO_JOIN, MESSAGE_DISABLE_DEJITTER);
-	memcpy(&message->param, param, sizeof(union parameter));
+	memcpy(&message->param, param, message_param_size(message->type));
 	message_put(message);
 }
 
@@ -2810,7 +2813,7 @@ void EndpointAppPBX::join_connect(struct port_list *portlist, int message_type,
 	memcpy(&e_connectinfo, &param->connectinfo, sizeof(e_callerinfo));
 	if(portlist) {
 		message = message_create(ea_endpoint->ep_serial, portlist->port_id, EPOINT_TO_PORT, MESSAGE_CONNECT);
-		memcpy(&message->param, param, sizeof(union parameter));
+		memcpy(&message->param, param, message_param_size(message->type));
 
 		/* screen clip if prefix is required */
 		if (e_ext.number[0] && message->param.connectinfo.id[0] && e_ext.clip_prefix[0]) {
@@ -3064,7 +3067,7 @@ void EndpointAppPBX::join_mISDNsignal(struct port_list *portlist, int message_ty
 
 	while(portlist) {
 		message = message_create(ea_endpoint->ep_serial, portlist->port_id, EPOINT_TO_PORT, MESSAGE_mISDNSIGNAL);
-		memcpy(&message->param, param, sizeof(union parameter));
+		memcpy(&message->param, param, message_param_size(message->type));
 		message_put(message);
 		portlist = portlist->next;
 	}
@@ -3077,7 +3080,7 @@ void EndpointAppPBX::join_bridge(struct port_list *portlist, int message_type, u
 
 	while(portlist) {
 		message = message_create(ea_endpoint->ep_serial, portlist->port_id, EPOINT_TO_PORT, MESSAGE_BRIDGE);
-		memcpy(&message->param, param, sizeof(union parameter));
+		memcpy(&message->param, param, message_param_size(message->type));
 		message_put(message);
 		portlist = portlist->next;
 	}
@@ -3144,7 +3147,7 @@ void EndpointAppPBX::join_dtmf(struct port_list *portlist, int message_type, uni
 
 	while(portlist) {
 		message = message_create(ea_endpoint->ep_serial, portlist->port_id, EPOINT_TO_PORT, MESSAGE_DTMF);
-		memcpy(&message->param, param, sizeof(union parameter));
+		memcpy(&message->param, param, message_param_size(message->type));
 		message_put(message);
 		portlist = portlist->next;
 	}
@@ -3157,7 +3160,7 @@ void EndpointAppPBX::join_disable_dejitter(struct port_list *portlist, int messa
 
 	while(portlist) {
 		message = message_create(ea_endpoint->ep_serial, portlist->port_id, EPOINT_TO_PORT, MESSAGE_DISABLE_DEJITTER);
-		memcpy(&message->param, param, sizeof(union parameter));
+		memcpy(&message->param, param, message_param_size(message->type));
 		message_put(message);
 		portlist = portlist->next;
 	}
@@ -83,6 +83,7 @@ class EndpointAppPBX : public EndpointApp
 	struct route_action	*e_action;		/* current action pointer (NULL=no action) */
 	int			e_rule_nesting;		/* 'goto'/'menu' recrusion counter to prevent infinie loops */
 	struct route_action	*e_match_to_action;	/* what todo when timeout */
+	struct route_state	*e_route_state;		/* rules that remain while dialing */
 	char			*e_match_to_extdialing;	/* dialing after matching timeout rule */
 	int			e_select;		/* current selection for various selector options */
 	char			*e_extdialing;		/* dialing after matching rule */
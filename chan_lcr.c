@@ -16,6 +16,8 @@ Registering to LCR:
 To connect, open an LCR socket and send a MESSAGE_HELLO to socket with
 the application name. This name is unique an can be used for routing calls.
 Now the channel driver is linked to LCR and can receive and make calls.
+The hello message also offers framed messages. If LCR replies with a
+MESSAGE_HELLO, only the used part of each message is sent from then on.
 
 
 Call is initiated by LCR:
@@ -123,6 +125,7 @@ it is called from ast_channel process which has already locked ast_channel.
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <sys/mman.h>
 
 #include <semaphore.h>
 
@@ -174,6 +177,7 @@ struct ast_channel;
 #include "extension.h"
 #include "message.h"
 #include "callerid.h"
+#include "spsc.h"
 #include "lcrsocket.h"
 #include "cause.h"
 #include "select.h"
@@ -220,12 +224,18 @@ int glob_channel = 0;
 int lcr_sock = -1;
 struct lcr_fd socket_fd;
 struct lcr_timer socket_retry;
+struct lcr_timer audio_timer;
 
 struct admin_list {
 	struct admin_list *next;
 	struct admin_message msg;
 } *admin_first = NULL;
 
+/* socket buffers, multiple messages are read and written at once */
+static unsigned char lcr_rx_buffer[ADMIN_BUFFER], lcr_tx_buffer[ADMIN_BUFFER];
+static int lcr_rx_len, lcr_tx_len;
+static int lcr_framing; /* LCR confirmed framed messages */
+
 static struct ast_channel_tech lcr_tech;
 
 /*
@@ -297,6 +307,8 @@ void free_call(struct chan_call *call)
 				close(call->pipe[0]);
 			if (call->pipe[1] > -1)
 				close(call->pipe[1]);
+			if (call->audio)
+				munmap(call->audio, sizeof(struct remote_audio));
 			if (call->bridge_call) {
 				if (call->bridge_call->bridge_call != call)
 					CERROR(call, NULL, "Linked call structure has no link to us.\n");
@@ -389,7 +401,7 @@ int send_message(int message_type, unsigned int ref, union parameter *param)
 	admin->msg.u.msg.type = message_type;
 	admin->msg.u.msg.ref = ref;
 	memcpy(&admin->msg.u.msg.param, param, sizeof(union parameter));
-	socket_fd.when |= LCR_FD_WRITE;
+	update_fd(&socket_fd, socket_fd.when | LCR_FD_WRITE);
 	if (!wake_global) {
 		wake_global = 1;
 		char byte = 0;
@@ -1553,6 +1565,76 @@ void lcr_in_dtmf(struct chan_call *call, int val)
 	strncat(call->queue_string, digit, sizeof(call->queue_string)-1);
 }
 
+/*
+ * audio received from LCR, write it to the channel's pipe
+ */
+static int receive_traffic(struct chan_call *call, struct param_traffic *traffic)
+{
+	unsigned char *p = traffic->data;
+	int i, len = traffic->len;
+
+	for (i = 0; i < len; i++, p++)
+		*p = flip_bits[*p];
+	return write(call->pipe[1], traffic->data, traffic->len);
+}
+
+/*
+ * map shared memory for audio, offered by LCR with the new ref
+ * if it fails, audio is exchanged through the socket.
+ */
+static void attach_audio(struct chan_call *call, char *name)
+{
+	struct remote_audio *audio;
+	int fd;
+
+	fd = shm_open(name, O_RDWR, 0);
+	if (fd < 0) {
+		CERROR(call, NULL, "Cannot open shared memory '%s' for audio, using socket.\n", name);
+		return;
+	}
+	audio = (struct remote_audio *)mmap(NULL, sizeof(struct remote_audio), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	/* the mapping stays valid, the name is not required anymore */
+	shm_unlink(name);
+	if (audio == MAP_FAILED) {
+		CERROR(call, NULL, "Cannot map shared memory '%s' for audio, using socket.\n", name);
+		return;
+	}
+	if (audio->version != REMOTE_AUDIO_VERSION) {
+		CERROR(call, NULL, "Shared memory '%s' has version %d, but we use version %d, using socket.\n", name, audio->version, REMOTE_AUDIO_VERSION);
+		munmap(audio, sizeof(struct remote_audio));
+		return;
+	}
+	call->audio = audio;
+	__atomic_store_n(&audio->attached, 1, __ATOMIC_RELEASE);
+	CDEBUG(call, NULL, "Audio is exchanged through shared memory '%s'.\n", name);
+
+	if (!audio_timer.active)
+		schedule_timer(&audio_timer, 0, 20000);
+}
+
+/* read audio from shared memory of all calls */
+static int handle_audio(struct lcr_timer *timer, void *instance, int index)
+{
+	struct chan_call *call;
+	struct param_traffic traffic;
+	int active = 0;
+
+	call = call_first;
+	while(call) {
+		if (call->audio) {
+			active = 1;
+			while (!spsc_get(&call->audio->from_lcr, &traffic))
+				receive_traffic(call, &traffic);
+		}
+		call = call->next;
+	}
+
+	if (active)
+		schedule_timer_next(&audio_timer, 0, 20000);
+	return 0;
+}
+
 /*
  * message received from LCR
  */
@@ -1608,6 +1690,8 @@ int receive_message(int message_type, unsigned int ref, union parameter *param)
 				return 0;
 			}
 		}
+		if (param->newref.audio_shm[0])
+			attach_audio(call, param->newref.audio_shm);
 		send_message(MESSAGE_ENABLEKEYPAD, call->ref, &newparam);
 		return 0;
 	}
@@ -1679,13 +1763,7 @@ int receive_message(int message_type, unsigned int ref, union parameter *param)
 		break;
 
 		case MESSAGE_TRAFFIC: // if remote audio connected or hold
-		{
-			unsigned char *p = param->traffic.data;
-			int i, len = param->traffic.len;
-			for (i = 0; i < len; i++, p++)
-				*p = flip_bits[*p];
-		}
-		rc = write(call->pipe[1], param->traffic.data, param->traffic.len);
+		rc = receive_traffic(call, &param->traffic);
 		break;
 
 		case MESSAGE_DTMF:
@@ -1748,13 +1826,13 @@ void close_socket(void);
  */
 static int handle_socket(struct lcr_fd *fd, unsigned int what, void *instance, int index)
 {
-	int len;
+	int len, size, offset;
 	struct admin_list *admin;
 	struct admin_message msg;
 
 	if ((what & LCR_FD_READ)) {
 		/* read from socket */
-		len = read(lcr_sock, &msg, sizeof(msg));
+		len = read(lcr_sock, lcr_rx_buffer + lcr_rx_len, sizeof(lcr_rx_buffer) - lcr_rx_len);
 		if (len == 0) {
 			CERROR(NULL, NULL, "Socket closed.(read)\n");
 			error:
@@ -1765,15 +1843,37 @@ static int handle_socket(struct lcr_fd *fd, unsigned int what, void *instance, i
 			return 0;
 		}
 		if (len > 0) {
-			if (len != sizeof(msg)) {
-				CERROR(NULL, NULL, "Socket short read. (len %d)\n", len);
-				goto error;
+			lcr_rx_len += len;
+			/* process all complete messages */
+			offset = 0;
+			while ((size = admin_frame_length(lcr_rx_buffer + offset, lcr_rx_len - offset)) > 0) {
+				admin_frame_decode(&msg, lcr_rx_buffer + offset);
+				offset += size;
+				if (msg.message != ADMIN_MESSAGE) {
+					CERROR(NULL, NULL, "Socket received illegal message %d.\n", msg.message);
+					goto error;
+				}
+				/* LCR confirms framing */
+				if (msg.u.msg.type == MESSAGE_HELLO) {
+					if (msg.u.msg.param.hello.framing >= ADMIN_FRAMING) {
+						CDEBUG(NULL, NULL, "LCR supports framed messages.\n");
+						lcr_framing = 1;
+					}
+					continue;
+				}
+				receive_message(msg.u.msg.type, msg.u.msg.ref, &msg.u.msg.param);
+				/* socket may be closed while processing message */
+				if (lcr_sock < 0)
+					return 0;
 			}
-			if (msg.message != ADMIN_MESSAGE) {
-				CERROR(NULL, NULL, "Socket received illegal message %d.\n", msg.message);
+			if (size < 0) {
+				CERROR(NULL, NULL, "Socket received invalid frame.\n");
 				goto error;
 			}
-			receive_message(msg.u.msg.type, msg.u.msg.ref, &msg.u.msg.param);
+			/* keep incomplete message */
+			lcr_rx_len -= offset;
+			if (offset && lcr_rx_len)
+				memmove(lcr_rx_buffer, lcr_rx_buffer + offset, lcr_rx_len);
 		} else {
 			CERROR(NULL, NULL, "Socket failed (errno %d).\n", errno);
 			goto error;
@@ -1781,26 +1881,37 @@ static int handle_socket(struct lcr_fd *fd, unsigned int what, void *instance, i
 	}
 
 	if ((what & LCR_FD_WRITE)) {
+		/* fill buffer with queued messages, so they are written at once */
+		while ((admin = admin_first)) {
+			size = (lcr_framing) ? admin_frame_max(&admin->msg) : (int)sizeof(struct admin_message);
+			if (lcr_tx_len + size > (int)sizeof(lcr_tx_buffer))
+				break;
+			if (lcr_framing)
+				lcr_tx_len += admin_frame_encode(lcr_tx_buffer + lcr_tx_len, &admin->msg);
+			else {
+				memcpy(lcr_tx_buffer + lcr_tx_len, &admin->msg, sizeof(struct admin_message));
+				lcr_tx_len += sizeof(struct admin_message);
+			}
+			/* free head */
+			admin_first = admin->next;
+			free(admin);
+			global_change = 1;
+		}
 		/* write to socket */
-		if (!admin_first) {
-			socket_fd.when &= ~LCR_FD_WRITE;
+		if (!lcr_tx_len) {
+			update_fd(&socket_fd, socket_fd.when & ~LCR_FD_WRITE);
 			return 0;
 		}
-		admin = admin_first;
-		len = write(lcr_sock, &admin->msg, sizeof(msg));
+		len = write(lcr_sock, lcr_tx_buffer, lcr_tx_len);
 		if (len == 0) {
 			CERROR(NULL, NULL, "Socket closed.(write)\n");
 			goto error;
 		}
 		if (len > 0) {
-			if (len != sizeof(msg)) {
-				CERROR(NULL, NULL, "Socket short write. (len %d)\n", len);
-				goto error;
-			}
-			/* free head */
-			admin_first = admin->next;
-			free(admin);
-			global_change = 1;
+			/* keep what is not written */
+			lcr_tx_len -= len;
+			if (lcr_tx_len)
+				memmove(lcr_tx_buffer, lcr_tx_buffer + len, lcr_tx_len);
 		} else {
 			CERROR(NULL, NULL, "Socket failed (errno %d).\n", errno);
 			goto error;
@@ -1843,9 +1954,12 @@ int open_socket(void)
 	socket_fd.fd = lcr_sock;
 	register_fd(&socket_fd, LCR_FD_READ | LCR_FD_EXCEPT, handle_socket, NULL, 0);
 
-	/* enque hello message */
+	/* enque hello message, framing is used after LCR confirmed it */
+	lcr_rx_len = lcr_tx_len = 0;
+	lcr_framing = 0;
 	memset(&param, 0, sizeof(param));
 	strcpy(param.hello.application, "asterisk");
+	param.hello.framing = ADMIN_FRAMING;
 	send_message(MESSAGE_HELLO, 0, &param);
 
 	return lcr_sock;
@@ -1869,6 +1983,8 @@ void close_socket(void)
 		free(temp);
 	}
 	admin_first = NULL;
+	lcr_rx_len = lcr_tx_len = 0;
+	lcr_framing = 0;
 
 	/* close socket */
 	close(lcr_sock);
@@ -2007,6 +2123,9 @@ static void *chan_thread(void *arg)
 	memset(&socket_retry, 0, sizeof(socket_retry));
 	add_timer(&socket_retry, handle_retry, NULL, 0);
 
+	memset(&audio_timer, 0, sizeof(audio_timer));
+	add_timer(&audio_timer, handle_audio, NULL, 0);
+
 	/* open socket the first time */
 	handle_retry(NULL, NULL, 0);
 
@@ -2802,7 +2921,11 @@ static int lcr_write(struct ast_channel *ast, struct ast_frame *fr)
 		len -= l;
 		for (; l; l--)
 			*q++ = flip_bits[*p++];
-		send_message(MESSAGE_TRAFFIC, call->ref, &newparam);
+		/* if LCR does not read, frames are dropped */
+		if (call->audio)
+			spsc_put(&call->audio->to_lcr, &newparam.traffic);
+		else
+			send_message(MESSAGE_TRAFFIC, call->ref, &newparam);
 	}
 	ast_mutex_unlock(&chan_lock);
 	if (f != fr) {
@@ -77,6 +77,8 @@ struct chan_call {
 					/* queue for asterisk */
 	int			has_pattern;
 					/* pattern are available, PROGRESS has been indicated */
+	struct remote_audio	*audio;
+					/* shared memory for audio or NULL */
 		
 };
 
@@ -2410,7 +2410,7 @@ void Pdss1::message_notify(unsigned int epoint_id, int message_id, union paramet
 			if (p_m_d_notify_pending)
 				message_free(p_m_d_notify_pending);
 			p_m_d_notify_pending = message_create(ACTIVE_EPOINT(p_epointlist), p_serial, EPOINT_TO_PORT, message_id);
-			memcpy(&p_m_d_notify_pending->param, param, sizeof(union parameter));
+			memcpy(&p_m_d_notify_pending->param, param, message_param_size(p_m_d_notify_pending->type));
 		} else {
 			/* sending notification */
 			l3m = create_l3msg();
@@ -2656,7 +2656,7 @@ if (/*	 ||*/ p_state==PORT_STATE_OUT_SETUP) {
 		/* sending release to endpoint */
 		while(p_epointlist) {
 			message = message_create(p_serial, p_epointlist->epoint_id, PORT_TO_EPOINT, MESSAGE_RELEASE);
-			memcpy(&message->param, param, sizeof(union parameter));
+			memcpy(&message->param, param, message_param_size(message->type));
 			message_put(message);
 			/* remove epoint */
 			free_epointlist(p_epointlist);
@@ -0,0 +1,136 @@
+/*****************************************************************************\
+**                                                                           **
+** LCR                                                                       **
+**                                                                           **
+**---------------------------------------------------------------------------**
+** Copyright: Andreas Eversberg                                              **
+**                                                                           **
+** software DTMF detector                                                    **
+**                                                                           **
+\*****************************************************************************/
+
+#include "main.h"
+
+/*
+ * samples are collected into blocks of DTMF_BLOCK samples. if the block's
+ * energy is high enough, the eight DTMF frequencies are calculated in one
+ * goertzel pass. a digit is detected, if one row and one column frequency
+ * exceed the threshold, if the twist between them is acceptable, if each is
+ * clearly the peak of its group, and if both hold most of the block's energy.
+ * a digit is reported when it was detected in two blocks in a row. it is
+ * reported again after two blocks without that digit.
+ */
+
+#define DTMF_TWIST_NORMAL	6.3	/* column may exceed row by 8 dB */
+#define DTMF_TWIST_REVERSE	2.5	/* row may exceed column by 4 dB */
+#define DTMF_RELATIVE_PEAK	6.3	/* other frequencies of a group must be 8 dB below */
+#define DTMF_TONE_ENERGY	0.5	/* row and column must hold half of the energy */
+
+static int dtmf_frequency[8] = {
+	697, 770, 852, 941, /* rows */
+	1209, 1336, 1477, 1633 /* columns */
+};
+
+static const char dtmf_digit[4][4] = {
+	{'1', '2', '3', 'A'},
+	{'4', '5', '6', 'B'},
+	{'7', '8', '9', 'C'},
+	{'*', '0', '#', 'D'}
+};
+
+static struct goertzel dtmf_goertzel;
+
+void dtmf_detector_init(struct dtmf_detector *d, int level)
+{
+	double amplitude;
+
+	if (!dtmf_goertzel.num)
+		goertzel_init(&dtmf_goertzel, dtmf_frequency, 8, 8000);
+
+	memset(d, 0, sizeof(*d));
+	/* a sine of amplitude A results in a power of (A * DTMF_BLOCK / 2)^2 */
+	amplitude = 32767.0 * pow(10.0, level / 20.0) * DTMF_BLOCK / 2;
+	d->threshold = amplitude * amplitude;
+	d->last = ' ';
+	d->reported = ' ';
+}
+
+/* analyze a full block, return digit or ' ' */
+static char dtmf_block(struct dtmf_detector *d)
+{
+	float power[8];
+	double energy = 0.0;
+	int i, row, col;
+
+	/* a tone holds A^2 * DTMF_BLOCK / 2, so skip silence before doing goertzel */
+	for (i = 0; i < DTMF_BLOCK; i++)
+		energy += (double)d->block[i] * d->block[i];
+	if (energy * DTMF_BLOCK / 2 < d->threshold * 2)
+		return ' ';
+
+	goertzel_power(&dtmf_goertzel, d->block, DTMF_BLOCK, power);
+
+	/* find peak of rows and columns */
+	row = 0;
+	col = 4;
+	for (i = 1; i < 4; i++) {
+		if (power[i] > power[row])
+			row = i;
+		if (power[i + 4] > power[col])
+			col = i + 4;
+	}
+
+	/* check level and twist */
+	if (power[row] < d->threshold || power[col] < d->threshold)
+		return ' ';
+	if (power[col] > power[row] * DTMF_TWIST_NORMAL
+	 || power[row] > power[col] * DTMF_TWIST_REVERSE)
+		return ' ';
+
+	/* other frequencies of a group must be lower */
+	for (i = 0; i < 4; i++) {
+		if (i != row && power[i] * DTMF_RELATIVE_PEAK > power[row])
+			return ' ';
+		if (i + 4 != col && power[i + 4] * DTMF_RELATIVE_PEAK > power[col])
+			return ' ';
+	}
+
+	/* both tones must hold most of the energy, so speech is not detected */
+	if (power[row] + power[col] < DTMF_TONE_ENERGY * energy * DTMF_BLOCK / 2)
+		return ' ';
+
+	return dtmf_digit[row][col - 4];
+}
+
+/* process law samples, store detected digits, return number of digits */
+int dtmf_detector_process(struct dtmf_detector *d, unsigned char *data, int len, char *digits, int size)
+{
+	int n, i, num = 0;
+	char digit;
+
+	while (len) {
+		n = DTMF_BLOCK - d->fill;
+		if (n > len)
+			n = len;
+		for (i = 0; i < n; i++)
+			d->block[d->fill + i] = audio_law_to_s32[data[i]];
+		d->fill += n;
+		data += n;
+		len -= n;
+		if (d->fill < DTMF_BLOCK)
+			break;
+		d->fill = 0;
+
+		digit = dtmf_block(d);
+		/* digit (or silence) must be stable for two blocks */
+		if (digit == d->last && digit != d->reported) {
+			d->reported = digit;
+			if (digit != ' ' && num < size)
+				digits[num++] = digit;
+		}
+		d->last = digit;
+	}
+
+	return num;
+}
+
@@ -0,0 +1,25 @@
+/*****************************************************************************\
+**                                                                           **
+** LCR                                                                       **
+**                                                                           **
+**---------------------------------------------------------------------------**
+** Copyright: Andreas Eversberg                                              **
+**                                                                           **
+** software DTMF detector header file                                        **
+**                                                                           **
+\*****************************************************************************/
+
+#define DTMF_BLOCK		102	/* samples analyzed at once (12.75 ms) */
+#define DTMF_LEVEL_DEFAULT	-30	/* minimum level of each tone in dB below full scale sine */
+
+struct dtmf_detector {
+	signed short	block[DTMF_BLOCK];	/* samples collected for next block */
+	int		fill;			/* number of samples in block */
+	float		threshold;		/* minimum power of each tone */
+	char		last;			/* digit of last block, or ' ' */
+	char		reported;		/* digit that has been reported, or ' ' */
+};
+
+void dtmf_detector_init(struct dtmf_detector *d, int level);
+int dtmf_detector_process(struct dtmf_detector *d, unsigned char *data, int len, char *digits, int size);
+
@@ -13,6 +13,10 @@
 
 unsigned int epoint_serial = 1; /* initial value must be 1, because 0== no epoint */
 
+/* index of endpoints by serial */
+#define EPOINT_HASH	4096 /* must be a power of two */
+static class Endpoint *epoint_hash[EPOINT_HASH];
+
 class Endpoint *epoint_first = NULL;
 
 
@@ -21,13 +25,12 @@ class Endpoint *epoint_first = NULL;
  */ 
 class Endpoint *find_epoint_id(unsigned int epoint_id)
 {
-	class Endpoint *epoint = epoint_first;
+	class Endpoint *epoint = epoint_hash[epoint_id & (EPOINT_HASH - 1)];
 
 	while(epoint) {
-//printf("comparing: '%s' with '%s'\n", name, epoint->name);
 		if (epoint->ep_serial == epoint_id)
 			return(epoint);
-		epoint = epoint->next;
+		epoint = epoint->hash_next;
 	}
 
 	return(NULL);
@@ -62,6 +65,8 @@ Endpoint::Endpoint(unsigned int port_id, unsigned int join_id)
 
 	/* serial */
 	ep_serial = epoint_serial++;
+	hash_next = epoint_hash[ep_serial & (EPOINT_HASH - 1)];
+	epoint_hash[ep_serial & (EPOINT_HASH - 1)] = this;
 
 	/* link to join or port */
 	if (port_id) {
@@ -131,6 +136,10 @@ Endpoint::~Endpoint(void)
 	if (temp == 0)
 		FATAL("Endpoint not in Endpoint's list.\n");
 	*tempp = next;
+	tempp = &epoint_hash[ep_serial & (EPOINT_HASH - 1)];
+	while(*tempp != this)
+		tempp = &(*tempp)->hash_next;
+	*tempp = hash_next;
 
 	del_work(&ep_delete);
 
@@ -25,6 +25,7 @@ class Endpoint
 	Endpoint(unsigned int port_id, unsigned int join_id);
 	~Endpoint();
 	class Endpoint		*next;		/* next in list */
+	class Endpoint		*hash_next;	/* next in hash bucket */
 	unsigned int		ep_serial;	/* a unique serial to identify */
 
 	/* applocaton relation */
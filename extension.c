@@ -10,6 +10,7 @@
 \*****************************************************************************/ 
 
 #include "main.h"
+#include <sys/inotify.h>
 
 /* extension */
 
@@ -29,6 +30,175 @@ const char *ext_yesno[] = {
 };
 
 
+/* extension cache
+ *
+ * parsed settings are kept in memory, so calls do not parse the settings
+ * file every time. the directory of each cached extension is watched with
+ * inotify. pending events are read before each lookup, so an entry is
+ * dropped as soon as the settings file was changed outside LCR. the cache is
+ * only used after extension_cache_init() was called.
+ */
+
+#define EXTENSION_CACHE_HASH	256
+
+struct extension_cache {
+	struct extension_cache *next;	/* next entry in hash bucket */
+	char number[32];
+	int wd;				/* watch of the extension's directory */
+	int valid;			/* ext holds the settings of the file */
+	ino_t ino;			/* settings file that ext was taken from */
+	off_t size;
+	struct timespec mtime;
+	struct extension ext;
+};
+
+static struct extension_cache *extension_cache_hash[EXTENSION_CACHE_HASH];
+static int extension_cache_fd = -1;
+unsigned int extension_cache_hit = 0; /* settings taken from cache */
+unsigned int extension_cache_miss = 0; /* settings parsed from file */
+
+static unsigned int extension_cache_key(const char *number)
+{
+	unsigned int key = 0;
+
+	while(*number)
+		key = key * 31 + (unsigned char)*number++;
+	return key % EXTENSION_CACHE_HASH;
+}
+
+static struct extension_cache *extension_cache_find(const char *number)
+{
+	struct extension_cache *entry = extension_cache_hash[extension_cache_key(number)];
+
+	while(entry) {
+		if (!strcmp(entry->number, number))
+			break;
+		entry = entry->next;
+	}
+	return entry;
+}
+
+/* check if the settings file is still the one the entry was taken from */
+static int extension_cache_same(struct extension_cache *entry)
+{
+	char filename[256];
+	struct stat st;
+
+	SPRINT(filename, "%s/%s/settings", EXTENSION_DATA, entry->number);
+	if (stat(filename, &st) < 0)
+		return(0);
+	return(st.st_ino == entry->ino
+	    && st.st_size == entry->size
+	    && st.st_mtim.tv_sec == entry->mtime.tv_sec
+	    && st.st_mtim.tv_nsec == entry->mtime.tv_nsec);
+}
+
+/* read pending inotify events and invalidate entries of changed files */
+static void extension_cache_events(void)
+{
+	char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	struct inotify_event *event;
+	struct extension_cache *entry;
+	int len, i, off;
+
+	while ((len = read(extension_cache_fd, buffer, sizeof(buffer))) > 0) {
+		for (off = 0; off < len; off += sizeof(struct inotify_event) + event->len) {
+			event = (struct inotify_event *)(buffer + off);
+			/* events were lost, so any file may have changed */
+			if (event->wd == -1 || (event->mask & IN_Q_OVERFLOW)) {
+				PDEBUG(DEBUG_CONFIG, "inotify queue overflow, removing all extensions from cache\n");
+				for (i = 0; i < EXTENSION_CACHE_HASH; i++) {
+					for (entry = extension_cache_hash[i]; entry; entry = entry->next)
+						entry->valid = 0;
+				}
+				continue;
+			}
+			/* events of other files in the directory are not relevant */
+			if (event->len && strcmp(event->name, "settings"))
+				continue;
+			for (i = 0; i < EXTENSION_CACHE_HASH; i++) {
+				for (entry = extension_cache_hash[i]; entry; entry = entry->next) {
+					if (entry->wd != event->wd)
+						continue;
+					if ((event->mask & IN_IGNORED))
+						entry->wd = -1;
+					/* our own write_extension() leaves the file as cached */
+					if (entry->valid && !extension_cache_same(entry)) {
+						PDEBUG(DEBUG_CONFIG, "settings of extension %s changed, removing from cache\n", entry->number);
+						entry->valid = 0;
+					}
+				}
+			}
+		}
+	}
+}
+
+/* store settings of given file in cache */
+static void extension_cache_store(struct extension *ext, const char *number, struct stat *st)
+{
+	struct extension_cache *entry;
+	char pathname[256];
+	unsigned int key;
+
+	if (!(entry = extension_cache_find(number))) {
+		entry = (struct extension_cache *)MALLOC(sizeof(struct extension_cache));
+		memuse++;
+		SCPY(entry->number, number);
+		entry->wd = -1;
+		key = extension_cache_key(number);
+		entry->next = extension_cache_hash[key];
+		extension_cache_hash[key] = entry;
+	}
+	if (entry->wd < 0) {
+		SPRINT(pathname, "%s/%s", EXTENSION_DATA, number);
+		entry->wd = inotify_add_watch(extension_cache_fd, pathname, IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_DELETE_SELF);
+		if (entry->wd < 0) {
+			/* without watch we would not see changes */
+			PERROR("Cannot watch extension directory \"%s\": %s\n", pathname, strerror(errno));
+			entry->valid = 0;
+			return;
+		}
+	}
+	memcpy(&entry->ext, ext, sizeof(struct extension));
+	SCPY(entry->ext.number, number);
+	entry->ino = st->st_ino;
+	entry->size = st->st_size;
+	entry->mtime = st->st_mtim;
+	entry->valid = 1;
+}
+
+int extension_cache_init(void)
+{
+	extension_cache_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (extension_cache_fd < 0) {
+		PERROR("Cannot create inotify instance, extension settings are not cached: %s\n", strerror(errno));
+		return(-1);
+	}
+	fduse++;
+	return(0);
+}
+
+void extension_cache_cleanup(void)
+{
+	struct extension_cache *entry;
+	int i;
+
+	if (extension_cache_fd < 0)
+		return;
+	for (i = 0; i < EXTENSION_CACHE_HASH; i++) {
+		while ((entry = extension_cache_hash[i])) {
+			extension_cache_hash[i] = entry->next;
+			FREE(entry, sizeof(struct extension_cache));
+			memuse--;
+		}
+	}
+	close(extension_cache_fd);
+	fduse--;
+	extension_cache_fd = -1;
+	PDEBUG(DEBUG_CONFIG, "extension cache: %u hits, %u misses\n", extension_cache_hit, extension_cache_miss);
+}
+
+
 /* read extension
  *
  * reads extension from given extension number and fills structure
@@ -44,6 +214,8 @@ int read_extension(struct extension *ext, char *num)
 	unsigned int line,i;
 	char buffer[1024];
 	int last_in_count = 0, last_out_count = 0;
+	struct extension_cache *entry;
+	struct stat st;
 
 	/* save number, so &ext and ext.number can be given as parameters - without overwriting itself */
 	SCPY(number, num);
@@ -51,6 +223,17 @@ int read_extension(struct extension *ext, char *num)
 	if (number[0] == '\0')
 		return(0);
 
+	if (extension_cache_fd >= 0) {
+		extension_cache_events();
+		entry = extension_cache_find(number);
+		if (entry && entry->valid) {
+			memcpy(ext, &entry->ext, sizeof(struct extension));
+			extension_cache_hit++;
+			return(1);
+		}
+		extension_cache_miss++;
+	}
+
 	SPRINT(filename, "%s/%s/settings", EXTENSION_DATA, number);
 
 	if (!(fp = fopen(filename, "r"))) {
@@ -58,6 +241,9 @@ int read_extension(struct extension *ext, char *num)
 		PDEBUG(DEBUG_CONFIG, "the given extension doesn't exist: \"%s\"\n", filename);
 		return(0);
 	}
+	/* stat the file we read, so a change while parsing is detected */
+	if (fstat(fileno(fp), &st) < 0)
+		memset(&st, 0, sizeof(st));
 
 	/* default values */
 	memset(ext, 0, sizeof(struct extension));
@@ -629,6 +815,8 @@ int read_extension(struct extension *ext, char *num)
 				ext->record = CODEC_8BIT;
 			else if (!strcasecmp(param, "law"))
 				ext->record = CODEC_LAW;
+			else if (!strcasecmp(param, "gsm"))
+				ext->record = CODEC_GSM;
 			else
 				ext->record = CODEC_OFF;
 			PDEBUG(DEBUG_CONFIG, "given record param: %s\n", param);
@@ -654,6 +842,8 @@ int read_extension(struct extension *ext, char *num)
 				ext->vbox_codec = CODEC_8BIT;
 			else if (!strcasecmp(param, "law"))
 				ext->vbox_codec = CODEC_LAW;
+			else if (!strcasecmp(param, "gsm"))
+				ext->vbox_codec = CODEC_GSM;
 			else
 				ext->vbox_codec = CODEC_MONO;
 			PDEBUG(DEBUG_CONFIG, "given record param: %s\n", param);
@@ -761,6 +951,10 @@ int read_extension(struct extension *ext, char *num)
 	}
 
 	if (fp) fclose(fp);
+
+	if (extension_cache_fd >= 0)
+		extension_cache_store(ext, number, &st);
+
 	return(1);
 }
 
@@ -774,6 +968,7 @@ int write_extension(struct extension *ext, char *number)
 	FILE *fp=NULL;
 	char filename[256];
 	int i;
+	struct stat st;
 
 	if (number[0] == '\0')
 		return(0);
@@ -1039,6 +1234,7 @@ int write_extension(struct extension *ext, char *number)
 	fprintf(fp,"# stereo (records wave 32 bit stereo, 256kbits/s)\n");
 	fprintf(fp,"# 8bit (records wave 8 bit mono, 64kbits/s)\n");
 	fprintf(fp,"# law (records xLaw encoded, as specified in options.conf, 64kbps/s)\n");
+	fprintf(fp,"# gsm (records wave GSM full rate, 13kbits/s, requires GSM support)\n");
 	switch(ext->record) {
 		case CODEC_MONO:
 		fprintf(fp,"record          mono\n\n");
@@ -1052,6 +1248,9 @@ int write_extension(struct extension *ext, char *number)
 		case CODEC_LAW:
 		fprintf(fp,"record          law\n\n");
 		break;
+		case CODEC_GSM:
+		fprintf(fp,"record          gsm\n\n");
+		break;
 		default:
 		fprintf(fp,"record          off\n\n");
 	}
@@ -1082,6 +1281,7 @@ int write_extension(struct extension *ext, char *number)
 	fprintf(fp,"# mono (16 bit mono wave file)\n");
 	fprintf(fp,"# stereo (16 bit stereo wave file)\n");
 	fprintf(fp,"# 8bit (8 bit mono wave file)\n");
+	fprintf(fp,"# gsm (GSM full rate wave file, requires GSM support and tone_cache for playback)\n");
 	switch(ext->vbox_codec) {
 		case CODEC_LAW:
 		fprintf(fp,"vbox_codec      law\n\n");
@@ -1092,6 +1292,9 @@ int write_extension(struct extension *ext, char *number)
 		case CODEC_8BIT:
 		fprintf(fp,"vbox_codec      8bit\n\n");
 		break;
+		case CODEC_GSM:
+		fprintf(fp,"vbox_codec      gsm\n\n");
+		break;
 		default:
 		fprintf(fp,"vbox_codec      mono\n\n");
 	}
@@ -1161,6 +1364,14 @@ int write_extension(struct extension *ext, char *number)
 
 
 	if (fp) fclose(fp);
+
+	/* write through, so the next read does not need to parse the file */
+	if (extension_cache_fd >= 0) {
+		extension_cache_events();
+		if (stat(filename, &st) == 0)
+			extension_cache_store(ext, number, &st);
+	}
+
 	return(1);
 }
 
@@ -1171,8 +1382,8 @@ int write_extension(struct extension *ext, char *number)
 int write_log(char *number, char *callerid, char *calledid, time_t start, time_t stop, int aoce, int cause, int location)
 {
 	const char *mon[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
-	FILE *fp=NULL;
 	char filename[256];
+	char buffer[1024], text[256];
 	struct tm *tm;
 
 	if (callerid[0] == '\0')
@@ -1180,23 +1391,23 @@ int write_log(char *number, char *callerid, char *calledid, time_t start, time_t
 
 	SPRINT(filename, "%s/%s/log", EXTENSION_DATA, number);
 
-	if (!(fp = fopen(filename, "a"))) {
-		PERROR("Cannot open log: \"%s\"\n", filename);
-		return(0);
-	}
-
 	tm = localtime(&start);
-	fprintf(fp,"%s %2d %04d %02d:%02d:%02d %s", mon[tm->tm_mon], tm->tm_mday, tm->tm_year+1900, tm->tm_hour, tm->tm_min, tm->tm_sec, number);
+	SPRINT(buffer, "%s %2d %04d %02d:%02d:%02d %s", mon[tm->tm_mon], tm->tm_mday, tm->tm_year+1900, tm->tm_hour, tm->tm_min, tm->tm_sec, number);
 	if (stop)
-		fprintf(fp," %2ld:%02d:%02d", (stop-start)/3600, (((unsigned int)(stop-start))/60)%60, ((unsigned int)(stop-start))%60);
+		SPRINT(text, " %2ld:%02d:%02d", (stop-start)/3600, (((unsigned int)(stop-start))/60)%60, ((unsigned int)(stop-start))%60);
 	else
-		fprintf(fp," --:--:--");
-	fprintf(fp," %s -> %s", callerid, calledid);
-	if (cause >= 1 && cause <=127 && location>=0 && location<=15)
-		fprintf(fp," (cause=%d '%s' location=%d '%s')", cause, isdn_cause[cause].german, location, isdn_location[location].german);
-	fprintf(fp,"\n");
+		SPRINT(text, " --:--:--");
+	SCAT(buffer, text);
+	SPRINT(text, " %s -> %s", callerid, calledid);
+	SCAT(buffer, text);
+	if (cause >= 1 && cause <=127 && location>=0 && location<=15) {
+		SPRINT(text, " (cause=%d '%s' location=%d '%s')", cause, isdn_cause[cause].german, location, isdn_location[location].german);
+		SCAT(buffer, text);
+	}
+	SCAT(buffer, "\n");
 
-	if (fp) fclose(fp);
+	/* written by log writer thread */
+	log_write(filename, buffer, strlen(buffer));
 	return(1);
 }
 
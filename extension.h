@@ -65,7 +65,8 @@ enum {
 	CODEC_MONO,			/* record wave mono */
 	CODEC_STEREO,			/* record wave stereo */
 	CODEC_8BIT,			/* record wave mono 8bit */
-	CODEC_LAW			/* record LAW */
+	CODEC_LAW,			/* record LAW */
+	CODEC_GSM			/* record wave GSM full rate */
 };
 
 /* VBOX mode */
@@ -171,6 +172,9 @@ struct extension {
 	int no_seconds;		/* don't include seconds in the connect message */
 };
 
+extern unsigned int extension_cache_hit, extension_cache_miss;
+int extension_cache_init(void);
+void extension_cache_cleanup(void);
 int read_extension(struct extension *ext, char *number);
 int write_extension(struct extension *ext, char *number);
 int write_log(char *number, char *callerid, char *calledid, time_t start, time_t stop, int aoce, int cause, int location);
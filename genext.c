@@ -47,6 +47,10 @@ void _printerror(const char *file, const char *function, int line, const char *f
 	fprintf(stderr, "%s", buffer);
 }
 
+void debug(const char *file, const char *function, int line, const char *prefix, char *buffer)
+{
+}
+
 int main(int argc, char *argv[])
 {
 	struct extension ext;
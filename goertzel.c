@@ -0,0 +1,53 @@
+/*****************************************************************************\
+**                                                                           **
+** LCR                                                                       **
+**                                                                           **
+**---------------------------------------------------------------------------**
+** Copyright: Andreas Eversberg                                              **
+**                                                                           **
+** multi frequency goertzel                                                  **
+**                                                                           **
+\*****************************************************************************/
+
+#include "main.h"
+
+/*
+ * all frequencies are calculated in one pass over the samples. the states of
+ * all frequencies are held in one vector, so the compiler uses SIMD
+ * instructions for each sample (e.g. two SSE or one AVX operation for eight
+ * frequencies). the result is the squared magnitude, so no sqrt() is needed
+ * to compare levels. a sine of amplitude A results in (A * len / 2)^2.
+ */
+
+typedef float goertzel_vector __attribute__((vector_size(GOERTZEL_MAX * sizeof(float))));
+
+void goertzel_init(struct goertzel *g, const int *frequency, int num, int rate)
+{
+	int i;
+
+	if (num > GOERTZEL_MAX) {
+		PERROR("Too many frequencies (%d > %d)\n", num, GOERTZEL_MAX);
+		num = GOERTZEL_MAX;
+	}
+	memset(g, 0, sizeof(*g));
+	g->num = num;
+	for (i = 0; i < num; i++)
+		g->coeff[i] = 2.0 * cos(2.0 * M_PI * frequency[i] / rate);
+}
+
+void goertzel_power(const struct goertzel *g, const signed short *samples, int len, float *power)
+{
+	goertzel_vector coeff, s0, s1, s2, p;
+	int n;
+
+	memcpy(&coeff, g->coeff, sizeof(coeff));
+	s1 = s2 = coeff - coeff;
+	for (n = 0; n < len; n++) {
+		s0 = coeff * s1 - s2 + (float)samples[n];
+		s2 = s1;
+		s1 = s0;
+	}
+	p = s1 * s1 + s2 * s2 - coeff * s1 * s2;
+	memcpy(power, &p, g->num * sizeof(float));
+}
+
@@ -0,0 +1,21 @@
+/*****************************************************************************\
+**                                                                           **
+** LCR                                                                       **
+**                                                                           **
+**---------------------------------------------------------------------------**
+** Copyright: Andreas Eversberg                                              **
+**                                                                           **
+** multi frequency goertzel header file                                      **
+**                                                                           **
+\*****************************************************************************/
+
+#define GOERTZEL_MAX	8	/* number of frequencies analyzed in one pass */
+
+struct goertzel {
+	int	num;			/* number of frequencies */
+	float	coeff[GOERTZEL_MAX];	/* 2 * cos(2 * PI * f / rate), unused are 0 */
+};
+
+void goertzel_init(struct goertzel *g, const int *frequency, int num, int rate);
+void goertzel_power(const struct goertzel *g, const signed short *samples, int len, float *power);
+
@@ -304,6 +304,9 @@ void Pgsm::frame_receive(void *arg)
 			PDEBUG(DEBUG_GSM, "received GSM frame with wrong magig 0x%x\n", frame->data[0]>>4);
 			goto bfi;
 		}
+		/* relay to remote port, if it uses the same codec */
+		if (!bridge_tx_frame(MEDIA_TYPE_GSM, frame->data, 33))
+			return;
 #ifdef WITH_GSMFR
 		/* decode */
 		gsm_fr_decode(p_g_fr_decoder, frame->data, p_g_samples);
@@ -343,6 +346,8 @@ void Pgsm::frame_receive(void *arg)
 		}
 		if ((frame->data[0]>>4) != 0xc)
 			goto bfi;
+		if (!bridge_tx_frame(MEDIA_TYPE_GSM_EFR, frame->data, 31))
+			return;
 #ifdef WITH_GSMAMR
 		/* decode */
 		gsm_efr_decode(p_g_amr_decoder, frame->data, p_g_samples);
@@ -419,6 +424,29 @@ int Pgsm::bridge_rx(unsigned char *data, int len)
 	return audio_send(data, len);
 }
 
+/* coded frames are relayed, if our lchan uses the same codec */
+int Pgsm::bridge_media(void)
+{
+	if (p_g_rtp_bridge)
+		return 0;
+	if (p_g_media_type == MEDIA_TYPE_GSM || p_g_media_type == MEDIA_TYPE_GSM_EFR)
+		return p_g_media_type;
+	return 0;
+}
+
+/* send coded traffic to gsm */
+int Pgsm::bridge_rx_frame(int media_type, unsigned char *data, int len)
+{
+	if (!media_type || media_type != bridge_media())
+		return -EINVAL;
+	if (p_tone_name[0] || p_record || p_tap || !p_g_tch_connected)
+		return -EINVAL;
+
+	frame_send(data, len, (media_type == MEDIA_TYPE_GSM) ? GSM_TCHF_FRAME : GSM_TCHF_FRAME_EFR);
+
+	return 0;
+}
+
 int Pgsm::audio_send(unsigned char *data, int len)
 {
 	unsigned char frame[33];
@@ -839,7 +867,7 @@ void Pgsm::message_notify(unsigned int epoint_id, int message_id, union paramete
 			if (p_g_notify_pending)
 				message_free(p_g_notify_pending);
 			p_g_notify_pending = message_create(ACTIVE_EPOINT(p_epointlist), p_serial, EPOINT_TO_PORT, message_id);
-			memcpy(&p_g_notify_pending->param, param, sizeof(union parameter));
+			memcpy(&p_g_notify_pending->param, param, message_param_size(p_g_notify_pending->type));
 		} else {
 			/* sending notification */
 			gsm_trace_header(p_interface_name, this, MNCC_NOTIFY_REQ, DIRECTION_OUT);
@@ -1222,7 +1250,7 @@ static int mncc_q_enqueue(struct lcr_gsm *lcr_gsm, struct gsm_mncc *mncc, unsign
 		lcr_gsm->mncc_q_tail = qe;
 	}
 
-	lcr_gsm->mncc_lfd.when |= LCR_FD_WRITE;
+	update_fd(&lcr_gsm->mncc_lfd, lcr_gsm->mncc_lfd.when | LCR_FD_WRITE);
 
 	return 0;
 }
@@ -1269,8 +1297,8 @@ static int mncc_fd_close(struct lcr_gsm *lcr_gsm, struct lcr_fd *lfd)
 	struct lcr_msg *message;
 
 	PERROR("Lost MNCC socket, retrying in %u seconds\n", SOCKET_RETRY_TIMER);
-	close(lfd->fd);
 	unregister_fd(lfd);
+	close(lfd->fd);
 	lfd->fd = -1;
 
 	/* free all the calls that were running through the MNCC interface */
@@ -1310,7 +1338,7 @@ static int mncc_fd_write(struct lcr_fd *lfd, void *inst, int idx)
 	while (1) {
 		qe = lcr_gsm->mncc_q_hd;
 		if (!qe) {
-			lfd->when &= ~LCR_FD_WRITE;
+			update_fd(lfd, lfd->when & ~LCR_FD_WRITE);
 			break;
 		}
 		rc = write(lfd->fd, qe->data, qe->len);
@@ -69,6 +69,8 @@ class Pgsm : public Port
 	void frame_receive(void *_frame);
 	int audio_send(unsigned char *data, int len);
 	int bridge_rx(unsigned char *data, int len);
+	int bridge_rx_frame(int media_type, unsigned char *data, int len);
+	int bridge_media(void);
 
 	void send_mncc_rtp_connect(void);
 	int hunt_bchannel(void);
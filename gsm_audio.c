@@ -26,6 +26,19 @@ void *gsm_fr_create(void)
 	return handle;
 }
 
+/* create gsm instance for wave files (WAV #49, two frames in 65 bytes) */
+void *gsm_fr_create_wav(void)
+{
+	int value = 1;
+	gsm handle;
+
+	handle = gsm_create();
+	if (handle)
+		gsm_option(handle, GSM_OPT_WAV49, &value);
+
+	return handle;
+}
+
 /* free gsm instance */
 void gsm_fr_destroy(void *arg)
 {
@@ -767,6 +767,21 @@ static int inter_dtmf_threshold(struct interface *interface, char *filename, int
 	ifport->dtmf_threshold = atoi(value);
 	return(0);
 }
+static int inter_dtmf_detect(struct interface *interface, char *filename, int line, char *parameter, char *value)
+{
+	int level = DTMF_LEVEL_DEFAULT;
+
+	if (value[0]) {
+		level = atoi(value);
+		if (level > 0 || level < -60) {
+			SPRINT(interface_error, "Error in %s (line %d): parameter '%s' expects level in range -60 .. 0.\n", filename, line, parameter);
+			return(-1);
+		}
+	}
+	interface->dtmf_detect = 1;
+	interface->dtmf_level = level;
+	return(0);
+}
 static int inter_filter(struct interface *interface, char *filename, int line, char *parameter, char *value)
 {
 	char *p, *q;
@@ -1015,6 +1030,45 @@ static int inter_rtp_bridge(struct interface *interface, char *filename, int lin
 
 	return(0);
 }
+static int inter_rtp_codec(struct interface *interface, char *filename, int line, char *parameter, char *value)
+{
+#ifndef WITH_SIP
+	SPRINT(interface_error, "Error in %s (line %d): SIP not compiled in.\n", filename, line);
+	return(-1);
+#else
+	int media_type;
+
+	if (!interface->sip) {
+		SPRINT(interface_error, "Error in %s (line %d): This parameter only works for SIP interface\n", filename, line);
+		return(-1);
+	}
+	if (!value || !value[0]) {
+		SPRINT(interface_error, "Error in %s (line %d): parameter '%s' expects one codec\n", filename, line, parameter);
+		return(-1);
+	}
+	if (!strcasecmp(value, "law"))
+		media_type = (options.law=='a') ? MEDIA_TYPE_ALAW : MEDIA_TYPE_ULAW;
+#ifdef WITH_GSMFR
+	else if (!strcasecmp(value, "gsm"))
+		media_type = MEDIA_TYPE_GSM;
+#endif
+#ifdef WITH_GSMAMR
+	else if (!strcasecmp(value, "efr"))
+		media_type = MEDIA_TYPE_GSM_EFR;
+#endif
+	else {
+		SPRINT(interface_error, "Error in %s (line %d): parameter '%s' expects 'law', 'gsm' or 'efr', codec '%s' is unknown or not compiled in\n", filename, line, parameter, value);
+		return(-1);
+	}
+	if (interface->rtp_codecs == (int)(sizeof(interface->rtp_codec_types) / sizeof(int))) {
+		SPRINT(interface_error, "Error in %s (line %d): Too many codecs defined\n", filename, line);
+		return(-1);
+	}
+	interface->rtp_codec_types[interface->rtp_codecs++] = media_type;
+
+	return(0);
+#endif
+}
 #if 0
 static int inter_rtp_payload(struct interface *interface, char *filename, int line, char *parameter, char *value)
 {
@@ -1331,6 +1385,12 @@ struct interface_param interface_param[] = {
 	"Set threshold value for minimum DTMF tone level.\n"
 	"This parameter must follow a 'port' parameter."},
 
+	{"dtmf-detect", &inter_dtmf_detect, "[<level>]",
+	"Detects DTMF tones in audio received from this interface by software.\n"
+	"Use it for interfaces without DTMF detection, e.g. SIP, GSM or remote.\n"
+	"The level is the minimum level of each tone in dB below a full scale sine.\n"
+	"The default is -30 dB."},
+
 	{"filter", &inter_filter, "<filter> <parameters>",
 	"Adds/appends a filter. Filters are ordered in transmit direction.\n"
 	"gain <tx-volume> <rx-volume> - Changes volume (-8 .. 8)\n"
@@ -1362,6 +1422,16 @@ struct interface_param interface_param[] = {
 	"Enables RTP bridging directly from this interface.\n"
 	"This only works if both bridged interfaces use RTP, e.g. between gsm-bs and sip.\n"
 	"This parameter must follow a 'bridge' parameter.\n"},
+	{"rtp-codec", &inter_rtp_codec, "law | gsm | efr",
+	"Define codec to use on RTP of a SIP interface, if RTP is not bridged.\n"
+	"If multiple codecs are defined, the first has highest priority.\n"
+	"If none are defined, only 'law' is used. If a SIP call is bridged to a GSM\n"
+	"call or another SIP call that uses the same GSM codec, frames are relayed\n"
+	"without transcoding. Otherwise they are transcoded by LCR.\n"
+	"An incoming call is answered with the codec of the bridged call, if offered.\n"
+	"With 'tones yes', audio is connected before the call is routed, so the first\n"
+	"codec of this list that is offered is used instead.\n"
+	"This parameter must follow a 'sip' parameter.\n"},
 #if 0
 	not needed, since ms defines what is supports and remote (sip) tells what is selected
 	{"rtp-payload", &inter_rtp_payload, "<codec>",
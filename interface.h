@@ -130,6 +130,10 @@ struct interface {
 	void			*sip_inst; /* sip instance */
 #endif
 	int			rtp_bridge; /* bridge RTP directly (for calls comming from interface) */
+	int			rtp_codecs; /* number of codecs given for own RTP */
+	int			rtp_codec_types[4]; /* media types of codecs, first is preferred */
+	int			dtmf_detect; /* detect DTMF in received audio by software */
+	int			dtmf_level; /* minimum DTMF tone level in dB */
 };
 
 struct interface_param {
@@ -0,0 +1,249 @@
+/*****************************************************************************\
+**                                                                           **
+** LCR                                                                       **
+**                                                                           **
+**---------------------------------------------------------------------------**
+** Copyright: Andreas Eversberg                                              **
+**                                                                           **
+** adaptive jitter buffer                                                    **
+**                                                                           **
+\*****************************************************************************/
+
+#include "main.h"
+
+/*
+ * received samples are stored at the position of their RTP timestamp, so
+ * packets are put in order, no matter in which order they arrive. every
+ * 20 ms, jitter_get() takes one frame at the play timestamp.
+ * playout starts when the target delay is buffered. if the buffer runs
+ * empty, playout waits until the target delay is buffered again, and the
+ * target is raised. it is also raised, if packets arrive too late and if
+ * the interarrival jitter grows. the minimum delay is checked during a
+ * window of frames, like the bridge does. at the end of the window, the
+ * delay is reduced to the target, and the target is lowered slowly.
+ * lost samples are concealed by repeating the last frame with falling
+ * level.
+ */
+
+#define JITTER_WINDOW	100	/* frames of one window (2 s) */
+#define JITTER_STEP	40	/* samples the target is changed by */
+#define JITTER_CONCEAL	3	/* frames that are concealed, then silence */
+
+static void jitter_restart(struct jitter_buffer *jb, uint16_t seq, uint32_t ts, uint32_t ssrc, unsigned int arrival)
+{
+	if (jb->started)
+		jb->expected += jb->max_seq - jb->base_seq + 1;
+	memset(jb->valid, 0, sizeof(jb->valid));
+	jb->started = 1;
+	jb->prefill = 1;
+	jb->ssrc = ssrc;
+	jb->play_ts = ts;
+	jb->end_ts = ts;
+	jb->base_seq = seq;
+	jb->max_seq = seq;
+	jb->min_depth = JITTER_SIZE;
+	jb->window = 0;
+	jb->raised = 0;
+	jb->transit = arrival - ts;
+	jb->concealing = JITTER_CONCEAL;
+}
+
+void jitter_init(struct jitter_buffer *jb)
+{
+	memset(jb, 0, sizeof(*jb));
+	jb->target = JITTER_MIN + JITTER_STEP;
+}
+
+/* raise target delay */
+static void jitter_raise(struct jitter_buffer *jb, int target)
+{
+	if (target > JITTER_MAX)
+		target = JITTER_MAX;
+	if (target > jb->target) {
+		jb->target = target;
+		jb->raised = 1;
+	}
+}
+
+/* count received packet, update sequence and interarrival jitter */
+static void jitter_stat(struct jitter_buffer *jb, uint16_t seq, uint32_t ts, unsigned int arrival)
+{
+	int transit, d;
+
+	jb->received++;
+	d = (int16_t)(seq - (uint16_t)jb->max_seq);
+	if (d > 0)
+		jb->max_seq += d;
+	else if (d < 0)
+		jb->reordered++;
+
+	/* interarrival jitter, see RFC 3550 */
+	transit = arrival - ts;
+	d = transit - jb->transit;
+	jb->transit = transit;
+	if (d < 0)
+		d = -d;
+	jb->jitter += d - ((jb->jitter + 8) >> 4);
+	jitter_raise(jb, JITTER_MIN + 3 * (jb->jitter >> 4));
+}
+
+/* store received samples, arrival is the receive time in samples */
+void jitter_put(struct jitter_buffer *jb, uint16_t seq, uint32_t ts, uint32_t ssrc, unsigned int arrival, unsigned char *data, int len)
+{
+	int delta, i;
+
+	if (len <= 0 || len > JITTER_SIZE - JITTER_MAX)
+		return;
+
+	/* start with the first packet, restart if the stream changes or jumps */
+	delta = (int32_t)(ts - jb->play_ts);
+	if (!jb->started || ssrc != jb->ssrc || delta + len > JITTER_SIZE || delta < -JITTER_SIZE) {
+		jitter_restart(jb, seq, ts, ssrc, arrival);
+		delta = 0;
+	}
+
+	jitter_stat(jb, seq, ts, arrival);
+
+	/* samples that are already played are dropped */
+	if (delta + len <= 0) {
+		jb->late++;
+		jitter_raise(jb, jb->target + JITTER_STEP);
+		return;
+	}
+	i = (delta < 0) ? -delta : 0;
+	for (; i < len; i++) {
+		jb->buffer[(ts + i) & (JITTER_SIZE - 1)] = data[i];
+		jb->valid[(ts + i) & (JITTER_SIZE - 1)] = 1;
+	}
+	if ((int32_t)(ts + len - jb->end_ts) > 0)
+		jb->end_ts = ts + len;
+}
+
+/* repeat last frame with falling level, return 0 if nothing is left to conceal */
+static int jitter_conceal(struct jitter_buffer *jb, unsigned char *data)
+{
+	int i;
+
+	if (jb->concealing >= JITTER_CONCEAL) {
+		memset(data, audio_s16_to_law[0], JITTER_FRAME);
+		return 0;
+	}
+	jb->concealing++;
+	jb->concealed++;
+	for (i = 0; i < JITTER_FRAME; i++)
+		data[i] = audio_s16_to_law[(jb->last[i] >> jb->concealing) & 0xffff];
+
+	return JITTER_FRAME;
+}
+
+/* only count a packet that is relayed without buffering, len is its duration */
+void jitter_count(struct jitter_buffer *jb, uint16_t seq, uint32_t ts, uint32_t ssrc, unsigned int arrival, int len)
+{
+	if (!jb->started || ssrc != jb->ssrc)
+		jitter_restart(jb, seq, ts, ssrc, arrival);
+	jitter_stat(jb, seq, ts, arrival);
+	/* nothing is buffered, so playout continues after the latest packet */
+	if ((int32_t)(ts + len - jb->end_ts) > 0)
+		jb->play_ts = jb->end_ts = ts + len;
+}
+
+/* remove samples that are not played */
+static void jitter_skip(struct jitter_buffer *jb, int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		jb->valid[(jb->play_ts + i) & (JITTER_SIZE - 1)] = 0;
+	jb->play_ts += len;
+	jb->skipped += len;
+}
+
+/* get next frame of JITTER_FRAME samples, return 0 if there is nothing to play */
+int jitter_get(struct jitter_buffer *jb, unsigned char *data)
+{
+	unsigned char conceal[JITTER_FRAME];
+	int depth, missing = 0, i, pos;
+
+	if (!jb->started)
+		return 0;
+
+	depth = (int32_t)(jb->end_ts - jb->play_ts);
+	if (jb->prefill) {
+		if (depth < jb->target)
+			return jitter_conceal(jb, data);
+		jb->prefill = 0;
+	} else if (depth < JITTER_FRAME) {
+		/* buffer ran empty, so wait until it is filled again */
+		jb->underrun++;
+		jb->prefill = 1;
+		jitter_raise(jb, jb->target + JITTER_STEP);
+		return jitter_conceal(jb, data);
+	}
+
+	/* find minimum delay, reduce it to the target at the end of a window */
+	if (depth < jb->min_depth)
+		jb->min_depth = depth;
+	if (++jb->window == JITTER_WINDOW) {
+		if (jb->min_depth > jb->target)
+			jitter_skip(jb, jb->min_depth - jb->target);
+		if (!jb->raised && jb->target - JITTER_STEP >= JITTER_MIN + 3 * (jb->jitter >> 4))
+			jb->target -= JITTER_STEP;
+		jb->min_depth = JITTER_SIZE;
+		jb->window = 0;
+		jb->raised = 0;
+	}
+
+	for (i = 0; i < JITTER_FRAME; i++) {
+		pos = (jb->play_ts + i) & (JITTER_SIZE - 1);
+		if (!jb->valid[pos])
+			missing++;
+	}
+	jb->play_ts += JITTER_FRAME;
+
+	/* the whole frame is lost */
+	if (missing == JITTER_FRAME) {
+		jitter_conceal(jb, data);
+		return JITTER_FRAME;
+	}
+
+	/* fill lost samples from concealment */
+	if (missing)
+		jitter_conceal(jb, conceal);
+	for (i = 0; i < JITTER_FRAME; i++) {
+		pos = (jb->play_ts - JITTER_FRAME + i) & (JITTER_SIZE - 1);
+		if (jb->valid[pos]) {
+			data[i] = jb->buffer[pos];
+			jb->valid[pos] = 0;
+		} else
+			data[i] = conceal[i];
+		jb->last[i] = audio_law_to_s32[data[i]];
+	}
+	jb->concealing = 0;
+
+	return JITTER_FRAME;
+}
+
+/* packets that were expected, according to sequence numbers */
+unsigned int jitter_expected(struct jitter_buffer *jb)
+{
+	if (!jb->started)
+		return jb->expected;
+	return jb->expected + jb->max_seq - jb->base_seq + 1;
+}
+
+/* packets that were never received */
+unsigned int jitter_lost(struct jitter_buffer *jb)
+{
+	unsigned int expected = jitter_expected(jb);
+
+	if (expected < jb->received)
+		return 0;
+	return expected - jb->received;
+}
+
+/* current target delay in milliseconds */
+int jitter_delay(struct jitter_buffer *jb)
+{
+	return jb->target / 8;
+}
+
@@ -0,0 +1,55 @@
+/*****************************************************************************\
+**                                                                           **
+** LCR                                                                       **
+**                                                                           **
+**---------------------------------------------------------------------------**
+** Copyright: Andreas Eversberg                                              **
+**                                                                           **
+** adaptive jitter buffer header file                                        **
+**                                                                           **
+\*****************************************************************************/
+
+#include <stdint.h>
+
+#define JITTER_SIZE	4096	/* samples of buffer (512 ms), must be a power of two */
+#define JITTER_FRAME	160	/* samples played at once (20 ms) */
+#define JITTER_MIN	160	/* minimum target delay */
+#define JITTER_MAX	1600	/* maximum target delay */
+
+struct jitter_buffer {
+	unsigned char	buffer[JITTER_SIZE];	/* law samples, indexed by timestamp */
+	unsigned char	valid[JITTER_SIZE];	/* if sample was received */
+	int		started;		/* first packet was received */
+	int		prefill;		/* wait until target delay is buffered */
+	uint32_t	ssrc;
+	uint32_t	play_ts;		/* timestamp of next sample to play */
+	uint32_t	end_ts;			/* timestamp after the latest sample received */
+	uint32_t	base_seq;		/* first sequence number */
+	uint32_t	max_seq;		/* highest sequence number, extended by wrap count */
+	unsigned int	expected;		/* packets expected before last restart */
+	int		target;			/* target delay in samples */
+	int		min_depth;		/* minimum delay during the current window */
+	int		window;			/* frames played in the current window */
+	int		raised;			/* target was raised during the current window */
+	int		transit;		/* relative transit time of last packet */
+	int		jitter;			/* interarrival jitter (RFC 3550) * 16 */
+	signed short	last[JITTER_FRAME];	/* last frame played, for concealment */
+	int		concealing;		/* number of frames concealed in a row */
+	/* statistics of the call */
+	unsigned int	received;		/* packets received */
+	unsigned int	late;			/* packets that arrived after their playout time */
+	unsigned int	reordered;		/* packets that arrived before a lower sequence number */
+	unsigned int	concealed;		/* frames that were concealed */
+	unsigned int	underrun;		/* buffer ran empty */
+	unsigned int	skipped;		/* samples removed to reduce the delay */
+	unsigned int	resync;			/* playout was restarted, because it was too far behind */
+};
+
+void jitter_init(struct jitter_buffer *jb);
+void jitter_put(struct jitter_buffer *jb, uint16_t seq, uint32_t ts, uint32_t ssrc, unsigned int arrival, unsigned char *data, int len);
+void jitter_count(struct jitter_buffer *jb, uint16_t seq, uint32_t ts, uint32_t ssrc, unsigned int arrival, int len);
+int jitter_get(struct jitter_buffer *jb, unsigned char *data);
+unsigned int jitter_expected(struct jitter_buffer *jb);
+unsigned int jitter_lost(struct jitter_buffer *jb);
+int jitter_delay(struct jitter_buffer *jb);
+
@@ -20,18 +20,21 @@ unsigned int join_serial = 1; /* must be 1, because 0== no join */
 
 class Join *join_first = NULL;
 
+/* index of joins by serial */
+#define JOIN_HASH	4096 /* must be a power of two */
+static class Join *join_hash[JOIN_HASH];
+
 /*
  * find the join with join_id
  */ 
 class Join *find_join_id(unsigned int join_id)
 {
-	class Join *join = join_first;
+	class Join *join = join_hash[join_id & (JOIN_HASH - 1)];
 
 	while(join) {
-//printf("comparing: '%s' with '%s'\n", name, join->j_name);
 		if (join->j_serial == join_id)
 			return(join);
-		join = join->next;
+		join = join->hash_next;
 	}
 
 	return(NULL);
@@ -46,6 +49,8 @@ Join::Join(void)
 	class Join **joinp;
 
 	j_serial = join_serial++;
+	hash_next = join_hash[j_serial & (JOIN_HASH - 1)];
+	join_hash[j_serial & (JOIN_HASH - 1)] = this;
 	j_type = JOIN_TYPE_NONE;
 
 	/* attach to chain */
@@ -79,6 +84,10 @@ Join::~Join()
 	if (!cl)
 		FATAL("software error, join not in chain!\n");
 	*clp = cl->next; /* detach from chain */
+	clp = &join_hash[j_serial & (JOIN_HASH - 1)];
+	while(*clp != this)
+		clp = &(*clp)->hash_next;
+	*clp = hash_next; /* detach from hash */
 }
 
 
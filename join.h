@@ -23,6 +23,7 @@ class Join
 	Join();
 	virtual ~Join();
 	class Join *next;		/* next node in list of joins */
+	class Join *hash_next;		/* next node in hash bucket */
 	virtual void message_epoint(unsigned int epoint_id, int message, union parameter *param);
 
 	unsigned int j_type;		/* join type (pbx or asterisk) */
@@ -831,7 +831,7 @@ void JoinPBX::message_epoint(unsigned int epoint_id, int message_type, union par
 			while(reltemp) {
 				if (reltemp->epoint_id!=epoint_id && reltemp->epoint_id) {
 					message = message_create(j_serial, reltemp->epoint_id, JOIN_TO_EPOINT, MESSAGE_NOTIFY);
-					memcpy(&message->param, param, sizeof(union parameter));
+					memcpy(&message->param, param, message_param_size(message->type));
 					message_put(message);
 				}
 				reltemp = reltemp->next;
@@ -897,7 +897,7 @@ void JoinPBX::message_epoint(unsigned int epoint_id, int message_type, union par
 				if (reltemp->type == RELATION_TYPE_SETUP) {
 					/* send release to endpoint */
 					message = message_create(j_serial, reltemp->epoint_id, JOIN_TO_EPOINT, message_type);
-					memcpy(&message->param, param, sizeof(union parameter));
+					memcpy(&message->param, param, message_param_size(message->type));
 					message_put(message);
 
 					if (release(reltemp, LOCATION_PRIVATE_LOCAL, CAUSE_NORMAL))
@@ -959,7 +959,7 @@ void JoinPBX::message_epoint(unsigned int epoint_id, int message_type, union par
 			if (relation->epoint_id != epoint_id) {
 				PDEBUG(DEBUG_JOIN, "sending message ep%ld -> ep%ld.\n", epoint_id, relation->epoint_id);
 				message = message_create(j_serial, relation->epoint_id, JOIN_TO_EPOINT, message_type);
-				memcpy(&message->param, param, sizeof(union parameter));
+				memcpy(&message->param, param, message_param_size(message->type));
 				message_put(message);
 				PDEBUG(DEBUG_JOIN, "message sent.\n");
 			}
@@ -1031,7 +1031,7 @@ int JoinPBX::out_setup(unsigned int epoint_id, int message_type, union parameter
 //i			if (options.deb & DEBUG_JOIN)
 //				joinpbx_debug(join, "Join::message_epoint");
 	message = message_create(j_serial, relation->epoint_id, JOIN_TO_EPOINT, message_type);
-	memcpy(&message->param, param, sizeof(union parameter));
+	memcpy(&message->param, param, message_param_size(message->type));
 	if (newnumber)
 		SCPY(message->param.setup.dialinginfo.id, newnumber);
 	else
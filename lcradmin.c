@@ -26,6 +26,7 @@
 #include "options.h"
 #include "join.h"
 #include "select.h"
+#include "spsc.h"
 #include "joinpbx.h"
 #include "extension.h"
 #include "message.h"
@@ -207,6 +208,42 @@ int debug_port(struct admin_message *msg, struct admin_message *m, int line, int
 			addstr(" hold");
 		}
 	}
+	if (m[i].u.p.rtp) {
+		color(cyan);
+		addstr(" jitter=");
+		color(white);
+		SPRINT(buffer, "%dms", m[i].u.p.rtp_delay);
+		addstr(buffer);
+		if (m[i].u.p.rtp_late || m[i].u.p.rtp_lost || m[i].u.p.rtp_reordered) {
+			color(red);
+			SPRINT(buffer, " late=%u lost=%u reorder=%u plc=%u", m[i].u.p.rtp_late, m[i].u.p.rtp_lost, m[i].u.p.rtp_reordered, m[i].u.p.rtp_concealed);
+			addstr(buffer);
+		}
+		if (m[i].u.p.rtp_resync) {
+			color(red);
+			SPRINT(buffer, " resync=%u", m[i].u.p.rtp_resync);
+			addstr(buffer);
+		}
+		if (m[i].u.p.rtp_rtt >= 0) {
+			color(cyan);
+			addstr(" rtt=");
+			color(white);
+			SPRINT(buffer, "%dms", m[i].u.p.rtp_rtt);
+			addstr(buffer);
+		}
+		if (m[i].u.p.rtp_remote_lost > 0) {
+			color(red);
+			SPRINT(buffer, " remote-lost=%d", m[i].u.p.rtp_remote_lost);
+			addstr(buffer);
+		}
+		if (m[i].u.p.rtp_mos) {
+			color(cyan);
+			addstr(" mos=");
+			color((m[i].u.p.rtp_mos < 360)?red:white);
+			SPRINT(buffer, "%d.%02d", m[i].u.p.rtp_mos / 100, m[i].u.p.rtp_mos % 100);
+			addstr(buffer);
+		}
+	}
 
 	return(line);
 }
@@ -993,6 +1030,18 @@ const char *admin_state(int sock, char *argv[])
 	msg.u.s.version_string[sizeof(msg.u.s.version_string)-1] = '\0';
 	SPRINT(buffer, "LCR %s", msg.u.s.version_string);
 	addstr(buffer);
+	if (COLS>70 && (msg.u.s.pacing_late || msg.u.s.pacing_resync)) {
+		color(red);
+		SPRINT(buffer, "  pacing late:%u resync:%u", msg.u.s.pacing_late, msg.u.s.pacing_resync);
+		addstr(buffer);
+		color(cyan);
+	}
+	if (COLS>90 && (msg.u.s.rec_dropped || msg.u.s.rec_stalls || msg.u.s.rec_errors)) {
+		color(red);
+		SPRINT(buffer, "  record dropped:%uk stalls:%u errors:%u", msg.u.s.rec_dropped / 1024, msg.u.s.rec_stalls, msg.u.s.rec_errors);
+		addstr(buffer);
+		color(cyan);
+	}
 	if (COLS>50) {
 		move(0, COLS-19);
 		SPRINT(buffer, "%04d-%02d-%02d %02d:%02d:%02d",
@@ -1016,10 +1065,26 @@ const char *admin_state(int sock, char *argv[])
 		color(red);
 		addstr(buffer);
 	}
+	if (COLS>100) {
+		SPRINT(buffer, "extensions cached:%u parsed:%u  messages reused:%u slabs:%u", msg.u.s.ext_cache_hit, msg.u.s.ext_cache_miss, msg.u.s.message_reused, msg.u.s.message_slabs);
+		move(1, COLS-2-strlen(buffer));
+		color(blue);
+		addstr(buffer);
+	} else if (COLS>70) {
+		SPRINT(buffer, "messages reused:%u slabs:%u", msg.u.s.message_reused, msg.u.s.message_slabs);
+		move(1, COLS-2-strlen(buffer));
+		color(blue);
+		addstr(buffer);
+	}
 	/* display end */
 	move(LINES-2, 0);
 	color(blue);
 	hline(ACS_HLINE, COLS);
+	if (COLS>70) {
+		SPRINT(buffer, "tones cached:%u converted:%u evicted:%u size:%uk", msg.u.s.tone_cache_hit, msg.u.s.tone_cache_miss, msg.u.s.tone_cache_evict, msg.u.s.tone_cache_bytes / 1024);
+		move(LINES-2, COLS-2-strlen(buffer));
+		addstr(buffer);
+	}
 	move(LINES-1, 0);
 	if (enter) {
 		color(white);
@@ -61,6 +61,19 @@ struct admin_response_state {
 	int		joins;
 	int		epoints;
 	int		ports;
+	unsigned int	pacing_late; /* audio clock events processed too late */
+	unsigned int	pacing_resync; /* audio clock restarts */
+	unsigned int	message_reused; /* messages taken from free lists */
+	unsigned int	message_slabs; /* message slabs allocated */
+	unsigned int	ext_cache_hit; /* extension settings taken from cache */
+	unsigned int	ext_cache_miss; /* extension settings parsed from file */
+	unsigned int	tone_cache_hit; /* tones taken from tone cache */
+	unsigned int	tone_cache_miss; /* tones converted into tone cache */
+	unsigned int	tone_cache_evict; /* tones removed from tone cache */
+	unsigned int	tone_cache_bytes; /* size of tone cache */
+	unsigned int	rec_dropped; /* recorded bytes dropped, because disk is too slow */
+	unsigned int	rec_stalls; /* recording jobs that did not fit into the queue */
+	unsigned int	rec_errors; /* recording writes failed */
 };
 
 struct admin_response_interface {
@@ -125,6 +138,16 @@ struct admin_response_port {
 	int		isdn_chan; /* bchannel number */
 	int		isdn_hold; /* on hold */
 	int		isdn_ces; /* ces to use (>=0)*/
+	int		rtp; /* if port receives RTP */
+	int		rtp_delay; /* target delay of jitter buffer in ms */
+	unsigned int	rtp_late; /* packets received too late */
+	unsigned int	rtp_lost; /* packets not received */
+	unsigned int	rtp_reordered; /* packets received out of order */
+	unsigned int	rtp_concealed; /* frames concealed */
+	unsigned int	rtp_resync; /* playout restarted, because it was too far behind */
+	int		rtp_rtt; /* round trip time in ms from RTCP, -1 if unknown */
+	int		rtp_remote_lost; /* packets lost as reported by remote RTCP */
+	int		rtp_mos; /* estimated MOS * 100, 0 if unknown */
 };
 
 struct admin_call {
@@ -178,6 +201,105 @@ struct admin_message {
 	} u;
 };
 
+/* framed messages
+ * a remote application announces support with param.hello.framing. if LCR
+ * supports it, LCR replies with a framed MESSAGE_HELLO. from then on, both
+ * sides send framed messages. a frame only carries the used part of union u,
+ * without trailing zeros. fixed size messages are still accepted, they are
+ * told apart by the first word.
+ * multiple messages are read and written at once, so buffers hold at least
+ * one fixed size message. */
+#define ADMIN_FRAMING		1
+#define ADMIN_FRAME_MAGIC	0x4c430000
+#define ADMIN_FRAME_MASK	0xffff0000
+#define ADMIN_BUFFER		((int)sizeof(struct admin_message) * 2)
+
+struct admin_frame {
+	unsigned int	magic_len;	/* ADMIN_FRAME_MAGIC | length of payload */
+	int		message;
+};
+
+/* returns the number of bytes of union u that may be used by a message */
+static inline int admin_payload_size(const struct admin_message *msg)
+{
+	if (msg->message == ADMIN_MESSAGE)
+		return (int)((const char *)&msg->u.msg.param - (const char *)&msg->u) + message_param_size(msg->u.msg.type);
+	return sizeof(msg->u);
+}
+
+/* returns the number of bytes of a frame, used to check for buffer space */
+static inline int admin_frame_max(const struct admin_message *msg)
+{
+	return sizeof(struct admin_frame) + admin_payload_size(msg);
+}
+
+/* write message as frame into buffer, returns the length */
+static inline int admin_frame_encode(unsigned char *buffer, const struct admin_message *msg)
+{
+	const unsigned char *u = (const unsigned char *)&msg->u;
+	struct admin_frame frame;
+	unsigned long long word;
+	int len = admin_payload_size(msg);
+
+	/* trailing zeros are not sent, the receiver clears them */
+	while (len >= 8) {
+		memcpy(&word, u + len - 8, 8);
+		if (word)
+			break;
+		len -= 8;
+	}
+	while (len && !u[len - 1])
+		len--;
+	frame.magic_len = ADMIN_FRAME_MAGIC | len;
+	frame.message = msg->message;
+	memcpy(buffer, &frame, sizeof(frame));
+	memcpy(buffer + sizeof(frame), u, len);
+	return sizeof(frame) + len;
+}
+
+/* returns the length of the message at the start of buffer, 0 if it is
+ * incomplete, or -1 if it is invalid */
+static inline int admin_frame_length(const unsigned char *buffer, int len)
+{
+	unsigned int word;
+	int size;
+
+	if (len < (int)sizeof(struct admin_frame))
+		return 0;
+	memcpy(&word, buffer, sizeof(word));
+	if ((word & ADMIN_FRAME_MASK) != ADMIN_FRAME_MAGIC)
+		size = sizeof(struct admin_message);
+	else {
+		if ((word & ~ADMIN_FRAME_MASK) > sizeof(((struct admin_message *)0)->u))
+			return -1;
+		size = sizeof(struct admin_frame) + (word & ~ADMIN_FRAME_MASK);
+	}
+	return (len >= size) ? size : 0;
+}
+
+/* read message from buffer, the length is given by admin_frame_length() */
+static inline void admin_frame_decode(struct admin_message *msg, const unsigned char *buffer)
+{
+	struct admin_frame frame;
+	int len, size;
+
+	memcpy(&frame, buffer, sizeof(frame));
+	if ((frame.magic_len & ADMIN_FRAME_MASK) != ADMIN_FRAME_MAGIC) {
+		memcpy(msg, buffer, sizeof(struct admin_message));
+		return;
+	}
+	len = frame.magic_len & ~ADMIN_FRAME_MASK;
+	msg->message = frame.message;
+	memcpy(&msg->u, buffer + sizeof(frame), len);
+	/* clear the rest, as far as the message may use it */
+	size = (int)((char *)&msg->u.msg.param - (char *)&msg->u);
+	if (len < size)
+		memset((unsigned char *)&msg->u + len, 0, size - len);
+	size = admin_payload_size(msg);
+	if (len < size)
+		memset((unsigned char *)&msg->u + len, 0, size - len);
+}
+
 /* call states */
 enum {
 	ADMIN_STATE_IDLE,
@@ -194,3 +316,21 @@ enum {
 	ADMIN_STATE_OUT_DISCONNECT,
 	ADMIN_STATE_RELEASE,
 };
+
+/* audio between LCR and remote application through shared memory
+ * LCR creates it for every remote port and sends its name with MESSAGE_NEWREF.
+ * the remote application maps it and sets 'attached', before it sends the
+ * next message for that ref. from then on, audio is exchanged through the
+ * queues, instead of MESSAGE_TRAFFIC at the socket. */
+#define REMOTE_AUDIO_SHM	"/lcr-audio-%d-%u"	/* pid of LCR, ref */
+#define REMOTE_AUDIO_VERSION	1
+#define REMOTE_AUDIO_FRAMES	32	/* frames of each queue, must be a power of two */
+
+struct remote_audio {
+	unsigned int		version;
+	unsigned int		attached;	/* set by remote application */
+	struct spsc		to_lcr;
+	struct param_traffic	to_lcr_frame[REMOTE_AUDIO_FRAMES];
+	struct spsc		from_lcr;
+	struct param_traffic	from_lcr_frame[REMOTE_AUDIO_FRAMES];
+};
@@ -0,0 +1,289 @@
+/*****************************************************************************\
+**                                                                           **
+** LCR                                                                       **
+**                                                                           **
+**---------------------------------------------------------------------------**
+** Copyright: Andreas Eversberg                                              **
+**                                                                           **
+** log writer thread                                                         **
+**                                                                           **
+\*****************************************************************************/
+
+#include "main.h"
+#include <semaphore.h>
+#include <sys/uio.h>
+
+/*
+ * log_write() queues text for a file and returns at once. the writer thread
+ * takes all queued records, and writes consecutive records of the same file
+ * with one writev(). files stay open, until log_rotate() is called, e.g. by
+ * SIGHUP. then the files are reopened before the next record is written, so
+ * no record is lost. if the queue is full, records are dropped and a note is
+ * written with the next record.
+ * as long as the thread is not running, text is written directly.
+ */
+
+#define LOG_QUEUE	1048576	/* bytes of queue, must be a power of two */
+#define LOG_FILES	32	/* number of files that stay open */
+#define LOG_IOV		64	/* number of records written at once */
+#define LOG_ALIGN(x)	(((x) + 7) & ~7)
+
+struct log_record {
+	unsigned int	len;		/* aligned length of record, 0 = skip to start of queue */
+	unsigned int	path_len;	/* length of path, including '\0' */
+	unsigned int	text_len;
+	char		data[0];	/* path, then text */
+};
+
+struct log_file {
+	char		path[256];
+	int		fd;		/* -1 = not open */
+	unsigned int	use;		/* when the file was used last */
+};
+
+static unsigned char log_queue[LOG_QUEUE] __attribute__((aligned(8)));
+static unsigned int log_head = 0, log_tail = 0; /* protected by log_mutex */
+static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+static sem_t log_sem;
+static pthread_t log_thread;
+static int log_running = 0, log_quit = 0;
+static volatile sig_atomic_t log_reopen = 0;
+static struct log_file log_file[LOG_FILES]; /* only used by writer thread */
+static unsigned int log_use = 0;
+unsigned int log_dropped = 0; /* records dropped, because queue was full */
+static unsigned int log_dropped_reported = 0;
+
+/* write text directly, if the writer thread is not running */
+static void log_direct(const char *path, const char *text, int len)
+{
+	int fd, ret;
+
+	fd = open(path, O_WRONLY | O_APPEND | O_CREAT, 0666);
+	if (fd < 0) {
+		PERROR("Cannot open log: \"%s\"\n", path);
+		return;
+	}
+	ret = write(fd, text, len);
+	if (ret < 0)
+		PERROR("Cannot write log: \"%s\"\n", path);
+	close(fd);
+}
+
+/* put record into queue, must be called with log_mutex locked */
+static int log_put(const char *path, const char *text, int len)
+{
+	struct log_record *record;
+	unsigned int path_len = strlen(path) + 1;
+	unsigned int size = LOG_ALIGN(sizeof(struct log_record) + path_len + len);
+	unsigned int pos = log_head & (LOG_QUEUE - 1);
+	unsigned int skip = (pos + size > LOG_QUEUE) ? LOG_QUEUE - pos : 0;
+
+	if (log_head + skip + size - log_tail > LOG_QUEUE)
+		return -1;
+	if (skip) {
+		((struct log_record *)(log_queue + pos))->len = 0;
+		pos = 0;
+	}
+	record = (struct log_record *)(log_queue + pos);
+	record->len = size;
+	record->path_len = path_len;
+	record->text_len = len;
+	memcpy(record->data, path, path_len);
+	memcpy(record->data + path_len, text, len);
+	log_head += skip + size;
+
+	return 0;
+}
+
+void log_write(const char *path, const char *text, int len)
+{
+	char note[64];
+
+	if (len <= 0)
+		return;
+
+	if (!log_running) {
+		log_direct(path, text, len);
+		return;
+	}
+
+	pthread_mutex_lock(&log_mutex);
+	if (log_dropped != log_dropped_reported) {
+		SPRINT(note, "*** %u log record(s) dropped ***\n", log_dropped - log_dropped_reported);
+		if (!log_put(path, note, strlen(note)))
+			log_dropped_reported = log_dropped;
+	}
+	if (log_put(path, text, len) < 0)
+		log_dropped++;
+	pthread_mutex_unlock(&log_mutex);
+
+	sem_post(&log_sem);
+}
+
+/* reopen all files before next write, may be called from signal handler */
+void log_rotate(void)
+{
+	log_reopen = 1;
+	if (log_running)
+		sem_post(&log_sem);
+}
+
+/* get file descriptor of given file, replace the least recently used file, if all are open */
+static int log_open(const char *path)
+{
+	struct log_file *file = NULL;
+	int i;
+
+	log_use++;
+	for (i = 0; i < LOG_FILES; i++) {
+		if (log_file[i].fd >= 0 && !strcmp(log_file[i].path, path)) {
+			log_file[i].use = log_use;
+			return log_file[i].fd;
+		}
+		/* remember a free slot, or else the least recently used one */
+		if (!file)
+			file = &log_file[i];
+		else if (file->fd >= 0 && (log_file[i].fd < 0 || log_file[i].use < file->use))
+			file = &log_file[i];
+	}
+
+	if (file->fd >= 0)
+		close(file->fd);
+	SCPY(file->path, path);
+	file->use = log_use;
+	file->fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0666);
+	if (file->fd < 0)
+		PERROR("Cannot open log: \"%s\"\n", path);
+	return file->fd;
+}
+
+static void log_close(void)
+{
+	int i;
+
+	for (i = 0; i < LOG_FILES; i++) {
+		if (log_file[i].fd >= 0)
+			close(log_file[i].fd);
+		log_file[i].fd = -1;
+	}
+}
+
+/* write records to file, continue after partial writes */
+static void log_flush(const char *path, struct iovec *iov, int num)
+{
+	int fd, ret;
+
+	if ((fd = log_open(path)) < 0)
+		return;
+	while (num) {
+		ret = writev(fd, iov, num);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			PERROR("Cannot write log: \"%s\"\n", path);
+			return;
+		}
+		while (num && ret >= (int)iov->iov_len) {
+			ret -= iov->iov_len;
+			iov++;
+			num--;
+		}
+		if (num) {
+			iov->iov_base = (char *)iov->iov_base + ret;
+			iov->iov_len -= ret;
+		}
+	}
+}
+
+static void *log_writer(void *arg)
+{
+	struct iovec iov[LOG_IOV];
+	struct log_record *record;
+	const char *path = NULL;
+	unsigned int head, tail, pos;
+	int num, quit;
+
+	while (1) {
+		while (sem_wait(&log_sem) < 0 && errno == EINTR)
+			;
+		if (log_reopen) {
+			log_reopen = 0;
+			log_close();
+		}
+
+		pthread_mutex_lock(&log_mutex);
+		head = log_head;
+		tail = log_tail;
+		quit = log_quit;
+		pthread_mutex_unlock(&log_mutex);
+
+		/* records between tail and head are not touched by producers */
+		num = 0;
+		while (tail != head) {
+			pos = tail & (LOG_QUEUE - 1);
+			record = (struct log_record *)(log_queue + pos);
+			if (!record->len) {
+				tail += LOG_QUEUE - pos;
+				continue;
+			}
+			if (num && (num == LOG_IOV || strcmp(path, record->data))) {
+				log_flush(path, iov, num);
+				num = 0;
+			}
+			path = record->data;
+			iov[num].iov_base = record->data + record->path_len;
+			iov[num].iov_len = record->text_len;
+			num++;
+			tail += record->len;
+		}
+		if (num)
+			log_flush(path, iov, num);
+
+		/* now the records may be overwritten */
+		pthread_mutex_lock(&log_mutex);
+		log_tail = tail;
+		pthread_mutex_unlock(&log_mutex);
+
+		if (quit)
+			break;
+	}
+
+	log_close();
+	return NULL;
+}
+
+int log_init(void)
+{
+	int i;
+
+	for (i = 0; i < LOG_FILES; i++)
+		log_file[i].fd = -1;
+	if (sem_init(&log_sem, 0, 0) < 0) {
+		PERROR("Cannot create log semaphore: %s\n", strerror(errno));
+		return -1;
+	}
+	log_quit = 0;
+	if (pthread_create(&log_thread, NULL, log_writer, NULL)) {
+		PERROR("Cannot create log writer thread\n");
+		sem_destroy(&log_sem);
+		return -1;
+	}
+	log_running = 1;
+
+	return 0;
+}
+
+/* write all queued records and stop thread */
+void log_exit(void)
+{
+	if (!log_running)
+		return;
+	pthread_mutex_lock(&log_mutex);
+	log_quit = 1;
+	pthread_mutex_unlock(&log_mutex);
+	sem_post(&log_sem);
+	pthread_join(log_thread, NULL);
+	log_running = 0;
+	sem_destroy(&log_sem);
+}
+
@@ -0,0 +1,17 @@
+/*****************************************************************************\
+**                                                                           **
+** LCR                                                                       **
+**                                                                           **
+**---------------------------------------------------------------------------**
+** Copyright: Andreas Eversberg                                              **
+**                                                                           **
+** log writer header file                                                    **
+**                                                                           **
+\*****************************************************************************/
+
+extern unsigned int log_dropped;
+int log_init(void);
+void log_exit(void);
+void log_rotate(void);
+void log_write(const char *path, const char *text, int len);
+
@@ -49,13 +49,23 @@ int upqueue_avail = 0;
 static int mISDN_upqueue(struct lcr_fd *fd, unsigned int what, void *instance, int i);
 static int mISDN_timeout(struct lcr_timer *timer, void *instance, int i);
 
+/* debug output of the mISDN library goes to the debug log through the log
+ * writer, so it is not mixed with LCR's own debug output */
 static int my_mISDNlib_debug(const char *file, int line, const char *func, int level, const char *fmt, va_list va)
 {
-        int ret = 0;
+	char debug_log[256], text[4096];
+	int len;
 
-        if (debug_fp > 0)
-        	ret = vfprintf(debug_fp, fmt, va);
-	return ret;
+	if (!debug_fp)
+		return 0;
+	SPRINT(debug_log, "%s/debug.log", LOG_DIR);
+	len = VUNPRINT(text, sizeof(text), fmt, va);
+	if (len < 0)
+		return 0;
+	if (len > (int)sizeof(text) - 1)
+		len = sizeof(text) - 1;
+	log_write(debug_log, text, len);
+	return len;
 }
 
 static struct mi_ext_fn_s myfn;
@@ -430,8 +440,8 @@ static int _bchannel_create(struct mISDNport *mISDNport, int i)
 	ret = bind(mISDNport->b_sock[i].fd, (struct sockaddr *)&addr, sizeof(addr));
 	if (ret < 0) {
 		PERROR("Error: Failed to bind bchannel-socket for index %d with mISDN-DSP layer (errno=%d). Did you load mISDN_dsp.ko?\n", i, errno);
-		close(mISDNport->b_sock[i].fd);
 		unregister_fd(&mISDNport->b_sock[i]);
+		close(mISDNport->b_sock[i].fd);
 		return(0);
 	}
 
@@ -543,8 +553,8 @@ static void _bchannel_destroy(struct mISDNport *mISDNport, int i)
 	add_trace("channel", NULL, "%d", i+1+(i>=15));
 	add_trace("socket", NULL, "%d", mISDNport->b_sock[i].fd);
 	end_trace();
-	close(mISDNport->b_sock[i].fd);
 	unregister_fd(&mISDNport->b_sock[i]);
+	close(mISDNport->b_sock[i].fd);
 }
 
 
@@ -943,10 +953,13 @@ void PmISDN::load_tx(void)
 	struct timeval current_time;
 
 	/* get elapsed */
-	gettimeofday(&current_time, NULL);
+	get_monotonic(&current_time);
 	if (p_m_last_tv_sec) {
 		elapsed = 8000 * (current_time.tv_sec - p_m_last_tv_sec)
 			+ 8 * (current_time.tv_usec/1000 - p_m_last_tv_msec);
+		/* timer came a full transmit period too late */
+		if (elapsed >= PORT_TRANSMIT * 2)
+			PACING_COUNT(pacing_late);
 	}
 	/* set clock of last process! */
 	p_m_last_tv_sec = current_time.tv_sec;
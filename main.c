@@ -55,9 +55,14 @@ int nooutput = 0;
 
 void debug(const char *file, const char *function, int line, const char *prefix, char *buffer)
 {
+	static char debug_log[256] = "";
+	char text[4096 + 256];
 	time_t now;
 	struct tm *now_tm;
 
+	if (!debug_log[0])
+		SPRINT(debug_log, "%s/debug.log", LOG_DIR);
+
 	/* if we have a new debug count, we add a mark */
 	if (last_debug != debug_count) {
 		last_debug = debug_count;
@@ -65,8 +70,10 @@ void debug(const char *file, const char *function, int line, const char *prefix,
 		now_tm = localtime(&now);
 		if (!nooutput)
 			printf("\033[34m--------------------- %04d.%02d.%02d %02d:%02d:%02d %06d\033[36m\n", now_tm->tm_year+1900, now_tm->tm_mon+1, now_tm->tm_mday, now_tm->tm_hour, now_tm->tm_min, now_tm->tm_sec, debug_count%1000000);
-		if (debug_fp)
-			fprintf(debug_fp, "--------------------- %04d.%02d.%02d %02d:%02d:%02d %06d\n", now_tm->tm_year+1900, now_tm->tm_mon+1, now_tm->tm_mday, now_tm->tm_hour, now_tm->tm_min, now_tm->tm_sec, debug_count%1000000);
+		if (debug_fp) {
+			SPRINT(text, "--------------------- %04d.%02d.%02d %02d:%02d:%02d %06d\n", now_tm->tm_year+1900, now_tm->tm_mon+1, now_tm->tm_mday, now_tm->tm_hour, now_tm->tm_min, now_tm->tm_sec, debug_count%1000000);
+			log_write(debug_log, text, strlen(text));
+		}
 	}
 
 	if (!nooutput) {
@@ -81,10 +88,10 @@ void debug(const char *file, const char *function, int line, const char *prefix,
 	if (debug_fp) {
 		if (debug_newline) {
 			if (function)
-				fprintf(debug_fp, "%s%s(in %s() line %d): %s", prefix?prefix:"", prefix?" ":"", function, line, buffer);
+				SPRINT(text, "%s%s(in %s() line %d): %s", prefix?prefix:"", prefix?" ":"", function, line, buffer);
 			else
-				fprintf(debug_fp, "%s%s: %s", prefix?prefix:"", prefix?" ":"", buffer);
-			fflush(debug_fp);
+				SPRINT(text, "%s%s: %s", prefix?prefix:"", prefix?" ":"", buffer);
+			log_write(debug_log, text, strlen(text));
 		}
 	}
 
@@ -143,8 +150,11 @@ void sighandler(int sigset)
 {
 	struct sched_param schedp;
 
-	if (sigset == SIGHUP)
+	if (sigset == SIGHUP) {
+		/* reopen log files, e.g. after rotation */
+		log_rotate();
 		return;
+	}
 	if (sigset == SIGPIPE)
 		return;
 	fprintf(stderr, "LCR: Signal received: %d\n", sigset);
@@ -181,7 +191,8 @@ int main(int argc, char *argv[])
 	int			i;
 	struct sched_param	schedp;
 	int			created_mutexd = 0,/* created_mutext = 0,*/ created_mutexe = 0,
-        			created_lock = 0, created_signal = 0, created_message = 0;
+        			created_lock = 0, created_signal = 0, created_message = 0,
+        			created_log = 0;
 #ifdef WITH_MISDN
 	int			created_misdn = 0;
 #endif
@@ -270,6 +281,15 @@ int main(int argc, char *argv[])
 		goto free;
 	}
 
+	/* start log writer */
+	if (log_init() < 0)
+		goto free;
+	created_log = 1;
+
+	/* start record writer */
+	if (rec_init() < 0)
+		goto free;
+
 #ifdef WITH_MISDN
 	/* init mISDN */
 	if (mISDN_initialize() < 0)
@@ -364,6 +384,9 @@ int main(int argc, char *argv[])
 		goto free;
 	}
 
+	/* remove shared memory for audio of a former LCR process */
+	remote_audio_unlink_stale();
+
 	/* generate alaw / ulaw tables */
 	generate_tables(options.law);
 
@@ -452,6 +475,12 @@ init is done when interface is up
 		}
 	}
 
+	/* audio thread */
+	if (options.audio_thread) {
+		if (bridge_thread_init() < 0)
+			goto free;
+	}
+
 	/* signal handlers */	
 	signal(SIGINT,sighandler);
 	signal(SIGHUP,sighandler);
@@ -463,6 +492,12 @@ init is done when interface is up
 	init_message();
 	created_message = 1;
 
+	/* render traces from main loop */
+	init_trace();
+
+	/* cache extension settings, continue without cache on failure */
+	extension_cache_init();
+
 	/*** main loop ***/
 	SPRINT(tracetext, "%s %s started, waiting for calls...", NAME, VERSION_STRING);
 	start_trace(-1, NULL, NULL, NULL, 0, 0, 0, tracetext);
@@ -488,19 +523,10 @@ init is done when interface is up
 		if (all_idle) {
 			usleep(10000);
 		}
-#else
-#ifdef WITH_SIP
-		if (options.polling || any_sip_interface) {
 #else
 		if (options.polling) {
-#endif
-			if (!select_main(1, NULL, NULL, NULL)) {
-#ifdef WITH_SIP
-				/* FIXME: check if work was done */
-				sip_handle();
-#endif
+			if (!select_main(1, NULL, NULL, NULL))
 				usleep(10000);
-			}
 		} else
 			select_main(0, NULL, NULL, NULL);
 #endif
@@ -546,6 +572,12 @@ free:
 	debug_count++;
 	join_free();
 
+	/* stop audio thread, after all bridges are removed */
+	bridge_thread_exit();
+
+	/* write pending recordings, after all ports are removed */
+	rec_exit();
+
 	/* free interfaces */
 	if (interface_first)
 		free_interfaces(interface_first);
@@ -571,9 +603,16 @@ free:
 	if (created_message)
 		cleanup_message();
 
+	/* free cached extensions */
+	extension_cache_cleanup();
+
+	/* render pending traces, further traces are rendered at once */
+	cleanup_trace();
+
 	/* free tones */
-	if (toneset_first)
+	if (tonepack_first)
 		free_tones();
+	free_tone_cache();
 
 	/* free admin socket */
 	admin_cleanup();
@@ -653,6 +692,10 @@ exit is done when interface is down
 	MEMCHECK("file descriptor(s) left",fduse)
 	MEMCHECK("file handler(s) left",fhuse)
 
+	/* write pending log records, further records are written directly */
+	if (created_log)
+		log_exit();
+
 	/* unlock LCR process */
 //	pthread_mutex_unlock(&mutex_lcr);
 
@@ -137,6 +137,10 @@ void debug(const char *file, const char *function, int line, const char *prefix,
 #endif
 #include "macro.h"
 #include "select.h"
+#include "spsc.h"
+#include "goertzel.h"
+#include "dtmf.h"
+#include "jitter.h"
 #include "options.h"
 #include "interface.h"
 #include "extension.h"
@@ -147,6 +151,7 @@ void debug(const char *file, const char *function, int line, const char *prefix,
 #include "appbridge.h"
 #include "callerid.h"
 #include "route.h"
+#include "tones.h"
 #include "port.h"
 #include "remote.h"
 #ifdef WITH_MISDN
@@ -176,10 +181,11 @@ void debug(const char *file, const char *function, int line, const char *prefix,
 #include "joinpbx.h"
 #include "cause.h"
 #include "alawulaw.h"
-#include "tones.h"
 #include "crypt.h"
 #include "socket_server.h"
 #include "trace.h"
+#include "logwriter.h"
+#include "recwriter.h"
 
 extern int quit;
 
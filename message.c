@@ -10,6 +10,10 @@
 \*****************************************************************************/ 
 
 #include "main.h"
+#include <stddef.h>
+#if defined(__SANITIZE_ADDRESS__)
+#include <sanitizer/asan_interface.h>
+#endif
 
 MESSAGES
 
@@ -19,6 +23,76 @@ struct lcr_work message_work;
 
 static int work_message(struct lcr_work *work, void *instance, int index);
 
+/*
+ * message blocks are taken from a free list for each size class. if a list
+ * is empty, a slab of MESSAGE_SLAB blocks is allocated. slabs are only freed
+ * by cleanup_message(), so no heap allocation is done once enough messages
+ * are in use.
+ * audio, dtmf and other messages with small parameters use small blocks,
+ * which only hold the first MESSAGE_SMALL_PARAM bytes of the parameter. so a
+ * parameter must be copied with message_param_size() bytes, never with
+ * sizeof(union parameter).
+ * when compiled with address sanitizer, each block gets a red zone and the
+ * parameter of free blocks is poisoned, so any write beyond the size of a
+ * block is reported.
+ */
+#define MESSAGE_SLAB		32
+#define MESSAGE_HEADER		((int)offsetof(struct lcr_msg, param))
+#define MESSAGE_ALIGN(size)	(((size) + 15) & ~15)
+#if defined(__SANITIZE_ADDRESS__)
+#define MESSAGE_REDZONE		16
+#define MESSAGE_POISON(addr, size)	ASAN_POISON_MEMORY_REGION(addr, size)
+#define MESSAGE_UNPOISON(addr, size)	ASAN_UNPOISON_MEMORY_REGION(addr, size)
+#else
+#define MESSAGE_REDZONE		0
+#define MESSAGE_POISON(addr, size)
+#define MESSAGE_UNPOISON(addr, size)
+#endif
+
+enum { /* size classes */
+	MESSAGE_POOL_SMALL,
+	MESSAGE_POOL_FULL,
+	MESSAGE_POOLS
+};
+
+struct message_slab {
+	struct message_slab *next;
+};
+
+static struct message_slab *message_slab_first = NULL;
+static struct lcr_msg *message_pool[MESSAGE_POOLS];
+unsigned int message_reused = 0; /* messages that did not require a heap allocation */
+unsigned int message_slabs = 0; /* slabs allocated */
+
+static int message_pool_param(int pool)
+{
+	return (pool == MESSAGE_POOL_SMALL) ? MESSAGE_SMALL_PARAM : (int)sizeof(union parameter);
+}
+
+/* allocate a slab and add its blocks to the free list of given size class */
+static void message_slab(int pool)
+{
+	struct message_slab *slab;
+	struct lcr_msg *message;
+	int block = MESSAGE_ALIGN(MESSAGE_HEADER + message_pool_param(pool)) + MESSAGE_REDZONE;
+	unsigned char *p;
+	int i;
+
+	slab = (struct message_slab *)MALLOC(MESSAGE_ALIGN(sizeof(struct message_slab)) + block * MESSAGE_SLAB);
+	slab->next = message_slab_first;
+	message_slab_first = slab;
+	message_slabs++;
+
+	p = (unsigned char *)slab + MESSAGE_ALIGN(sizeof(struct message_slab));
+	for (i = 0; i < MESSAGE_SLAB; i++, p += block) {
+		message = (struct lcr_msg *)p;
+		message->next = message_pool[pool];
+		message_pool[pool] = message;
+		MESSAGE_POISON(p + MESSAGE_HEADER, block - MESSAGE_HEADER);
+	}
+	PDEBUG(DEBUG_MSG, "allocated slab of %d messages with %d bytes each\n", MESSAGE_SLAB, block);
+}
+
 void init_message(void)
 {
 	memset(&message_work, 0, sizeof(message_work));
@@ -27,19 +101,36 @@ void init_message(void)
 
 void cleanup_message(void)
 {
+	struct message_slab *slab;
+
 	del_work(&message_work);
+
+	while ((slab = message_slab_first)) {
+		message_slab_first = slab->next;
+		FREE(slab, 0);
+	}
+	memset(message_pool, 0, sizeof(message_pool));
+	PDEBUG(DEBUG_MSG, "%u slabs were allocated, %u messages were taken from free lists\n", message_slabs, message_reused);
 }
 
 /* creates a new message with the given attributes. the message must be filled then. after filling, the message_put must be called */
 struct lcr_msg *message_create(int id_from, int id_to, int flow, int type)
 {
 	struct lcr_msg *message;
-
-	message = (struct lcr_msg *)MALLOC(sizeof(struct lcr_msg));
-	if (!message)
-		FATAL("No memory for message.\n");
+	int pool;
+
+	pool = (message_param_size(type) == MESSAGE_SMALL_PARAM) ? MESSAGE_POOL_SMALL : MESSAGE_POOL_FULL;
+	if (!message_pool[pool])
+		message_slab(pool);
+	else
+		message_reused++;
+	message = message_pool[pool];
+	message_pool[pool] = message->next;
+	MESSAGE_UNPOISON(&message->param, message_pool_param(pool));
+	memset(message, 0, MESSAGE_HEADER + message_pool_param(pool));
 	mmemuse++;
 
+	message->pool = pool;
 	message->id_from = id_from;
 	message->id_to = id_to;
 	message->flow = flow;
@@ -113,7 +204,9 @@ void message_free(struct lcr_msg *message)
 {
 	if (message->keep)
 		return;
-	FREE(message, sizeof(struct lcr_msg));
+	message->next = message_pool[message->pool];
+	message_pool[message->pool] = message;
+	MESSAGE_POISON(&message->param, message_pool_param(message->pool));
 	mmemuse--;
 }
 
@@ -324,6 +324,7 @@ struct param_crypt {
 
 struct param_hello {
 	char application[32]; /* name of remote application */
+	int framing; /* version of framed messages supported (ADMIN_FRAMING) or 0 */
 };
 
 struct param_bchannel {
@@ -340,6 +341,7 @@ struct param_bchannel {
 struct param_newref {
         int direction; /* who requests a refe? */
 	char interface[32]; /* interface name for selecting remote interface */
+	char audio_shm[32]; /* name of shared memory for audio (struct remote_audio) or empty */
 };
 
 struct param_traffic {
@@ -399,6 +401,7 @@ struct lcr_msg {
 	unsigned int id_from; /* in case of flow==PORT_TO_EPOINT: id_from is the port's serial, id_to is the epoint's serial */
 	unsigned int id_to;
 	int keep;
+	int pool; /* size class of the message block (see message.c) */
 	union parameter param;
 };
 
@@ -489,6 +492,24 @@ void _message_put(struct lcr_msg *message, const char *file, int line);
 struct lcr_msg *message_forward(int id_from, int id_to, int flow, union parameter *param);
 struct lcr_msg *message_get(void);
 void message_free(struct lcr_msg *message);
+
+/* returns the number of parameter bytes that a message of given type can hold
+ * it is also used by remote applications, so it is inline */
+#define MESSAGE_SMALL_PARAM	((int)sizeof(struct param_traffic))
+static inline int message_param_size(int type)
+{
+	switch(type) {
+		case MESSAGE_DTMF:
+		case MESSAGE_TONE_COUNTER:
+		case MESSAGE_BRIDGE:
+		case MESSAGE_TRAFFIC:
+		case MESSAGE_DISABLE_DEJITTER:
+		return MESSAGE_SMALL_PARAM;
+	}
+	return sizeof(union parameter);
+}
+
+extern unsigned int message_reused, message_slabs;
 void init_message(void);
 void cleanup_message(void);
 
@@ -0,0 +1,83 @@
+/*****************************************************************************\
+**                                                                           **
+** Linux Call Router                                                         **
+**                                                                           **
+**---------------------------------------------------------------------------**
+** Copyright: Andreas Eversberg                                              **
+**                                                                           **
+** conference mixing of port.cpp                                             **
+**                                                                           **
+\*****************************************************************************/
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define SHORT_MIN -32768
+#define SHORT_MAX 32767
+
+/*
+ * conference mixing
+ *
+ * the sum buffer holds 32 bit sums, the member buffers hold the linear
+ * samples of each member. the audio sent to a member is the sum minus its
+ * own samples, saturated to 16 bits. AVX2 or SSE2 is used, if the compiler
+ * targets it, the remaining samples are mixed by the plain loop.
+ */
+static inline void bridge_mix_add(signed int *sum, const signed short *data, int len)
+{
+	int i = 0;
+
+#if defined(__AVX2__)
+	for (; i < (len & ~7); i += 8) {
+		__m256i s = _mm256_loadu_si256((const __m256i *)(sum + i));
+		__m256i d = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(data + i)));
+		_mm256_storeu_si256((__m256i *)(sum + i), _mm256_add_epi32(s, d));
+	}
+#elif defined(__SSE2__)
+	for (; i < (len & ~7); i += 8) {
+		__m128i d = _mm_loadu_si128((const __m128i *)(data + i));
+		/* sign extend samples to 32 bits */
+		__m128i d0 = _mm_srai_epi32(_mm_unpacklo_epi16(d, d), 16);
+		__m128i d1 = _mm_srai_epi32(_mm_unpackhi_epi16(d, d), 16);
+		_mm_storeu_si128((__m128i *)(sum + i), _mm_add_epi32(_mm_loadu_si128((const __m128i *)(sum + i)), d0));
+		_mm_storeu_si128((__m128i *)(sum + i + 4), _mm_add_epi32(_mm_loadu_si128((const __m128i *)(sum + i + 4)), d1));
+	}
+#endif
+	/* the remaining len & 7 samples after the vector loop */
+	for (; i < len; i++)
+		sum[i] += data[i];
+}
+
+static inline void bridge_mix_out(signed short *out, const signed int *sum, const signed short *own, int len)
+{
+	signed int sample;
+	int i = 0;
+
+#if defined(__AVX2__)
+	for (; i < (len & ~15); i += 16) {
+		__m256i s0 = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i *)(sum + i)),
+			_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(own + i))));
+		__m256i s1 = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i *)(sum + i + 8)),
+			_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(own + i + 8))));
+		/* pack works within 128 bit lanes, so restore sample order */
+		_mm256_storeu_si256((__m256i *)(out + i), _mm256_permute4x64_epi64(_mm256_packs_epi32(s0, s1), 0xd8));
+	}
+#elif defined(__SSE2__)
+	for (; i < (len & ~7); i += 8) {
+		__m128i o = _mm_loadu_si128((const __m128i *)(own + i));
+		__m128i s0 = _mm_sub_epi32(_mm_loadu_si128((const __m128i *)(sum + i)), _mm_srai_epi32(_mm_unpacklo_epi16(o, o), 16));
+		__m128i s1 = _mm_sub_epi32(_mm_loadu_si128((const __m128i *)(sum + i + 4)), _mm_srai_epi32(_mm_unpackhi_epi16(o, o), 16));
+		_mm_storeu_si128((__m128i *)(out + i), _mm_packs_epi32(s0, s1));
+	}
+#endif
+	/* the remaining samples after the vector loop */
+	for (; i < len; i++) {
+		sample = sum[i] - own[i];
+		if (sample < SHORT_MIN) sample = SHORT_MIN;
+		if (sample > SHORT_MAX) sample = SHORT_MAX;
+		out[i] = sample;
+	}
+}
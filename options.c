@@ -36,6 +36,9 @@ struct options options = {
 	-1,                             /* socket user (-1= no change) */
 	-1,                             /* socket group (-1= no change) */
 	1,				/* use polling of main loop */
+	0,				/* no audio thread */
+	8192,				/* kbytes of tone cache */
+	0,				/* no shared RTP port */
 };
 
 char options_error[256];
@@ -234,7 +237,32 @@ int read_options(char *options_error)
 			options.socketrights = strtol(param, NULL, 0);
 		} else
 		if (!strcmp(option,"polling")) {
-			options.polling = 1;
+			options.polling = !!strcmp(param, "no");
+		} else
+		if (!strcmp(option,"audio_thread")) {
+			options.audio_thread = atoi(param);
+			if (options.audio_thread < 0) {
+				UPRINT(options_error, "Error in %s (line %d): parameter for option %s must be at least '0'.\n", filename,line,option);
+				goto error;
+			}
+			if (options.audio_thread > 99) {
+				UPRINT(options_error, "Error in %s (line %d): parameter for option %s must be '99' or less.\n", filename,line,option);
+				goto error;
+			}
+		} else
+		if (!strcmp(option,"tone_cache")) {
+			options.tone_cache = atoi(param);
+			if (options.tone_cache < 0) {
+				UPRINT(options_error, "Error in %s (line %d): parameter for option %s must be at least '0'.\n", filename,line,option);
+				goto error;
+			}
+		} else
+		if (!strcmp(option,"rtp_shared_port")) {
+			options.rtp_shared_port = atoi(param);
+			if (options.rtp_shared_port < 0 || options.rtp_shared_port > 65534 || (options.rtp_shared_port & 1)) {
+				UPRINT(options_error, "Error in %s (line %d): parameter for option %s must be an even port number.\n", filename,line,option);
+				goto error;
+			}
 		} else {
 			UPRINT(options_error, "Error in %s (line %d): wrong option keyword %s.\n", filename,line,option);
 			goto error;
@@ -30,6 +30,9 @@ struct options {
 	int     socketuser;             /* socket chown to this user */
 	int     socketgroup;            /* socket chgrp to this group */
 	int	polling;
+	int	audio_thread;		/* mix conferences in a thread @ given priority (0 = off) */
+	int	tone_cache;		/* kbytes of converted tones kept in memory (0 = off) */
+	int	rtp_shared_port;	/* RTP port that is shared by all SIP calls (0 = off) */
 };	
 
 extern struct options options;
@@ -46,19 +46,29 @@ Functions:
 */
 
 #include "main.h"
+#include <sys/eventfd.h>
+#include "mix.h"
 
 /* enable to test conference mixing, even if only two members are bridged */
 //#define TEST_CONFERENCE 1
 
-#define SHORT_MIN -32768
-#define SHORT_MAX 32767
-
 class Port *port_first = NULL;
 
 unsigned int port_serial = 1; /* must be 1, because 0== no port */
 
+/* index of ports by serial. serials are given in sequence, so the lower bits
+ * spread them evenly over the buckets */
+#define PORT_HASH	4096 /* must be a power of two */
+static class Port *port_hash[PORT_HASH];
+
 struct port_bridge *p_bridge_first;
 
+unsigned int pacing_late = 0;
+unsigned int pacing_resync = 0;
+
+/* if the bridge clock is more than this behind, don't catch up the gap, but restart clock */
+#define BRIDGE_RESYNC	100000 /* 100 MS */
+
 static void remove_bridge(struct port_bridge *bridge, class Port *port);
 
 /* free epointlist relation
@@ -164,8 +174,12 @@ Port::Port(int type, const char *portname, struct port_settings *settings, struc
 	p_tone_dir[0] = '\0';
 	p_type = type;
 	p_serial = port_serial++;
+	hash_next = port_hash[p_serial & (PORT_HASH - 1)];
+	port_hash[p_serial & (PORT_HASH - 1)] = this;
 	p_tone_fh = -1;
 	p_tone_fetched = NULL;
+	p_tone_cached = NULL;
+	memset(&p_tone_gsm, 0, sizeof(p_tone_gsm));
 	p_tone_name[0] = '\0';
 	p_state = PORT_STATE_IDLE;
 	p_epointlist = NULL;
@@ -177,11 +191,18 @@ Port::Port(int type, const char *portname, struct port_settings *settings, struc
 	p_echotest = 0;
 	p_bridge = 0;
 
+	/* software DTMF detection */
+	p_dtmf = NULL;
+	if (interface && interface->dtmf_detect) {
+		p_dtmf = (struct dtmf_detector *)MALLOC(sizeof(struct dtmf_detector));
+		memuse++;
+		dtmf_detector_init(p_dtmf, interface->dtmf_level);
+	}
+
 	/* call recording */
 	p_record = NULL;
 	p_tap = 0;
 	p_record_type = 0;
-	p_record_length = 0;
 	p_record_skip = 0;
 	p_record_filename[0] = '\0';
 	p_record_buffer_readp = 0;
@@ -222,6 +243,11 @@ Port::~Port(void)
 	if (p_record)
 		close_record(0, 0);
 
+	if (p_dtmf) {
+		FREE(p_dtmf, sizeof(struct dtmf_detector));
+		memuse--;
+	}
+
 	classuse--;
 
 	/* disconnect port from endpoint */
@@ -249,13 +275,14 @@ Port::~Port(void)
 	/* detach */
 	*tempp=this->next;
 
+	/* remove port from hash */
+	tempp = &port_hash[p_serial & (PORT_HASH - 1)];
+	while(*tempp != this)
+		tempp = &(*tempp)->hash_next;
+	*tempp = hash_next;
+
 	/* close open tones file */
-	if (p_tone_fh >= 0) {
-		close(p_tone_fh);
-		p_tone_fh = -1;
-		fhuse--;
-	}
-	p_tone_fetched = NULL;
+	close_tone();
 }
 
 PORT_STATE_NAMES
@@ -274,13 +301,13 @@ void Port::new_state(int state)
  */ 
 class Port *find_port_id(unsigned int port_id)
 {
-	class Port *port = port_first;
+	class Port *port;
 
+	port = port_hash[port_id & (PORT_HASH - 1)];
 	while(port) {
-//printf("comparing: '%s' with '%s'\n", name, port->name);
 		if (port->p_serial == port_id)
 			return(port);
-		port = port->next;
+		port = port->hash_next;
 	}
 
 	return(NULL);
@@ -296,6 +323,39 @@ void Port::set_echotest(int echotest)
 }
 
 
+/*
+ * close current tone file or release cached tone
+ */
+void Port::close_tone(void)
+{
+	if (p_tone_fh >= 0) {
+		close(p_tone_fh);
+		p_tone_fh = -1;
+		fhuse--;
+		free_tone_gsm(&p_tone_gsm);
+	}
+	if (p_tone_cached) {
+		close_tone_cached(p_tone_cached);
+		p_tone_cached = NULL;
+	}
+	p_tone_fetched = NULL;
+}
+
+/*
+ * open tone file, take it from tone cache, if possible
+ */
+int Port::open_tone_file(const char *filename)
+{
+	if ((p_tone_cached = open_tone_cached(filename, &p_tone_codec, &p_tone_size, &p_tone_left))) {
+		p_tone_fetched = p_tone_cached;
+		return(0);
+	}
+	if ((p_tone_fh=open_tone((char *)filename, &p_tone_codec, &p_tone_size, &p_tone_left)) < 0)
+		return(-1);
+	fhuse++;
+	return(0);
+}
+
 /*
  * set the file in the tone directory with the given name
  */
@@ -316,12 +376,7 @@ void Port::set_tone(const char *dir, const char *name)
 	p_tone_speed = 1;
 	p_tone_codec = CODEC_LAW;
 
-	if (p_tone_fh >= 0) {
-		close(p_tone_fh);
-		p_tone_fh = -1;
-		fhuse--;
-	}
-	p_tone_fetched = NULL;
+	close_tone();
 
 	if (name[0]) {
 		if (name[0] == '/') {
@@ -390,12 +445,7 @@ void Port::set_vbox_tone(const char *dir, const char *name)
 	p_tone_codec = CODEC_LAW;
 	p_tone_eof = 1;
 
-	if (p_tone_fh >= 0) {
-		close(p_tone_fh);
-		p_tone_fh = -1;
-		fhuse--;
-	}
-	p_tone_fetched = NULL;
+	close_tone();
 
 	SPRINT(p_tone_dir,  dir);
 	SPRINT(p_tone_name,  name);
@@ -409,15 +459,13 @@ void Port::set_vbox_tone(const char *dir, const char *name)
 			return;
 		}
 		SPRINT(filename, "%s/%s/%s", SHARE_DATA, p_tone_dir, p_tone_name);
-		if ((p_tone_fh=open_tone(filename, &p_tone_codec, &p_tone_size, &p_tone_left)) >= 0) {
-			fhuse++;
+		if (open_tone_file(filename) >= 0) {
 			PDEBUG(DEBUG_PORT, "PORT(%s) opening tone: %s\n", p_name, filename);
 			return;
 		}
 	} else {
 		SPRINT(filename, "%s", p_tone_name);
-		if ((p_tone_fh=open_tone(filename, &p_tone_codec, &p_tone_size, &p_tone_left)) >= 0) {
-			fhuse++;
+		if (open_tone_file(filename) >= 0) {
 			PDEBUG(DEBUG_PORT, "PORT(%s) opening tone: %s\n", p_name, filename);
 			return;
 		}
@@ -436,7 +484,7 @@ void Port::set_vbox_play(const char *name, int offset)
 
 	/* use ser_box_tone() */
 	set_vbox_tone("", name);
-	if (p_tone_fh < 0)
+	if (p_tone_fh < 0 && !p_tone_fetched)
 		return;
 
 	/* enable counter */
@@ -493,20 +541,18 @@ int Port::read_audio(unsigned char *buffer, int length)
 			if (!(p_tone_fetched=open_tone_fetched(p_tone_dir, filename, &p_tone_codec, &p_tone_size, &p_tone_left))) {
 				SPRINT(filename, "%s/%s/%s", SHARE_DATA, p_tone_dir, p_tone_name);
 				/* if file does not exist */
-				if ((p_tone_fh=open_tone(filename, &p_tone_codec, &p_tone_size, &p_tone_left)) < 0) {
+				if (open_tone_file(filename) < 0) {
 					PDEBUG(DEBUG_PORT, "PORT(%s) no tone: %s\n", p_name, filename);
 					goto try_loop;
 				}
-				fhuse++;
 			}
 		} else {
 			SPRINT(filename, "%s", p_tone_name);
 			/* if file does not exist */
-			if ((p_tone_fh=open_tone(filename, &p_tone_codec, &p_tone_size, &p_tone_left)) < 0) {
+			if (open_tone_file(filename) < 0) {
 				PDEBUG(DEBUG_PORT, "PORT(%s) no tone: %s\n", p_name, filename);
 				goto try_loop;
 			}
-			fhuse++;
 		}
 		PDEBUG(DEBUG_PORT, "PORT(%s) opening %stone: %s\n", p_name, p_tone_fetched?"fetched ":"", filename);
 	}
@@ -515,7 +561,7 @@ read_more:
 	/* file descriptor is open read data */
 	tone_left_before = p_tone_left;
 	if (p_tone_fh >= 0) {
-		l = read_tone(p_tone_fh, buffer, p_tone_codec, len, p_tone_size, &p_tone_left, p_tone_speed);
+		l = read_tone(p_tone_fh, buffer, p_tone_codec, len, p_tone_size, &p_tone_left, p_tone_speed, &p_tone_gsm);
 		if (l<0 || l>len) /* paranoia */
 			l=0;
 		buffer += l;
@@ -545,12 +591,7 @@ read_more:
 	if (len==0)
 		return(length-len);
 
-	if (p_tone_fh >= 0) {
-		close(p_tone_fh);
-		p_tone_fh = -1;
-		fhuse--;
-	}
-	p_tone_fetched = NULL;
+	close_tone();
 
 	if (l)
 		nodata=0;
@@ -577,24 +618,22 @@ try_loop:
 		if (!(p_tone_fetched=open_tone_fetched(p_tone_dir, filename, &p_tone_codec, &p_tone_size, &p_tone_left))) {
 			SPRINT(filename, "%s/%s/%s_loop", SHARE_DATA, p_tone_dir, p_tone_name);
 			/* if file does not exist */
-			if ((p_tone_fh=open_tone(filename, &p_tone_codec, &p_tone_size, &p_tone_left)) < 0) {
+			if (open_tone_file(filename) < 0) {
 				PDEBUG(DEBUG_PORT, "PORT(%s) no tone loop: %s\n",p_name, filename);
 				p_tone_dir[0] = '\0';
 				p_tone_name[0] = '\0';
 				return(length-len);
 			}
-			fhuse++;
 		}
 	} else {
 		SPRINT(filename, "%s_loop", p_tone_name);
 		/* if file does not exist */
-		if ((p_tone_fh=open_tone(filename, &p_tone_codec, &p_tone_size, &p_tone_left)) < 0) {
+		if (open_tone_file(filename) < 0) {
 			PDEBUG(DEBUG_PORT, "PORT(%s) no tone loop: %s\n",p_name, filename);
 			p_tone_dir[0] = '\0';
 			p_tone_name[0] = '\0';
 			return(length-len);
 		}
-		fhuse++;
 	}
 	nodata++;
 	PDEBUG(DEBUG_PORT, "PORT(%s) opening %stone: %s\n", p_name, p_tone_fetched?"fetched ":"", filename);
@@ -653,6 +692,22 @@ struct fmt {
 	unsigned short	bits_sample; /* bits per sample (one channel) */
 };
 
+/* recording that is closed by the record writer */
+struct record_close {
+	struct rec_close close;
+	unsigned int serial;
+	int vbox;
+	unsigned int size, wsize;
+	char extension[32];
+	int vbox_year, vbox_mon, vbox_mday, vbox_hour, vbox_min;
+	char vbox_email[128];
+	int vbox_email_file;
+	char callerid[256];
+	struct caller_info callerinfo;
+	int type;
+	unsigned int samples;
+};
+
 
 /*
  * open record file (actually a wave file with empty header which will be
@@ -661,12 +716,10 @@ struct fmt {
  */
 int Port::open_record(int type, int vbox, int skip, char *extension, int anon_ignore, const char *vbox_email, int vbox_email_file)
 {
-	/* RIFFxxxxWAVEfmt xxxx(fmt-size)dataxxxx... */
-	char dummyheader[8+4+8+sizeof(fmt)+8];
 	char filename[256];
+	unsigned int header_len = 0;
 	time_t now;
 	struct tm *now_tm;
-	int ret;
 
 	if (!extension) {
 		PERROR("Port(%d) not an extension\n", p_serial);
@@ -682,6 +735,13 @@ int Port::open_record(int type, int vbox, int skip, char *extension, int anon_ig
 		return(0);
 	}
 
+#ifndef WITH_GSMFR
+	if (type == CODEC_GSM) {
+		PERROR("Port(%d) cannot record GSM, because LCR is compiled without GSM support\n", p_serial);
+		return(0);
+	}
+#endif
+
 	if (vbox != 0)
 		SPRINT(filename, "%s/%s/vbox", EXTENSION_DATA, p_record_extension);
 	else
@@ -710,33 +770,39 @@ int Port::open_record(int type, int vbox, int skip, char *extension, int anon_ig
 
 	/* check, if file exists (especially when an extension calls the same extension) */
 	if (vbox != 1)
-	if ((p_record = fopen(filename, "r"))) {
-		fclose(p_record);
+	if (!access(filename, F_OK))
 		SCAT(filename, "_2nd");
-	}
 			
-	p_record = fopen(filename, "w");
-	if (!p_record) {
+	/* space for header, it is written when closing */
+	switch(type) {
+		case CODEC_MONO:
+		case CODEC_STEREO:
+		case CODEC_8BIT:
+		/* RIFFxxxxWAVEfmt xxxx(fmt-size)dataxxxx... */
+		header_len = 8+4+8+sizeof(fmt)+8;
+		break;
+
+		case CODEC_GSM:
+		/* RIFFxxxxWAVEfmt xxxx(fmt-size+4)factxxxxxxxxdataxxxx... */
+		header_len = 8+4+8+sizeof(fmt)+4+12+8;
+		break;
+	}
+
+	/* the file is written (and encoded) by the record writer thread */
+	p_record = (struct rec_stream *)MALLOC(sizeof(struct rec_stream));
+	memuse++;
+	if (rec_open(p_record, filename, header_len, (type == CODEC_GSM) ? REC_ENCODE_GSM : REC_ENCODE_NONE) < 0) {
 		PERROR("Port(%d) cannot record because file cannot be opened '%s'\n", p_serial, filename);
+		FREE(p_record, sizeof(struct rec_stream));
+		memuse--;
+		p_record = NULL;
 		return(0);
 	}
 	update_rxoff();
-	fduse++;
 
 	p_record_type = type;
 	p_record_vbox = vbox;
 	p_record_skip = skip;
-	p_record_length = 0;
-	switch(p_record_type) {
-		case CODEC_MONO:
-		case CODEC_STEREO:
-		case CODEC_8BIT:
-		ret = fwrite(dummyheader, sizeof(dummyheader), 1, p_record);
-		break;
-
-		case CODEC_LAW:
-		break;
-	}
 	UCPY(p_record_filename, filename);
 
 	PDEBUG(DEBUG_PORT, "Port(%d) recording started with file name '%s'\n", p_serial, filename);
@@ -744,22 +810,23 @@ int Port::open_record(int type, int vbox, int skip, char *extension, int anon_ig
 }
 
 
+static void record_header(struct rec_close *close, unsigned int size, unsigned int samples);
+static void record_done(struct rec_close *close);
+
 /*
  * close the recoding file, put header in front and rename
  */
 void Port::close_record(int beep, int mute)
 {
 	static signed short beep_mono[256];
-	unsigned int size = 0, wsize = 0;
-	struct fmt fmt;
-	char filename[512], indexname[512];
-	FILE *fp;
+	unsigned int size;
+	struct record_close *rclose;
+	char filename[512];
 	int i, ii;
 	char number[256], callerid[256];
 	char *p;
 	struct caller_info callerinfo;
 	const char *valid_chars = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ01234567890_.-!$%&/()=+*;~";
-	int ret;
 
 	if (!p_record)
 		return;
@@ -806,15 +873,15 @@ void Port::close_record(int beep, int mute)
 	}
 
 	/* mute */
-	if (mute && p_record_type==CODEC_MONO) {
-		i = p_record_length;
-		if (i > mute)
-			i = mute;	
-		fseek(p_record, -(i<<1), SEEK_END);
-		p_record_length -= (i<<1);
+	size = p_record->length;
+	if (mute && (p_record_type==CODEC_MONO || p_record_type==CODEC_GSM)) {
+		i = mute << 1;
+		if (i > (int)size)
+			i = size;
+		rec_truncate(p_record, size - i);
 	}
 	/* add beep to the end of recording */
-	if (beep && p_record_type==CODEC_MONO) {
+	if (beep && (p_record_type==CODEC_MONO || p_record_type==CODEC_GSM)) {
 		i = 0;
 		while(i < 256) {
 			beep_mono[i] = (signed short)(sin((double)i / 5.688888888889 * 2.0 * 3.1415927) * 2000.0);
@@ -822,71 +889,26 @@ void Port::close_record(int beep, int mute)
 		}
 		i = 0;
 		while(i < beep) {
-			ret = fwrite(beep_mono, sizeof(beep_mono), 1, p_record);
+			rec_write(p_record, beep_mono, sizeof(beep_mono));
 			i += sizeof(beep_mono);
-			p_record_length += sizeof(beep_mono);
 		}
 	}
 
-	/* complete header */
+	rclose = (struct record_close *)MALLOC(sizeof(struct record_close));
+	memuse++;
+
 	switch(p_record_type) {
 		case CODEC_MONO:
 		case CODEC_STEREO:
 		case CODEC_8BIT:
 		/* cue */
-		fprintf(p_record, "cue %c%c%c%c%c%c%c%c", 4, 0, 0, 0, 0,0,0,0);
+		rec_write(p_record, "cue \4\0\0\0\0\0\0\0", 12);
 
 		/* LIST */
-		fprintf(p_record, "LIST%c%c%c%cadtl", 4, 0, 0, 0);
-
-		/* go to header */
-		fseek(p_record, 0, SEEK_SET);
-
-		/* WAVEfmt xxxx(fmt-size)dataxxxx[data]cue xxxx0000LISTxxxxadtl*/
-		size = p_record_length;
-		wsize = 4+8+sizeof(fmt)+8+size+8+4+8+4;
-
-		/* RIFF */
-		fprintf(p_record, "RIFF%c%c%c%c", (unsigned char)(wsize&0xff), (unsigned char)((wsize>>8)&0xff), (unsigned char)((wsize>>16)&0xff), (unsigned char)(wsize>>24));
-
-		/* WAVE */
-		fprintf(p_record, "WAVE");
-
-		/* fmt */
-		fprintf(p_record, "fmt %c%c%c%c", (unsigned int)sizeof(fmt), 0, 0, 0);
-		switch(p_record_type) {
-			case CODEC_MONO:
-			fmt.stereo = 1;
-			fmt.channels = 1;
-			fmt.sample_rate = 8000; /* samples/sec */
-			fmt.data_rate = 16000; /* full data rate */
-			fmt.bytes_sample = 2; /* all channels */
-			fmt.bits_sample = 16; /* one channel */
-			break;
-
-			case CODEC_STEREO:
-			fmt.stereo = 1;
-			fmt.channels = 2;
-			fmt.sample_rate = 8000; /* samples/sec */
-			fmt.data_rate = 32000; /* full data rate */
-			fmt.bytes_sample = 4; /* all channels */
-			fmt.bits_sample = 16; /* one channel */
-			break;
-
-			case CODEC_8BIT:
-			fmt.stereo = 1;
-			fmt.channels = 1;
-			fmt.sample_rate = 8000; /* samples/sec */
-			fmt.data_rate = 8000; /* full data rate */
-			fmt.bytes_sample = 1; /* all channels */
-			fmt.bits_sample = 8; /* one channel */
-			break;
-		}
-		ret = fwrite(&fmt, sizeof(fmt), 1, p_record);
-
-		/* data */
-		fprintf(p_record, "data%c%c%c%c", (unsigned char)(size&0xff), (unsigned char)((size>>8)&0xff), (unsigned char)((size>>16)&0xff), (unsigned char)(size>>24));
+		rec_write(p_record, "LIST\4\0\0\0adtl", 12);
+		/* FALLTHRU */
 
+		case CODEC_GSM:
 		/* rename file */
 		if (p_record_vbox == 1)
 			SPRINT(filename, "%s.wav", p_record_filename);
@@ -903,20 +925,156 @@ void Port::close_record(int beep, int mute)
 		break;
 	}
 
-	fclose(p_record);
-	fduse--;
+	/* the header is completed by record_header(), the rest is done by
+	 * record_done(), after the file is written */
+	rclose->close.header_cb = record_header;
+	SCPY(rclose->close.from, p_record_filename);
+	SCPY(rclose->close.to, filename);
+	rclose->close.done = record_done;
+	rclose->serial = p_serial;
+	rclose->vbox = p_record_vbox;
+	rclose->type = p_record_type;
+	SCPY(rclose->extension, p_record_extension);
+	rclose->vbox_year = p_record_vbox_year;
+	rclose->vbox_mon = p_record_vbox_mon;
+	rclose->vbox_mday = p_record_vbox_mday;
+	rclose->vbox_hour = p_record_vbox_hour;
+	rclose->vbox_min = p_record_vbox_min;
+	SCPY(rclose->vbox_email, p_record_vbox_email);
+	rclose->vbox_email_file = p_record_vbox_email_file;
+	SCPY(rclose->callerid, callerid);
+	memcpy(&rclose->callerinfo, &callerinfo, sizeof(struct caller_info));
+
+	rec_close(p_record, &rclose->close);
+	FREE(p_record, sizeof(struct rec_stream));
+	memuse--;
 	p_record = NULL;
 	update_rxoff();
+}
 
-	if (rename(p_record_filename, filename) < 0) {
-		PERROR("Port(%d) cannot rename from '%s' to '%s'\n", p_serial, p_record_filename, filename);
-		return;
+static void record_le32(unsigned char *p, unsigned int value)
+{
+	p[0] = value;
+	p[1] = value >> 8;
+	p[2] = value >> 16;
+	p[3] = value >> 24;
+}
+
+/*
+ * complete the wave header, called by the record writer thread
+ * size is the number of bytes written after the header
+ */
+static void record_header(struct rec_close *close, unsigned int size, unsigned int samples)
+{
+	struct record_close *rclose = (struct record_close *)close;
+	unsigned char *h = rclose->close.header;
+	unsigned int header_len = 8+4+8+sizeof(fmt)+8, data;
+	struct fmt fmt;
+
+	memset(&fmt, 0, sizeof(fmt));
+	switch(rclose->type) {
+		case CODEC_MONO:
+		fmt.stereo = 1;
+		fmt.channels = 1;
+		fmt.sample_rate = 8000; /* samples/sec */
+		fmt.data_rate = 16000; /* full data rate */
+		fmt.bytes_sample = 2; /* all channels */
+		fmt.bits_sample = 16; /* one channel */
+		break;
+
+		case CODEC_STEREO:
+		fmt.stereo = 1;
+		fmt.channels = 2;
+		fmt.sample_rate = 8000; /* samples/sec */
+		fmt.data_rate = 32000; /* full data rate */
+		fmt.bytes_sample = 4; /* all channels */
+		fmt.bits_sample = 16; /* one channel */
+		break;
+
+		case CODEC_8BIT:
+		fmt.stereo = 1;
+		fmt.channels = 1;
+		fmt.sample_rate = 8000; /* samples/sec */
+		fmt.data_rate = 8000; /* full data rate */
+		fmt.bytes_sample = 1; /* all channels */
+		fmt.bits_sample = 8; /* one channel */
+		break;
+
+		case CODEC_GSM:
+		fmt.stereo = 0x31; /* GSM 6.10 */
+		fmt.channels = 1;
+		fmt.sample_rate = 8000; /* samples/sec */
+		fmt.data_rate = 1625; /* full data rate */
+		fmt.bytes_sample = 65; /* bytes of two frames */
+		fmt.bits_sample = 0;
+		header_len += 4+12;
+		break;
+	}
+
+	/* WAVEfmt xxxx(fmt-size)dataxxxx[data]cue xxxx0000LISTxxxxadtl */
+	data = size;
+	if (rclose->type != CODEC_GSM)
+		data -= 8+4+8+4;
+
+	/* RIFF */
+	memcpy(h, "RIFF", 4);
+	record_le32(h + 4, header_len - 8 + size);
+
+	/* WAVE */
+	memcpy(h + 8, "WAVE", 4);
+
+	/* fmt */
+	memcpy(h + 12, "fmt ", 4);
+	memcpy(h + 20, &fmt, sizeof(fmt));
+	h += 20 + sizeof(fmt);
+	if (rclose->type == CODEC_GSM) {
+		record_le32(h - sizeof(fmt) - 4, sizeof(fmt) + 4);
+		/* extra size, samples of two frames */
+		h[0] = 2;
+		h[1] = 0;
+		h[2] = 320 & 0xff;
+		h[3] = 320 >> 8;
+		h += 4;
+
+		/* fact */
+		memcpy(h, "fact", 4);
+		record_le32(h + 4, 4);
+		record_le32(h + 8, samples);
+		h += 12;
+	} else {
+		record_le32(h - sizeof(fmt) - 4, sizeof(fmt));
+		samples = data / fmt.bytes_sample;
+	}
+
+	/* data */
+	memcpy(h, "data", 4);
+	record_le32(h + 4, data);
+
+	rclose->size = data;
+	rclose->wsize = header_len - 8 + size;
+	rclose->samples = samples;
+}
+
+/*
+ * called when the record writer has written, closed and renamed the file
+ */
+static void record_done(struct rec_close *close)
+{
+	struct record_close *rclose = (struct record_close *)close;
+	char *filename = rclose->close.to;
+	char indexname[512];
+	FILE *fp;
+	char *p;
+
+	if (rclose->close.error) {
+		PERROR("Port(%d) cannot write header or rename from '%s' to '%s' (errno = %d)\n", rclose->serial, rclose->close.from, filename, rclose->close.error);
+		goto out;
 	}
 
-	PDEBUG(DEBUG_PORT, "Port(%d) recording is written and renamed to '%s' and must have the following size:%lu raw:%lu samples:%lu\n", p_serial, filename, wsize+8, size, size>>1);
+	PDEBUG(DEBUG_PORT, "Port(%d) recording is written and renamed to '%s' and must have the following size:%lu raw:%lu samples:%lu\n", rclose->serial, filename, rclose->wsize+8, rclose->size, rclose->samples);
 
-	if (p_record_vbox == 2) {
-		SPRINT(indexname, "%s/%s/vbox/index", EXTENSION_DATA, p_record_extension);
+	if (rclose->vbox == 2) {
+		SPRINT(indexname, "%s/%s/vbox/index", EXTENSION_DATA, rclose->extension);
 		if ((fp = fopen(indexname,"a"))) {
 			fduse++;
 
@@ -924,19 +1082,23 @@ void Port::close_record(int beep, int mute)
 			p = filename;
 			while(strchr(p, '/'))
 				p = strchr(p, '/')+1;
-			fprintf(fp, "%s %d %d %d %d %d %s\n", p, p_record_vbox_year, p_record_vbox_mon, p_record_vbox_mday, p_record_vbox_hour, p_record_vbox_min, callerid);
+			fprintf(fp, "%s %d %d %d %d %d %s\n", p, rclose->vbox_year, rclose->vbox_mon, rclose->vbox_mday, rclose->vbox_hour, rclose->vbox_min, rclose->callerid);
 
 			fclose(fp);
 			fduse--;
 		} else {
-			PERROR("Port(%d) cannot open index file '%s' to append.\n", p_serial, indexname);
+			PERROR("Port(%d) cannot open index file '%s' to append.\n", rclose->serial, indexname);
 		}
 
 		/* send email with sample*/
-		if (p_record_vbox_email[0]) {
-			send_mail(p_record_vbox_email_file?filename:(char *)"", callerid, callerinfo.extension, callerinfo.name, p_record_vbox_email, p_record_vbox_year, p_record_vbox_mon, p_record_vbox_mday, p_record_vbox_hour, p_record_vbox_min, p_record_extension);
+		if (rclose->vbox_email[0]) {
+			send_mail(rclose->vbox_email_file?filename:(char *)"", rclose->callerid, rclose->callerinfo.extension, rclose->callerinfo.name, rclose->vbox_email, rclose->vbox_year, rclose->vbox_mon, rclose->vbox_mday, rclose->vbox_hour, rclose->vbox_min, rclose->extension);
 		}
 	}
+
+out:
+	FREE(rclose, sizeof(struct record_close));
+	memuse--;
 }
 
 
@@ -960,7 +1122,6 @@ void Port::record(unsigned char *data, int length, int dir_fromup)
 	signed short *s;
 	int free, i, ii;
 	signed int sample;
-	int ret;
 
 	/* no recording */
 	if (!p_record || !length)
@@ -1003,6 +1164,7 @@ same_again:
 		/* still data left, buffer is full, so we need to write a chunk to file */
 		switch(p_record_type) {
 			case CODEC_MONO:
+			case CODEC_GSM:
 			s = (signed short *)write_buffer;
 			i = 0;
 			while(i < 256) {
@@ -1010,8 +1172,7 @@ same_again:
 				p_record_buffer_readp = (p_record_buffer_readp + 1) & RECORD_BUFFER_MASK;
 				i++;
 			}
-			ret = fwrite(write_buffer, 512, 1, p_record);
-			p_record_length += 512;
+			rec_write(p_record, write_buffer, 512);
 			break;
 
 			case CODEC_STEREO:
@@ -1033,8 +1194,7 @@ same_again:
 					i++;
 				}
 			}
-			ret = fwrite(write_buffer, 1024, 1, p_record);
-			p_record_length += 1024;
+			rec_write(p_record, write_buffer, 1024);
 			break;
 
 			case CODEC_8BIT:
@@ -1045,8 +1205,7 @@ same_again:
 				p_record_buffer_readp = (p_record_buffer_readp + 1) & RECORD_BUFFER_MASK;
 				i++;
 			}
-			ret = fwrite(write_buffer, 512, 1, p_record);
-			p_record_length += 512;
+			rec_write(p_record, write_buffer, 512);
 			break;
 
 			case CODEC_LAW:
@@ -1057,8 +1216,7 @@ same_again:
 				p_record_buffer_readp = (p_record_buffer_readp + 1) & RECORD_BUFFER_MASK;
 				i++;
 			}
-			ret = fwrite(write_buffer, 256, 1, p_record);
-			p_record_length += 256;
+			rec_write(p_record, write_buffer, 256);
 			break;
 		}
 		/* because we still have data, we write again */
@@ -1086,6 +1244,7 @@ different_again:
 	/* write data mixed with the buffer */
 	switch(p_record_type) {
 		case CODEC_MONO:
+		case CODEC_GSM:
 		s = (signed short *)write_buffer;
 		i = 0;
 		while(i < ii) {
@@ -1097,8 +1256,7 @@ different_again:
 			*s++ = sample;
 			i++;
 		}
-		ret = fwrite(write_buffer, ii<<1, 1, p_record);
-		p_record_length += (ii<<1);
+		rec_write(p_record, write_buffer, ii<<1);
 		break;
 		
 		case CODEC_STEREO:
@@ -1120,8 +1278,7 @@ different_again:
 				i++;
 			}
 		}
-		ret = fwrite(write_buffer, ii<<2, 1, p_record);
-		p_record_length += (ii<<2);
+		rec_write(p_record, write_buffer, ii<<2);
 		break;
 		
 		case CODEC_8BIT:
@@ -1136,8 +1293,7 @@ different_again:
 			*d++ = (sample+0x8000) >> 8;
 			i++;
 		}
-		ret = fwrite(write_buffer, ii, 1, p_record);
-		p_record_length += ii;
+		rec_write(p_record, write_buffer, ii);
 		break;
 		
 		case CODEC_LAW:
@@ -1152,8 +1308,7 @@ different_again:
 			*d++ = audio_s16_to_law[sample & 0xffff];
 			i++;
 		}
-		ret = fwrite(write_buffer, ii, 1, p_record);
-		p_record_length += ii;
+		rec_write(p_record, write_buffer, ii);
 		break;
 	}
 	length -= ii;
@@ -1184,6 +1339,278 @@ void Port::update_load(void)
 
 int bridge_timeout(struct lcr_timer *timer, void *instance, int index);
 
+/*
+ * audio thread
+ *
+ * if enabled, conferences are mixed by a real time thread with its own clock.
+ * ports are only used by the main thread: bridge_tx() queues 20 ms frames to
+ * the audio thread, the mixed frames are queued back and given to bridge_rx()
+ * when the audio thread wakes the main loop through an eventfd.
+ * members and bridges are added and removed by commands. removed members and
+ * bridges are freed by the main thread after the audio thread confirmed it.
+ */
+enum {
+	BRIDGE_CMD_ADD,		/* add member (and its bridge) */
+	BRIDGE_CMD_DEL,		/* remove member */
+	BRIDGE_CMD_FREE,	/* remove bridge */
+};
+
+struct bridge_cmd {
+	int cmd;
+	struct port_bridge *bridge;
+	struct port_bridge_member *member;
+};
+
+#define BRIDGE_CMDS 1024 /* power of two */
+
+static int bridge_thread_run = 0;		/* audio thread is running */
+static int bridge_thread_quit;
+static pthread_t bridge_thread_id;
+static struct lcr_fd bridge_thread_fd;
+static struct port_bridge *bridge_thread_first;	/* used by audio thread only */
+static struct spsc bridge_cmd_queue, bridge_ack_queue;
+static struct bridge_cmd bridge_cmd_buffer[BRIDGE_CMDS], bridge_ack_buffer[BRIDGE_CMDS];
+
+/* audio thread: process commands, as long as they can be confirmed */
+static void bridge_thread_commands(void)
+{
+	struct bridge_cmd c;
+	struct port_bridge **bridgep;
+	struct port_bridge_member **memberp;
+
+	while (spsc_count(&bridge_ack_queue) < BRIDGE_CMDS && !spsc_get(&bridge_cmd_queue, &c)) {
+		switch (c.cmd) {
+			case BRIDGE_CMD_ADD:
+			memset(c.member->buffer, 0, 160 * sizeof(c.member->buffer[0]));
+			if (!c.bridge->a_listed) {
+				c.bridge->a_next = bridge_thread_first;
+				bridge_thread_first = c.bridge;
+				c.bridge->a_listed = 1;
+			}
+			c.member->a_next = c.bridge->a_first;
+			c.bridge->a_first = c.member;
+			continue;
+
+			case BRIDGE_CMD_DEL:
+			memberp = &c.bridge->a_first;
+			while (*memberp != c.member)
+				memberp = &((*memberp)->a_next);
+			*memberp = c.member->a_next;
+			break;
+
+			case BRIDGE_CMD_FREE:
+			if (c.bridge->a_listed) {
+				bridgep = &bridge_thread_first;
+				while (*bridgep != c.bridge)
+					bridgep = &((*bridgep)->a_next);
+				*bridgep = c.bridge->a_next;
+			}
+			break;
+		}
+		spsc_put(&bridge_ack_queue, &c);
+	}
+}
+
+/* main thread: free what the audio thread has removed */
+static void bridge_thread_acks(void)
+{
+	struct bridge_cmd c;
+
+	while (!spsc_get(&bridge_ack_queue, &c)) {
+		switch (c.cmd) {
+			case BRIDGE_CMD_DEL:
+			FREE(c.member, sizeof(struct port_bridge_member));
+			memuse--;
+			break;
+
+			case BRIDGE_CMD_FREE:
+			FREE(c.bridge, sizeof(struct port_bridge));
+			memuse--;
+			break;
+		}
+	}
+}
+
+/* main thread: send command to audio thread */
+static void bridge_thread_cmd(int cmd, struct port_bridge *bridge, struct port_bridge_member *member)
+{
+	struct bridge_cmd c;
+
+	c.cmd = cmd;
+	c.bridge = bridge;
+	c.member = member;
+	while (spsc_put(&bridge_cmd_queue, &c) < 0) {
+		/* queue is full, the audio thread will take commands with its next frame */
+		bridge_thread_acks();
+		usleep(1000);
+	}
+}
+
+/* audio thread: mix one frame of a conference */
+static void bridge_thread_mix(struct port_bridge *bridge)
+{
+	struct port_bridge_member *member;
+	signed int sum[160];
+	signed short sample[160];
+	unsigned char frame[160];
+	int i, members = 0;
+
+	for (member = bridge->a_first; member; member = member->a_next)
+		members++;
+#ifndef TEST_CONFERENCE
+	if (members < 3) {
+#else
+	if (members < 2) {
+#endif
+		/* no conference, discard frames that were queued when it was one */
+		for (member = bridge->a_first; member; member = member->a_next) {
+			while (!spsc_get(&member->rx, frame))
+				;
+		}
+		return;
+	}
+
+	memset(sum, 0, sizeof(sum));
+	for (member = bridge->a_first; member; member = member->a_next) {
+		/* remove delay, if frames pile up */
+		while (spsc_count(&member->rx) > BRIDGE_QUEUE / 2)
+			spsc_get(&member->rx, frame);
+		if (spsc_get(&member->rx, frame) < 0)
+			memset(member->buffer, 0, 160 * sizeof(member->buffer[0]));
+		else {
+			for (i = 0; i < 160; i++)
+				member->buffer[i] = audio_law_to_s32[frame[i]];
+		}
+		bridge_mix_add(sum, member->buffer, 160);
+	}
+	for (member = bridge->a_first; member; member = member->a_next) {
+		bridge_mix_out(sample, sum, member->buffer, 160);
+		for (i = 0; i < 160; i++)
+			frame[i] = audio_s16_to_law[sample[i] & 0xffff];
+		/* if the main loop does not take frames, they are dropped */
+		spsc_put(&member->tx, frame);
+	}
+}
+
+static void *bridge_thread(void *arg)
+{
+	struct port_bridge *bridge;
+	struct timespec next, now;
+	sigset_t set;
+	long long late;
+
+	/* signals are handled by the main thread */
+	sigfillset(&set);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	while (!__atomic_load_n(&bridge_thread_quit, __ATOMIC_ACQUIRE)) {
+		next.tv_nsec += 20000000; /* 20 MS */
+		if (next.tv_nsec >= 1000000000) {
+			next.tv_nsec -= 1000000000;
+			next.tv_sec++;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+		/* check how late we are */
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		late = (now.tv_sec - next.tv_sec) * MICRO_SECONDS + (now.tv_nsec - next.tv_nsec) / 1000;
+		if (late >= BRIDGE_RESYNC) {
+			/* restart clock from now */
+			PACING_COUNT(pacing_resync);
+			next = now;
+		} else if (late >= 20000)
+			PACING_COUNT(pacing_late);
+
+		bridge_thread_commands();
+		for (bridge = bridge_thread_first; bridge; bridge = bridge->a_next)
+			bridge_thread_mix(bridge);
+
+		/* wake main loop */
+		eventfd_write(bridge_thread_fd.fd, 1);
+	}
+
+	return NULL;
+}
+
+/* main thread: give mixed frames to the ports */
+static int bridge_thread_cb(struct lcr_fd *fd, unsigned int what, void *instance, int index)
+{
+	struct port_bridge *bridge;
+	struct port_bridge_member *member;
+	unsigned char frame[160];
+	eventfd_t value;
+
+	eventfd_read(fd->fd, &value);
+	bridge_thread_acks();
+	for (bridge = p_bridge_first; bridge; bridge = bridge->next) {
+		for (member = bridge->first; member; member = member->next) {
+			while (!spsc_get(&member->tx, frame))
+				member->port->bridge_rx(frame, 160);
+		}
+	}
+
+	return 0;
+}
+
+int bridge_thread_init(void)
+{
+	struct sched_param schedp;
+	pthread_attr_t attr;
+	int fd, rc;
+
+	spsc_init(&bridge_cmd_queue, bridge_cmd_buffer, BRIDGE_CMDS, sizeof(struct bridge_cmd));
+	spsc_init(&bridge_ack_queue, bridge_ack_buffer, BRIDGE_CMDS, sizeof(struct bridge_cmd));
+
+	fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (fd < 0) {
+		PERROR("Failed to create eventfd for audio thread (errno = %d).\n", errno);
+		return -1;
+	}
+	memset(&bridge_thread_fd, 0, sizeof(bridge_thread_fd));
+	bridge_thread_fd.fd = fd;
+	register_fd(&bridge_thread_fd, LCR_FD_READ, bridge_thread_cb, NULL, 0);
+
+	pthread_attr_init(&attr);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+	memset(&schedp, 0, sizeof(schedp));
+	schedp.sched_priority = options.audio_thread;
+	pthread_attr_setschedparam(&attr, &schedp);
+	bridge_thread_quit = 0;
+	rc = pthread_create(&bridge_thread_id, &attr, bridge_thread, NULL);
+	pthread_attr_destroy(&attr);
+	if (rc) {
+		PERROR("Failed to start audio thread with priority %d (errno = %d).\nCheck options.conf 'audio_thread', exitting...\n", options.audio_thread, rc);
+		unregister_fd(&bridge_thread_fd);
+		close(fd);
+		return -1;
+	}
+	bridge_thread_run = 1;
+	PDEBUG(DEBUG_PORT, "Audio thread started with priority %d.\n", options.audio_thread);
+
+	return 0;
+}
+
+void bridge_thread_exit(void)
+{
+	if (!bridge_thread_run)
+		return;
+
+	__atomic_store_n(&bridge_thread_quit, 1, __ATOMIC_RELEASE);
+	pthread_join(bridge_thread_id, NULL);
+	bridge_thread_run = 0;
+
+	/* the audio thread is gone, so process its remaining commands here */
+	do {
+		bridge_thread_commands();
+		bridge_thread_acks();
+	} while (spsc_count(&bridge_cmd_queue));
+
+	unregister_fd(&bridge_thread_fd);
+	close(bridge_thread_fd.fd);
+}
+
 static void remove_bridge(struct port_bridge *bridge, class Port *port)
 {
 	struct port_bridge **temp = &p_bridge_first;
@@ -1196,15 +1623,21 @@ static void remove_bridge(struct port_bridge *bridge, class Port *port)
 				if ((*memberp)->port == port) {
 					member = *memberp;
 					*memberp = member->next;
-					FREE(member, sizeof(struct port_bridge_member));
-					memuse--;
+					if (bridge_thread_run) {
+						/* freed when the audio thread has removed it */
+						bridge_thread_cmd(BRIDGE_CMD_DEL, bridge, member);
+					} else {
+						FREE(member, sizeof(struct port_bridge_member));
+						memuse--;
+					}
 #ifndef TEST_CONFERENCE
 					if (bridge->first && bridge->first->next && !bridge->first->next->next) {
 #else
 					if (bridge->first && !bridge->first->next) {
 #endif
 						PDEBUG(DEBUG_PORT, "bridge %u is no conference anymore\n", bridge->bridge_id);
-						del_timer(&bridge->timer);
+						if (!bridge_thread_run)
+							del_timer(&bridge->timer);
 					}
 					break;
 				}
@@ -1214,8 +1647,12 @@ static void remove_bridge(struct port_bridge *bridge, class Port *port)
 			if (bridge->first == NULL) {
 				PDEBUG(DEBUG_PORT, "Remove bridge %u\n", bridge->bridge_id);
 				*temp = bridge->next;
-				FREE(bridge, sizeof(struct port_bridge));
-				memuse--;
+				if (bridge_thread_run)
+					bridge_thread_cmd(BRIDGE_CMD_FREE, bridge, NULL);
+				else {
+					FREE(bridge, sizeof(struct port_bridge));
+					memuse--;
+				}
 			}
 			return;
 		}
@@ -1226,7 +1663,7 @@ static void remove_bridge(struct port_bridge *bridge, class Port *port)
 
 void Port::bridge(unsigned int bridge_id)
 {
-	struct port_bridge_member **memberp;
+	struct port_bridge_member **memberp, *member;
 
 	/* Remove bridge, if we leave bridge or if we join a different bridge. */
 	if (p_bridge && bridge_id != p_bridge->bridge_id) {
@@ -1283,34 +1720,68 @@ void Port::bridge(unsigned int bridge_id)
 	/* check if bridge becomes a conference */
 #ifndef TEST_CONFERENCE
 	if (p_bridge->first->next && p_bridge->first->next->next && !p_bridge->first->next->next->next) {
-		p_bridge->first->next->next->write_p = 0;
-		p_bridge->first->next->next->min_space = 0;
-		memset(p_bridge->first->next->next->buffer, silence, sizeof((*memberp)->buffer));
 #else
 	if (p_bridge->first->next && !p_bridge->first->next->next) {
 #endif
-		p_bridge->first->next->write_p = 0;
-		p_bridge->first->next->min_space = 0;
-		memset(p_bridge->first->next->buffer, silence, sizeof((*memberp)->buffer));
-		p_bridge->first->write_p = 0;
-		p_bridge->first->min_space = 0;
-		memset(p_bridge->first->buffer, silence, sizeof((*memberp)->buffer));
-		memset(p_bridge->sum_buffer, 0, sizeof(p_bridge->sum_buffer));
-		p_bridge->read_p = 0;
-		add_timer(&p_bridge->timer, bridge_timeout, p_bridge, 0);
-		schedule_timer(&p_bridge->timer, 0, 20000); /* 20 MS */
-		p_bridge->sample_count = 0;
+		/* the audio thread resets a member, when it is added */
+		if (!bridge_thread_run) {
+			for (member = p_bridge->first; member; member = member->next) {
+				member->write_p = 0;
+				member->min_space = 0;
+				memset(member->buffer, 0, sizeof(member->buffer));
+			}
+			memset(p_bridge->sum_buffer, 0, sizeof(p_bridge->sum_buffer));
+			p_bridge->read_p = 0;
+			p_bridge->sample_count = 0;
+			add_timer(&p_bridge->timer, bridge_timeout, p_bridge, 0);
+			schedule_timer(&p_bridge->timer, 0, 20000); /* 20 MS */
+		}
 		PDEBUG(DEBUG_PORT, "bridge %u became a conference\n", p_bridge->bridge_id);
 	}
+	/* hand member over to the audio thread, from now on only the audio thread uses its buffer */
+	if (bridge_thread_run) {
+		spsc_init(&(*memberp)->rx, (*memberp)->rx_buffer, BRIDGE_QUEUE, 160);
+		spsc_init(&(*memberp)->tx, (*memberp)->tx_buffer, BRIDGE_QUEUE, 160);
+		bridge_thread_cmd(BRIDGE_CMD_ADD, p_bridge, *memberp);
+	}
+}
+
+/* detect DTMF in audio from port and send digits to endpoint */
+void Port::dtmf_receive(unsigned char *data, int len)
+{
+	char digits[8];
+	struct lcr_msg *message;
+	int i, num;
+
+	num = dtmf_detector_process(p_dtmf, data, len, digits, sizeof(digits));
+	for (i = 0; i < num; i++) {
+		start_trace(-1,
+			NULL,
+			numberrize_callerinfo(p_callerinfo.id, p_callerinfo.ntype, options.national, options.international),
+			p_dialinginfo.id,
+			DIRECTION_IN,
+			CATEGORY_CH,
+			p_serial,
+			"DTMF detected");
+		add_trace("digit", NULL, "%c", digits[i]);
+		end_trace();
+		if (!ACTIVE_EPOINT(p_epointlist))
+			continue;
+		message = message_create(p_serial, ACTIVE_EPOINT(p_epointlist), PORT_TO_EPOINT, MESSAGE_DTMF);
+		message->param.dtmf = digits[i];
+		message_put(message);
+	}
 }
 
 /* send data to remote Port or add to sum buffer */
 int Port::bridge_tx(unsigned char *data, int len)
 {
-	int write_p, space;
+	int write_p, space, i, n;
 	struct port_bridge_member *member;
-	signed long *sum;
-	unsigned char *buf;
+
+	/* all audio from port passes here, so detect DTMF, even if not bridged */
+	if (p_dtmf)
+		dtmf_receive(data, len);
 
 	/* less than two ports, so drop */
 	if (!p_bridge || !p_bridge->first || !p_bridge->first->next)
@@ -1334,19 +1805,40 @@ int Port::bridge_tx(unsigned char *data, int len)
 	}
 	if (!member)
 		return -EINVAL;
+	if (bridge_thread_run) {
+		/* collect 20 ms frames for the audio thread, drop them if it does not take them */
+		while (len) {
+			n = 160 - member->rx_len;
+			if (n > len)
+				n = len;
+			memcpy(member->rx_frame + member->rx_len, data, n);
+			member->rx_len += n;
+			data += n;
+			len -= n;
+			if (member->rx_len == 160) {
+				spsc_put(&member->rx, member->rx_frame);
+				member->rx_len = 0;
+			}
+		}
+		return 0;
+	}
 	write_p = member->write_p;
 	/* calculate space, so write pointer will not overrun (or reach) read pointer in ring buffer */
 	space = (p_bridge->read_p - write_p - 1) & (BRIDGE_BUFFER - 1);
 	/* clip len, if it does not fit */
 	if (space < len)
 		len = space;
-	/* apply audio samples to sum buffer */
-	sum = p_bridge->sum_buffer;
-	buf = member->buffer;
-	while (len--) {
-		sum[write_p] += audio_law_to_s32[*data];
-		buf[write_p] = *data++;
-		write_p = (write_p + 1) & (BRIDGE_BUFFER - 1);
+	/* apply audio samples to sum buffer, in two parts if the ring buffer wraps */
+	while (len) {
+		n = BRIDGE_BUFFER - write_p;
+		if (n > len)
+			n = len;
+		for (i = 0; i < n; i++)
+			member->buffer[write_p + i] = audio_law_to_s32[data[i]];
+		bridge_mix_add(p_bridge->sum_buffer + write_p, member->buffer + write_p, n);
+		data += n;
+		len -= n;
+		write_p = (write_p + n) & (BRIDGE_BUFFER - 1);
 	}
 	/* raise write pointer */
 	member->write_p = write_p;
@@ -1358,35 +1850,41 @@ int bridge_timeout(struct lcr_timer *timer, void *instance, int index)
 {
 	struct port_bridge *bridge = (struct port_bridge *)instance;
 	struct port_bridge_member *member = bridge->first;
-	unsigned long long timer_time;
-	signed long *sum, sample;
-	unsigned char buffer[160], *buf, *d;
-	int i, read_p, space;
+	struct timeval current_time;
+	long long late;
+	signed short sample[160];
+	unsigned char buffer[160];
+	int i, n, read_p, space;
 	
 	bridge->sample_count += 160;
 
-	/* schedule exactly 20ms from last schedule */
-	timer_time = timer->timeout.tv_sec * MICRO_SECONDS + timer->timeout.tv_usec;
-	timer_time += 20000; /* 20 MS */
-	timer->timeout.tv_sec = timer_time / MICRO_SECONDS;
-	timer->timeout.tv_usec = timer_time % MICRO_SECONDS;
-	timer->active = 1;
+	/* check how late we are */
+	get_monotonic(&current_time);
+	late = (current_time.tv_sec - timer->timeout.tv_sec) * MICRO_SECONDS + current_time.tv_usec - timer->timeout.tv_usec;
+	if (late >= BRIDGE_RESYNC) {
+		/* restart clock from now */
+		PACING_COUNT(pacing_resync);
+		schedule_timer(timer, 0, 20000); /* 20 MS */
+	} else {
+		if (late >= 20000)
+			PACING_COUNT(pacing_late);
+		/* schedule exactly 20ms from last schedule */
+		schedule_timer_next(timer, 0, 20000); /* 20 MS */
+	}
 
 	while (member) {
-		/* calculate transmit data */
+		/* calculate transmit data, in two parts if the ring buffer wraps */
 		read_p = bridge->read_p;
-		sum = bridge->sum_buffer;
-		buf = member->buffer;
-		d = buffer;
-		for (i = 0; i < 160; i++) {
-			sample = sum[read_p];
-			sample -= audio_law_to_s32[buf[read_p]];
-			buf[read_p] = silence;
-			if (sample < SHORT_MIN) sample = SHORT_MIN;
-			if (sample > SHORT_MAX) sample = SHORT_MAX;
-			*d++ = audio_s16_to_law[sample & 0xffff];
-			read_p = (read_p + 1) & (BRIDGE_BUFFER - 1);
+		for (i = 0; i < 160; i += n) {
+			n = BRIDGE_BUFFER - read_p;
+			if (n > 160 - i)
+				n = 160 - i;
+			bridge_mix_out(sample + i, bridge->sum_buffer + read_p, member->buffer + read_p, n);
+			memset(member->buffer + read_p, 0, n * sizeof(member->buffer[0]));
+			read_p = (read_p + n) & (BRIDGE_BUFFER - 1);
 		}
+		for (i = 0; i < 160; i++)
+			buffer[i] = audio_s16_to_law[sample[i] & 0xffff];
 		/* send data */
 		member->port->bridge_rx(buffer, 160);
 	 	/* raise write pointer, if read pointer would overrun them */
@@ -1411,10 +1909,12 @@ int bridge_timeout(struct lcr_timer *timer, void *instance, int index)
 
 	/* clear sample data */
 	read_p = bridge->read_p;
-	sum = bridge->sum_buffer;
-	for (i = 0; i < 160; i++) {
-		sum[read_p] = 0;
-		read_p = (read_p + 1) & (BRIDGE_BUFFER - 1);
+	for (i = 0; i < 160; i += n) {
+		n = BRIDGE_BUFFER - read_p;
+		if (n > 160 - i)
+			n = 160 - i;
+		memset(bridge->sum_buffer + read_p, 0, n * sizeof(bridge->sum_buffer[0]));
+		read_p = (read_p + n) & (BRIDGE_BUFFER - 1);
 	}
 
 	/* raise read pointer */
@@ -1433,3 +1933,46 @@ int Port::bridge_rx(unsigned char *data, int len)
 	return 0; /* datenklo */
 }
 
+/*
+ * coded frames (e.g. GSM full rate) may be passed between two bridged ports
+ * that use the same codec, so they are neither decoded nor encoded. if the
+ * frame is not taken, the port must decode it and give it to bridge_tx().
+ * audio of a port is always decoded, if it is recorded, tapped, echoed or
+ * DTMF is detected from it.
+ */
+class Port *Port::bridge_remote(void)
+{
+	if (!p_bridge || !p_bridge->first || !p_bridge->first->next || p_bridge->first->next->next)
+		return NULL;
+#ifdef TEST_CONFERENCE
+	return NULL;
+#endif
+	if (p_bridge->first->port == this)
+		return p_bridge->first->next->port;
+	return p_bridge->first->port;
+}
+
+int Port::bridge_tx_frame(int media_type, unsigned char *data, int len)
+{
+	class Port *remote;
+
+	if (p_record || p_tap || p_echotest || p_dtmf)
+		return -EINVAL;
+	remote = bridge_remote();
+	if (!remote)
+		return -EIO;
+
+	return remote->bridge_rx_frame(media_type, data, len);
+}
+
+/* receive coded frame from remote Port (dummy, ports that support it inherit it) */
+int Port::bridge_rx_frame(int media_type, unsigned char *data, int len)
+{
+	return -EINVAL;
+}
+
+int Port::bridge_media(void)
+{
+	return 0;
+}
+
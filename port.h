@@ -160,13 +160,23 @@ struct port_settings {
 };
 
 #define BRIDGE_BUFFER 4096
+#define BRIDGE_QUEUE 8 /* 20 ms frames queued to or from the audio thread (power of two) */
 
 struct port_bridge_member {
 	struct port_bridge_member *next;
 	class Port *port;
-	unsigned char buffer[BRIDGE_BUFFER];
+	signed short buffer[BRIDGE_BUFFER];	/* linear samples, so they can be mixed by vector instructions */
 	int write_p;				/* points to write position in buffer */
 	int min_space;				/* minimum space to calculate how much delay can be removed */
+
+	/* if conferences are mixed by the audio thread */
+	struct port_bridge_member *a_next;	/* next member in audio thread's list */
+	struct spsc rx;				/* frames from port to audio thread */
+	struct spsc tx;				/* mixed frames from audio thread to port */
+	unsigned char rx_buffer[BRIDGE_QUEUE][160];
+	unsigned char tx_buffer[BRIDGE_QUEUE][160];
+	unsigned char rx_frame[160];		/* frame being collected by bridge_tx() */
+	int rx_len;
 };
 
 /* port bridge instance */
@@ -174,14 +184,30 @@ struct port_bridge {
 	struct port_bridge *next;		/* next bridge node */
 	unsigned int bridge_id;			/* unique ID to identify bridge */
 	struct port_bridge_member *first;	/* list of ports that are bridged */
-	signed long sum_buffer[BRIDGE_BUFFER];
+	signed int sum_buffer[BRIDGE_BUFFER];
 	int read_p;				/* points to read position in buffer */
 	struct lcr_timer timer;			/* clock to transmit sum data */
 	int sample_count;			/* counter of samples since last delay check */
+
+	/* if conferences are mixed by the audio thread */
+	struct port_bridge *a_next;		/* next bridge in audio thread's list */
+	struct port_bridge_member *a_first;	/* members known by audio thread */
+	int a_listed;				/* bridge is in audio thread's list */
 };
 
 extern struct port_bridge *p_bridge_first;
 
+/* audio thread to mix conferences (options.audio_thread) */
+int bridge_thread_init(void);
+void bridge_thread_exit(void);
+
+/* pacing errors of audio clocks, shown by admin state */
+extern unsigned int pacing_late;	/* clock events that were processed one frame or more too late */
+extern unsigned int pacing_resync;	/* clock was reset, because it was too far behind */
+/* the audio thread counts too, so they must only be accessed by these */
+#define PACING_COUNT(counter)	__atomic_add_fetch(&(counter), 1, __ATOMIC_RELAXED)
+#define PACING_READ(counter)	__atomic_load_n(&(counter), __ATOMIC_RELAXED)
+
 /* generic port class */
 class Port
 {
@@ -190,6 +216,7 @@ class Port
 	Port(int type, const char *portname, struct port_settings *settings, struct interface *interface);
 	virtual ~Port();
 	class Port *next;			/* next port in list */
+	class Port *hash_next;			/* next port in hash bucket */
 	int p_type;				/* type of port */
 	virtual int message_epoint(unsigned int epoint_id, int message, union parameter *param);
 	virtual void set_echotest(int echotest);
@@ -205,7 +232,9 @@ class Port
 	char p_tone_name[256];			/* name of current tone */
 	char p_tone_fh;				/* file descriptor of current tone or -1 if not open */
 	void *p_tone_fetched;			/* pointer to fetched data */
+	void *p_tone_cached;			/* cached tone, p_tone_fetched points into it */
 	int p_tone_codec;			/* codec that the tone is made of */
+	struct tone_gsm p_tone_gsm;		/* decoder state, if the tone is GSM */
 	signed int p_tone_size, p_tone_left;	/* size of tone in bytes (not samples), bytes left */
 	signed int p_tone_eof;			/* flag that makes the use of eof message */
 	signed int p_tone_counter;		/* flag that makes the use of counter message */
@@ -214,6 +243,8 @@ class Port
 //	void *p_knock_fetched;			/* pointer to fetched data */
 //	int p_knock_codec;
 //	signed int p_knock_size, p_knock_left;
+	void close_tone(void);
+	int open_tone_file(const char *filename);
 	void set_vbox_tone(const char *dir, const char *name);/* tone of answering machine */
 	void set_vbox_play(const char *name, int offset); /* sample of answ. */
 	void set_vbox_speed(int speed);	/* speed of answ. */
@@ -230,6 +261,10 @@ class Port
 	void bridge(unsigned int bridge_id);	/* join a bridge */
 	int bridge_tx(unsigned char *data, int len); /* used to transmit data to remote port */
 	virtual int bridge_rx(unsigned char *data, int len); /* function to be inherited, so data is received */
+	class Port *bridge_remote(void);	/* other port, if bridged to exactly one port */
+	int bridge_tx_frame(int media_type, unsigned char *data, int len); /* transmit coded frame to remote port without transcoding */
+	virtual int bridge_rx_frame(int media_type, unsigned char *data, int len); /* coded frame is received, returns 0 if taken */
+	virtual int bridge_media(void);		/* media type of coded frames that port exchanges, 0 if none */
 
 	/* state */
 	int p_state;				/* state of port */
@@ -241,16 +276,19 @@ class Port
 	struct capa_info p_capainfo;	/* info on l2,l3 capacity */
 	int p_echotest;				/* set to echo audio data FROM port back to port's mixer */
 
+	/* software DTMF detection (interface option 'dtmf-detect') */
+	struct dtmf_detector *p_dtmf;		/* detector or NULL if disabled */
+	void dtmf_receive(unsigned char *data, int len); /* detect DTMF in audio from port */
+
 	/* recording/tapping */
 	int open_record(int type, int mode, int skip, char *terminal, int anon_ignore, const char *vbox_email, int vbox_email_file);
 	void close_record(int beep, int mute);
 	void record(unsigned char *data, int length, int dir_fromup);
 	void tap(unsigned char *data, int length, int dir_fromup);
-	FILE *p_record;				/* recording fp: if not NULL, recording is enabled */
+	struct rec_stream *p_record;		/* recording stream: if not NULL, recording is enabled */
 	unsigned int p_tap;			/* enpoint to send tapping audio to */
 	int p_record_type;			/* codec to use: RECORD_MONO, RECORD_STEREO, ... */
 	int p_record_skip;			/* skip bytes before writing the sample */
-	unsigned int p_record_length;		/* size of what's written so far */
 
 	signed short p_record_buffer[RECORD_BUFFER_LENGTH];
 	unsigned int p_record_buffer_readp;
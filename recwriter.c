@@ -0,0 +1,555 @@
+/*****************************************************************************\
+**                                                                           **
+** LCR                                                                       **
+**                                                                           **
+**---------------------------------------------------------------------------**
+** Copyright: Andreas Eversberg                                              **
+**                                                                           **
+** record writer thread                                                      **
+**                                                                           **
+\*****************************************************************************/
+
+#include "main.h"
+#include <semaphore.h>
+#include <sys/uio.h>
+#include <sys/eventfd.h>
+#ifdef WITH_GSMFR
+extern "C" {
+#include "gsm_audio.h"
+}
+#endif
+
+/*
+ * rec_write() copies data of a recording into a block of REC_BLOCK bytes.
+ * each full block is queued to the writer thread, which takes all queued
+ * blocks and writes the blocks of each file with one writev(). written blocks are sent back
+ * through a second queue and are used again. if no block is free, because the
+ * disk is too slow, the data is dropped and counted.
+ * truncating and closing a file are queued also, so they are done in order
+ * with the data. on close, the header is completed with the size of the
+ * data and written to the start of the file. then the file is closed and
+ * renamed, the main loop is woken, and the done() function of the recording
+ * is called.
+ * if the recording is encoded (GSM), the samples are encoded by the writer
+ * thread, so encoding does not load the main loop.
+ * the main thread never waits for the writer. if the queue is full, a block
+ * of data is dropped and counted, but truncate and close are kept in a
+ * backlog, until the writer has taken enough jobs.
+ */
+
+#define REC_BLOCKS	256	/* number of blocks */
+#define REC_JOBS	512	/* number of jobs in each queue, must be a power of two */
+#define REC_IOV		16	/* number of blocks written at once */
+#define REC_GSM_SAMPLES	320	/* samples of two GSM frames */
+#define REC_GSM_BYTES	65	/* bytes of two GSM frames in WAV #49 format */
+
+enum {
+	REC_JOB_WRITE,
+	REC_JOB_TRUNCATE,
+	REC_JOB_CLOSE,
+};
+
+/* state of a file, only used by writer thread while the file is open */
+struct rec_file {
+	int		fd;
+	unsigned int	header_len;	/* space at the start of the file */
+	unsigned int	size;		/* bytes after header */
+	int		encode;
+	void		*gsm;		/* encoder instance */
+	signed short	rest[REC_GSM_SAMPLES]; /* samples that are not encoded yet */
+	unsigned int	rest_num;
+	unsigned int	samples;	/* samples that are encoded */
+};
+
+struct rec_job {
+	int		type;
+	struct rec_file	*file;
+	unsigned char	*block;		/* REC_JOB_WRITE: data */
+	unsigned int	len;		/* REC_JOB_WRITE: bytes, REC_JOB_TRUNCATE: new size */
+	struct rec_close *close;	/* REC_JOB_CLOSE */
+};
+
+static unsigned char rec_pool[REC_BLOCKS][REC_BLOCK] __attribute__((aligned(4096)));
+static unsigned char *rec_free[REC_BLOCKS]; /* stack of free blocks, only used by main thread */
+static int rec_free_num = 0;
+static struct spsc rec_queue, rec_done; /* jobs to writer, jobs back from writer */
+static struct rec_job rec_queue_buffer[REC_JOBS], rec_done_buffer[REC_JOBS];
+static unsigned int rec_pending = 0; /* jobs that are not back yet */
+#ifdef WITH_GSMFR
+static unsigned char rec_encoded[REC_IOV * (REC_BLOCK / (REC_GSM_SAMPLES << 1) + 1) * REC_GSM_BYTES]; /* used by writer */
+#endif
+static sem_t rec_sem;
+static pthread_t rec_thread;
+static int rec_running = 0, rec_quit = 0;
+static struct lcr_fd rec_fd;
+struct rec_backlog {
+	struct rec_backlog *next;
+	struct rec_job	job;
+};
+static struct rec_backlog *rec_backlog_first = NULL, **rec_backlog_last = &rec_backlog_first; /* only used by main thread */
+static int rec_backlog_wake = 0; /* writer must wake the main loop, when it has taken jobs */
+static time_t rec_stall_logged = 0;
+unsigned int rec_dropped = 0; /* bytes dropped, because no block was free or the queue was full */
+unsigned int rec_stalls = 0; /* jobs that did not fit into the queue */
+unsigned int rec_errors = 0; /* writes that failed */
+
+/*
+ * writer thread
+ */
+
+#ifdef WITH_GSMFR
+/* encode samples, return number of bytes */
+static int rec_encode(struct rec_file *file, const unsigned char *data, unsigned int len, unsigned char *out)
+{
+	unsigned int l;
+	int encoded = 0;
+
+	len >>= 1;
+	while (len) {
+		l = REC_GSM_SAMPLES - file->rest_num;
+		if (l > len)
+			l = len;
+		memcpy(file->rest + file->rest_num, data, l << 1);
+		file->rest_num += l;
+		data += l << 1;
+		len -= l;
+		if (file->rest_num < REC_GSM_SAMPLES)
+			break;
+		gsm_fr_encode(file->gsm, file->rest, out);
+		gsm_fr_encode(file->gsm, file->rest + 160, out + 32);
+		out += REC_GSM_BYTES;
+		encoded += REC_GSM_BYTES;
+		file->samples += REC_GSM_SAMPLES;
+		file->rest_num = 0;
+	}
+
+	return encoded;
+}
+#endif
+
+/* write blocks of one file, continue after partial writes */
+static void rec_writev(struct rec_job *job, int num)
+{
+	struct rec_file *file = job->file;
+	struct iovec iov[REC_IOV], *iovp = iov;
+	int i, ret;
+
+	for (i = 0; i < num; i++) {
+		iov[i].iov_base = job[i].block;
+		iov[i].iov_len = job[i].len;
+	}
+#ifdef WITH_GSMFR
+	if (file->encode == REC_ENCODE_GSM) {
+		iov[0].iov_base = rec_encoded;
+		iov[0].iov_len = 0;
+		for (i = 0; i < num; i++)
+			iov[0].iov_len += rec_encode(file, job[i].block, job[i].len, rec_encoded + iov[0].iov_len);
+		num = 1;
+	}
+#endif
+	for (i = 0; i < num; i++)
+		file->size += iov[i].iov_len;
+	while (num) {
+		ret = writev(file->fd, iovp, num);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			__atomic_add_fetch(&rec_errors, 1, __ATOMIC_RELAXED);
+			break;
+		}
+		while (num && ret >= (int)iovp->iov_len) {
+			ret -= iovp->iov_len;
+			iovp++;
+			num--;
+		}
+		if (num) {
+			iovp->iov_base = (char *)iovp->iov_base + ret;
+			iovp->iov_len -= ret;
+		}
+	}
+}
+
+static void rec_do(struct rec_job *job)
+{
+	struct rec_file *file = job->file;
+	struct rec_close *rclose = job->close;
+	unsigned int size = job->len;
+#ifdef WITH_GSMFR
+	unsigned char frame[REC_GSM_BYTES];
+#endif
+
+	switch(job->type) {
+		case REC_JOB_TRUNCATE:
+#ifdef WITH_GSMFR
+		if (file->encode == REC_ENCODE_GSM) {
+			/* samples not encoded yet are removed first, then whole frames */
+			size >>= 1;
+			if (size >= file->samples) {
+				file->rest_num = size - file->samples;
+				break;
+			}
+			file->rest_num = 0;
+			file->samples = size / REC_GSM_SAMPLES * REC_GSM_SAMPLES;
+			size = file->samples / REC_GSM_SAMPLES * REC_GSM_BYTES;
+		}
+#endif
+		file->size = size;
+		if (ftruncate(file->fd, file->header_len + size) < 0 || lseek(file->fd, file->header_len + size, SEEK_SET) < 0)
+			__atomic_add_fetch(&rec_errors, 1, __ATOMIC_RELAXED);
+		break;
+
+		case REC_JOB_CLOSE:
+#ifdef WITH_GSMFR
+		if (file->encode == REC_ENCODE_GSM) {
+			/* fill last frames with silence */
+			if (file->rest_num) {
+				size = file->samples + file->rest_num;
+				memset(file->rest + file->rest_num, 0, (REC_GSM_SAMPLES - file->rest_num) << 1);
+				gsm_fr_encode(file->gsm, file->rest, frame);
+				gsm_fr_encode(file->gsm, file->rest + 160, frame + 32);
+				if (write(file->fd, frame, REC_GSM_BYTES) != REC_GSM_BYTES)
+					__atomic_add_fetch(&rec_errors, 1, __ATOMIC_RELAXED);
+				file->size += REC_GSM_BYTES;
+				file->samples = size;
+			}
+			gsm_fr_destroy(file->gsm);
+		}
+#endif
+		if (file->header_len) {
+			rclose->header_cb(rclose, file->size, file->samples);
+			if (pwrite(file->fd, rclose->header, file->header_len, 0) != (int)file->header_len) {
+				__atomic_add_fetch(&rec_errors, 1, __ATOMIC_RELAXED);
+				rclose->error = errno;
+			}
+		}
+		close(file->fd);
+		if (rclose->to[0] && rename(rclose->from, rclose->to) < 0)
+			rclose->error = errno;
+		break;
+	}
+}
+
+static void *rec_writer(void *arg)
+{
+	static struct rec_job job[REC_JOBS];
+	static char written[REC_JOBS];
+	struct rec_job batch[REC_IOV];
+	int num, quit, closed, i, j, n;
+
+	while (1) {
+		while (sem_wait(&rec_sem) < 0 && errno == EINTR)
+			;
+		quit = __atomic_load_n(&rec_quit, __ATOMIC_ACQUIRE);
+
+		/* take all queued jobs */
+		num = 0;
+		while (num < REC_JOBS && !spsc_get(&rec_queue, &job[num]))
+			written[num++] = 0;
+
+		/* write blocks of the same file together, up to the next truncate or close of that file */
+		closed = 0;
+		for (i = 0; i < num; i++) {
+			if (written[i])
+				continue;
+			if (job[i].type != REC_JOB_WRITE) {
+				rec_do(&job[i]);
+				spsc_put(&rec_done, &job[i]);
+				if (job[i].type == REC_JOB_CLOSE)
+					closed = 1;
+				continue;
+			}
+			n = 0;
+			for (j = i; j < num && n < REC_IOV; j++) {
+				if (written[j] || job[j].file != job[i].file)
+					continue;
+				if (job[j].type != REC_JOB_WRITE)
+					break;
+				batch[n++] = job[j];
+				written[j] = 1;
+			}
+			rec_writev(batch, n);
+			for (j = 0; j < n; j++)
+				spsc_put(&rec_done, &batch[j]);
+		}
+
+		/* the main loop must call done() or queue its backlog */
+		if (closed || __atomic_load_n(&rec_backlog_wake, __ATOMIC_ACQUIRE))
+			eventfd_write(rec_fd.fd, 1);
+
+		if (quit && !spsc_count(&rec_queue))
+			break;
+	}
+
+	return NULL;
+}
+
+/*
+ * main thread
+ */
+
+/* queue jobs of the backlog, as long as there is space */
+static void rec_flush_backlog(void)
+{
+	struct rec_backlog *backlog;
+
+	while ((backlog = rec_backlog_first) && rec_pending < REC_JOBS) {
+		spsc_put(&rec_queue, &backlog->job);
+		rec_pending++;
+		sem_post(&rec_sem);
+		rec_backlog_first = backlog->next;
+		FREE(backlog, sizeof(struct rec_backlog));
+		memuse--;
+	}
+	if (!rec_backlog_first) {
+		rec_backlog_last = &rec_backlog_first;
+		__atomic_store_n(&rec_backlog_wake, 0, __ATOMIC_RELEASE);
+	}
+}
+
+/* take back jobs from writer */
+static void rec_reap(void)
+{
+	struct rec_job job;
+
+	while (!spsc_get(&rec_done, &job)) {
+		rec_pending--;
+		if (job.block)
+			rec_free[rec_free_num++] = job.block;
+		if (job.type == REC_JOB_CLOSE) {
+			FREE(job.file, sizeof(struct rec_file));
+			memuse--;
+			fduse--;
+			job.close->done(job.close);
+		}
+	}
+	if (rec_backlog_first)
+		rec_flush_backlog();
+}
+
+static int rec_fd_cb(struct lcr_fd *fd, unsigned int what, void *instance, int index)
+{
+	eventfd_t value;
+
+	eventfd_read(fd->fd, &value);
+	rec_reap();
+
+	return 0;
+}
+
+/* queue job. if the queue is full, data is dropped, other jobs are kept in
+ * the backlog, so they are done in order. returns -1 if data was dropped */
+static int rec_put(struct rec_job *job)
+{
+	struct rec_backlog *backlog;
+	time_t now;
+
+	rec_reap();
+	if (rec_pending < REC_JOBS && !rec_backlog_first) {
+		spsc_put(&rec_queue, job);
+		rec_pending++;
+		sem_post(&rec_sem);
+		return 0;
+	}
+
+	rec_stalls++;
+	time(&now);
+	if (now - rec_stall_logged >= 10) {
+		rec_stall_logged = now;
+		PERROR("Record writer is too slow, %u jobs did not fit into the queue, %u bytes dropped so far.\n", rec_stalls, rec_dropped);
+	}
+	if (job->type == REC_JOB_WRITE) {
+		rec_free[rec_free_num++] = job->block;
+		rec_dropped += job->len;
+		return -1;
+	}
+	backlog = (struct rec_backlog *)MALLOC(sizeof(struct rec_backlog));
+	memuse++;
+	backlog->job = *job;
+	*rec_backlog_last = backlog;
+	rec_backlog_last = &backlog->next;
+	__atomic_store_n(&rec_backlog_wake, 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+/* queue the block of a stream */
+static void rec_queue_block(struct rec_stream *stream)
+{
+	struct rec_job job;
+
+	if (!stream->fill)
+		return;
+	memset(&job, 0, sizeof(job));
+	job.type = REC_JOB_WRITE;
+	job.file = stream->file;
+	job.block = stream->block;
+	job.len = stream->fill;
+	/* dropped data is not in the file, so later offsets (rec_truncate)
+	 * and the header refer to what is written */
+	if (rec_put(&job) < 0)
+		stream->length -= job.len;
+	stream->block = NULL;
+	stream->fill = 0;
+}
+
+/* open file, the header is written when closing */
+int rec_open(struct rec_stream *stream, const char *filename, unsigned int header_len, int encode)
+{
+	struct rec_file *file;
+
+	if (!rec_running)
+		return -1;
+#ifndef WITH_GSMFR
+	if (encode == REC_ENCODE_GSM)
+		return -1;
+#endif
+
+	memset(stream, 0, sizeof(struct rec_stream));
+	file = (struct rec_file *)MALLOC(sizeof(struct rec_file));
+	memuse++;
+	file->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	if (file->fd < 0) {
+		FREE(file, sizeof(struct rec_file));
+		memuse--;
+		return -1;
+	}
+	fduse++;
+	file->header_len = header_len;
+	if (header_len)
+		lseek(file->fd, header_len, SEEK_SET);
+	file->encode = encode;
+#ifdef WITH_GSMFR
+	if (encode == REC_ENCODE_GSM && !(file->gsm = gsm_fr_create_wav())) {
+		close(file->fd);
+		fduse--;
+		FREE(file, sizeof(struct rec_file));
+		memuse--;
+		return -1;
+	}
+#endif
+	stream->file = file;
+
+	return 0;
+}
+
+void rec_write(struct rec_stream *stream, const void *data, unsigned int len)
+{
+	unsigned int l;
+
+	while (len) {
+		if (!stream->block) {
+			rec_reap();
+			if (!rec_free_num) {
+				rec_dropped += len;
+				return;
+			}
+			stream->block = rec_free[--rec_free_num];
+		}
+		l = REC_BLOCK - stream->fill;
+		if (l > len)
+			l = len;
+		memcpy(stream->block + stream->fill, data, l);
+		stream->fill += l;
+		stream->length += l;
+		data = (const unsigned char *)data + l;
+		len -= l;
+		if (stream->fill == REC_BLOCK)
+			rec_queue_block(stream);
+	}
+}
+
+/* cut the file to the given length */
+void rec_truncate(struct rec_stream *stream, unsigned int length)
+{
+	struct rec_job job;
+
+	if (length >= stream->length)
+		return;
+	/* still in block */
+	if (stream->length - length <= stream->fill) {
+		stream->fill -= stream->length - length;
+		stream->length = length;
+		return;
+	}
+	rec_queue_block(stream);
+	memset(&job, 0, sizeof(job));
+	job.type = REC_JOB_TRUNCATE;
+	job.file = stream->file;
+	job.len = length;
+	rec_put(&job);
+	stream->length = length;
+}
+
+/* write pending data, then write header, close and rename the file */
+void rec_close(struct rec_stream *stream, struct rec_close *close)
+{
+	struct rec_job job;
+
+	rec_queue_block(stream);
+	if (stream->block) {
+		rec_free[rec_free_num++] = stream->block;
+		stream->block = NULL;
+	}
+	memset(&job, 0, sizeof(job));
+	job.type = REC_JOB_CLOSE;
+	job.file = stream->file;
+	job.close = close;
+	rec_put(&job);
+	stream->file = NULL;
+}
+
+int rec_init(void)
+{
+	int i;
+
+	for (i = 0; i < REC_BLOCKS; i++)
+		rec_free[i] = rec_pool[i];
+	rec_free_num = REC_BLOCKS;
+	spsc_init(&rec_queue, rec_queue_buffer, REC_JOBS, sizeof(struct rec_job));
+	spsc_init(&rec_done, rec_done_buffer, REC_JOBS, sizeof(struct rec_job));
+
+	memset(&rec_fd, 0, sizeof(rec_fd));
+	rec_fd.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (rec_fd.fd < 0) {
+		PERROR("Failed to create eventfd for record writer (errno = %d).\n", errno);
+		return -1;
+	}
+	if (sem_init(&rec_sem, 0, 0) < 0) {
+		PERROR("Cannot create record semaphore: %s\n", strerror(errno));
+		close(rec_fd.fd);
+		return -1;
+	}
+	rec_quit = 0;
+	if (pthread_create(&rec_thread, NULL, rec_writer, NULL)) {
+		PERROR("Cannot create record writer thread\n");
+		sem_destroy(&rec_sem);
+		close(rec_fd.fd);
+		return -1;
+	}
+	register_fd(&rec_fd, LCR_FD_READ, rec_fd_cb, NULL, 0);
+	rec_running = 1;
+
+	return 0;
+}
+
+/* write all queued recordings and stop thread */
+void rec_exit(void)
+{
+	if (!rec_running)
+		return;
+	/* the backlog must be queued before the writer quits */
+	while (rec_backlog_first) {
+		rec_reap();
+		if (rec_backlog_first)
+			usleep(1000);
+	}
+	__atomic_store_n(&rec_quit, 1, __ATOMIC_RELEASE);
+	sem_post(&rec_sem);
+	pthread_join(rec_thread, NULL);
+	rec_running = 0;
+	rec_reap();
+	unregister_fd(&rec_fd);
+	close(rec_fd.fd);
+	sem_destroy(&rec_sem);
+}
+
@@ -0,0 +1,45 @@
+/*****************************************************************************\
+**                                                                           **
+** LCR                                                                       **
+**                                                                           **
+**---------------------------------------------------------------------------**
+** Copyright: Andreas Eversberg                                              **
+**                                                                           **
+** record writer header file                                                 **
+**                                                                           **
+\*****************************************************************************/
+
+#define REC_BLOCK	16384	/* bytes of one block, a multiple of the page size */
+
+/* how data is written to file */
+enum {
+	REC_ENCODE_NONE,		/* as given */
+	REC_ENCODE_GSM,			/* 16 bit mono samples are encoded to GSM full rate (WAV #49) */
+};
+
+/* a recording that is open */
+struct rec_stream {
+	struct rec_file	*file;		/* state of file, used by writer thread */
+	unsigned char	*block;		/* block that is filled, or NULL */
+	unsigned int	fill;		/* bytes in block */
+	unsigned int	length;		/* bytes given to rec_write(), after all jobs are done */
+};
+
+/* what to do when closing a recording, released by done() */
+struct rec_close {
+	unsigned char	header[64];	/* written to the start of the file */
+	void		(*header_cb)(struct rec_close *close, unsigned int size, unsigned int samples); /* called by writer thread to complete header */
+	char		from[256];	/* rename file, if to[0] is set */
+	char		to[512];
+	int		error;		/* errno, if header or rename failed */
+	void		(*done)(struct rec_close *close); /* called by main thread */
+};
+
+extern unsigned int rec_dropped, rec_stalls, rec_errors;
+int rec_init(void);
+void rec_exit(void);
+int rec_open(struct rec_stream *stream, const char *filename, unsigned int header_len, int encode);
+void rec_write(struct rec_stream *stream, const void *data, unsigned int len);
+void rec_truncate(struct rec_stream *stream, unsigned int length);
+void rec_close(struct rec_stream *stream, struct rec_close *close);
+
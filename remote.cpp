@@ -13,6 +13,57 @@
 
 unsigned int new_remote = 1000;
 
+/* ports with attached shared memory for audio, their queues are read every 20 ms */
+static class Premote *remote_audio_first = NULL;
+static struct lcr_timer remote_audio_timer;
+
+static int remote_audio_timeout(struct lcr_timer *timer, void *instance, int index)
+{
+	class Premote *remote, *next;
+	union parameter param;
+
+	remote = remote_audio_first;
+	while(remote) {
+		/* message_remote() does not destroy the port on MESSAGE_TRAFFIC */
+		next = remote->p_r_audio_next;
+		while (!spsc_get(&remote->p_r_audio->to_lcr, &param.traffic))
+			remote->message_remote(MESSAGE_TRAFFIC, &param);
+		remote = next;
+	}
+
+	if (remote_audio_first)
+		schedule_timer_next(&remote_audio_timer, 0, 20000);
+	return 0;
+}
+
+/*
+ * remove shared memory for audio that was left by an LCR process that did
+ * not exit, so /dev/shm does not fill up with names nobody will remove
+ */
+void remote_audio_unlink_stale(void)
+{
+	DIR *dir;
+	struct dirent *dirent;
+	char name[sizeof(dirent->d_name) + 1];
+	int pid;
+	unsigned int ref;
+
+	dir = opendir("/dev/shm");
+	if (!dir)
+		return;
+	while((dirent = readdir(dir))) {
+		SPRINT(name, "/%s", dirent->d_name);
+		if (sscanf(name, REMOTE_AUDIO_SHM, &pid, &ref) != 2)
+			continue;
+		/* the name of a running process is not stale */
+		if (pid == (int)getpid() || !kill(pid, 0) || errno != ESRCH)
+			continue;
+		PDEBUG(DEBUG_PORT, "Removing stale shared memory '%s' for audio.\n", name);
+		shm_unlink(name);
+	}
+	closedir(dir);
+}
+
 /*
  * constructor
  */
@@ -25,11 +76,17 @@ Premote::Premote(int type, char *portname, struct port_settings *settings, struc
 	SCPY(p_r_remote_app, interface->remote_app);
 	p_r_tones = (interface->is_tones == IS_YES);
 	p_r_earlyb = (interface->is_earlyb == IS_YES);
+	p_r_audio = NULL;
+	p_r_audio_name[0] = '\0';
+	p_r_audio_attached = 0;
+	p_r_audio_next = NULL;
+	audio_create();
 
 	/* send new ref to remote socket */
 	memset(&param, 0, sizeof(union parameter));
 	if (type == PORT_TYPE_REMOTE_OUT)
 		param.newref.direction = 1; /* new ref from lcr */
+	SCPY(param.newref.audio_shm, p_r_audio_name);
 	p_r_remote_id = remote_id;
 	if (admin_message_from_lcr(p_r_remote_id, p_r_ref, MESSAGE_NEWREF, &param) < 0)
 		FATAL("No socket with remote application '%s' found, this shall not happen. because we already created one.\n", p_r_remote_app);
@@ -43,6 +100,23 @@ Premote::Premote(int type, char *portname, struct port_settings *settings, struc
  */
 Premote::~Premote()
 {
+	class Premote **remotep;
+
+	if (p_r_audio) {
+		remotep = &remote_audio_first;
+		while(*remotep) {
+			if (*remotep == this) {
+				*remotep = p_r_audio_next;
+				break;
+			}
+			remotep = &((*remotep)->p_r_audio_next);
+		}
+		if (!remote_audio_first)
+			unsched_timer(&remote_audio_timer);
+		munmap(p_r_audio, sizeof(struct remote_audio));
+		/* the remote application removes the name when it attaches */
+		shm_unlink(p_r_audio_name);
+	}
 	PDEBUG(DEBUG_PORT, "Destroyed Remote process(%s).\n", p_name);
 }
 
@@ -138,6 +212,11 @@ void Premote::message_remote(int message_type, union parameter *param)
 	struct lcr_msg *message;
 	struct interface *interface;
 
+	/* the remote application sets 'attached' before it sends any other
+	 * message for our ref, so we check it here */
+	if (p_r_audio && !p_r_audio_attached && __atomic_load_n(&p_r_audio->attached, __ATOMIC_ACQUIRE))
+		audio_attached();
+
 	switch (message_type) {
 	case MESSAGE_TRAFFIC:
 		/* record audio */
@@ -153,7 +232,7 @@ void Premote::message_remote(int message_type, union parameter *param)
 				record(param->traffic.data, param->traffic.len, 1); // from up
 			if (p_tap)
 				tap(param->traffic.data, param->traffic.len, 1); // from up
-			admin_message_from_lcr(p_r_remote_id, p_r_ref, MESSAGE_TRAFFIC, param);
+			audio_send(param);
 		}
 		return;
 
@@ -218,7 +297,7 @@ void Premote::message_remote(int message_type, union parameter *param)
 
 	/* cannot just forward, because param is not of container "struct lcr_msg" */
 	message = message_create(p_serial, ACTIVE_EPOINT(p_epointlist), PORT_TO_EPOINT, message_type);
-	memcpy(&message->param, param, sizeof(message->param));
+	memcpy(&message->param, param, message_param_size(message_type));
 	message_put(message);
 
 	if (message_type == MESSAGE_RELEASE) {
@@ -260,10 +339,68 @@ int Premote::bridge_rx(unsigned char *data, int len)
 			record(data, len, 1); // from up
 		if (p_tap)
 			tap(data, len, 1); // from up
-		admin_message_from_lcr(p_r_remote_id, p_r_ref, MESSAGE_TRAFFIC, &newparam);
+		audio_send(&newparam);
 	}
 
 	return 0;
 }
 
+/* create shared memory for audio, so the remote application can attach to it */
+void Premote::audio_create(void)
+{
+	int fd;
+	void *mem;
+
+	SPRINT(p_r_audio_name, REMOTE_AUDIO_SHM, (int)getpid(), p_r_ref);
+	fd = shm_open(p_r_audio_name, O_RDWR | O_CREAT | O_EXCL, options.socketrights & 0666);
+	if (fd < 0) {
+		PERROR("Cannot create shared memory '%s' for audio (errno=%d), using socket.\n", p_r_audio_name, errno);
+		p_r_audio_name[0] = '\0';
+		return;
+	}
+	/* same access rights as the socket */
+	if (fchown(fd, options.socketuser, options.socketgroup) < 0)
+		PDEBUG(DEBUG_PORT, "Failed to change owner of shared memory '%s' (errno=%d).\n", p_r_audio_name, errno);
+	if (ftruncate(fd, sizeof(struct remote_audio)) < 0
+	 || (mem = mmap(NULL, sizeof(struct remote_audio), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		PERROR("Cannot map shared memory '%s' for audio (errno=%d), using socket.\n", p_r_audio_name, errno);
+		close(fd);
+		shm_unlink(p_r_audio_name);
+		p_r_audio_name[0] = '\0';
+		return;
+	}
+	close(fd);
+
+	p_r_audio = (struct remote_audio *)mem;
+	p_r_audio->version = REMOTE_AUDIO_VERSION;
+	spsc_init(&p_r_audio->to_lcr, NULL, REMOTE_AUDIO_FRAMES, sizeof(struct param_traffic));
+	spsc_init(&p_r_audio->from_lcr, NULL, REMOTE_AUDIO_FRAMES, sizeof(struct param_traffic));
+}
+
+/* the remote application has mapped the shared memory, so its queue is read
+ * from now on. the timer only runs while any port is attached. */
+void Premote::audio_attached(void)
+{
+	PDEBUG(DEBUG_PORT, "Remote application attached to shared memory '%s' for audio.\n", p_r_audio_name);
+	p_r_audio_attached = 1;
+
+	if (!remote_audio_timer.inuse) {
+		memset(&remote_audio_timer, 0, sizeof(remote_audio_timer));
+		add_timer(&remote_audio_timer, remote_audio_timeout, NULL, 0);
+	}
+	if (!remote_audio_first)
+		schedule_timer(&remote_audio_timer, 0, 20000);
+	p_r_audio_next = remote_audio_first;
+	remote_audio_first = this;
+}
 
+/* send audio to remote application, use shared memory, if attached */
+void Premote::audio_send(union parameter *param)
+{
+	if (p_r_audio && __atomic_load_n(&p_r_audio->attached, __ATOMIC_ACQUIRE)) {
+		/* if the remote application does not read, frames are dropped */
+		spsc_put(&p_r_audio->from_lcr, &param->traffic);
+		return;
+	}
+	admin_message_from_lcr(p_r_remote_id, p_r_ref, MESSAGE_TRAFFIC, param);
+}
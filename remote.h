@@ -1,4 +1,5 @@
 extern unsigned int new_remote;
+void remote_audio_unlink_stale(void);
 
 /* GSM port class */
 class Premote : public Port
@@ -12,9 +13,16 @@ class Premote : public Port
 	char p_r_remote_app[32];
 	int p_r_tones;
 	int p_r_earlyb;
+	struct remote_audio *p_r_audio; /* shared memory for audio or NULL */
+	char p_r_audio_name[32];
+	int p_r_audio_attached; /* remote application has attached */
+	class Premote *p_r_audio_next; /* next port with attached shared memory */
 
 	int message_epoint(unsigned int epoint_id, int message_id, union parameter *param);
 	void message_remote(int message_type, union parameter *param);
+	void audio_create(void);
+	void audio_attached(void);
+	void audio_send(union parameter *param);
 
 	int bridge_rx(unsigned char *data, int len);
 };
@@ -541,6 +541,7 @@ void ruleset_free(struct route_ruleset *ruleset_start)
 			FREE(rule, sizeof(struct route_rule));
 			rmemuse--;
 		}
+		ruleset_index_free(ruleset);
 		FREE(ruleset, sizeof(struct route_ruleset));
 		rmemuse--;
 	}
@@ -1890,6 +1891,8 @@ struct route_ruleset *ruleset_parse(void)
 	if (!ruleset_start) {
 		SPRINT(failure, "No ruleset defined.");
 	}
+	for (ruleset = ruleset_start; ruleset; ruleset = ruleset->next)
+		ruleset_compile(ruleset);
 	return(ruleset_start);
 
 	parse_error:
@@ -1940,7 +1943,8 @@ struct route_action *EndpointAppPBX::route(struct route_ruleset *ruleset)
 				couldbetrue,
 				condition,
 				dialing_required;
-	struct route_rule	*rule = ruleset->rule_first;
+	struct route_rule	*rule;
+	int			rule_index = -1;
 	struct route_cond	*cond;
 	struct route_action	*action = NULL;
 	unsigned long		comp_len;
@@ -1948,6 +1952,7 @@ struct route_action *EndpointAppPBX::route(struct route_ruleset *ruleset)
 	char			isdn_port[10];
 	char			*argv[11]; /* check also number of args below */
 	char			callerid[64], callerid2[64], redirid[64];
+	int			have_callerid = 0, have_callerid2 = 0, have_redirid = 0;
 	int			integer;
 	char			*string;
 	FILE			*tfp;
@@ -1971,12 +1976,12 @@ struct route_action *EndpointAppPBX::route(struct route_ruleset *ruleset)
 	/* reset timeout action */
 	e_match_to_action = NULL;
 
-	SCPY(callerid, numberrize_callerinfo(e_callerinfo.id, e_callerinfo.ntype, options.national, options.international));
-	SCPY(callerid2, numberrize_callerinfo(e_callerinfo.id2, e_callerinfo.ntype2, options.national, options.international));
-	SCPY(redirid, numberrize_callerinfo(e_redirinfo.id, e_redirinfo.ntype, options.national, options.international));
-	
+	/* select rules that may match the dialed number */
+	ruleset_candidates(ruleset, e_dialinginfo.id);
+	ruleset_remain(ruleset, &e_route_state, e_dialinginfo.id);
+
 	PDEBUG(DEBUG_ROUTE, "parsing ruleset '%s'\n", ruleset->name);
-	while(rule) {
+	while((rule = ruleset_next_rule(ruleset, &rule_index))) {
 		PDEBUG(DEBUG_ROUTE, "checking rule in line %d\n", rule->line);
 		match = 1; /* this rule matches */
 		dialing_required = 0;
@@ -2015,10 +2020,18 @@ struct route_action *EndpointAppPBX::route(struct route_ruleset *ruleset)
 				goto match_string;
 
 				case MATCH_CALLERID:
+				if (!have_callerid) {
+					SCPY(callerid, numberrize_callerinfo(e_callerinfo.id, e_callerinfo.ntype, options.national, options.international));
+					have_callerid = 1;
+				}
 				string = callerid;
 				goto match_string_prefix;
 
 				case MATCH_CALLERID2:
+				if (!have_callerid2) {
+					SCPY(callerid2, numberrize_callerinfo(e_callerinfo.id2, e_callerinfo.ntype2, options.national, options.international));
+					have_callerid2 = 1;
+				}
 				string = callerid2;
 				goto match_string_prefix;
 
@@ -2081,6 +2094,10 @@ struct route_action *EndpointAppPBX::route(struct route_ruleset *ruleset)
 				break;
 
 				case MATCH_REDIRID:
+				if (!have_redirid) {
+					SCPY(redirid, numberrize_callerinfo(e_redirinfo.id, e_redirinfo.ntype, options.national, options.international));
+					have_redirid = 1;
+				}
 				string = redirid;
 				goto match_string_prefix;
 
@@ -2458,6 +2475,9 @@ struct route_action *EndpointAppPBX::route(struct route_ruleset *ruleset)
 					cond = cond->next;
 					goto checkextension;
 				}
+				/* no need to check it again while dialing */
+				if (!condition && cond->match == MATCH_DIALING)
+					e_route_state->remain[rule_index >> 6] &= ~(1ULL << (rule_index & 63));
 				match = condition;
 				break;
 			}
@@ -2489,7 +2509,6 @@ struct route_action *EndpointAppPBX::route(struct route_ruleset *ruleset)
 			/* rule could match if more is dialed */
 			couldmatch = 1;
 		}
-		rule = rule->next;
 	}
 	if (match_timeout == 0)
 		unsched_timer(&e_match_timeout); /* no timeout */
@@ -237,12 +237,38 @@ struct route_rule { /* a rule has a list of items and actions */
 //	int			temp_couldmatch;	/* stores, if the dialing could match. this is used to make a list of rules, that could match */
 };
 
+struct route_trie { /* node of prefix tree of dialing values */
+	struct route_trie	*child;			/* first node of next character */
+	struct route_trie	*sibling;		/* next node with same parent */
+	char			c;			/* character of this node */
+	int			rule_begin;		/* rules with a value ending at this node (index of trie_rules) */
+	int			rule_end;		/* end of these rules, begin of rules below this node */
+	int			sub_end;		/* end of rules below this node */
+};
+
 struct route_ruleset { /* the ruleset is a list of rules */
 	struct route_ruleset	*next;			/* next item */
 	char			file[128];		/* filename */
 	int			line;			/* line parsed from */
 	char			name[64];		/* name of ruleset */
 	struct route_rule	*rule_first;		/* linke to rule list */
+
+	/* lookup of rules by dialed number, see ruleset_compile() */
+	unsigned int		serial;			/* changes when rules are parsed again */
+	int			rule_count;		/* number of rules */
+	struct route_rule	**rule_table;		/* rules by number */
+	struct route_trie	*trie;			/* prefix tree of dialing values */
+	int			*trie_rules;		/* rule numbers, referenced by tree nodes */
+	unsigned long long	*always;		/* bitmap of rules that are always checked */
+	unsigned long long	*candidate;		/* bitmap of rules to check by route() */
+};
+
+struct route_state { /* rules that remain for a call, while more digits are dialed */
+	struct route_ruleset	*ruleset;		/* ruleset of the remaining rules */
+	unsigned int		serial;			/* serial of that ruleset */
+	char			dialing[256];		/* dialed number when rules were checked */
+	unsigned long long	*remain;		/* bitmap of rules that are not excluded by dialing */
+	int			words;			/* size of bitmap */
 };
 
 struct cond_defs { /* defintion of all conditions */
@@ -295,4 +321,11 @@ void ruleset_debug(struct route_ruleset *ruleset_start);
 extern char ruleset_error[256];
 struct route_ruleset *ruleset_parse(void);
 struct route_ruleset *getrulesetbyname(const char *name);
+/* route_index.c */
+void ruleset_compile(struct route_ruleset *ruleset);
+void ruleset_index_free(struct route_ruleset *ruleset);
+void ruleset_candidates(struct route_ruleset *ruleset, const char *dialing);
+struct route_rule *ruleset_next_rule(struct route_ruleset *ruleset, int *index);
+void ruleset_remain(struct route_ruleset *ruleset, struct route_state **statep, const char *dialing);
+void route_state_free(struct route_state *state);
 
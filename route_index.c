@@ -0,0 +1,286 @@
+/*****************************************************************************\
+**                                                                           **
+** Linux Call Router                                                         **
+**                                                                           **
+**---------------------------------------------------------------------------**
+** Copyright: Andreas Eversberg                                              **
+**                                                                           **
+** index of routing rules by dialed number                                   **
+**                                                                           **
+\*****************************************************************************/
+
+#include "main.h"
+
+/*
+ * compile ruleset for lookup by dialed number
+ *
+ * a rule that has a 'dialing' condition with string values can only match
+ * (or could match) if one of these values is a prefix of the dialed number,
+ * or if the dialed number is a prefix of one of them. all values are stored
+ * in a prefix tree, so route() only needs to check the rules found along the
+ * dialed number, the rules below it, and all rules that are not indexed.
+ * the order of rules is kept, because they are checked in order of their
+ * numbers.
+ */
+
+/* returns the first value of the rule's 'dialing' condition, if the rule can
+ * be indexed. this is the first 'dialing' condition of the rule, if it has
+ * string values only and no condition with side effects is checked before.
+ */
+static struct route_cond *rule_dialing_cond(struct route_rule *rule)
+{
+	struct route_cond *cond = rule->cond_first, *value;
+
+	while(cond) {
+		if (cond->match == MATCH_EXECUTE || cond->match == MATCH_FILE)
+			return(NULL);
+		if (cond->match == MATCH_DIALING) {
+			value = cond;
+			while(1) {
+				if (value->value_type != VALUE_TYPE_STRING)
+					return(NULL);
+				if (!value->value_extension || !value->next)
+					break;
+				value = value->next;
+			}
+			return(cond);
+		}
+		/* skip other values of this condition */
+		while(cond->value_extension && cond->next)
+			cond = cond->next;
+		cond = cond->next;
+	}
+	return(NULL);
+}
+
+/* get node of given value, create it if required */
+static struct route_trie *trie_node(struct route_trie *node, const char *value, int create)
+{
+	struct route_trie **nodep;
+
+	while(*value) {
+		nodep = &node->child;
+		while(*nodep && (*nodep)->c != *value)
+			nodep = &((*nodep)->sibling);
+		if (!*nodep) {
+			if (!create)
+				return(NULL);
+			*nodep = (struct route_trie *)MALLOC(sizeof(struct route_trie));
+			rmemuse++;
+			(*nodep)->c = *value;
+		}
+		node = *nodep;
+		value++;
+	}
+	return(node);
+}
+
+/* give each node its range of trie_rules, rule_end holds the number of rules
+ * of a node and is used as fill position afterwards */
+static int trie_layout(struct route_trie *node, int pos)
+{
+	struct route_trie *child;
+	int count = node->rule_end;
+
+	node->rule_begin = node->rule_end = pos;
+	pos += count;
+	for (child = node->child; child; child = child->sibling)
+		pos = trie_layout(child, pos);
+	node->sub_end = pos;
+	return(pos);
+}
+
+static void trie_free(struct route_trie *node)
+{
+	struct route_trie *child;
+
+	while((child = node->child)) {
+		node->child = child->sibling;
+		trie_free(child);
+	}
+	FREE(node, sizeof(struct route_trie));
+	rmemuse--;
+}
+
+void ruleset_compile(struct route_ruleset *ruleset)
+{
+	static unsigned int serial = 0;
+	struct route_rule *rule;
+	struct route_cond *cond;
+	int i, words, values = 0, indexed = 0;
+
+	ruleset->serial = ++serial;
+
+	for (rule = ruleset->rule_first; rule; rule = rule->next)
+		ruleset->rule_count++;
+	words = (ruleset->rule_count + 63) / 64 + 1;
+	ruleset->rule_table = (struct route_rule **)MALLOC(sizeof(struct route_rule *) * (ruleset->rule_count + 1));
+	rmemuse++;
+	ruleset->always = (unsigned long long *)MALLOC(sizeof(unsigned long long) * words);
+	rmemuse++;
+	ruleset->candidate = (unsigned long long *)MALLOC(sizeof(unsigned long long) * words);
+	rmemuse++;
+	ruleset->trie = (struct route_trie *)MALLOC(sizeof(struct route_trie));
+	rmemuse++;
+
+	/* build tree and count rules of each node */
+	for (i = 0, rule = ruleset->rule_first; rule; i++, rule = rule->next) {
+		ruleset->rule_table[i] = rule;
+		cond = rule_dialing_cond(rule);
+		if (!cond) {
+			ruleset->always[i >> 6] |= 1ULL << (i & 63);
+			continue;
+		}
+		indexed++;
+		while(1) {
+			trie_node(ruleset->trie, cond->string_value, 1)->rule_end++;
+			values++;
+			if (!cond->value_extension || !cond->next)
+				break;
+			cond = cond->next;
+		}
+	}
+
+	/* store rule numbers */
+	trie_layout(ruleset->trie, 0);
+	ruleset->trie_rules = (int *)MALLOC(sizeof(int) * (values + 1));
+	rmemuse++;
+	for (i = 0, rule = ruleset->rule_first; rule; i++, rule = rule->next) {
+		cond = rule_dialing_cond(rule);
+		if (!cond)
+			continue;
+		while(1) {
+			ruleset->trie_rules[trie_node(ruleset->trie, cond->string_value, 0)->rule_end++] = i;
+			if (!cond->value_extension || !cond->next)
+				break;
+			cond = cond->next;
+		}
+	}
+
+	PDEBUG(DEBUG_ROUTE, "ruleset '%s' has %d rules, %d of them are indexed by dialing.\n", ruleset->name, ruleset->rule_count, indexed);
+}
+
+/* select the rules that route() must check for the given dialed number */
+void ruleset_candidates(struct route_ruleset *ruleset, const char *dialing)
+{
+	struct route_trie *node = ruleset->trie;
+	unsigned long long *candidate = ruleset->candidate;
+	int *trie_rules = ruleset->trie_rules;
+	int i, end;
+
+	memcpy(candidate, ruleset->always, sizeof(unsigned long long) * ((ruleset->rule_count + 63) / 64 + 1));
+
+	/* rules with values that are a prefix of the dialed number */
+	while(1) {
+		for (i = node->rule_begin; i < node->rule_end; i++)
+			candidate[trie_rules[i] >> 6] |= 1ULL << (trie_rules[i] & 63);
+		if (!*dialing)
+			break;
+		for (node = node->child; node && node->c != *dialing; node = node->sibling)
+			;
+		if (!node)
+			return;
+		dialing++;
+	}
+
+	/* rules with values that start with the dialed number. if these are
+	 * many (only few digits dialed), it is faster to check all rules */
+	end = node->sub_end;
+	if (end - node->rule_end > ruleset->rule_count / 4) {
+		memset(candidate, 0xff, sizeof(unsigned long long) * ((ruleset->rule_count + 63) / 64));
+		return;
+	}
+	for (i = node->rule_end; i < end; i++)
+		candidate[trie_rules[i] >> 6] |= 1ULL << (trie_rules[i] & 63);
+}
+
+/*
+ * during overlap dialing, route() is called for every digit. a rule that is
+ * false because of a 'dialing' condition stays false when more digits are
+ * dialed, so it is excluded from the call's state. as long as the dialed
+ * number only grows, route() only checks rules that remain.
+ */
+void ruleset_remain(struct route_ruleset *ruleset, struct route_state **statep, const char *dialing)
+{
+	struct route_state *state = *statep;
+	int i, words = (ruleset->rule_count + 63) / 64 + 1;
+
+	if (!state) {
+		state = *statep = (struct route_state *)MALLOC(sizeof(struct route_state));
+		rmemuse++;
+	}
+	if (state->ruleset == ruleset && state->serial == ruleset->serial
+	 && !strncmp(dialing, state->dialing, strlen(state->dialing))) {
+		for (i = 0; i < words; i++)
+			ruleset->candidate[i] &= state->remain[i];
+	} else {
+		/* different ruleset, rules were parsed again, or dialing was changed */
+		if (state->words < words) {
+			if (state->remain) {
+				FREE(state->remain, 0);
+				rmemuse--;
+			}
+			state->remain = (unsigned long long *)MALLOC(sizeof(unsigned long long) * words);
+			rmemuse++;
+			state->words = words;
+		}
+		memset(state->remain, 0xff, sizeof(unsigned long long) * words);
+		state->ruleset = ruleset;
+		state->serial = ruleset->serial;
+	}
+	SCPY(state->dialing, dialing);
+}
+
+void route_state_free(struct route_state *state)
+{
+	if (!state)
+		return;
+	if (state->remain) {
+		FREE(state->remain, 0);
+		rmemuse--;
+	}
+	FREE(state, sizeof(struct route_state));
+	rmemuse--;
+}
+
+/* get next rule selected by ruleset_candidates(), start with index -1 */
+struct route_rule *ruleset_next_rule(struct route_ruleset *ruleset, int *index)
+{
+	unsigned long long bits;
+	int i = *index + 1;
+
+	while(i < ruleset->rule_count) {
+		bits = ruleset->candidate[i >> 6] >> (i & 63);
+		if (bits) {
+			i += __builtin_ctzll(bits);
+			*index = i;
+			return(ruleset->rule_table[i]);
+		}
+		i = ((i >> 6) + 1) << 6;
+	}
+	return(NULL);
+}
+
+/* free what ruleset_compile() allocated */
+void ruleset_index_free(struct route_ruleset *ruleset)
+{
+	if (ruleset->rule_table) {
+		FREE(ruleset->rule_table, 0);
+		rmemuse--;
+	}
+	if (ruleset->always) {
+		FREE(ruleset->always, 0);
+		rmemuse--;
+	}
+	if (ruleset->candidate) {
+		FREE(ruleset->candidate, 0);
+		rmemuse--;
+	}
+	if (ruleset->trie) {
+		trie_free(ruleset->trie);
+	}
+	if (ruleset->trie_rules) {
+		FREE(ruleset->trie_rules, 0);
+		rmemuse--;
+	}
+}
@@ -6,19 +6,62 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <time.h>
 #include <sys/time.h>
+#ifdef WITH_EPOLL
+#include <sys/epoll.h>
+#endif
 #include "macro.h"
 #include "select.h"
 
+#ifdef WITH_EPOLL
+/* maximum number of events that are dispatched with one wakeup */
+#define EPOLL_EVENTS	64
+
+static int epoll_fd = -1;
+static struct epoll_event pending_event[EPOLL_EVENTS]; /* events of current wakeup */
+static int pending_num = 0; /* number of events not dispatched yet */
+#else
 static int maxfd = 0;
 static int unregistered;
 static struct lcr_fd *fd_first = NULL;
+#endif
+static void update_time(void);
 static struct timeval *nearest_timer(struct timeval *select_timer, int *work);
 static int next_work(void);
 
+#ifdef WITH_EPOLL
+static unsigned int epoll_events(int when)
+{
+	unsigned int events = 0;
+
+	if (when & LCR_FD_READ)
+		events |= EPOLLIN;
+	if (when & LCR_FD_WRITE)
+		events |= EPOLLOUT;
+	if (when & LCR_FD_EXCEPT)
+		events |= EPOLLPRI;
+
+	return events;
+}
+
+static void epoll_open(void)
+{
+	if (epoll_fd >= 0)
+		return;
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd < 0)
+		FATAL("Failed to create epoll instance (errno = %d)\n", errno);
+}
+#endif
+
 int _register_fd(struct lcr_fd *fd, int when, int (*cb)(struct lcr_fd *fd, unsigned int what, void *instance, int index), void *instance, int index, const char *func)
 {
 	int flags;
+#ifdef WITH_EPOLL
+	struct epoll_event event;
+#endif
 
 	if (fd->inuse)
 		FATAL("FD that is registered in function %s is already in use\n", func);
@@ -33,24 +76,54 @@ int _register_fd(struct lcr_fd *fd, int when, int (*cb)(struct lcr_fd *fd, unsig
 	if (flags < 0)
 		FATAL("Failed to F_SETFL O_NONBLOCK\n");
 
-	/* Register FD */
-	if (fd->fd > maxfd)
-		maxfd = fd->fd;
-
-	/* append to list */
 	fd->inuse = 1;
 	fd->when = when;
 	fd->cb = cb;
 	fd->cb_instance = instance;
 	fd->cb_index = index;
+
+#ifdef WITH_EPOLL
+	/* add to epoll set, the fd itself points to our structure */
+	epoll_open();
+	memset(&event, 0, sizeof(event));
+	event.events = epoll_events(when);
+	event.data.ptr = fd;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd->fd, &event) < 0)
+		FATAL("FD that is registered in function %s cannot be added to epoll set (errno = %d)\n", func, errno);
+#else
+	/* Register FD */
+	if (fd->fd > maxfd)
+		maxfd = fd->fd;
+
+	/* append to list */
 	fd->next = fd_first;
 	fd_first = fd;
+#endif
 
 	return 0;
 }
 
 void _unregister_fd(struct lcr_fd *fd, const char *func)
 {
+#ifdef WITH_EPOLL
+	int i;
+
+	if (!fd->inuse) {
+		FATAL("FD unregistered in function %s not in use\n", func);
+	}
+
+	/* remove from epoll set, the kernel did it already if the fd was closed */
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd->fd, NULL) < 0 && errno != EBADF)
+		FATAL("FD unregistered in function %s cannot be removed from epoll set (errno = %d)\n", func, errno);
+
+	/* forget events of this wakeup that are not dispatched yet */
+	for (i = 0; i < pending_num; i++) {
+		if (pending_event[i].data.ptr == fd)
+			pending_event[i].data.ptr = NULL;
+	}
+
+	fd->inuse = 0;
+#else
 	struct lcr_fd **lcr_fdp;
 
 	/* find pointer to fd */
@@ -68,13 +141,40 @@ void _unregister_fd(struct lcr_fd *fd, const char *func)
 	fd->inuse = 0;
 	*lcr_fdp = fd->next;
 	unregistered = 1;
+#endif
 }
 
+/* change the events to select on */
+void _update_fd(struct lcr_fd *fd, int when, const char *func)
+{
+#ifdef WITH_EPOLL
+	struct epoll_event event;
+#endif
+
+	if (fd->when == when)
+		return;
+	fd->when = when;
+
+#ifdef WITH_EPOLL
+	/* may be called before registration, e.g. when queueing to a closed socket */
+	if (!fd->inuse)
+		return;
+	memset(&event, 0, sizeof(event));
+	event.events = epoll_events(when);
+	event.data.ptr = fd;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd->fd, &event) < 0)
+		FATAL("FD that is updated in function %s cannot be modified in epoll set (errno = %d)\n", func, errno);
+#endif
+}
 
 int select_main(int polling, int *global_change, void (*lock)(void), void (*unlock)(void))
 {
 	struct lcr_fd *lcr_fd;
+#ifdef WITH_EPOLL
+	int timeout, i;
+#else
 	fd_set readset, writeset, exceptset;
+#endif
 	int work = 0, temp, rc;
 	struct timeval no_time = {0, 0};
 	struct timeval select_timer, *timer;
@@ -108,6 +208,57 @@ again:
 //	if (!timer)
 //		printf("wait till infinity ..."); fflush(stdout);
 
+#ifdef WITH_EPOLL
+	/* round up, so we do not wake up before the timer expires */
+	if (timer)
+		timeout = timer->tv_sec * 1000 + (timer->tv_usec + 999) / 1000;
+	else
+		timeout = -1;
+
+	epoll_open();
+	if (unlock)
+		unlock();
+	rc = epoll_wait(epoll_fd, pending_event, EPOLL_EVENTS, timeout);
+	if (lock)
+		lock();
+	update_time();
+	if (rc < 0)
+		return 0;
+	if (global_change && *global_change) {
+		*global_change = 0;
+		return 1;
+	}
+
+	/* call registered callback functions of all ready fds */
+	pending_num = rc;
+	for (i = 0; i < pending_num; i++) {
+		int flags = 0;
+
+		/* fd was unregistered by a previous callback */
+		lcr_fd = (struct lcr_fd *)pending_event[i].data.ptr;
+		if (!lcr_fd)
+			continue;
+
+		if ((pending_event[i].events & EPOLLIN))
+			flags |= LCR_FD_READ;
+		if ((pending_event[i].events & EPOLLOUT))
+			flags |= LCR_FD_WRITE;
+		if ((pending_event[i].events & EPOLLPRI))
+			flags |= LCR_FD_EXCEPT;
+		/* select reports errors and hangup as readable and writable */
+		if ((pending_event[i].events & (EPOLLERR | EPOLLHUP)))
+			flags |= LCR_FD_READ | LCR_FD_WRITE;
+		/* a previous callback may have changed what we select on */
+		flags &= lcr_fd->when;
+		if (flags) {
+			work = 1;
+			lcr_fd->cb(lcr_fd, flags, lcr_fd->cb_instance, lcr_fd->cb_index);
+		}
+	}
+	pending_num = 0;
+
+	return work;
+#else
 	FD_ZERO(&readset);
 	FD_ZERO(&writeset);
 	FD_ZERO(&exceptset);
@@ -129,6 +280,7 @@ again:
 	rc = select(maxfd+1, &readset, &writeset, &exceptset, timer);
 	if (lock)
 		lock();
+	update_time();
 //#warning TESTING
 //	if (!timer)
 //		printf("interrupted.\n");
@@ -173,10 +325,153 @@ restart:
 		lcr_fd = lcr_fd->next;
 	}
 	return work;
+#endif
 }
 
 
-static struct lcr_timer *timer_first = NULL;
+/*
+ * Timers are kept in a hierarchical timer wheel, so scheduling and
+ * unscheduling does not depend on the number of timers.
+ *
+ * The first level has one slot for each tick of the next 256 ticks. Each
+ * further level has 64 slots, each slot covering the whole range of the level
+ * below. Whenever a level wraps, the next slot of the level above is cascaded
+ * down. Timers that expire before the next tick are kept in a separate list.
+ */
+#define TIMER_TICK	1000 /* microseconds per tick */
+#define WHEEL_LEVELS	5
+#define WHEEL_BITS0	8
+#define WHEEL_BITS	6
+#define WHEEL_SIZE0	(1 << WHEEL_BITS0)
+#define WHEEL_SIZE	(1 << WHEEL_BITS)
+#define WHEEL_SLOTS	(WHEEL_SIZE0 + (WHEEL_LEVELS - 1) * WHEEL_SIZE)
+#define WHEEL_BASE(level) ((level) ? WHEEL_SIZE0 + ((level) - 1) * WHEEL_SIZE : 0)
+#define WHEEL_SHIFT(level) ((level) ? WHEEL_BITS0 + ((level) - 1) * WHEEL_BITS : 0)
+#define WHEEL_MASK(level) ((level) ? WHEEL_SIZE - 1 : WHEEL_SIZE0 - 1)
+
+static struct lcr_timer *wheel_slot[WHEEL_SLOTS];
+static unsigned long long wheel_map[WHEEL_SLOTS / 64]; /* bit is set for each slot in use */
+static unsigned long long wheel_tick = 0; /* next tick to process */
+static struct lcr_timer *timer_expired = NULL; /* timers to fire with next pass */
+static unsigned long long timer_now = 0; /* time of current pass */
+
+/* read monotonic clock, this is done once every pass of select_main() */
+static void update_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	timer_now = ts.tv_sec * MICRO_SECONDS + ts.tv_nsec / 1000;
+	if (!wheel_tick)
+		wheel_tick = timer_now / TIMER_TICK;
+}
+
+void get_monotonic(struct timeval *tv)
+{
+	if (!timer_now)
+		update_time();
+	tv->tv_sec = timer_now / MICRO_SECONDS;
+	tv->tv_usec = timer_now % MICRO_SECONDS;
+}
+
+static void timer_link(struct lcr_timer **head, struct lcr_timer *timer)
+{
+	int slot;
+
+	timer->next = *head;
+	if (timer->next)
+		timer->next->pprev = &timer->next;
+	timer->pprev = head;
+	*head = timer;
+
+	if (head >= wheel_slot && head < wheel_slot + WHEEL_SLOTS) {
+		slot = head - wheel_slot;
+		wheel_map[slot / 64] |= 1ULL << (slot % 64);
+	}
+}
+
+static void timer_unlink(struct lcr_timer *timer)
+{
+	struct lcr_timer **pprev = timer->pprev;
+	int slot;
+
+	*pprev = timer->next;
+	if (timer->next)
+		timer->next->pprev = pprev;
+	timer->next = NULL;
+	timer->pprev = NULL;
+
+	/* slot became empty */
+	if (!*pprev && pprev >= wheel_slot && pprev < wheel_slot + WHEEL_SLOTS) {
+		slot = pprev - wheel_slot;
+		wheel_map[slot / 64] &= ~(1ULL << (slot % 64));
+	}
+}
+
+/* put timer into the slot where it expires */
+static void wheel_insert(struct lcr_timer *timer)
+{
+	unsigned long long timeout, expires, delta;
+	int level;
+
+	timeout = timer->timeout.tv_sec * MICRO_SECONDS + timer->timeout.tv_usec;
+	expires = (timeout + TIMER_TICK - 1) / TIMER_TICK;
+	if (timeout <= timer_now || expires < wheel_tick) {
+		timer_link(&timer_expired, timer);
+		return;
+	}
+
+	delta = expires - wheel_tick;
+	for (level = 0; level < WHEEL_LEVELS - 1; level++) {
+		if (delta < (1ULL << (WHEEL_SHIFT(level + 1))))
+			break;
+	}
+	/* beyond the range of the wheel, it will be cascaded again */
+	if (delta >= (1ULL << WHEEL_SHIFT(level + 1)))
+		expires = wheel_tick + (1ULL << WHEEL_SHIFT(level + 1)) - 1;
+	timer_link(&wheel_slot[WHEEL_BASE(level) + ((expires >> WHEEL_SHIFT(level)) & WHEEL_MASK(level))], timer);
+}
+
+/* move timers of the current slot of given level to the levels below */
+static int wheel_cascade(int level)
+{
+	struct lcr_timer *timer, *list;
+	int index;
+
+	index = (wheel_tick >> WHEEL_SHIFT(level)) & WHEEL_MASK(level);
+	list = wheel_slot[WHEEL_BASE(level) + index];
+	if (list) {
+		list->pprev = &list;
+		wheel_slot[WHEEL_BASE(level) + index] = NULL;
+		wheel_map[(WHEEL_BASE(level) + index) / 64] &= ~(1ULL << ((WHEEL_BASE(level) + index) % 64));
+	}
+	while ((timer = list)) {
+		timer_unlink(timer);
+		wheel_insert(timer);
+	}
+
+	return index;
+}
+
+/* find the next slot in use of given level, starting at given index */
+static int wheel_find(int level, int index)
+{
+	int size = WHEEL_MASK(level) + 1, offset, slot, bit;
+	unsigned long long map;
+
+	for (offset = 0; offset < size; offset += 64 - slot % 64) {
+		slot = WHEEL_BASE(level) + ((index + offset) & WHEEL_MASK(level));
+		map = wheel_map[slot / 64] >> (slot % 64);
+		if (map) {
+			bit = __builtin_ctzll(map);
+			if (offset + bit < size)
+				return offset + bit;
+			break;
+		}
+	}
+
+	return -1;
+}
 
 int _add_timer(struct lcr_timer *timer, int (*cb)(struct lcr_timer *timer, void *instance, int index), void *instance, int index, const char *func)
 {
@@ -184,15 +479,6 @@ int _add_timer(struct lcr_timer *timer, int (*cb)(struct lcr_timer *timer, void
 		FATAL("timer that is registered in function %s is already in use\n", func);
 	}
 
-#if 0
-	struct lcr_timer *test = timer_first;
-	while(test) {
-		if (test == timer)
-			FATAL("Timer already in list %s\n", func);
-		test = test->next;
-	}
-#endif
-
 	timer->inuse = 1;
 	timer->active = 0;
 	timer->timeout.tv_sec = 0;
@@ -200,93 +486,151 @@ int _add_timer(struct lcr_timer *timer, int (*cb)(struct lcr_timer *timer, void
 	timer->cb = cb;
 	timer->cb_instance = instance;
 	timer->cb_index = index;
-	timer->next = timer_first;
-	timer_first = timer;
+	timer->next = NULL;
+	timer->pprev = NULL;
 
 	return 0;
 }
 
 void _del_timer(struct lcr_timer *timer, const char *func)
 {
-	struct lcr_timer **lcr_timerp;
-
-	/* find pointer to timer */
-	lcr_timerp = &timer_first;
-	while(*lcr_timerp) {
-		if (*lcr_timerp == timer)
-			break;
-		lcr_timerp = &((*lcr_timerp)->next);
-	}
-	if (!*lcr_timerp) {
-		FATAL("timer deleted in function %s not in list\n", func);
+	if (!timer->inuse) {
+		FATAL("timer deleted in function %s not in use\n", func);
 	}
 
-	/* remove timer from list */
+	if (timer->active)
+		timer_unlink(timer);
+	timer->active = 0;
 	timer->inuse = 0;
-	*lcr_timerp = timer->next;
 }
 
 void schedule_timer(struct lcr_timer *timer, int seconds, int microseconds)
 {
-	struct timeval current_time;
+	unsigned long long timeout;
 
 	if (!timer->inuse) {
 		FATAL("Timer not added\n");
 	}
 
-	gettimeofday(&current_time, NULL);
-	unsigned long long currentTime = current_time.tv_sec * MICRO_SECONDS + current_time.tv_usec;
-	currentTime += seconds * MICRO_SECONDS + microseconds;
-	timer->timeout.tv_sec = currentTime / MICRO_SECONDS;
-	timer->timeout.tv_usec = currentTime % MICRO_SECONDS;
+	if (!timer_now)
+		update_time();
+	timeout = timer_now + seconds * MICRO_SECONDS + microseconds;
+	timer->timeout.tv_sec = timeout / MICRO_SECONDS;
+	timer->timeout.tv_usec = timeout % MICRO_SECONDS;
+	if (timer->active)
+		timer_unlink(timer);
 	timer->active = 1;
+	wheel_insert(timer);
+}
+
+/* schedule relative to the last timeout, so periodic timers do not drift */
+void schedule_timer_next(struct lcr_timer *timer, int seconds, int microseconds)
+{
+	unsigned long long timeout;
+
+	if (!timer->inuse) {
+		FATAL("Timer not added\n");
+	}
+
+	timeout = timer->timeout.tv_sec * MICRO_SECONDS + timer->timeout.tv_usec;
+	timeout += seconds * MICRO_SECONDS + microseconds;
+	timer->timeout.tv_sec = timeout / MICRO_SECONDS;
+	timer->timeout.tv_usec = timeout % MICRO_SECONDS;
+	if (timer->active)
+		timer_unlink(timer);
+	timer->active = 1;
+	wheel_insert(timer);
 }
 
 void unsched_timer(struct lcr_timer *timer)
 {
+	if (timer->active)
+		timer_unlink(timer);
 	timer->active = 0;
 }
 
-/* if a timeout is reached, process timer, if not, return timer value for select */
+/* process all timers that reached their timeout, then return timer value for select */
 static struct timeval *nearest_timer(struct timeval *select_timer, int *work)
 {
-	struct timeval current;
-	struct timeval *nearest = NULL;
-	struct lcr_timer *lcr_timer, *lcr_nearest = NULL;
-
-	/* find nearest timer, or NULL, if no timer active */
-	lcr_timer = timer_first;
-	while(lcr_timer) {
-		if (lcr_timer->active && (!nearest || TIME_SMALLER(&lcr_timer->timeout, nearest))) {
-			nearest = &lcr_timer->timeout;
-			lcr_nearest = lcr_timer;
+	struct lcr_timer *fire = NULL, **fire_tail = &fire, *timer;
+	unsigned long long now_tick, nearest, tick;
+	int level, index, offset;
+
+	update_time();
+	now_tick = timer_now / TIMER_TICK;
+
+	/* collect expired timers, ordered by tick */
+	while ((timer = timer_expired)) {
+		timer_unlink(timer);
+		timer_link(fire_tail, timer);
+		fire_tail = &timer->next;
+	}
+	while (wheel_tick <= now_tick) {
+		index = wheel_tick & WHEEL_MASK(0);
+		if (!index) {
+			for (level = 1; level < WHEEL_LEVELS; level++) {
+				if (wheel_cascade(level))
+					break;
+			}
+		}
+		/* skip empty slots of first level, but not beyond the point where it wraps */
+		offset = wheel_find(0, index);
+		if (offset < 0 || index + offset > WHEEL_SIZE0)
+			offset = WHEEL_SIZE0 - index;
+		if (offset) {
+			wheel_tick += offset;
+			continue;
+		}
+		while ((timer = wheel_slot[index])) {
+			timer_unlink(timer);
+			timer_link(fire_tail, timer);
+			fire_tail = &timer->next;
 		}
-		lcr_timer = lcr_timer->next;
+		wheel_tick++;
+	}
+	/* we may have skipped beyond now */
+	if (wheel_tick > now_tick + 1)
+		wheel_tick = now_tick + 1;
+
+	/* fire timers, a callback may unschedule timers that are not fired yet */
+	while ((timer = fire)) {
+		timer_unlink(timer);
+		timer->active = 0;
+		(*timer->cb)(timer, timer->cb_instance, timer->cb_index);
+		/* don't wait so we can process the queues, indicate "work=1" */
+		*work = 1;
 	}
 
 	select_timer->tv_sec = 0;
 	select_timer->tv_usec = 0;
 
+	if (*work || timer_expired)
+		return select_timer;
+
+	/* first level slots hold timers of the exact tick, further levels
+	 * are cascaded when the level below wraps */
+	nearest = 0;
+	offset = wheel_find(0, wheel_tick & WHEEL_MASK(0));
+	if (offset >= 0)
+		nearest = wheel_tick + offset;
+	for (level = 1; level < WHEEL_LEVELS; level++) {
+		tick = (wheel_tick + (1ULL << WHEEL_SHIFT(level)) - 1) >> WHEEL_SHIFT(level);
+		offset = wheel_find(level, tick & WHEEL_MASK(level));
+		if (offset < 0)
+			continue;
+		tick = (tick + offset) << WHEEL_SHIFT(level);
+		if (!nearest || tick < nearest)
+			nearest = tick;
+	}
+
 	if (!nearest)
 		return NULL; /* wait until infinity */
 
-	gettimeofday(&current, NULL);
-	unsigned long long nearestTime = nearest->tv_sec * MICRO_SECONDS + nearest->tv_usec;
-	unsigned long long currentTime = current.tv_sec * MICRO_SECONDS + current.tv_usec;
-
-	if (nearestTime > currentTime) {
-		select_timer->tv_sec = (nearestTime - currentTime) / MICRO_SECONDS;
-		select_timer->tv_usec = (nearestTime - currentTime) % MICRO_SECONDS;
-		return select_timer;
-	} else {
-		lcr_nearest->active = 0;
-		(*lcr_nearest->cb)(lcr_nearest, lcr_nearest->cb_instance, lcr_nearest->cb_index);
-		/* don't wait so we can process the queues, indicate "work=1" */
-		select_timer->tv_sec = 0;
-		select_timer->tv_usec = 0;
-		*work = 1;
-		return select_timer;
+	if (nearest * TIMER_TICK > timer_now) {
+		select_timer->tv_sec = (nearest * TIMER_TICK - timer_now) / MICRO_SECONDS;
+		select_timer->tv_usec = (nearest * TIMER_TICK - timer_now) % MICRO_SECONDS;
 	}
+	return select_timer;
 }
 
 
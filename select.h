@@ -12,7 +12,7 @@ struct lcr_fd {
 	struct lcr_fd	*next;	/* pointer to next element in list */
 	int		inuse;	/* if in use */
 	int		fd;	/* file descriptior if in use */
-	int		when;	/* select on what event */
+	int		when;	/* select on what event (change with update_fd) */
 	int		(*cb)(struct lcr_fd *fd, unsigned int what, void *instance, int index); /* callback */
 	void		*cb_instance;
 	int		cb_index;
@@ -22,14 +22,17 @@ struct lcr_fd {
 int _register_fd(struct lcr_fd *fd, int when, int (*cb)(struct lcr_fd *fd, unsigned int what, void *instance, int index), void *instance, int index, const char *func);
 #define unregister_fd(a) _unregister_fd(a, __func__);
 void _unregister_fd(struct lcr_fd *fd, const char *func);
+#define update_fd(a, b) _update_fd(a, b, __func__)
+void _update_fd(struct lcr_fd *fd, int when, const char *func);
 int select_main(int polling, int *global_change, void (*lock)(void), void (*unlock)(void));
 
 
 struct lcr_timer {
-	struct lcr_timer *next;	/* pointer to next element in list */
+	struct lcr_timer *next;	/* pointer to next element in timer wheel slot */
+	struct lcr_timer **pprev; /* pointer to the pointer that points to this element */
 	int		inuse;	/* if in use */
 	int		active;	/* if timer is currently active */
-	struct timeval	timeout; /* timestamp when to timeout */
+	struct timeval	timeout; /* timestamp when to timeout (monotonic clock) */
 	int		(*cb)(struct lcr_timer *timer, void *instance, int index); /* callback */
 	void		*cb_instance;
 	int		cb_index;
@@ -40,7 +43,9 @@ int _add_timer(struct lcr_timer *timer, int (*cb)(struct lcr_timer *timer, void
 #define del_timer(a) _del_timer(a, __func__);
 void _del_timer(struct lcr_timer *timer, const char *func);
 void schedule_timer(struct lcr_timer *timer, int seconds, int microseconds);
+void schedule_timer_next(struct lcr_timer *timer, int seconds, int microseconds);
 void unsched_timer(struct lcr_timer *timer);
+void get_monotonic(struct timeval *tv);
 
 
 struct lcr_work {
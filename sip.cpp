@@ -10,10 +10,17 @@
 \*****************************************************************************/ 
 
 #include "main.h"
+#ifdef WITH_GSMFR
+extern "C" {
+#include "gsm_audio.h"
+}
+#endif
 #include <sofia-sip/sip_status.h>
 #include <sofia-sip/su_log.h>
 #include <sofia-sip/sdp.h>
 #include <sofia-sip/sip_header.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 
 #undef NUTAG_AUTO100
 
@@ -30,19 +37,40 @@ struct sip_inst {
 	char			remote_peer[32];
 	su_root_t		*root;
 	nua_t			*nua;
+	struct lcr_fd		root_fd;	/* file descriptor of root */
+	struct lcr_timer	root_timer;	/* next timer of root */
+	int			polling;	/* root_fd is unknown, so timer polls root */
 };
 
 static int delete_event(struct lcr_work *work, void *instance, int index);
 static int load_timer(struct lcr_timer *timer, void *instance, int index);
+static int jitter_timer(struct lcr_timer *timer, void *instance, int index);
+static int rtcp_timer(struct lcr_timer *timer, void *instance, int index);
+static void rtcp_decode(class Psip *psip, unsigned char *data, int len);
+static void rtp_codec_free(class Psip *psip);
 
 /*
  * initialize SIP port
  */
 Psip::Psip(int type, char *portname, struct port_settings *settings, struct interface *interface) : Port(type, portname, settings, interface)
 {
+	int i;
+
 	p_s_rtp_bridge = 0;
 	if (interface->rtp_bridge)
 		p_s_rtp_bridge = 1;
+	p_s_rtp_codecs = 0;
+	for (i = 0; i < interface->rtp_codecs; i++)
+		p_s_rtp_codec_types[p_s_rtp_codecs++] = interface->rtp_codec_types[i];
+	if (!p_s_rtp_codecs)
+		p_s_rtp_codec_types[p_s_rtp_codecs++] = (options.law=='a') ? MEDIA_TYPE_ALAW : MEDIA_TYPE_ULAW;
+	p_s_rtp_offers = 0;
+	memset(p_s_rtp_offer_types, 0, sizeof(p_s_rtp_offer_types));
+	memset(p_s_rtp_offer_payloads, 0, sizeof(p_s_rtp_offer_payloads));
+	p_s_rtp_media_type = 0;
+	p_s_rtp_payload_type = 0;
+	p_s_encoder = NULL;
+	p_s_decoder = NULL;
 	p_s_sip_inst = interface->sip_inst;
 	memset(&p_s_delete, 0, sizeof(p_s_delete));
 	add_work(&p_s_delete, delete_event, this, 0);
@@ -58,16 +86,34 @@ Psip::Psip(int type, char *portname, struct port_settings *settings, struct inte
 	p_s_rtp_ip_remote = 0;
 	p_s_rtp_port_local = 0;
 	p_s_rtp_port_remote = 0;
+	p_s_rtp_hashed = 0;
+	p_s_rtp_hash_next = NULL;
 	p_s_b_sock = -1;
 	p_s_b_index = -1;
 	p_s_b_active = 0;
 	p_s_rxpos = 0;
 	p_s_rtp_tx_action = 0;
+	p_s_rtp_tx_packets = 0;
+	p_s_rtp_tx_octets = 0;
+	memset(&p_s_rtcp_timer, 0, sizeof(p_s_rtcp_timer));
+	add_timer(&p_s_rtcp_timer, rtcp_timer, this, 0);
+	p_s_rtcp_expected_prior = 0;
+	p_s_rtcp_received_prior = 0;
+	p_s_rtcp_lsr = 0;
+	p_s_rtcp_reports = 0;
+	p_s_rtcp_rtt = -1;
+	p_s_rtcp_remote_fraction = 0;
+	p_s_rtcp_remote_lost = 0;
+	p_s_rtcp_remote_jitter = 0;
 
 	/* audio */
 	memset(&p_s_loadtimer, 0, sizeof(p_s_loadtimer));
 	add_timer(&p_s_loadtimer, load_timer, this, 0);
 	p_s_next_tv_sec = 0;
+	jitter_init(&p_s_jitter);
+	memset(&p_s_jitter_timer, 0, sizeof(p_s_jitter_timer));
+	add_timer(&p_s_jitter_timer, jitter_timer, this, 0);
+	p_s_jitter_idle = 0;
 
 	PDEBUG(DEBUG_SIP, "Created new Psip(%s).\n", portname);
 	if (!p_s_sip_inst)
@@ -83,9 +129,12 @@ Psip::~Psip()
 	PDEBUG(DEBUG_SIP, "Destroyed SIP process(%s).\n", p_name);
 
 	del_timer(&p_s_loadtimer);
+	del_timer(&p_s_jitter_timer);
 	del_work(&p_s_delete);
 
 	rtp_close();
+	del_timer(&p_s_rtcp_timer);
+	rtp_codec_free(this);
 }
 
 static const char *media_type2name(uint8_t media_type) {
@@ -157,6 +206,141 @@ struct rtp_x_hdr {
 #define PAYLOAD_TYPE_ALAW 8
 #define PAYLOAD_TYPE_GSM 3
 
+#define PAYLOAD_TYPE_EFR 96 /* dynamic payload type we offer for GSM-EFR */
+
+/* payload type we offer for a codec */
+static uint8_t rtp_codec_payload(int media_type)
+{
+	switch (media_type) {
+	case MEDIA_TYPE_ALAW:
+		return PAYLOAD_TYPE_ALAW;
+	case MEDIA_TYPE_ULAW:
+		return PAYLOAD_TYPE_ULAW;
+	case MEDIA_TYPE_GSM:
+		return PAYLOAD_TYPE_GSM;
+	}
+	return PAYLOAD_TYPE_EFR;
+}
+
+/* length of a coded 20 ms frame, 0 if the codec is law */
+static int rtp_frame_len(int media_type)
+{
+	switch (media_type) {
+	case MEDIA_TYPE_GSM:
+		return 33;
+	case MEDIA_TYPE_GSM_EFR:
+		return 31;
+	}
+	return 0;
+}
+
+static void rtp_codec_free(class Psip *psip)
+{
+	switch (psip->p_s_rtp_media_type) {
+#ifdef WITH_GSMFR
+	case MEDIA_TYPE_GSM:
+		if (psip->p_s_encoder)
+			gsm_fr_destroy(psip->p_s_encoder);
+		if (psip->p_s_decoder)
+			gsm_fr_destroy(psip->p_s_decoder);
+		break;
+#endif
+#ifdef WITH_GSMAMR
+	case MEDIA_TYPE_GSM_EFR:
+		if (psip->p_s_encoder)
+			gsm_amr_destroy(psip->p_s_encoder);
+		if (psip->p_s_decoder)
+			gsm_amr_destroy(psip->p_s_decoder);
+		break;
+#endif
+	}
+	psip->p_s_encoder = NULL;
+	psip->p_s_decoder = NULL;
+}
+
+/* select codec of own RTP, create transcoder for frames that are not relayed */
+void Psip::rtp_codec(int media_type, uint8_t payload_type)
+{
+	if (media_type != p_s_rtp_media_type) {
+		rtp_codec_free(this);
+		switch (media_type) {
+#ifdef WITH_GSMFR
+		case MEDIA_TYPE_GSM:
+			p_s_encoder = gsm_fr_create();
+			p_s_decoder = gsm_fr_create();
+			break;
+#endif
+#ifdef WITH_GSMAMR
+		case MEDIA_TYPE_GSM_EFR:
+			p_s_encoder = gsm_amr_create();
+			p_s_decoder = gsm_amr_create();
+			break;
+#endif
+		}
+		if (rtp_frame_len(media_type) && (!p_s_encoder || !p_s_decoder))
+			PERROR("Failed to create %s codec instance\n", media_type2name(media_type));
+	}
+	p_s_rtp_media_type = media_type;
+	p_s_rtp_payload_type = payload_type;
+}
+
+/* select codec for our answer, prefer the codec of the bridged port, so frames
+ * are relayed. if we answer early to send tones, we are not bridged yet and our
+ * first codec that is offered is used for the whole call. */
+void Psip::rtp_answer_codec(void)
+{
+	class Port *remote = bridge_remote();
+	int media_type = 0;
+	int i = 0;
+
+	if (p_s_rtp_media_type)
+		return; /* already answered */
+	if (!p_s_rtp_offers) {
+		/* no codec listed, because the invite was received for RTP bridging */
+		rtp_codec(p_s_rtp_codec_types[0], rtp_codec_payload(p_s_rtp_codec_types[0]));
+		return;
+	}
+	if (remote)
+		media_type = remote->bridge_media();
+	if (media_type) {
+		for (i = 0; i < p_s_rtp_offers; i++) {
+			if (p_s_rtp_offer_types[i] == media_type)
+				break;
+		}
+		if (i == p_s_rtp_offers)
+			i = 0;
+	}
+	rtp_codec(p_s_rtp_offer_types[i], p_s_rtp_offer_payloads[i]);
+}
+
+/* decode received frame to law samples */
+static int rtp_decode_frame(class Psip *psip, unsigned char *payload, unsigned char *data)
+{
+	int i;
+
+	if (!psip->p_s_decoder)
+		return -EINVAL;
+	switch (psip->p_s_rtp_media_type) {
+#ifdef WITH_GSMFR
+	case MEDIA_TYPE_GSM:
+		if (gsm_fr_decode(psip->p_s_decoder, payload, psip->p_s_samples))
+			return -EINVAL;
+		break;
+#endif
+#ifdef WITH_GSMAMR
+	case MEDIA_TYPE_GSM_EFR:
+		gsm_efr_decode(psip->p_s_decoder, payload, psip->p_s_samples);
+		break;
+#endif
+	default:
+		return -EINVAL;
+	}
+	for (i = 0; i < 160; i++)
+		data[i] = audio_s16_to_law[psip->p_s_samples[i] & 0xffff];
+
+	return 0;
+}
+
 /* decode an rtp frame  */
 static int rtp_decode(class Psip *psip, unsigned char *data, int len)
 {
@@ -167,6 +351,10 @@ static int rtp_decode(class Psip *psip, unsigned char *data, int len)
 	int x_len;
 	unsigned char *from, *to;
 	int n;
+	struct timeval current_time;
+	unsigned int arrival;
+	int frame_len = 0;
+	unsigned char data_law[160];
 
 	if (len < 12) {
 		PDEBUG(DEBUG_SIP, "received RTP frame too short (len = %d)\n", len);
@@ -214,33 +402,6 @@ static int rtp_decode(class Psip *psip, unsigned char *data, int len)
 	}
 
 	switch (rtph->payload_type) {
-#if 0
-we only support alaw and ulaw!
-	case RTP_PT_GSM_FULL:
-		if (payload_len != 33) {
-			PDEBUG(DEBUG_SIP, "received RTP full rate frame with "
-				"payload length != 33 (len = %d)\n",
-				payload_len);
-			return -EINVAL;
-		}
-		break;
-	case RTP_PT_GSM_EFR:
-		if (payload_len != 31) {
-			PDEBUG(DEBUG_SIP, "received RTP full rate frame with "
-				"payload length != 31 (len = %d)\n",
-				payload_len);
-			return -EINVAL;
-		}
-		break;
-	case RTP_PT_GSM_HALF:
-		if (payload_len != 14) {
-			PDEBUG(DEBUG_SIP, "received RTP half rate frame with "
-				"payload length != 14 (len = %d)\n",
-				payload_len);
-			return -EINVAL;
-		}
-		break;
-#endif
 	case PAYLOAD_TYPE_ALAW:
 		if (options.law != 'a') {
 			PDEBUG(DEBUG_SIP, "received Alaw, but we don't do Alaw\n");
@@ -254,9 +415,20 @@ we only support alaw and ulaw!
 		}
 		break;
 	default:
-		PDEBUG(DEBUG_SIP, "received RTP frame with unknown payload "
-			"type %d\n", rtph->payload_type);
-		return -EINVAL;
+		/* coded frames of the codec we selected */
+		if (rtph->payload_type == psip->p_s_rtp_payload_type)
+			frame_len = rtp_frame_len(psip->p_s_rtp_media_type);
+		if (!frame_len) {
+			PDEBUG(DEBUG_SIP, "received RTP frame with unknown payload "
+				"type %d\n", rtph->payload_type);
+			return -EINVAL;
+		}
+		if (payload_len != frame_len) {
+			PDEBUG(DEBUG_SIP, "received RTP %s frame with "
+				"payload length != %d (len = %d)\n",
+				media_type2name(psip->p_s_rtp_media_type), frame_len, payload_len);
+			return -EINVAL;
+		}
 	}
 
 	if (payload_len <= 0) {
@@ -264,23 +436,75 @@ we only support alaw and ulaw!
 		return 0;
 	}
 
+	get_monotonic(&current_time);
+	arrival = current_time.tv_sec * 8000 + current_time.tv_usec / 125;
+
+	if (frame_len) {
+		/* relay to remote port, if it uses the same codec, otherwise decode */
+		if (!psip->bridge_tx_frame(psip->p_s_rtp_media_type, payload, payload_len)) {
+			jitter_count(&psip->p_s_jitter, ntohs(rtph->sequence), ntohl(rtph->timestamp), ntohl(rtph->ssrc), arrival, 160);
+			return 0;
+		}
+		if (psip->p_echotest) {
+			psip->rtp_send_frame(payload, payload_len, psip->p_s_rtp_payload_type);
+			return 0;
+		}
+		if (rtp_decode_frame(psip, payload, data_law) < 0)
+			return 0;
+		payload = data_law;
+		payload_len = 160;
+	} else {
+		n = payload_len;
+		from = payload;
+		to = payload;
+		if (psip->p_echotest) {
+			/* echo rtp data we just received */
+			psip->rtp_send_frame(from, n, (options.law=='a')?PAYLOAD_TYPE_ALAW:PAYLOAD_TYPE_ULAW);
+			return 0;
+		}
+		while(n--)
+			*to++ = flip[*from++];
+	}
+
 	/* record audio */
 	if (psip->p_record)
 		psip->record(payload, payload_len, 0); // from down
 	if (psip->p_tap)
 		psip->tap(payload, payload_len, 0); // from down
 
-	n = payload_len;
-	from = payload;
-	to = payload;
-	if (psip->p_echotest) {
-		/* echo rtp data we just received */
-		psip->rtp_send_frame(from, n, (options.law=='a')?PAYLOAD_TYPE_ALAW:PAYLOAD_TYPE_ULAW);
-		return 0;
-	}
-	while(n--)
-		*to++ = flip[*from++];
-	psip->bridge_tx(payload, payload_len);
+	/* put into jitter buffer, it is played by jitter_timer() */
+	jitter_put(&psip->p_s_jitter, ntohs(rtph->sequence), ntohl(rtph->timestamp), ntohl(rtph->ssrc), arrival, payload, payload_len);
+	psip->p_s_jitter_idle = 0;
+	/* start on the 20 ms grid, so the frames of all calls are processed together */
+	if (!psip->p_s_jitter_timer.active)
+		schedule_timer(&psip->p_s_jitter_timer, 0, 20000 - current_time.tv_usec % 20000);
+
+	return 0;
+}
+
+#define JITTER_IDLE	50 /* frames without audio, until the jitter timer stops */
+
+/* play one frame from jitter buffer every 20 ms */
+static int jitter_timer(struct lcr_timer *timer, void *instance, int index)
+{
+	class Psip *psip = (class Psip *)instance;
+	unsigned char frame[JITTER_FRAME];
+	struct timeval current_time;
+	long long late;
+
+	if (jitter_get(&psip->p_s_jitter, frame))
+		psip->bridge_tx(frame, JITTER_FRAME);
+	else if (++psip->p_s_jitter_idle == JITTER_IDLE)
+		return 0; /* stop until next packet is received */
+
+	/* schedule exactly 20ms from last schedule, unless we are far behind */
+	get_monotonic(&current_time);
+	late = (current_time.tv_sec - timer->timeout.tv_sec) * MICRO_SECONDS + current_time.tv_usec - timer->timeout.tv_usec;
+	if (late >= 100000) {
+		psip->p_s_jitter.resync++;
+		schedule_timer(timer, 0, 20000 - current_time.tv_usec % 20000);
+	} else
+		schedule_timer_next(timer, 0, 20000); /* 20 MS */
 
 	return 0;
 }
@@ -309,7 +533,7 @@ static int rtp_sock_callback(struct lcr_fd *fd, unsigned int what, void *instanc
 
 static int rtcp_sock_callback(struct lcr_fd *fd, unsigned int what, void *instance, int index)
 {
-//	class Psip *psip = (class Psip *) instance;
+	class Psip *psip = (class Psip *) instance;
 	int len;
 	unsigned char buffer[256];
 
@@ -321,12 +545,482 @@ static int rtcp_sock_callback(struct lcr_fd *fd, unsigned int what, void *instan
 //			psip->rtp_shutdown();
 			return len;
 		}
-		PDEBUG(DEBUG_SIP, "rtcp!\n");
+		if (psip->p_s_rtp_is_connected)
+			rtcp_decode(psip, buffer, len);
+	}
+
+	return 0;
+}
+
+/*
+ * shared RTP port
+ *
+ * if rtp_shared_port is set, all calls use one RTP socket and one RTCP
+ * socket. received packets are assigned to the call by their source address,
+ * which is the remote address given by SDP. all packets that are waiting are
+ * received with one recvmmsg(). packets that are sent during one pass of the
+ * event loop are collected and sent with one sendmmsg(), when all timers
+ * and events were processed. since the jitter timers of all calls run on the
+ * same 20 ms grid, the frames of all calls are sent together.
+ */
+#define RTP_BATCH	64	/* packets received or sent with one system call */
+#define RTP_HASH	1024	/* must be a power of two */
+#define RTP_PACKET	256
+
+static struct lcr_fd rtp_shared_fd, rtcp_shared_fd;
+static class Psip *rtp_shared_hash[RTP_HASH];
+static struct lcr_work rtp_shared_work;
+static struct mmsghdr rtp_tx_msg[RTP_BATCH];
+static struct iovec rtp_tx_iov[RTP_BATCH];
+static struct sockaddr_in rtp_tx_sin[RTP_BATCH];
+static unsigned char rtp_tx_buffer[RTP_BATCH][RTP_PACKET];
+static int rtp_tx_num = 0;
+
+static unsigned int rtp_shared_index(uint32_t ip, uint16_t port)
+{
+	return (ip ^ (ip >> 16) ^ (port * 31)) & (RTP_HASH - 1);
+}
+
+/* find call by source address of a packet */
+static class Psip *rtp_shared_find(struct sockaddr_in *sin)
+{
+	class Psip *psip = rtp_shared_hash[rtp_shared_index(sin->sin_addr.s_addr, sin->sin_port)];
+
+	while (psip) {
+		if (psip->p_s_rtp_sin_remote.sin_addr.s_addr == sin->sin_addr.s_addr
+		 && psip->p_s_rtp_sin_remote.sin_port == sin->sin_port)
+			return psip;
+		psip = psip->p_s_rtp_hash_next;
+	}
+
+	return NULL;
+}
+
+static void rtp_shared_link(class Psip *psip)
+{
+	class Psip **psipp = &rtp_shared_hash[rtp_shared_index(psip->p_s_rtp_sin_remote.sin_addr.s_addr, psip->p_s_rtp_sin_remote.sin_port)];
+
+	if (rtp_shared_find(&psip->p_s_rtp_sin_remote))
+		PERROR("Remote RTP address is used by another call, packets are only received by the first call.\n");
+	/* append, so the first call keeps receiving */
+	while (*psipp)
+		psipp = &((*psipp)->p_s_rtp_hash_next);
+	psip->p_s_rtp_hash_next = NULL;
+	*psipp = psip;
+	psip->p_s_rtp_hashed = 1;
+}
+
+static void rtp_shared_unlink(class Psip *psip)
+{
+	class Psip **psipp = &rtp_shared_hash[rtp_shared_index(psip->p_s_rtp_sin_remote.sin_addr.s_addr, psip->p_s_rtp_sin_remote.sin_port)];
+
+	while (*psipp != psip)
+		psipp = &((*psipp)->p_s_rtp_hash_next);
+	*psipp = psip->p_s_rtp_hash_next;
+	psip->p_s_rtp_hashed = 0;
+}
+
+/* receive all packets that are waiting */
+static int rtp_shared_callback(struct lcr_fd *fd, unsigned int what, void *instance, int index)
+{
+	static struct mmsghdr msg[RTP_BATCH];
+	static struct iovec iov[RTP_BATCH];
+	static unsigned char buffer[RTP_BATCH][RTP_PACKET];
+	static struct sockaddr_in sin[RTP_BATCH];
+	class Psip *psip;
+	int num, i;
+
+	if (!(what & LCR_FD_READ))
+		return 0;
+
+	do {
+		for (i = 0; i < RTP_BATCH; i++) {
+			iov[i].iov_base = buffer[i];
+			iov[i].iov_len = RTP_PACKET;
+			memset(&msg[i].msg_hdr, 0, sizeof(msg[i].msg_hdr));
+			msg[i].msg_hdr.msg_name = &sin[i];
+			msg[i].msg_hdr.msg_namelen = sizeof(sin[i]);
+			msg[i].msg_hdr.msg_iov = &iov[i];
+			msg[i].msg_hdr.msg_iovlen = 1;
+		}
+		num = recvmmsg(fd->fd, msg, RTP_BATCH, MSG_DONTWAIT, NULL);
+		if (num <= 0)
+			break;
+		for (i = 0; i < num; i++) {
+			/* RTCP is sent from the port above RTP */
+			if (index)
+				sin[i].sin_port = htons(ntohs(sin[i].sin_port) - 1);
+			psip = rtp_shared_find(&sin[i]);
+			if (!psip || !psip->p_s_rtp_is_connected)
+				continue;
+			if (index)
+				rtcp_decode(psip, buffer[i], msg[i].msg_len);
+			else
+				rtp_decode(psip, buffer[i], msg[i].msg_len);
+		}
+	} while (num == RTP_BATCH);
+
+	return 0;
+}
+
+/* send all collected packets */
+static void rtp_shared_flush(void)
+{
+	int i = 0, rc;
+
+	while (i < rtp_tx_num) {
+		rc = sendmmsg(rtp_shared_fd.fd, rtp_tx_msg + i, rtp_tx_num - i, 0);
+		if (rc < 0 && errno == EINTR)
+			continue;
+		if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			PDEBUG(DEBUG_SIP, "RTP socket buffer is full, dropping %d packets\n", rtp_tx_num - i);
+			break;
+		}
+		if (rc <= 0) {
+			/* skip packet that cannot be sent */
+			PDEBUG(DEBUG_SIP, "sendmmsg failed (errno=%d)\n", errno);
+			rc = 1;
+		}
+		i += rc;
 	}
+	rtp_tx_num = 0;
+}
+
+static int rtp_shared_work_cb(struct lcr_work *work, void *instance, int index)
+{
+	rtp_shared_flush();
+
+	return 0;
+}
+
+/* collect packet, it is sent when the event loop has processed all events */
+static void rtp_shared_send(struct sockaddr_in *sin, unsigned char *data, int len)
+{
+	if (rtp_tx_num == RTP_BATCH)
+		rtp_shared_flush();
+	memcpy(rtp_tx_buffer[rtp_tx_num], data, len);
+	memcpy(&rtp_tx_sin[rtp_tx_num], sin, sizeof(*sin));
+	rtp_tx_iov[rtp_tx_num].iov_base = rtp_tx_buffer[rtp_tx_num];
+	rtp_tx_iov[rtp_tx_num].iov_len = len;
+	memset(&rtp_tx_msg[rtp_tx_num].msg_hdr, 0, sizeof(rtp_tx_msg[rtp_tx_num].msg_hdr));
+	rtp_tx_msg[rtp_tx_num].msg_hdr.msg_name = &rtp_tx_sin[rtp_tx_num];
+	rtp_tx_msg[rtp_tx_num].msg_hdr.msg_namelen = sizeof(*sin);
+	rtp_tx_msg[rtp_tx_num].msg_hdr.msg_iov = &rtp_tx_iov[rtp_tx_num];
+	rtp_tx_msg[rtp_tx_num].msg_hdr.msg_iovlen = 1;
+	rtp_tx_num++;
+	trigger_work(&rtp_shared_work);
+}
+
+static int rtp_shared_open(struct lcr_fd *fd, unsigned short port, int index)
+{
+	struct sockaddr_in sin;
+
+	fd->fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (fd->fd < 0)
+		return -EIO;
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_ANY);
+	sin.sin_port = htons(port);
+	if (bind(fd->fd, (struct sockaddr *) &sin, sizeof(sin)) < 0) {
+		PERROR("Failed to bind shared RTP port %d (errno=%d)\n", port, errno);
+		close(fd->fd);
+		fd->fd = -1;
+		return -EIO;
+	}
+	register_fd(fd, LCR_FD_READ, rtp_shared_callback, NULL, index);
 
 	return 0;
 }
 
+static void rtp_shared_close(void)
+{
+	rtp_shared_flush();
+	if (rtp_shared_work.inuse)
+		del_work(&rtp_shared_work);
+	if (rtp_shared_fd.inuse) {
+		unregister_fd(&rtp_shared_fd);
+		close(rtp_shared_fd.fd);
+	}
+	if (rtcp_shared_fd.inuse) {
+		unregister_fd(&rtcp_shared_fd);
+		close(rtcp_shared_fd.fd);
+	}
+	memset(&rtp_shared_fd, 0, sizeof(rtp_shared_fd));
+	memset(&rtcp_shared_fd, 0, sizeof(rtcp_shared_fd));
+	rtp_shared_fd.fd = -1;
+	rtcp_shared_fd.fd = -1;
+}
+
+/* initialize sequences of sent stream */
+static void rtp_tx_init(class Psip *psip)
+{
+	psip->p_s_rtp_tx_action = 1;
+	psip->p_s_rtp_tx_ssrc = rand();
+	psip->p_s_rtp_tx_sequence = random();
+	psip->p_s_rtp_tx_timestamp = random();
+	memset(&psip->p_s_rtp_tx_last_tv, 0, sizeof(psip->p_s_rtp_tx_last_tv));
+}
+
+/*
+ * RTCP
+ *
+ * every 5 seconds (randomized), a sender report is sent, or a receiver
+ * report if we did not send audio yet. the report block about the received
+ * stream is taken from the jitter buffer. report blocks about our stream
+ * tell the loss and jitter at the remote side and the round trip time.
+ * the quality (MOS) is only estimated when it is asked for, so nothing is
+ * added to the audio path, except counting sent packets.
+ */
+#define RTCP_INTERVAL	5000000	/* mean interval of reports in us */
+#define RTCP_SR		200
+#define RTCP_RR		201
+#define RTCP_SDES	202
+#define NTP_OFFSET	2208988800u /* seconds from 1900 to 1970 */
+
+static unsigned char *rtcp_put32(unsigned char *p, uint32_t value)
+{
+	p[0] = value >> 24;
+	p[1] = value >> 16;
+	p[2] = value >> 8;
+	p[3] = value;
+	return p + 4;
+}
+
+static uint32_t rtcp_get32(unsigned char *p)
+{
+	return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+/* NTP timestamp of wall clock */
+static void rtcp_ntp(uint32_t *msw, uint32_t *lsw)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	*msw = tv.tv_sec + NTP_OFFSET;
+	*lsw = ((uint64_t)tv.tv_usec << 32) / 1000000;
+}
+
+/* add report block about received stream, see RFC 3550 */
+static unsigned char *rtcp_report_block(class Psip *psip, unsigned char *p)
+{
+	struct jitter_buffer *jb = &psip->p_s_jitter;
+	unsigned int expected, expected_interval, received_interval;
+	int lost_interval, lost, fraction = 0;
+	uint32_t dlsr = 0;
+	struct timeval now;
+
+	expected = jitter_expected(jb);
+	expected_interval = expected - psip->p_s_rtcp_expected_prior;
+	received_interval = jb->received - psip->p_s_rtcp_received_prior;
+	psip->p_s_rtcp_expected_prior = expected;
+	psip->p_s_rtcp_received_prior = jb->received;
+	lost_interval = expected_interval - received_interval;
+	if (expected_interval && lost_interval > 0)
+		fraction = (lost_interval << 8) / expected_interval;
+	if (fraction > 255)
+		fraction = 255;
+	lost = expected - jb->received;
+	if (lost > 0x7fffff)
+		lost = 0x7fffff;
+	if (lost < -0x800000)
+		lost = -0x800000;
+
+	/* delay since last SR in units of 1/65536 seconds */
+	if (psip->p_s_rtcp_lsr) {
+		get_monotonic(&now);
+		dlsr = ((long long)(now.tv_sec - psip->p_s_rtcp_lsr_tv.tv_sec) * MICRO_SECONDS + now.tv_usec - psip->p_s_rtcp_lsr_tv.tv_usec) * 65536 / MICRO_SECONDS;
+	}
+
+	p = rtcp_put32(p, jb->ssrc);
+	p = rtcp_put32(p, (fraction << 24) | (lost & 0xffffff));
+	p = rtcp_put32(p, jb->max_seq);
+	p = rtcp_put32(p, jb->jitter >> 4);
+	p = rtcp_put32(p, psip->p_s_rtcp_lsr);
+	p = rtcp_put32(p, dlsr);
+
+	return p;
+}
+
+/* send SR or RR with SDES */
+static void rtcp_send(class Psip *psip)
+{
+	unsigned char buffer[128], *p = buffer, *start;
+	uint32_t msw, lsw, timestamp;
+	struct timeval now;
+	long long elapsed;
+	int count = (psip->p_s_jitter.started) ? 1 : 0;
+	char cname[32];
+	int len, rc;
+
+	if (!psip->p_s_rtp_tx_action)
+		rtp_tx_init(psip);
+
+	start = p;
+	if (psip->p_s_rtp_tx_packets) {
+		rtcp_ntp(&msw, &lsw);
+		/* RTP timestamp of the NTP time: the last packet's timestamp,
+		 * advanced by the samples (8000 per second) since it was sent */
+		get_monotonic(&now);
+		elapsed = (long long)(now.tv_sec - psip->p_s_rtp_tx_sent_tv.tv_sec) * MICRO_SECONDS + now.tv_usec - psip->p_s_rtp_tx_sent_tv.tv_usec;
+		timestamp = psip->p_s_rtp_tx_sent_timestamp + (uint32_t)(elapsed * 8000 / MICRO_SECONDS);
+		*p++ = (RTP_VERSION << 6) | count;
+		*p++ = RTCP_SR;
+		p += 2;
+		p = rtcp_put32(p, psip->p_s_rtp_tx_ssrc);
+		p = rtcp_put32(p, msw);
+		p = rtcp_put32(p, lsw);
+		p = rtcp_put32(p, timestamp);
+		p = rtcp_put32(p, psip->p_s_rtp_tx_packets);
+		p = rtcp_put32(p, psip->p_s_rtp_tx_octets);
+	} else {
+		*p++ = (RTP_VERSION << 6) | count;
+		*p++ = RTCP_RR;
+		p += 2;
+		p = rtcp_put32(p, psip->p_s_rtp_tx_ssrc);
+	}
+	if (count)
+		p = rtcp_report_block(psip, p);
+	start[2] = ((p - start) / 4 - 1) >> 8;
+	start[3] = (p - start) / 4 - 1;
+
+	/* SDES with CNAME, followed by end of list, padded to 32 bits */
+	SPRINT(cname, "lcr@%s", inet_ntoa(psip->p_s_rtp_sin_local.sin_addr));
+	len = strlen(cname);
+	start = p;
+	*p++ = (RTP_VERSION << 6) | 1;
+	*p++ = RTCP_SDES;
+	p += 2;
+	p = rtcp_put32(p, psip->p_s_rtp_tx_ssrc);
+	*p++ = 1; /* CNAME */
+	*p++ = len;
+	memcpy(p, cname, len);
+	p += len;
+	do {
+		*p++ = 0;
+	} while (((p - start) & 3));
+	start[2] = ((p - start) / 4 - 1) >> 8;
+	start[3] = (p - start) / 4 - 1;
+
+	len = p - buffer;
+	if (psip->p_s_rtp_hashed && rtcp_shared_fd.inuse)
+		rc = sendto(rtcp_shared_fd.fd, buffer, len, 0, (struct sockaddr *)&psip->p_s_rtcp_sin_remote, sizeof(psip->p_s_rtcp_sin_remote));
+	else if (psip->p_s_rtcp_fd.fd > 0)
+		rc = write(psip->p_s_rtcp_fd.fd, buffer, len);
+	else
+		return;
+	if (rc != len)
+		PDEBUG(DEBUG_SIP, "rtcp write result=%d\n", rc);
+}
+
+/* process report block about our stream */
+static void rtcp_report(class Psip *psip, unsigned char *block)
+{
+	uint32_t msw, lsw, lsr, dlsr, rtt;
+	int lost;
+
+	psip->p_s_rtcp_reports++;
+	psip->p_s_rtcp_remote_fraction = block[4];
+	lost = (block[5] << 16) | (block[6] << 8) | block[7];
+	if ((lost & 0x800000))
+		lost -= 0x1000000;
+	psip->p_s_rtcp_remote_lost = lost;
+	psip->p_s_rtcp_remote_jitter = rtcp_get32(block + 12);
+
+	/* round trip time = now - LSR - DLSR */
+	lsr = rtcp_get32(block + 16);
+	dlsr = rtcp_get32(block + 20);
+	if (!lsr)
+		return;
+	rtcp_ntp(&msw, &lsw);
+	rtt = ((msw << 16) | (lsw >> 16)) - lsr - dlsr;
+	if ((int32_t)rtt >= 0)
+		psip->p_s_rtcp_rtt = ((uint64_t)rtt * 1000) >> 16;
+}
+
+/* decode compound RTCP packet */
+static void rtcp_decode(class Psip *psip, unsigned char *data, int len)
+{
+	unsigned char *block;
+	int count, plen, i;
+
+	while (len >= 8) {
+		if ((data[0] >> 6) != RTP_VERSION)
+			return;
+		count = data[0] & 0x1f;
+		plen = ((data[2] << 8) | data[3]) * 4 + 4;
+		if (plen > len)
+			return;
+		block = NULL;
+		switch (data[1]) {
+		case RTCP_SR:
+			if (plen < 28)
+				return;
+			psip->p_s_rtcp_lsr = (rtcp_get32(data + 8) << 16) | (rtcp_get32(data + 12) >> 16);
+			get_monotonic(&psip->p_s_rtcp_lsr_tv);
+			block = data + 28;
+			break;
+		case RTCP_RR:
+			block = data + 8;
+			break;
+		}
+		for (i = 0; block && i < count && block + 24 <= data + plen; i++, block += 24) {
+			if (psip->p_s_rtp_tx_action && rtcp_get32(block) == psip->p_s_rtp_tx_ssrc)
+				rtcp_report(psip, block);
+		}
+		data += plen;
+		len -= plen;
+	}
+}
+
+static int rtcp_timer(struct lcr_timer *timer, void *instance, int index)
+{
+	class Psip *psip = (class Psip *)instance;
+
+	if (psip->p_s_rtp_is_connected)
+		rtcp_send(psip);
+	schedule_timer(timer, 0, RTCP_INTERVAL / 2 + random() % RTCP_INTERVAL);
+
+	return 0;
+}
+
+/*
+ * estimate MOS * 100 with the simplified E-model (ITU-T G.107): the effective
+ * loss is the worse one of both directions, including packets that were too
+ * late to be played. the delay is half of the round trip time, the delay of
+ * the jitter buffer and the packetization.
+ */
+int Psip::rtp_mos(void)
+{
+	unsigned int expected = jitter_expected(&p_s_jitter);
+	double loss = 0.0, r;
+	int delay;
+
+	if (!p_s_jitter.received && !p_s_rtcp_reports)
+		return 0;
+	if (expected)
+		loss = 100.0 * (jitter_lost(&p_s_jitter) + p_s_jitter.late) / expected;
+	if (p_s_rtcp_reports && p_s_rtp_tx_packets && p_s_rtcp_remote_lost > 0
+	 && 100.0 * p_s_rtcp_remote_lost / p_s_rtp_tx_packets > loss)
+		loss = 100.0 * p_s_rtcp_remote_lost / p_s_rtp_tx_packets;
+	delay = jitter_delay(&p_s_jitter) + 20;
+	if (p_s_rtcp_rtt > 0)
+		delay += p_s_rtcp_rtt / 2;
+
+	r = 93.2 - 2.5 * loss;
+	if (delay < 160)
+		r -= delay / 40.0;
+	else
+		r -= (delay - 120) / 10.0;
+	if (r < 0.0)
+		r = 0.0;
+	if (r > 100.0)
+		r = 100.0;
+
+	return (int)(100.0 * (1.0 + 0.035 * r + 0.000007 * r * (r - 60.0) * (100.0 - r)) + 0.5);
+}
+
 #define RTP_PORT_BASE	30000
 #define RTP_PORT_MAX	39998
 static unsigned short next_udp_port = RTP_PORT_BASE;
@@ -374,6 +1068,14 @@ int Psip::rtp_open(void)
 	unsigned int ip;
 	unsigned short start_port;
 
+	/* all calls use the shared port */
+	if (rtp_shared_fd.inuse) {
+		p_s_rtp_port_local = options.rtp_shared_port;
+		p_s_rtp_ip_local = 0;
+		PDEBUG(DEBUG_SIP, "local ip %08x port %d (shared)\n", p_s_rtp_ip_local, p_s_rtp_port_local);
+		return p_s_rtp_port_local;
+	}
+
 	/* create socket */
 	rc = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
 	if (rc < 0) {
@@ -438,12 +1140,36 @@ try_next_port:
 
 int Psip::rtp_connect(void)
 {
-	int rc;
+	int rc, fd;
 	struct in_addr ia;
 
 	ia.s_addr = htonl(p_s_rtp_ip_remote);
 	PDEBUG(DEBUG_SIP, "rtp_connect(ip=%s, port=%u)\n", inet_ntoa(ia), p_s_rtp_port_remote);
 
+	if (rtp_shared_fd.inuse) {
+		/* a connected socket tells the local ip that is used for the remote ip */
+		if (p_s_rtp_hashed)
+			rtp_shared_unlink(this);
+		rc = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		if (rc < 0)
+			return -EIO;
+		fd = rc;
+		rc = rtp_sub_socket_connect(fd, &p_s_rtp_sin_local, &p_s_rtp_sin_remote, p_s_rtp_ip_remote, p_s_rtp_port_remote);
+		close(fd);
+		if (rc < 0)
+			return rc;
+		p_s_rtcp_sin_remote = p_s_rtp_sin_remote;
+		p_s_rtcp_sin_remote.sin_port = htons(p_s_rtp_port_remote + 1);
+		rtp_shared_link(this);
+		p_s_rtp_ip_local = ntohl(p_s_rtp_sin_local.sin_addr.s_addr);
+		PDEBUG(DEBUG_SIP, "local ip %08x port %d (shared)\n", p_s_rtp_ip_local, p_s_rtp_port_local);
+		PDEBUG(DEBUG_SIP, "remote ip %08x port %d\n", p_s_rtp_ip_remote, p_s_rtp_port_remote);
+		p_s_rtp_is_connected = 1;
+		if (!p_s_rtcp_timer.active)
+			schedule_timer(&p_s_rtcp_timer, 0, RTCP_INTERVAL / 2);
+		return 0;
+	}
+
 	rc = rtp_sub_socket_connect(p_s_rtp_fd.fd, &p_s_rtp_sin_local, &p_s_rtp_sin_remote, p_s_rtp_ip_remote, p_s_rtp_port_remote);
 	if (rc < 0)
 		return rc;
@@ -456,11 +1182,15 @@ int Psip::rtp_connect(void)
 	PDEBUG(DEBUG_SIP, "local ip %08x port %d\n", p_s_rtp_ip_local, p_s_rtp_port_local);
 	PDEBUG(DEBUG_SIP, "remote ip %08x port %d\n", p_s_rtp_ip_remote, p_s_rtp_port_remote);
 	p_s_rtp_is_connected = 1;
+	if (!p_s_rtcp_timer.active)
+		schedule_timer(&p_s_rtcp_timer, 0, RTCP_INTERVAL / 2);
 
 	return 0;
 }
 void Psip::rtp_close(void)
 {
+	if (p_s_rtp_hashed)
+		rtp_shared_unlink(this);
 	if (p_s_rtp_fd.fd > 0) {
 		unregister_fd(&p_s_rtp_fd);
 		close(p_s_rtp_fd.fd);
@@ -471,9 +1201,30 @@ void Psip::rtp_close(void)
 		close(p_s_rtcp_fd.fd);
 		p_s_rtcp_fd.fd = 0;
 	}
+	unsched_timer(&p_s_rtcp_timer);
 	if (p_s_rtp_is_connected) {
 		PDEBUG(DEBUG_SIP, "rtp closed\n");
 		p_s_rtp_is_connected = 0;
+		/* write quality of the call to the log */
+		if (p_s_jitter.received || p_s_rtp_tx_packets) {
+			int mos = rtp_mos();
+
+			sip_trace_header(this, "RTP quality", DIRECTION_NONE);
+			add_trace("sent", "packets", "%u", p_s_rtp_tx_packets);
+			add_trace("received", "packets", "%u", p_s_jitter.received);
+			add_trace("received", "lost", "%u", jitter_lost(&p_s_jitter));
+			add_trace("received", "late", "%u", p_s_jitter.late);
+			add_trace("received", "jitter", "%d ms", (p_s_jitter.jitter >> 4) / 8);
+			if (p_s_rtcp_reports) {
+				add_trace("remote", "lost", "%d", p_s_rtcp_remote_lost);
+				add_trace("remote", "jitter", "%u ms", p_s_rtcp_remote_jitter / 8);
+			}
+			if (p_s_rtcp_rtt >= 0)
+				add_trace("rtt", NULL, "%d ms", p_s_rtcp_rtt);
+			if (mos)
+				add_trace("mos", NULL, "%d.%02d", mos / 100, mos % 100);
+			end_trace();
+		}
 	}
 }
 
@@ -492,6 +1243,46 @@ void tv_difference(struct timeval *diff, const struct timeval *from,
 	diff->tv_sec = to->tv_sec - from->tv_sec;
 }
 
+/* send 20 ms of audio, encode it if we do not use law */
+void Psip::rtp_send_audio(unsigned char *data)
+{
+	unsigned char frame[160];
+	int i;
+
+	/* record audio */
+	if (p_record)
+		record(data, 160, 1); // from up
+	if (p_tap)
+		tap(data, 160, 1); // from up
+
+	switch (p_s_rtp_media_type) {
+#ifdef WITH_GSMFR
+	case MEDIA_TYPE_GSM:
+		if (!p_s_encoder)
+			return;
+		for (i = 0; i < 160; i++)
+			p_s_samples[i] = audio_law_to_s32[data[i]];
+		gsm_fr_encode(p_s_encoder, p_s_samples, frame);
+		rtp_send_frame(frame, 33, p_s_rtp_payload_type);
+		return;
+#endif
+#ifdef WITH_GSMAMR
+	case MEDIA_TYPE_GSM_EFR:
+		if (!p_s_encoder)
+			return;
+		for (i = 0; i < 160; i++)
+			p_s_samples[i] = audio_law_to_s32[data[i]];
+		gsm_efr_encode(p_s_encoder, p_s_samples, frame);
+		rtp_send_frame(frame, 31, p_s_rtp_payload_type);
+		return;
+#endif
+	}
+
+	for (i = 0; i < 160; i++)
+		frame[i] = flip[data[i]];
+	rtp_send_frame(frame, 160, (options.law=='a')?PAYLOAD_TYPE_ALAW:PAYLOAD_TYPE_ULAW);
+}
+
 /* encode and send a rtp frame */
 int Psip::rtp_send_frame(unsigned char *data, unsigned int len, uint8_t payload_type)
 {
@@ -500,50 +1291,28 @@ int Psip::rtp_send_frame(unsigned char *data, unsigned int len, uint8_t payload_
 	int duration; /* in samples */
 	unsigned char buffer[256];
 
-	/* record audio */
-	if (p_record)
-		record(data, len, 1); // from up
-	if (p_tap)
-		tap(data, len, 1); // from up
-
 	if (!p_s_rtp_is_connected) {
 		/* drop silently */
 		return 0;
 	}
 
-	if (!p_s_rtp_tx_action) {
-		/* initialize sequences */
-		p_s_rtp_tx_action = 1;
-		p_s_rtp_tx_ssrc = rand();
-		p_s_rtp_tx_sequence = random();
-		p_s_rtp_tx_timestamp = random();
-		memset(&p_s_rtp_tx_last_tv, 0, sizeof(p_s_rtp_tx_last_tv));
-	}
+	if (!p_s_rtp_tx_action)
+		rtp_tx_init(this);
 
 	switch (payload_type) {
-#if 0
-we only support alaw and ulaw!
-	case RTP_PT_GSM_FULL:
-		payload_len = 33;
-		duration = 160;
-		break;
-	case RTP_PT_GSM_EFR:
-		payload_len = 31;
-		duration = 160;
-		break;
-	case RTP_PT_GSM_HALF:
-		payload_len = 14;
-		duration = 160;
-		break;
-#endif
 	case PAYLOAD_TYPE_ALAW:
 	case PAYLOAD_TYPE_ULAW:
 		payload_len = len;
 		duration = len;
 		break;
 	default:
-		PERROR("unsupported message type %d\n", payload_type);
-		return -EINVAL;
+		/* coded frame of the codec we selected */
+		if (payload_type != p_s_rtp_payload_type || (int)len != rtp_frame_len(p_s_rtp_media_type)) {
+			PERROR("unsupported message type %d\n", payload_type);
+			return -EINVAL;
+		}
+		payload_len = len;
+		duration = 160;
 	}
 
 #if 0
@@ -577,11 +1346,17 @@ we only support alaw and ulaw!
 	rtph->payload_type = payload_type;
 	rtph->sequence = htons(p_s_rtp_tx_sequence++);
 	rtph->timestamp = htonl(p_s_rtp_tx_timestamp);
+	p_s_rtp_tx_sent_timestamp = p_s_rtp_tx_timestamp;
+	get_monotonic(&p_s_rtp_tx_sent_tv);
 	p_s_rtp_tx_timestamp += duration;
 	rtph->ssrc = htonl(p_s_rtp_tx_ssrc);
 	memcpy(buffer + sizeof(struct rtp_hdr), data, payload_len);
+	p_s_rtp_tx_packets++;
+	p_s_rtp_tx_octets += payload_len;
 
-	if (p_s_rtp_fd.fd > 0) {
+	if (p_s_rtp_hashed)
+		rtp_shared_send(&p_s_rtp_sin_remote, buffer, sizeof(struct rtp_hdr) + payload_len);
+	else if (p_s_rtp_fd.fd > 0) {
 		len = write(p_s_rtp_fd.fd, &buffer, sizeof(struct rtp_hdr) + payload_len);
 		if (len != sizeof(struct rtp_hdr) + payload_len) {
 			PDEBUG(DEBUG_SIP, "write result=%d\n", len);
@@ -603,18 +1378,38 @@ int Psip::bridge_rx(unsigned char *data, int len)
 
 	/* write to rx buffer */
 	while(len--) {
-		p_s_rxdata[p_s_rxpos++] = flip[*data++];
+		p_s_rxdata[p_s_rxpos++] = *data++;
 		if (p_s_rxpos == 160) {
 			p_s_rxpos = 0;
 
 			/* transmit data via rtp */
-			rtp_send_frame(p_s_rxdata, 160, (options.law=='a')?PAYLOAD_TYPE_ALAW:PAYLOAD_TYPE_ULAW);
+			rtp_send_audio(p_s_rxdata);
 		}
 	}
 
 	return 0;
 }
 
+/* receive coded frame from remote, it is relayed if we use the same codec */
+int Psip::bridge_rx_frame(int media_type, unsigned char *data, int len)
+{
+	if (!media_type || media_type != bridge_media())
+		return -EINVAL;
+	if (p_tone_name[0] || p_record || p_tap)
+		return -EINVAL;
+
+	return rtp_send_frame(data, len, p_s_rtp_payload_type);
+}
+
+int Psip::bridge_media(void)
+{
+	if (p_s_rtp_bridge || !p_s_rtp_is_connected)
+		return 0;
+	if (!rtp_frame_len(p_s_rtp_media_type))
+		return 0;
+	return p_s_rtp_media_type;
+}
+
 /* taken from freeswitch */
 /* map sip responses to QSIG cause codes ala RFC4497 section 8.4.4 */
 static int status2cause(int status)
@@ -808,8 +1603,9 @@ int Psip::message_connect(unsigned int epoint_id, int message_id, union paramete
 		PDEBUG(DEBUG_SIP, "remote ip %08x port %d\n", p_s_rtp_ip_remote, p_s_rtp_port_remote);
 	} else {
 		PDEBUG(DEBUG_SIP, "RTP info not given by remote, so we do our own RTP\n");
-		media_type = (options.law=='a') ? MEDIA_TYPE_ALAW : MEDIA_TYPE_ULAW;
-		payload_type = (options.law=='a') ? PAYLOAD_TYPE_ALAW : PAYLOAD_TYPE_ULAW;
+		rtp_answer_codec();
+		media_type = p_s_rtp_media_type;
+		payload_type = p_s_rtp_payload_type;
 		/* open local RTP peer (if not bridging) */
 		if (!p_s_rtp_is_connected && rtp_connect() < 0) {
 			nua_cancel(p_s_handle, TAG_END());
@@ -934,8 +1730,7 @@ int Psip::message_setup(unsigned int epoint_id, int message_id, union parameter
 	struct epoint_list *epointlist;
 	sip_cseq_t *cseq = NULL;
 	struct lcr_msg *message;
-	int lcr_media = { (options.law=='a') ? MEDIA_TYPE_ALAW : MEDIA_TYPE_ULAW };
-	unsigned char lcr_payload = { (options.law=='a') ? PAYLOAD_TYPE_ALAW : PAYLOAD_TYPE_ULAW };
+	unsigned char lcr_payloads[4];
 	int *media_types;
 	unsigned char *payload_types;
 	int payloads = 0;
@@ -960,9 +1755,12 @@ int Psip::message_setup(unsigned int epoint_id, int message_id, union parameter
 	} else {
 		PDEBUG(DEBUG_SIP, "RTP info not given by remote, so we do our own RTP\n");
 		p_s_rtp_bridge = 0;
-		media_types = &lcr_media;
-		payload_types = &lcr_payload;
-		payloads = 1;
+		/* offer our codecs */
+		for (i = 0; i < p_s_rtp_codecs; i++)
+			lcr_payloads[i] = rtp_codec_payload(p_s_rtp_codec_types[i]);
+		media_types = p_s_rtp_codec_types;
+		payload_types = lcr_payloads;
+		payloads = p_s_rtp_codecs;
 
 		/* open local RTP peer (if not bridging) */
 		if (rtp_open() < 0) {
@@ -1437,17 +2235,25 @@ void Psip::i_invite(int status, char const *phrase, nua_t *nua, nua_magic_t *mag
 	sip_trace_header(this, "Payload received", DIRECTION_NONE);
 	ret = parse_sdp(sip, &p_s_rtp_ip_remote, &p_s_rtp_port_remote, payload_types, media_types, &payloads, sizeof(payload_types));
 	if (!ret) {
-		/* if no RTP bridge, we must support LAW codec, otherwise we forward what we have */
+		/* if no RTP bridge, we must support one of the codecs, otherwise we forward what we have */
 		if (!p_s_rtp_bridge) {
-			int i;
-
-			/* check if supported payload type exists */
-			for (i = 0; i < payloads; i++) {
-				if (media_types[i] == ((options.law=='a') ? MEDIA_TYPE_ALAW : MEDIA_TYPE_ULAW))
-					break;
+			int i, j;
+
+			/* list offered codecs that we support, in order of our preference */
+			p_s_rtp_offers = 0;
+			for (i = 0; i < p_s_rtp_codecs; i++) {
+				for (j = 0; j < payloads; j++) {
+					if (media_types[j] == p_s_rtp_codec_types[i])
+						break;
+				}
+				if (j < payloads) {
+					p_s_rtp_offer_types[p_s_rtp_offers] = media_types[j];
+					p_s_rtp_offer_payloads[p_s_rtp_offers] = payload_types[j];
+					p_s_rtp_offers++;
+				}
 			}
-			if (i == payloads) {
-				add_trace("error", NULL, "Expected LAW payload type (not bridged)");
+			if (!p_s_rtp_offers) {
+				add_trace("error", NULL, "Expected supported payload type (not bridged)");
 				ret = 415;
 			}
 		}
@@ -1589,8 +2395,9 @@ void Psip::i_invite(int status, char const *phrase, nua_t *nua, nua_magic_t *mag
 		unsigned char payload_type;
 
 		PDEBUG(DEBUG_SIP, "Connecting audio, since we have tones available\n");
-		media_type = (options.law=='a') ? MEDIA_TYPE_ALAW : MEDIA_TYPE_ULAW;
-		payload_type = (options.law=='a') ? PAYLOAD_TYPE_ALAW : PAYLOAD_TYPE_ULAW;
+		rtp_answer_codec();
+		media_type = p_s_rtp_media_type;
+		payload_type = p_s_rtp_payload_type;
 		/* open local RTP peer (if not bridging) */
 		if (rtp_connect() < 0) {
 			nua_respond(nh, SIP_500_INTERNAL_SERVER_ERROR, TAG_END());
@@ -1747,13 +2554,26 @@ void Psip::r_invite(int status, char const *phrase, nua_t *nua, nua_magic_t *mag
 		sip_trace_header(this, "Payload received", DIRECTION_NONE);
 		ret = parse_sdp(sip, &p_s_rtp_ip_remote, &p_s_rtp_port_remote, payload_types, media_types, &payloads, sizeof(payload_types));
 		if (!ret) {
-			if (payloads != 1)
+			if (payloads < 1)
 				ret = 415;
 			else if (!p_s_rtp_bridge) {
-				if (media_types[0] != ((options.law=='a') ? MEDIA_TYPE_ALAW : MEDIA_TYPE_ULAW)) {
-					add_trace("error", NULL, "Expected LAW payload type (not bridged)");
-					ret = 415;
+				int i, j;
+
+				/* the answer may list more than one codec, use the
+				 * first one that is one of our codecs */
+				for (j = 0; j < payloads; j++) {
+					for (i = 0; i < p_s_rtp_codecs; i++) {
+						if (media_types[j] == p_s_rtp_codec_types[i])
+							break;
+					}
+					if (i < p_s_rtp_codecs)
+						break;
 				}
+				if (j == payloads) {
+					add_trace("error", NULL, "Expected supported payload type (not bridged)");
+					ret = 415;
+				} else
+					rtp_codec(media_types[j], payload_types[j]);
 			}
 		}
 		end_trace();
@@ -1975,6 +2795,124 @@ void Psip::rtp_shutdown(void)
 	trigger_work(&p_s_delete);
 }
 
+/*
+ * sofia-sip does not tell which file descriptor a root waits for. but the
+ * epoll port of a root has its own epoll instance, which becomes readable if
+ * one of the root's wait objects (or its mailbox) has an event. to find it,
+ * an eventfd is registered with the root by su_root_register(). the file
+ * descriptor we wait for must become readable exactly when that eventfd is
+ * written, and must not be readable before it is written and after it is
+ * read again. only a file descriptor that passes this check is added to our
+ * event loop. the time until the next timer of the root is returned by
+ * su_root_step().
+ * if no such file descriptor is found (e.g. sofia-sip uses its poll port),
+ * the root timer steps the root every SIP_POLL_INTERVAL ms.
+ */
+#define SIP_PROBE_FDS		4096
+#define SIP_POLL_INTERVAL	10
+
+static int sip_probe_wakeup(su_root_magic_t *magic, su_wait_t *wait, su_wakeup_arg_t *arg)
+{
+	return 0;
+}
+
+/* remove all file descriptors that are (not) readable */
+static int sip_probe_poll(struct pollfd *fds, int num, int readable)
+{
+	int i, j;
+
+	for (i = 0; i < num; i++)
+		fds[i].revents = 0;
+	if (poll(fds, num, 0) < 0)
+		return 0;
+	for (i = 0, j = 0; i < num; i++) {
+		if (!!(fds[i].revents & POLLIN) == readable)
+			fds[j++] = fds[i];
+	}
+
+	return j;
+}
+
+/* return the file descriptor that becomes readable with the root's wait
+ * objects, or -1 if there is none or more than one */
+static int sip_root_find_fd(su_root_t *root)
+{
+	struct pollfd fds[SIP_PROBE_FDS];
+	su_wait_t wait[1];
+	eventfd_t value;
+	int probe, index, num = 0, max, fd, ret = -1;
+
+	probe = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (probe < 0)
+		return -1;
+	if (su_wait_create(wait, probe, SU_WAIT_IN) < 0) {
+		close(probe);
+		return -1;
+	}
+	index = su_root_register(root, wait, sip_probe_wakeup, NULL, 0);
+	if (index < 0) {
+		su_wait_destroy(wait);
+		close(probe);
+		return -1;
+	}
+
+	/* all open file descriptors, except the probe */
+	max = sysconf(_SC_OPEN_MAX);
+	if (max < 0 || max > SIP_PROBE_FDS)
+		max = SIP_PROBE_FDS;
+	for (fd = 0; fd < max; fd++) {
+		if (fd == probe || fcntl(fd, F_GETFD) < 0)
+			continue;
+		fds[num].fd = fd;
+		fds[num].events = POLLIN;
+		num++;
+	}
+	/* not readable before, readable when the probe is written, not
+	 * readable when the probe is read again */
+	num = sip_probe_poll(fds, num, 0);
+	eventfd_write(probe, 1);
+	num = sip_probe_poll(fds, num, 1);
+	eventfd_read(probe, &value);
+	num = sip_probe_poll(fds, num, 0);
+	if (num == 1)
+		ret = fds[0].fd;
+
+	su_root_deregister(root, index);
+	close(probe);
+
+	return ret;
+}
+
+/* process events and timers of root, then wait for the next timer */
+static void sip_step(struct sip_inst *inst)
+{
+	su_duration_t timeout;
+
+	timeout = su_root_step(inst->root, 0);
+	/* wake up at least once a second, in case a timer was added by us
+	 * without waking up the root. without a file descriptor, the root is
+	 * polled. */
+	if (timeout < 0 || timeout > 1000)
+		timeout = 1000;
+	if (inst->polling && timeout > SIP_POLL_INTERVAL)
+		timeout = SIP_POLL_INTERVAL;
+	schedule_timer(&inst->root_timer, timeout / 1000, (timeout % 1000) * 1000);
+}
+
+static int sip_root_fd(struct lcr_fd *fd, unsigned int what, void *instance, int index)
+{
+	sip_step((struct sip_inst *)instance);
+
+	return 0;
+}
+
+static int sip_root_timer(struct lcr_timer *timer, void *instance, int index)
+{
+	sip_step((struct sip_inst *)instance);
+
+	return 0;
+}
+
 int sip_init_inst(struct interface *interface)
 {
 	struct sip_inst *inst = (struct sip_inst *) MALLOC(sizeof(*inst));
@@ -1992,6 +2930,14 @@ int sip_init_inst(struct interface *interface)
 		sip_exit_inst(interface);
 		return -EINVAL;
 	}
+	add_timer(&inst->root_timer, sip_root_timer, inst, 0);
+	inst->root_fd.fd = sip_root_find_fd(inst->root);
+	if (inst->root_fd.fd >= 0) {
+		register_fd(&inst->root_fd, LCR_FD_READ, sip_root_fd, inst, 0);
+	} else {
+		PDEBUG(DEBUG_SIP, "File descriptor of SIP root not found, SIP root is polled every %d ms\n", SIP_POLL_INTERVAL);
+		inst->polling = 1;
+	}
 
 	SPRINT(local, "sip:%s",inst->local_peer);
 	if (!strchr(inst->local_peer, ':'))
@@ -2023,6 +2969,8 @@ int sip_init_inst(struct interface *interface)
 
 	any_sip_interface = 1;
 
+	sip_step(inst);
+
 	return 0;
 }
 
@@ -2032,6 +2980,10 @@ void sip_exit_inst(struct interface *interface)
 
 	if (!inst)
 		return;
+	if (inst->root_fd.inuse)
+		unregister_fd(&inst->root_fd);
+	if (inst->root_timer.inuse)
+		del_timer(&inst->root_timer);
 	if (inst->root)
 		su_root_destroy(inst->root);
 	if (inst->nua) {
@@ -2074,6 +3026,16 @@ int sip_init(void)
 	for (i = 0; i < 256; i++)
 		flip[i] = ((i & 1) << 7) + ((i & 2) << 5) + ((i & 4) << 3) + ((i & 8) << 1) + ((i & 16) >> 1) + ((i & 32) >> 3) + ((i & 64) >> 5) + ((i & 128) >> 7);
 
+	if (options.rtp_shared_port) {
+		memset(&rtp_shared_work, 0, sizeof(rtp_shared_work));
+		add_work(&rtp_shared_work, rtp_shared_work_cb, NULL, 0);
+		if (rtp_shared_open(&rtp_shared_fd, options.rtp_shared_port, 0) < 0
+		 || rtp_shared_open(&rtcp_shared_fd, options.rtp_shared_port + 1, 1) < 0) {
+			rtp_shared_close();
+			return -EIO;
+		}
+	}
+
 	PDEBUG(DEBUG_SIP, "SIP globals initialized\n");
 
 	return 0;
@@ -2081,26 +3043,13 @@ int sip_init(void)
 
 void sip_exit(void)
 {
+	rtp_shared_close();
 	su_home_deinit(sip_home);
 	su_deinit();
 
 	PDEBUG(DEBUG_SIP, "SIP globals de-initialized\n");
 }
 
-void sip_handle(void)
-{
-	struct interface *interface = interface_first;
-	struct sip_inst *inst;
-
-	while (interface) {
-		if (interface->sip_inst) {
-			inst = (struct sip_inst *) interface->sip_inst;
-			su_root_step(inst->root, 0);
-		}
-		interface = interface->next;
-	}
-}
-
 /* deletes when back in event loop */
 static int delete_event(struct lcr_work *work, void *instance, int index)
 {
@@ -2156,11 +3105,11 @@ void Psip::load_tx(void)
 {
 	int diff;
 	struct timeval current_time;
-	int tosend = SEND_SIP_LEN, i;
+	int tosend = SEND_SIP_LEN;
 	unsigned char buf[SEND_SIP_LEN], *p = buf;
 
 	/* get elapsed */
-	gettimeofday(&current_time, NULL);
+	get_monotonic(&current_time);
 	if (!p_s_next_tv_sec) {
 		/* if timer expired the first time, set next expected timeout 160 samples in advance */
 		p_s_next_tv_sec = current_time.tv_sec;
@@ -2175,6 +3124,7 @@ void Psip::load_tx(void)
 			+ (current_time.tv_usec - p_s_next_tv_usec);
 		if (diff < -SEND_SIP_LEN * 125 || diff > SEND_SIP_LEN * 125) {
 			/* if clock drifts too much, set next timeout event to current timer + 160 */
+			PACING_COUNT(pacing_resync);
 			diff = 0;
 			p_s_next_tv_sec = current_time.tv_sec;
 			p_s_next_tv_usec = current_time.tv_usec + SEND_SIP_LEN * 125;
@@ -2202,12 +3152,7 @@ void Psip::load_tx(void)
 		return;
 	}
 
-	p = buf;
-	for (i = 0; i < SEND_SIP_LEN; i++) {
-		*p = flip[*p];
-		p++;
-	}
 	/* transmit data via rtp */
-	rtp_send_frame(buf, SEND_SIP_LEN, (options.law=='a')?PAYLOAD_TYPE_ALAW:PAYLOAD_TYPE_ULAW);
+	rtp_send_audio(buf);
 }
 
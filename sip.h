@@ -49,11 +49,43 @@ class Psip : public Port
 	struct lcr_fd p_s_rtp_fd;
 	struct lcr_fd p_s_rtcp_fd;
 	int p_s_rtp_is_connected; /* if RTP session is connected, so we may send frames */
+	int p_s_rtp_hashed; /* if remote address is linked to shared RTP port */
+	class Psip *p_s_rtp_hash_next;
 	int p_s_rtp_tx_action;
 	uint16_t p_s_rtp_tx_sequence;
 	uint32_t p_s_rtp_tx_timestamp;
 	uint32_t p_s_rtp_tx_ssrc;
 	struct timeval p_s_rtp_tx_last_tv;
+	unsigned int p_s_rtp_tx_packets; /* packets sent, for RTCP SR */
+	unsigned int p_s_rtp_tx_octets; /* payload octets sent, for RTCP SR */
+	uint32_t p_s_rtp_tx_sent_timestamp; /* timestamp of last packet sent, for RTCP SR */
+	struct timeval p_s_rtp_tx_sent_tv; /* when last packet was sent */
+	struct lcr_timer p_s_rtcp_timer; /* sends RTCP reports */
+	unsigned int p_s_rtcp_expected_prior; /* expected packets at last report */
+	unsigned int p_s_rtcp_received_prior; /* received packets at last report */
+	uint32_t p_s_rtcp_lsr; /* middle 32 bits of NTP timestamp of last SR received */
+	struct timeval p_s_rtcp_lsr_tv; /* when last SR was received */
+	int p_s_rtcp_reports; /* reports received about our stream */
+	int p_s_rtcp_rtt; /* round trip time in ms, -1 if unknown */
+	int p_s_rtcp_remote_fraction; /* fraction lost (x/256) reported by remote */
+	int p_s_rtcp_remote_lost; /* cumulative packets lost reported by remote */
+	unsigned int p_s_rtcp_remote_jitter; /* interarrival jitter in samples reported by remote */
+	int p_s_rtp_codecs; /* codecs used on own RTP, first is preferred */
+	int p_s_rtp_codec_types[4];
+	int p_s_rtp_offers; /* codecs offered by remote that we support, in order of preference */
+	int p_s_rtp_offer_types[4];
+	uint8_t p_s_rtp_offer_payloads[4];
+	int p_s_rtp_media_type; /* codec of own RTP, 0 if not selected yet */
+	uint8_t p_s_rtp_payload_type;
+	void *p_s_encoder; /* transcoder, if coded frames are not relayed */
+	void *p_s_decoder;
+	signed short p_s_samples[160];
+	void rtp_codec(int media_type, uint8_t payload_type);
+	void rtp_answer_codec(void);
+	void rtp_send_audio(unsigned char *data);
+	int bridge_rx_frame(int media_type, unsigned char *data, int len);
+	int bridge_media(void);
+	int rtp_mos(void);
 	int rtp_open(void);
 	int rtp_connect(void);
 	void rtp_close(void);
@@ -62,6 +94,9 @@ class Psip : public Port
 	struct lcr_fd p_s_b_fd; /* event node */
 	int p_s_b_index; /* SIP bchannel socket index to use */
 	int p_s_b_active; /* SIP bchannel socket is activated */
+	struct jitter_buffer p_s_jitter; /* received RTP audio */
+	struct lcr_timer p_s_jitter_timer; /* plays jitter buffer */
+	int p_s_jitter_idle; /* frames that were not played */
 	unsigned char p_s_rxdata[160]; /* receive audio buffer */
 	int p_s_rxpos; /* position in audio buffer 0..159 */
 	int bridge_rx(unsigned char *data, int len);
@@ -81,4 +116,3 @@ int sip_init_inst(struct interface *interface);
 void sip_exit_inst(struct interface *interface);
 int sip_init(void);
 void sip_exit(void);
-void sip_handle(void);
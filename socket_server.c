@@ -566,7 +566,7 @@ void admin_call_response(int adminid, int message, const char *connected, int ca
 	/* attach to response chain */
 	*responsep = response;
 	responsep = &response->next;
-	admin->fd.when |= LCR_FD_WRITE;
+	update_fd(&admin->fd, admin->fd.when | LCR_FD_WRITE);
 }
 
 
@@ -608,7 +608,18 @@ int admin_message_to_lcr(struct admin_msg *msg, struct admin_list *admin)
 			0,
 			"REMOTE APP registers");
 		add_trace("app", "name", "%s", admin->remote_name);
+		if (msg->param.hello.framing >= ADMIN_FRAMING)
+			add_trace("app", "framing", "%d", ADMIN_FRAMING);
 		end_trace();
+		/* confirm framing, the reply is the first framed message */
+		if (msg->param.hello.framing >= ADMIN_FRAMING) {
+			union parameter param;
+
+			admin->framing = 1;
+			memset(&param, 0, sizeof(param));
+			param.hello.framing = ADMIN_FRAMING;
+			admin_message_from_lcr(admin->sock, 0, MESSAGE_HELLO, &param);
+		}
 		return(0);
 	}
 
@@ -734,8 +745,9 @@ int admin_message_from_lcr(int remote_id, unsigned int ref, int message_type, un
 	(*responsep)->am[0].message = ADMIN_MESSAGE;
 	(*responsep)->am[0].u.msg.type = message_type;
 	(*responsep)->am[0].u.msg.ref = ref;
-	memcpy(&(*responsep)->am[0].u.msg.param, param, sizeof(union parameter));
-	admin->fd.when |= LCR_FD_WRITE;
+	/* param may be stored in a small message block, so copy only what it holds */
+	memcpy(&(*responsep)->am[0].u.msg.param, param, message_param_size(message_type));
+	update_fd(&admin->fd, admin->fd.when | LCR_FD_WRITE);
 	return(0);
 }
 
@@ -753,6 +765,9 @@ int admin_state(struct admin_queue **responsep)
 	struct mISDNport	*mISDNport;
 	struct select_channel	*selchannel;
 	int			anybusy;
+#endif
+#ifdef WITH_SIP
+	class Psip		*psip;
 #endif
 	struct interface	*interface;
 	struct interface_port	*ifport;
@@ -824,6 +839,21 @@ int admin_state(struct admin_queue **responsep)
 		port = port->next;
 	}
 	response->am[0].u.s.ports = i;
+	/* audio clock pacing errors */
+	response->am[0].u.s.pacing_late = PACING_READ(pacing_late);
+	response->am[0].u.s.pacing_resync = PACING_READ(pacing_resync);
+	/* message pool */
+	response->am[0].u.s.message_reused = message_reused;
+	response->am[0].u.s.message_slabs = message_slabs;
+	response->am[0].u.s.ext_cache_hit = extension_cache_hit;
+	response->am[0].u.s.ext_cache_miss = extension_cache_miss;
+	response->am[0].u.s.tone_cache_hit = tone_cache_hit;
+	response->am[0].u.s.tone_cache_miss = tone_cache_miss;
+	response->am[0].u.s.tone_cache_evict = tone_cache_evict;
+	response->am[0].u.s.tone_cache_bytes = tone_cache_bytes;
+	response->am[0].u.s.rec_dropped = rec_dropped;
+	response->am[0].u.s.rec_stalls = rec_stalls;
+	response->am[0].u.s.rec_errors = __atomic_load_n(&rec_errors, __ATOMIC_RELAXED);
 	/* attach to response chain */
 	*responsep = response;
 	responsep = &response->next;
@@ -1123,6 +1153,24 @@ int admin_state(struct admin_queue **responsep)
 			response->am[num].u.p.isdn_hold = pdss1->p_m_hold;
 			response->am[num].u.p.isdn_ces = pdss1->p_m_d_ces;
 		}
+#endif
+#ifdef WITH_SIP
+		/* rtp */
+		if ((port->p_type & PORT_CLASS_mISDN_MASK) == PORT_CLASS_SIP) {
+			psip = (class Psip *)port;
+			if (psip->p_s_jitter.received || psip->p_s_rtp_tx_packets) {
+				response->am[num].u.p.rtp = 1;
+				response->am[num].u.p.rtp_delay = jitter_delay(&psip->p_s_jitter);
+				response->am[num].u.p.rtp_late = psip->p_s_jitter.late;
+				response->am[num].u.p.rtp_lost = jitter_lost(&psip->p_s_jitter);
+				response->am[num].u.p.rtp_reordered = psip->p_s_jitter.reordered;
+				response->am[num].u.p.rtp_concealed = psip->p_s_jitter.concealed;
+				response->am[num].u.p.rtp_resync = psip->p_s_jitter.resync;
+				response->am[num].u.p.rtp_rtt = psip->p_s_rtcp_rtt;
+				response->am[num].u.p.rtp_remote_lost = psip->p_s_rtcp_remote_lost;
+				response->am[num].u.p.rtp_mos = psip->rtp_mos();
+			}
+		}
 #endif
 		/* */
 		port = port->next;
@@ -1166,17 +1214,105 @@ int admin_handle(struct lcr_fd *fd, unsigned int what, void *instance, int index
 	return 0;
 }
 
+/* process a message from socket, returns -1 if the connection must be closed */
+static int admin_handle_msg(struct admin_list *admin, struct admin_message *msg)
+{
+	/* process socket command */
+	if ((admin->response || admin->tx_len) && msg->message != ADMIN_MESSAGE) {
+		PERROR("Data from socket %d while sending response.\n", admin->sock);
+		return(-1);
+	}
+	switch (msg->message) {
+		case ADMIN_REQUEST_CMD_INTERFACE:
+		if (admin_interface(&admin->response) < 0) {
+			PERROR("Failed to create dial response for socket %d.\n", admin->sock);
+			goto response_error;
+		}
+		update_fd(&admin->fd, admin->fd.when | LCR_FD_WRITE);
+		break;
+
+		case ADMIN_REQUEST_CMD_ROUTE:
+		if (admin_route(&admin->response) < 0) {
+			PERROR("Failed to create dial response for socket %d.\n", admin->sock);
+			goto response_error;
+		}
+		update_fd(&admin->fd, admin->fd.when | LCR_FD_WRITE);
+		break;
+
+		case ADMIN_REQUEST_CMD_DIAL:
+		if (admin_dial(&admin->response, msg->u.x.message) < 0) {
+			PERROR("Failed to create dial response for socket %d.\n", admin->sock);
+			goto response_error;
+		}
+		update_fd(&admin->fd, admin->fd.when | LCR_FD_WRITE);
+		break;
+
+		case ADMIN_REQUEST_CMD_RELEASE:
+		if (admin_release(&admin->response, msg->u.x.message) < 0) {
+			PERROR("Failed to create release response for socket %d.\n", admin->sock);
+			goto response_error;
+		}
+		update_fd(&admin->fd, admin->fd.when | LCR_FD_WRITE);
+		break;
+
+		case ADMIN_REQUEST_STATE:
+		if (admin_state(&admin->response) < 0) {
+			PERROR("Failed to create state response for socket %d.\n", admin->sock);
+			goto response_error;
+		}
+		update_fd(&admin->fd, admin->fd.when | LCR_FD_WRITE);
+		break;
+
+		case ADMIN_TRACE_REQUEST:
+		if (admin_trace(admin, &msg->u.trace_req) < 0) {
+			PERROR("Failed to create trace response for socket %d.\n", admin->sock);
+			goto response_error;
+		}
+		update_fd(&admin->fd, admin->fd.when | LCR_FD_WRITE);
+		break;
+
+		case ADMIN_REQUEST_CMD_BLOCK:
+		if (admin_block(&admin->response, msg->u.x.portnum, msg->u.x.block) < 0) {
+			PERROR("Failed to create block response for socket %d.\n", admin->sock);
+			goto response_error;
+		}
+		update_fd(&admin->fd, admin->fd.when | LCR_FD_WRITE);
+		break;
+
+		case ADMIN_MESSAGE:
+		if (admin_message_to_lcr(&msg->u.msg, admin) < 0) {
+			PERROR("Failed to deliver message for socket %d.\n", admin->sock);
+			goto response_error;
+		}
+		break;
+
+		case ADMIN_CALL_SETUP:
+		if (admin_call(admin, msg) < 0) {
+			PERROR("Failed to create call for socket %d.\n", admin->sock);
+			response_error:
+			return(-1);
+		}
+		break;
+
+		default:
+		PERROR("Invalid message %d from socket %d.\n", msg->message, admin->sock);
+		return(-1);
+	}
+
+	return(0);
+}
+
 int admin_handle_con(struct lcr_fd *fd, unsigned int what, void *instance, int index)
 {
 	struct admin_list *admin = (struct admin_list *)instance;
-	void			*temp;
-	struct admin_message	msg;
-	int			len;
+	struct admin_queue	*response;
+	struct admin_message	msg, *am;
+	int			len, size, offset;
 	struct Endpoint		*epoint;
 
 	if ((what & LCR_FD_READ)) {
-		/* read command */
-		len = read(admin->sock, &msg, sizeof(msg));
+		/* read as many messages as fit into buffer */
+		len = read(admin->sock, admin->rx_buffer + admin->rx_len, sizeof(admin->rx_buffer) - admin->rx_len);
 		if (len < 0) {
 			brokenpipe:
 			PDEBUG(DEBUG_LOG, "Broken pipe on socket %d. (errno=%d).\n", admin->sock, errno);
@@ -1195,113 +1331,57 @@ int admin_handle_con(struct lcr_fd *fd, unsigned int what, void *instance, int i
 		}
 		if (len == 0)
 			goto end;
-		if (len != sizeof(msg)) {
-			PERROR("Short/long read on socket %d. (len=%d != size=%d).\n", admin->sock, len, sizeof(msg));
-			goto end;
-		}
-		/* process socket command */
-		if (admin->response && msg.message != ADMIN_MESSAGE) {
-			PERROR("Data from socket %d while sending response.\n", admin->sock);
-			goto end;
-		}
-		switch (msg.message) {
-			case ADMIN_REQUEST_CMD_INTERFACE:
-			if (admin_interface(&admin->response) < 0) {
-				PERROR("Failed to create dial response for socket %d.\n", admin->sock);
-				goto response_error;
-			}
-			admin->fd.when |= LCR_FD_WRITE;
-			break;
-
-			case ADMIN_REQUEST_CMD_ROUTE:
-			if (admin_route(&admin->response) < 0) {
-				PERROR("Failed to create dial response for socket %d.\n", admin->sock);
-				goto response_error;
-			}
-			admin->fd.when |= LCR_FD_WRITE;
-			break;
-
-			case ADMIN_REQUEST_CMD_DIAL:
-			if (admin_dial(&admin->response, msg.u.x.message) < 0) {
-				PERROR("Failed to create dial response for socket %d.\n", admin->sock);
-				goto response_error;
-			}
-			admin->fd.when |= LCR_FD_WRITE;
-			break;
-
-			case ADMIN_REQUEST_CMD_RELEASE:
-			if (admin_release(&admin->response, msg.u.x.message) < 0) {
-				PERROR("Failed to create release response for socket %d.\n", admin->sock);
-				goto response_error;
-			}
-			admin->fd.when |= LCR_FD_WRITE;
-			break;
-
-			case ADMIN_REQUEST_STATE:
-			if (admin_state(&admin->response) < 0) {
-				PERROR("Failed to create state response for socket %d.\n", admin->sock);
-				goto response_error;
-			}
-			admin->fd.when |= LCR_FD_WRITE;
-			break;
-
-			case ADMIN_TRACE_REQUEST:
-			if (admin_trace(admin, &msg.u.trace_req) < 0) {
-				PERROR("Failed to create trace response for socket %d.\n", admin->sock);
-				goto response_error;
-			}
-			admin->fd.when |= LCR_FD_WRITE;
-			break;
-
-			case ADMIN_REQUEST_CMD_BLOCK:
-			if (admin_block(&admin->response, msg.u.x.portnum, msg.u.x.block) < 0) {
-				PERROR("Failed to create block response for socket %d.\n", admin->sock);
-				goto response_error;
-			}
-			admin->fd.when |= LCR_FD_WRITE;
-			break;
-
-			case ADMIN_MESSAGE:
-			if (admin_message_to_lcr(&msg.u.msg, admin) < 0) {
-				PERROR("Failed to deliver message for socket %d.\n", admin->sock);
-				goto response_error;
-			}
-			break;
-
-			case ADMIN_CALL_SETUP:
-			if (admin_call(admin, &msg) < 0) {
-				PERROR("Failed to create call for socket %d.\n", admin->sock);
-				response_error:
+		admin->rx_len += len;
+		/* process all complete messages */
+		offset = 0;
+		while ((size = admin_frame_length(admin->rx_buffer + offset, admin->rx_len - offset)) > 0) {
+			admin_frame_decode(&msg, admin->rx_buffer + offset);
+			offset += size;
+			if (admin_handle_msg(admin, &msg) < 0)
 				goto end;
-			}
-			break;
-
-			default:
-			PERROR("Invalid message %d from socket %d.\n", msg.message, admin->sock);
+		}
+		if (size < 0) {
+			PERROR("Invalid frame on socket %d.\n", admin->sock);
 			goto end;
 		}
+		/* keep incomplete message */
+		admin->rx_len -= offset;
+		if (offset && admin->rx_len)
+			memmove(admin->rx_buffer, admin->rx_buffer + offset, admin->rx_len);
 	}
 
 	if ((what & LCR_FD_WRITE)) {
-		/* write queue */
-		if (admin->response) {
-			len = write(admin->sock, ((unsigned char *)(admin->response->am))+admin->response->offset, sizeof(struct admin_message)*(admin->response->num)-admin->response->offset);
-			if (len < 0) {
-				goto brokenpipe;
+		/* fill buffer with queued messages, so they are written at once */
+		while ((response = admin->response)) {
+			am = &response->am[response->offset];
+			size = (admin->framing) ? admin_frame_max(am) : (int)sizeof(struct admin_message);
+			if (admin->tx_len + size > (int)sizeof(admin->tx_buffer))
+				break;
+			if (admin->framing)
+				admin->tx_len += admin_frame_encode(admin->tx_buffer + admin->tx_len, am);
+			else {
+				memcpy(admin->tx_buffer + admin->tx_len, am, sizeof(struct admin_message));
+				admin->tx_len += sizeof(struct admin_message);
 			}
-			if (len == 0)
-				goto end;
-			if (len < (int)(sizeof(struct admin_message)*(admin->response->num) - admin->response->offset)) {
-				admin->response->offset+=len;
-				return 0;
-			} else {
-				temp = admin->response;
-				admin->response = admin->response->next;
-				FREE(temp, 0);
+			if (++response->offset == response->num) {
+				admin->response = response->next;
+				FREE(response, 0);
 				memuse--;
 			}
-		} else
-			admin->fd.when &= ~LCR_FD_WRITE;
+		}
+		if (!admin->tx_len) {
+			update_fd(&admin->fd, admin->fd.when & ~LCR_FD_WRITE);
+			return 0;
+		}
+		len = write(admin->sock, admin->tx_buffer, admin->tx_len);
+		if (len < 0) {
+			goto brokenpipe;
+		}
+		if (len == 0)
+			goto end;
+		admin->tx_len -= len;
+		if (admin->tx_len)
+			memmove(admin->tx_buffer, admin->tx_buffer + len, admin->tx_len);
 	}
 
 	return 0;
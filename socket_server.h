@@ -13,7 +13,7 @@
 
 struct admin_queue {
 	struct admin_queue	*next;
-	unsigned int		offset; /* current offset writing */
+	unsigned int		offset; /* next message to write */
 	unsigned int		num; /* number of admin messages */
 	struct admin_message	am[0];
 };
@@ -27,6 +27,11 @@ struct admin_list {
 	struct admin_trace_req trace; /* stores trace, if detail != 0 */
 	unsigned int epointid;
 	struct admin_queue *response;
+	int framing; /* remote application accepts framed messages */
+	unsigned char rx_buffer[ADMIN_BUFFER]; /* received data, not yet processed */
+	int rx_len;
+	unsigned char tx_buffer[ADMIN_BUFFER]; /* messages, not yet written */
+	int tx_len;
 };
 
 extern struct admin_list *admin_first;
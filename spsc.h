@@ -0,0 +1,74 @@
+/*****************************************************************************\
+**                                                                           **
+** LCR                                                                       **
+**                                                                           **
+**---------------------------------------------------------------------------**
+** Copyright: Andreas Eversberg                                              **
+**                                                                           **
+** Lock-free queue between one producer thread and one consumer thread       **
+**                                                                           **
+\*****************************************************************************/
+
+/*
+ * elements have a fixed size and are copied into and out of the queue.
+ * the buffer is given by the caller and must hold 'num' elements, where
+ * 'num' is a power of two. head and tail are on different cache lines, so
+ * producer and consumer do not share a line they write.
+ * if the buffer is NULL, the elements directly follow the structure. then the
+ * queue contains no pointer and can be placed in shared memory.
+ */
+struct spsc {
+	unsigned int	head;		/* next element to write (producer) */
+	unsigned char	head_pad[60];
+	unsigned int	tail;		/* next element to read (consumer) */
+	unsigned char	tail_pad[60];
+	unsigned int	num;		/* number of elements */
+	unsigned int	size;		/* size of one element */
+	unsigned char	*buffer;
+};
+
+static inline void spsc_init(struct spsc *q, void *buffer, unsigned int num, unsigned int size)
+{
+	q->head = q->tail = 0;
+	q->num = num;
+	q->size = size;
+	q->buffer = (unsigned char *)buffer;
+}
+
+static inline unsigned char *spsc_element(struct spsc *q, unsigned int index)
+{
+	unsigned char *buffer = (q->buffer) ? q->buffer : (unsigned char *)(q + 1);
+
+	return buffer + (index & (q->num - 1)) * q->size;
+}
+
+/* returns the number of elements in the queue */
+static inline unsigned int spsc_count(struct spsc *q)
+{
+	return __atomic_load_n(&q->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+}
+
+/* producer: copy element to queue, returns -1 if full */
+static inline int spsc_put(struct spsc *q, const void *element)
+{
+	unsigned int head = q->head;
+
+	if (head - __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) == q->num)
+		return -1;
+	memcpy(spsc_element(q, head), element, q->size);
+	__atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/* consumer: copy element from queue, returns -1 if empty */
+static inline int spsc_get(struct spsc *q, void *element)
+{
+	unsigned int tail = q->tail;
+
+	if (__atomic_load_n(&q->head, __ATOMIC_ACQUIRE) == tail)
+		return -1;
+	memcpy(element, spsc_element(q, tail), q->size);
+	__atomic_store_n(&q->tail, tail + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
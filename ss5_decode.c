@@ -23,16 +23,14 @@
 #define NOISE_MIN_DB	(TONE_MIN_DB / 2) /* noise must be higher than the minimum of two tones */
 #define SNR		1.3	/* noise may not exceed signal by that factor */
 
-/* For DTMF recognition:
- * 2 * cos(2 * PI * k / N) precalculated for all k
- */
-static signed long long cos2pik[NCOEFF] =
+/* frequencies to be analyzed */
+static int frequency[NCOEFF] =
 {
-	/* k = 2*cos(2*PI*f/8000), k << 15 
-	 * 700, 900, 1100, 1300, 1500, 1700, 2400, 2600 */
-	55879, 49834, 42562, 34242, 25080, 15299, -20252, -29753
+	700, 900, 1100, 1300, 1500, 1700, 2400, 2600
 };
 
+static struct goertzel ss5_goertzel;
+
 /* detection matrix for two frequencies */
 static char decode_two[8][8] =
 {
@@ -55,13 +53,16 @@ static char decode_one[8] =
 char ss5_decode(unsigned char *data, int len)
 {
 	signed short buf[len];
-	signed long sk, sk1, sk2, low, high;
-	int k, n, i;
+	signed long sk, low, high;
+	int n, i;
 	int f1 = 0, f2 = 0;
-	double result[NCOEFF], power, noise, snr;
-	signed long long cos2pik_;
+	float power[NCOEFF];
+	double result[NCOEFF], level, noise, snr, scale;
 	char digit = ' ';
 
+	if (!ss5_goertzel.num)
+		goertzel_init(&ss5_goertzel, frequency, NCOEFF, 8000);
+
 	/* convert samples */
 	for (i = 0; i < len; i++)
 		buf[i] = audio_law_to_s32[*data++];
@@ -82,66 +83,52 @@ char ss5_decode(unsigned char *data, int len)
 	if (noise < NOISE_MIN_DB)
 		return digit;
 
-	/* now we have a full buffer of signed long samples - we do goertzel */
-	for (k = 0; k < NCOEFF; k++) {
-		sk = 0;
-		sk1 = 0;
-		sk2 = 0;
-		cos2pik_ = cos2pik[k];
-		for (n = 0; n < len; n++) {
-			sk = ((cos2pik_*sk1)>>15) - sk2 + buf[n];
-			sk2 = sk1;
-			sk1 = sk;
-		}
-		sk >>= 8;
-		sk2 >>= 8;
-		if (sk > 32767 || sk < -32767 || sk2 > 32767 || sk2 < -32767)
-			PERROR("Tone-Detection overflow\n");
-		/* compute |X(k)|**2 */
-		result[k] = sqrt (
-				(sk * sk) -
-				(((cos2pik[k] * sk) >> 15) * sk2) +
-				(sk2 * sk2)
-			) / len / 62; /* level of 1 is 0 db*/
-	}
+	/* now we have a full buffer of samples - we do goertzel for all frequencies at once */
+	goertzel_power(&ss5_goertzel, buf, len, power);
+
+	/* compute |X(k)|**2, level of 1 is 0 db
+	 * levels are compared squared, so sqrt() is only needed for the SNR */
+	scale = 1.0 / ((double)len * len * 62 * 62 * 65536);
+	for (i = 0; i < NCOEFF; i++)
+		result[i] = power[i] * scale;
 
 	/* find the two loudest frequencies + one less lower frequency to detect noise */
-	power = 0.0;
+	level = 0.0;
 	for (i = 0; i < NCOEFF; i++) {
-		if (result[i] > power) {
-			power = result[i];
+		if (result[i] > level) {
+			level = result[i];
 			f1 = i;
 		}
 	}
-	power = 0.0;
+	level = 0.0;
 	for (i = 0; i < NCOEFF; i++) {
-		if (i != f1 && result[i] > power) {
-			power = result[i];
+		if (i != f1 && result[i] > level) {
+			level = result[i];
 			f2 = i;
 		}
 	}
 
 	snr = 0;
 	/* check one frequency */
-	if (result[f1] > TONE_MIN_DB /* must be at least -17 db */
-	 && result[f1]*SNR > noise) { /*  */
+	if (result[f1] > TONE_MIN_DB * TONE_MIN_DB /* must be at least -17 db */
+	 && sqrt(result[f1])*SNR > noise) { /*  */
 		digit = decode_one[f1];
 		if (digit != ' ')
-			snr = result[f1] / noise;
+			snr = sqrt(result[f1]) / noise;
 	}
 	/* check two frequencies */
-	if (result[f1] > TONE_MIN_DB && result[f2] > TONE_MIN_DB /* must be at lease -17 db */
-	 && result[f1]*TONE_DIFF_DB <= result[f2] /* f2 must be not less than 5 db below f1 */
-	 && (result[f1]+result[f2])*SNR > noise) { /* */
+	if (result[f1] > TONE_MIN_DB * TONE_MIN_DB && result[f2] > TONE_MIN_DB * TONE_MIN_DB /* must be at lease -17 db */
+	 && result[f1]*(TONE_DIFF_DB * TONE_DIFF_DB) <= result[f2] /* f2 must be not less than 5 db below f1 */
+	 && (sqrt(result[f1])+sqrt(result[f2]))*SNR > noise) { /* */
 		digit = decode_two[f1][f2];
 		if (digit != ' ')
-			snr = (result[f1]+result[f2]) / noise;
+			snr = (sqrt(result[f1])+sqrt(result[f2])) / noise;
 	}
 
 	/* debug powers */
 #ifdef DEBUG_LEVELS
 	for (i = 0; i < NCOEFF; i++)
-		printf("%d:%3d %c ", i, (int)(result[i]*100), (f1==i || f2==i)?'*':' ');
+		printf("%d:%3d %c ", i, (int)(sqrt(result[i])*100), (f1==i || f2==i)?'*':' ');
 	printf("N:%3d digit:%c snr=%3d\n", (int)(noise*100), digit, (int)(snr*100));
 // 	if (result[f1]*TONE_DIFF_DB <= result[f2]) /* f2 must be not less than 5 db below f1 */
 //		printf("jo!");
@@ -0,0 +1,68 @@
+/*****************************************************************************\
+**                                                                           **
+** Linux Call Router                                                         **
+**                                                                           **
+**---------------------------------------------------------------------------**
+** Copyright: Andreas Eversberg                                              **
+**                                                                           **
+** benchmark of lookup by serial                                             **
+**                                                                           **
+** joins are created and looked up by random serials, once by walking the    **
+** list (as find_join_id() did before) and once through find_join_id().      **
+** ports and endpoints use the same index. usage: bench_lookup [lookups]     **
+**                                                                           **
+\*****************************************************************************/
+
+#include "main.h"
+#include "tests/tests.h"
+
+/* the lookup as it was before the hash index */
+static class Join *find_join_id_list(unsigned int join_id)
+{
+	class Join *join = join_first;
+
+	while(join) {
+		if (join->j_serial == join_id)
+			return(join);
+		join = join->next;
+	}
+
+	return(NULL);
+}
+
+int main(int argc, char *argv[])
+{
+	static const int sizes[] = { 10, 1000, 10000 };
+	int lookups = (argc > 1) ? atoi(argv[1]) : 1000000;
+	unsigned int first, id;
+	double t, list, hash;
+	int i, j, n, count;
+
+	for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+		n = sizes[i];
+		first = join_serial;
+		for (j = 0; j < n; j++)
+			new Join();
+		/* the list walk is slow, so it gets fewer lookups with many joins */
+		count = lookups / (n / 1000 + 1);
+
+		t = bench_now();
+		for (j = 0; j < count; j++) {
+			id = first + (j * 7919u) % n;
+			CHECK(find_join_id_list(id)->j_serial == id);
+		}
+		list = (bench_now() - t) / count;
+
+		t = bench_now();
+		for (j = 0; j < count; j++) {
+			id = first + (j * 7919u) % n;
+			CHECK(find_join_id(id)->j_serial == id);
+		}
+		hash = (bench_now() - t) / count;
+
+		printf("%6d joins: list %8.1f ns  hash %5.1f ns\n", n, list, hash);
+		join_free();
+	}
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,142 @@
+/*****************************************************************************\
+**                                                                           **
+** Linux Call Router                                                         **
+**                                                                           **
+**---------------------------------------------------------------------------**
+** Copyright: Andreas Eversberg                                              **
+**                                                                           **
+** benchmark of conference mixing                                            **
+**                                                                           **
+** a conference of n members gets one 20 ms frame of random audio from each  **
+** member and sends one frame to each. the plain loop that mixed law bytes   **
+** into a sum buffer of longs is compared with the functions of mix.h. the   **
+** output of both must be the same. SSE2 is used on x86-64, build with       **
+** CXXFLAGS="-O2 -mavx2" for AVX2. usage: bench_mix [frames]                 **
+**                                                                           **
+\*****************************************************************************/
+
+#include "main.h"
+#include "mix.h"
+#include "tests/tests.h"
+
+#define MAX_MEMBERS	64
+
+/* old buffers: law bytes per member, long sums */
+static unsigned char old_buffer[MAX_MEMBERS][BRIDGE_BUFFER];
+static long old_sum[BRIDGE_BUFFER];
+
+/* new buffers: linear samples per member, 32 bit sums */
+static signed short new_buffer[MAX_MEMBERS][BRIDGE_BUFFER];
+static signed int new_sum[BRIDGE_BUFFER];
+
+static void old_mix(int members, unsigned char in[][160], unsigned char out[][160], int write_p, int read_p)
+{
+	int m, i, p;
+	long sample;
+
+	for (m = 0; m < members; m++) {
+		p = write_p;
+		for (i = 0; i < 160; i++) {
+			old_sum[p] += audio_law_to_s32[in[m][i]];
+			old_buffer[m][p] = in[m][i];
+			p = (p + 1) & (BRIDGE_BUFFER - 1);
+		}
+	}
+	for (m = 0; m < members; m++) {
+		p = read_p;
+		for (i = 0; i < 160; i++) {
+			sample = old_sum[p] - audio_law_to_s32[old_buffer[m][p]];
+			old_buffer[m][p] = silence;
+			if (sample < SHORT_MIN) sample = SHORT_MIN;
+			if (sample > SHORT_MAX) sample = SHORT_MAX;
+			out[m][i] = audio_s16_to_law[sample & 0xffff];
+			p = (p + 1) & (BRIDGE_BUFFER - 1);
+		}
+	}
+	p = read_p;
+	for (i = 0; i < 160; i++) {
+		old_sum[p] = 0;
+		p = (p + 1) & (BRIDGE_BUFFER - 1);
+	}
+}
+
+/* like Port::bridge_tx() and bridge_timeout(), a frame that crosses
+ * the end of the ring buffer is mixed in two parts */
+static void new_mix(int members, unsigned char in[][160], unsigned char out[][160], int write_p, int read_p)
+{
+	signed short linear[160], sample[160];
+	int m, i, p, n;
+
+	for (m = 0; m < members; m++) {
+		for (i = 0; i < 160; i++)
+			linear[i] = audio_law_to_s32[in[m][i]];
+		for (i = 0, p = write_p; i < 160; i += n, p = (p + n) & (BRIDGE_BUFFER - 1)) {
+			n = BRIDGE_BUFFER - p;
+			if (n > 160 - i)
+				n = 160 - i;
+			memcpy(new_buffer[m] + p, linear + i, n * sizeof(signed short));
+			bridge_mix_add(new_sum + p, linear + i, n);
+		}
+	}
+	for (m = 0; m < members; m++) {
+		for (i = 0, p = read_p; i < 160; i += n, p = (p + n) & (BRIDGE_BUFFER - 1)) {
+			n = BRIDGE_BUFFER - p;
+			if (n > 160 - i)
+				n = 160 - i;
+			bridge_mix_out(sample + i, new_sum + p, new_buffer[m] + p, n);
+			memset(new_buffer[m] + p, 0, n * sizeof(signed short));
+		}
+		for (i = 0; i < 160; i++)
+			out[m][i] = audio_s16_to_law[sample[i] & 0xffff];
+	}
+	for (i = 0, p = read_p; i < 160; i += n, p = (p + n) & (BRIDGE_BUFFER - 1)) {
+		n = BRIDGE_BUFFER - p;
+		if (n > 160 - i)
+			n = 160 - i;
+		memset(new_sum + p, 0, n * sizeof(signed int));
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	static const int sizes[] = { 3, 10, 32, 64 };
+	static unsigned char in[MAX_MEMBERS][160], out_old[MAX_MEMBERS][160], out_new[MAX_MEMBERS][160];
+	int frames = (argc > 1) ? atoi(argv[1]) : 20000;
+	double t_old, t_new, t;
+	int i, j, k, m, members, p;
+
+	generate_tables('a');
+	memset(old_buffer, silence, sizeof(old_buffer));
+	srand(1);
+
+	printf("members  old loop  %s\n",
+#if defined(__AVX2__)
+		"AVX2"
+#elif defined(__SSE2__)
+		"SSE2"
+#else
+		"plain"
+#endif
+		);
+	for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+		members = sizes[i];
+		t_old = t_new = 0;
+		for (j = 0; j < frames; j++) {
+			for (m = 0; m < members; m++)
+				for (k = 0; k < 160; k++)
+					in[m][k] = rand();
+			/* start near the end, so frames cross the end of the ring buffer */
+			p = (BRIDGE_BUFFER - 80 + j * 160) & (BRIDGE_BUFFER - 1);
+			t = bench_now();
+			old_mix(members, in, out_old, p, p);
+			t_old += bench_now() - t;
+			t = bench_now();
+			new_mix(members, in, out_new, p, p);
+			t_new += bench_now() - t;
+			CHECK(!memcmp(out_old, out_new, members * 160));
+		}
+		printf("%4d    %6.1f us %6.1f us\n", members, t_old / frames / 1000, t_new / frames / 1000);
+	}
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,220 @@
+/*****************************************************************************\
+**                                                                           **
+** Linux Call Router                                                         **
+**                                                                           **
+**---------------------------------------------------------------------------**
+** Copyright: Andreas Eversberg                                              **
+**                                                                           **
+** benchmark of rule selection by dialed number                              **
+**                                                                           **
+** a ruleset of random prefix rules is checked for numbers of different      **
+** length, once rule by rule (as route() did before) and once with the       **
+** rules selected by route_index.c. both must select the same rule, and the  **
+** same 'could match' result, also when the number is dialed digit by digit. **
+** conditions are evaluated like route() does for 'dialing', other           **
+** conditions have a fixed result. usage: bench_route [rules]                **
+**                                                                           **
+\*****************************************************************************/
+
+#include "main.h"
+#include "tests/tests.h"
+
+/* evaluate a rule like route(): returns 1 if it matches, 2 if it could
+ * match, 0 if not. if state is given, a rule that is false because of its
+ * dialing condition is excluded from the remaining rules */
+static int rule_check(struct route_rule *rule, const char *dialing, struct route_state *state, int rule_index)
+{
+	struct route_cond *cond = rule->cond_first;
+	int condition, istrue, couldbetrue;
+	size_t comp_len;
+
+	while(cond) {
+		condition = 0;
+		checkextension:
+		istrue = couldbetrue = 0;
+		if (cond->match == MATCH_DIALING) {
+			comp_len = strlen(cond->string_value);
+			if (strlen(dialing) < comp_len) {
+				couldbetrue = 1;
+				comp_len = strlen(dialing);
+			}
+			if (cond->value_type == VALUE_TYPE_STRING) {
+				if (!strncmp(dialing, cond->string_value, comp_len))
+					istrue = 1;
+			} else {
+				if (strncmp(dialing, cond->string_value, comp_len) >= 0
+				 && strncmp(dialing, cond->string_value_to, comp_len) <= 0)
+					istrue = 1;
+			}
+		} else
+			istrue = cond->integer_value;
+		if (istrue && !couldbetrue)
+			condition = 1;
+		if (istrue && couldbetrue && !condition)
+			condition = 2;
+		if (condition != 1) {
+			if (cond->value_extension && cond->next) {
+				cond = cond->next;
+				goto checkextension;
+			}
+			if (state && !condition && cond->match == MATCH_DIALING)
+				state->remain[rule_index >> 6] &= ~(1ULL << (rule_index & 63));
+			return condition;
+		}
+		while(cond->value_extension && cond->next)
+			cond = cond->next;
+		cond = cond->next;
+	}
+	return 1;
+}
+
+/* returns the index of the matching rule or -1, sets could if a rule could match */
+static int route_linear(struct route_ruleset *ruleset, const char *dialing, int *could)
+{
+	struct route_rule *rule;
+	int i, match;
+
+	*could = 0;
+	for (i = 0, rule = ruleset->rule_first; rule; i++, rule = rule->next) {
+		match = rule_check(rule, dialing, NULL, i);
+		if (match == 1)
+			return i;
+		if (match == 2)
+			*could = 1;
+	}
+	return -1;
+}
+
+static int route_indexed(struct route_ruleset *ruleset, const char *dialing, int *could, struct route_state **statep)
+{
+	struct route_rule *rule;
+	int i = -1, match;
+
+	*could = 0;
+	ruleset_candidates(ruleset, dialing);
+	if (statep)
+		ruleset_remain(ruleset, statep, dialing);
+	while((rule = ruleset_next_rule(ruleset, &i))) {
+		match = rule_check(rule, dialing, statep ? *statep : NULL, i);
+		if (match == 1)
+			return i;
+		if (match == 2)
+			*could = 1;
+	}
+	return -1;
+}
+
+static struct route_cond *new_cond(int match, const char *value)
+{
+	struct route_cond *cond;
+
+	cond = (struct route_cond *)MALLOC(sizeof(struct route_cond));
+	cond->match = match;
+	cond->value_type = VALUE_TYPE_STRING;
+	cond->string_value = strdup(value);
+	cond->integer_value = 1;
+	return cond;
+}
+
+static void random_number(char *number, int min, int max)
+{
+	int i, len = min + rand() % (max - min + 1);
+
+	number[0] = '0';
+	for (i = 1; i < len; i++)
+		number[i] = '0' + rand() % 10;
+	number[len] = '\0';
+}
+
+/* random prefix rules. about 15% of them cannot be indexed, because of an
+ * 'execute'/'file' condition before 'dialing' or a range */
+static struct route_ruleset *random_ruleset(int rules)
+{
+	struct route_ruleset *ruleset;
+	struct route_rule **rulep;
+	struct route_cond **condp;
+	char value[16];
+	int i, v, values, kind;
+
+	ruleset = (struct route_ruleset *)MALLOC(sizeof(struct route_ruleset));
+	SCPY(ruleset->name, "bench");
+	rulep = &ruleset->rule_first;
+	for (i = 0; i < rules; i++) {
+		*rulep = (struct route_rule *)MALLOC(sizeof(struct route_rule));
+		(*rulep)->line = i + 1;
+		condp = &(*rulep)->cond_first;
+		kind = rand() % 20;
+		if (kind == 0) {
+			*condp = new_cond(MATCH_EXTERN, "");
+			(*condp)->integer_value = rand() % 2;
+			condp = &(*condp)->next;
+		}
+		if (kind == 1) {
+			*condp = new_cond(MATCH_FILE, "");
+			condp = &(*condp)->next;
+		}
+		values = (rand() % 6) ? 1 : 2;
+		for (v = 0; v < values; v++) {
+			random_number(value, 3, 8);
+			*condp = new_cond(MATCH_DIALING, value);
+			(*condp)->value_extension = (v < values - 1);
+			if (kind == 2) {
+				(*condp)->value_type = VALUE_TYPE_STRING_RANGE;
+				(*condp)->string_value_to = strdup(value);
+				(*condp)->string_value[strlen(value) - 1] = '0';
+			}
+			condp = &(*condp)->next;
+		}
+		rulep = &(*rulep)->next;
+	}
+	ruleset_compile(ruleset);
+	return ruleset;
+}
+
+int main(int argc, char *argv[])
+{
+	static const char *number = "049301234567";
+	static const int lens[] = { 1, 2, 4, 12 };
+	int rules = (argc > 1) ? atoi(argv[1]) : 10000;
+	struct route_ruleset *ruleset;
+	struct route_state *state = NULL;
+	char dialing[32], prefix[32];
+	int i, j, l, repeat = 200, could1, could2;
+	double t, linear, indexed;
+	volatile int sink = 0;
+
+	srand(3);
+	ruleset = random_ruleset(rules);
+
+	/* same result for random numbers, also digit by digit */
+	for (i = 0; i < 200; i++) {
+		random_number(dialing, 1, 10);
+		CHECK(route_linear(ruleset, dialing, &could1) == route_indexed(ruleset, dialing, &could2, NULL));
+		CHECK(could1 == could2);
+		for (l = 0; l <= (int)strlen(dialing); l++) {
+			memcpy(prefix, dialing, l);
+			prefix[l] = '\0';
+			CHECK(route_linear(ruleset, prefix, &could1) == route_indexed(ruleset, prefix, &could2, &state));
+			CHECK(could1 == could2);
+		}
+	}
+
+	printf("%d rules\n", rules);
+	for (i = 0; i < (int)(sizeof(lens) / sizeof(lens[0])); i++) {
+		memcpy(dialing, number, lens[i]);
+		dialing[lens[i]] = '\0';
+		t = bench_now();
+		for (j = 0; j < repeat; j++)
+			sink += route_linear(ruleset, dialing, &could1);
+		linear = (bench_now() - t) / repeat;
+		t = bench_now();
+		for (j = 0; j < repeat; j++)
+			sink += route_indexed(ruleset, dialing, &could2, NULL);
+		indexed = (bench_now() - t) / repeat;
+		printf("dialed %-13s linear %6.1f us  indexed %6.1f us\n", dialing, linear / 1000, indexed / 1000);
+	}
+
+	route_state_free(state);
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,268 @@
+/*****************************************************************************\
+**                                                                           **
+** Linux Call Router                                                         **
+**                                                                           **
+**---------------------------------------------------------------------------**
+** Copyright: Andreas Eversberg                                              **
+**                                                                           **
+** benchmark of RTP receive and send on the shared RTP port                  **
+**                                                                           **
+** every 20 ms tick, each call gets one RTP packet from its remote socket    **
+** and sends one packet back on loopback. once with one socket per call,     **
+** epoll_wait() and read()/write() per packet (as before rtp_shared_port),   **
+** once with one shared socket, recvmmsg() and sendmmsg() like sip.cpp does. **
+** every packet must be received once and be found by its source address.   **
+** only our side is timed and counted. usage: bench_rtp [calls] [ticks]      **
+**                                                                           **
+\*****************************************************************************/
+
+#include "main.h"
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include "tests/tests.h"
+
+#define BATCH	64	/* like RTP_BATCH */
+#define PACKET	172	/* RTP header and 160 samples */
+
+static unsigned char packet[PACKET];
+static unsigned short call_of_port[65536];
+
+static int open_udp(unsigned short *port)
+{
+	struct sockaddr_in sin;
+	socklen_t len = sizeof(sin);
+	int fd, size = 1 << 20;
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0) {
+		perror("socket");
+		exit(1);
+	}
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(fd, (struct sockaddr *)&sin, sizeof(sin)) < 0) {
+		perror("bind");
+		exit(1);
+	}
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	getsockname(fd, (struct sockaddr *)&sin, &len);
+	*port = ntohs(sin.sin_port);
+	return fd;
+}
+
+static void connect_udp(int fd, unsigned short port)
+{
+	struct sockaddr_in sin;
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	sin.sin_port = htons(port);
+	connect(fd, (struct sockaddr *)&sin, sizeof(sin));
+}
+
+/* the packet of a call carries its number and tick */
+static void remote_send(int fd, int call, int tick)
+{
+	memcpy(packet, &call, sizeof(int));
+	memcpy(packet + sizeof(int), &tick, sizeof(int));
+	if (write(fd, packet, PACKET) != PACKET)
+		CHECK(0);
+}
+
+static void check_packet(unsigned char *data, int len, int call, int tick)
+{
+	int c, t;
+
+	CHECK(len == PACKET);
+	memcpy(&c, data, sizeof(int));
+	memcpy(&t, data + sizeof(int), sizeof(int));
+	CHECK(c == call);
+	CHECK(t == tick);
+}
+
+/* read what our side sent, so the remote sockets do not fill up */
+static void remote_drain(int *remote, int calls)
+{
+	unsigned char buffer[256];
+	int i;
+
+	for (i = 0; i < calls; i++) {
+		if (read(remote[i], buffer, sizeof(buffer)) != PACKET)
+			CHECK(0);
+	}
+}
+
+/* one socket per call */
+static double per_socket(int calls, int ticks, long *syscalls)
+{
+	int local[calls], remote[calls], ep, t, i, n, k, left, len;
+	unsigned short local_port[calls], remote_port;
+	struct epoll_event ev[64], e;
+	unsigned char buffer[256];
+	double start, time = 0;
+
+	ep = epoll_create1(0);
+	for (i = 0; i < calls; i++) {
+		local[i] = open_udp(&local_port[i]);
+		remote[i] = open_udp(&remote_port);
+		connect_udp(local[i], remote_port);
+		connect_udp(remote[i], local_port[i]);
+		memset(&e, 0, sizeof(e));
+		e.events = EPOLLIN;
+		e.data.u32 = i;
+		epoll_ctl(ep, EPOLL_CTL_ADD, local[i], &e);
+	}
+
+	for (t = 0; t < ticks; t++) {
+		for (i = 0; i < calls; i++)
+			remote_send(remote[i], i, t);
+		start = bench_now();
+		for (left = calls; left > 0; ) {
+			n = epoll_wait(ep, ev, 64, 100);
+			(*syscalls)++;
+			if (n <= 0) {
+				CHECK(0);
+				break;
+			}
+			for (k = 0; k < n; k++) {
+				i = ev[k].data.u32;
+				len = read(local[i], buffer, sizeof(buffer));
+				(*syscalls)++;
+				check_packet(buffer, len, i, t);
+				left--;
+			}
+		}
+		for (i = 0; i < calls; i++) {
+			if (write(local[i], packet, PACKET) != PACKET)
+				CHECK(0);
+			(*syscalls)++;
+		}
+		time += bench_now() - start;
+		remote_drain(remote, calls);
+	}
+
+	for (i = 0; i < calls; i++) {
+		close(local[i]);
+		close(remote[i]);
+	}
+	close(ep);
+	return time;
+}
+
+/* one shared socket, packets are found by their source port */
+static double shared(int calls, int ticks, long *syscalls)
+{
+	static struct mmsghdr msg[BATCH];
+	static struct iovec iov[BATCH];
+	static unsigned char buffer[BATCH][256];
+	static struct sockaddr_in sin[BATCH];
+	int remote[calls], received[calls], ep, sock, t, i, k, n, num, sent, left;
+	struct sockaddr_in dest[calls];
+	unsigned short local_port, remote_port;
+	struct epoll_event e;
+	double start, time = 0;
+
+	ep = epoll_create1(0);
+	sock = open_udp(&local_port);
+	for (i = 0; i < calls; i++) {
+		remote[i] = open_udp(&remote_port);
+		connect_udp(remote[i], local_port);
+		call_of_port[remote_port] = i;
+		memset(&dest[i], 0, sizeof(dest[i]));
+		dest[i].sin_family = AF_INET;
+		dest[i].sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		dest[i].sin_port = htons(remote_port);
+	}
+	memset(&e, 0, sizeof(e));
+	e.events = EPOLLIN;
+	epoll_ctl(ep, EPOLL_CTL_ADD, sock, &e);
+
+	for (t = 0; t < ticks; t++) {
+		for (i = 0; i < calls; i++)
+			remote_send(remote[i], i, t);
+		memset(received, 0, sizeof(received));
+		start = bench_now();
+		for (left = calls; left > 0; ) {
+			n = epoll_wait(ep, &e, 1, 100);
+			(*syscalls)++;
+			if (n <= 0) {
+				CHECK(0);
+				break;
+			}
+			do {
+				for (k = 0; k < BATCH; k++) {
+					iov[k].iov_base = buffer[k];
+					iov[k].iov_len = sizeof(buffer[k]);
+					memset(&msg[k].msg_hdr, 0, sizeof(msg[k].msg_hdr));
+					msg[k].msg_hdr.msg_name = &sin[k];
+					msg[k].msg_hdr.msg_namelen = sizeof(sin[k]);
+					msg[k].msg_hdr.msg_iov = &iov[k];
+					msg[k].msg_hdr.msg_iovlen = 1;
+				}
+				num = recvmmsg(sock, msg, BATCH, MSG_DONTWAIT, NULL);
+				(*syscalls)++;
+				for (k = 0; k < num; k++) {
+					i = call_of_port[ntohs(sin[k].sin_port)];
+					check_packet(buffer[k], msg[k].msg_len, i, t);
+					received[i]++;
+					left--;
+				}
+			} while (num == BATCH);
+		}
+		for (i = 0; i < calls; i += n) {
+			n = (calls - i < BATCH) ? calls - i : BATCH;
+			for (k = 0; k < n; k++) {
+				iov[k].iov_base = packet;
+				iov[k].iov_len = PACKET;
+				memset(&msg[k].msg_hdr, 0, sizeof(msg[k].msg_hdr));
+				msg[k].msg_hdr.msg_name = &dest[i + k];
+				msg[k].msg_hdr.msg_namelen = sizeof(dest[0]);
+				msg[k].msg_hdr.msg_iov = &iov[k];
+				msg[k].msg_hdr.msg_iovlen = 1;
+			}
+			for (sent = 0; sent < n; sent += num) {
+				num = sendmmsg(sock, msg + sent, n - sent, 0);
+				(*syscalls)++;
+				if (num <= 0) {
+					CHECK(0);
+					break;
+				}
+			}
+		}
+		time += bench_now() - start;
+		for (i = 0; i < calls; i++)
+			CHECK(received[i] == 1);
+		remote_drain(remote, calls);
+	}
+
+	for (i = 0; i < calls; i++)
+		close(remote[i]);
+	close(sock);
+	close(ep);
+	return time;
+}
+
+int main(int argc, char *argv[])
+{
+	int calls = (argc > 1) ? atoi(argv[1]) : 300;
+	int ticks = (argc > 2) ? atoi(argv[2]) : 500;
+	long syscalls;
+	double t;
+
+	if (calls < 1 || calls * 2 + 16 > (int)sysconf(_SC_OPEN_MAX)) {
+		fprintf(stderr, "%d calls need more file descriptors than allowed\n", calls);
+		return 1;
+	}
+	printf("%d calls, %d ticks of 20 ms\n", calls, ticks);
+
+	syscalls = 0;
+	t = per_socket(calls, ticks, &syscalls);
+	printf("socket per call  %7.1f us per tick %6ld syscalls per tick\n", t / ticks / 1000, syscalls / ticks);
+	syscalls = 0;
+	t = shared(calls, ticks, &syscalls);
+	printf("shared socket    %7.1f us per tick %6ld syscalls per tick\n", t / ticks / 1000, syscalls / ticks);
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,150 @@
+/*****************************************************************************\
+**                                                                           **
+** Linux Call Router                                                         **
+**                                                                           **
+**---------------------------------------------------------------------------**
+** Copyright: Andreas Eversberg                                              **
+**                                                                           **
+** benchmark of messages on the LCR socket                                   **
+**                                                                           **
+** messages of 500 calls, 90% traffic and 10% setup, are sent through a      **
+** socket pair. once as fixed size messages with one write() and read() per  **
+** message (as before framing), once as fixed size messages collected in a   **
+** buffer, and once framed and collected in a buffer, like socket_server.c   **
+** and chan_lcr.c do. every message must arrive unchanged and in order.      **
+** usage: bench_socket [messages]                                            **
+**                                                                           **
+\*****************************************************************************/
+
+#include "main.h"
+#include "tests/tests.h"
+
+#define CALLS	500
+
+static struct admin_message msg, rcv;
+static unsigned char tx[ADMIN_BUFFER], rx[ADMIN_BUFFER];
+
+/* message number n of the test */
+static void make_message(struct admin_message *m, int n)
+{
+	memset(m, 0, sizeof(struct admin_message));
+	m->message = ADMIN_MESSAGE;
+	m->u.msg.ref = n % CALLS;
+	if ((n % 10)) {
+		m->u.msg.type = MESSAGE_TRAFFIC;
+		m->u.msg.param.traffic.len = 160;
+		memset(m->u.msg.param.traffic.data, n, 160);
+	} else {
+		m->u.msg.type = MESSAGE_SETUP;
+		SPRINT(m->u.msg.param.setup.dialinginfo.id, "%d", n);
+	}
+}
+
+static void check_message(struct admin_message *m, int n)
+{
+	make_message(&msg, n);
+	CHECK(m->u.msg.ref == msg.u.msg.ref);
+	CHECK(m->u.msg.type == msg.u.msg.type);
+	if (msg.u.msg.type == MESSAGE_TRAFFIC)
+		CHECK(!memcmp(&m->u.msg.param.traffic, &msg.u.msg.param.traffic, sizeof(struct param_traffic)));
+	else
+		CHECK(!strcmp(m->u.msg.param.setup.dialinginfo.id, msg.u.msg.param.setup.dialinginfo.id));
+}
+
+/* one write() and read() per message */
+static void single(int sock[2], int messages, long *bytes, long *calls)
+{
+	int i, len, ret;
+
+	for (i = 0; i < messages; i++) {
+		make_message(&msg, i);
+		ret = write(sock[0], &msg, sizeof(msg));
+		(*calls)++;
+		if (ret > 0)
+			*bytes += ret;
+		for (len = 0; len < (int)sizeof(rcv); len += ret) {
+			ret = read(sock[1], (char *)&rcv + len, sizeof(rcv) - len);
+			(*calls)++;
+			if (ret <= 0) {
+				CHECK(0);
+				return;
+			}
+		}
+		check_message(&rcv, i);
+	}
+}
+
+/* messages are collected in a buffer and written at once, all complete
+ * messages that are read are processed */
+static void batched(int sock[2], int messages, int framing, long *bytes, long *calls)
+{
+	int sent = 0, received = 0, tx_len = 0, rx_len = 0, offset, size, ret;
+
+	while(received < messages) {
+		while(sent < messages) {
+			make_message(&msg, sent);
+			size = (framing) ? admin_frame_max(&msg) : (int)sizeof(msg);
+			if (tx_len + size > ADMIN_BUFFER)
+				break;
+			if (framing)
+				tx_len += admin_frame_encode(tx + tx_len, &msg);
+			else {
+				memcpy(tx + tx_len, &msg, sizeof(msg));
+				tx_len += sizeof(msg);
+			}
+			sent++;
+		}
+		ret = write(sock[0], tx, tx_len);
+		(*calls)++;
+		if (ret > 0) {
+			*bytes += ret;
+			tx_len -= ret;
+			memmove(tx, tx + ret, tx_len);
+		}
+		ret = read(sock[1], rx + rx_len, sizeof(rx) - rx_len);
+		(*calls)++;
+		if (ret <= 0) {
+			CHECK(0);
+			return;
+		}
+		rx_len += ret;
+		offset = 0;
+		while((size = admin_frame_length(rx + offset, rx_len - offset)) > 0) {
+			admin_frame_decode(&rcv, rx + offset);
+			check_message(&rcv, received++);
+			offset += size;
+		}
+		rx_len -= offset;
+		memmove(rx, rx + offset, rx_len);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	static const char *names[] = { "one message per syscall", "fixed size, batched", "framed and batched" };
+	int messages = (argc > 1) ? atoi(argv[1]) : CALLS * 50;
+	int sock[2], mode, size = 1 << 20;
+	long bytes, calls;
+	double t;
+
+	for (mode = 0; mode < 3; mode++) {
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, sock) < 0) {
+			perror("socketpair");
+			return 1;
+		}
+		setsockopt(sock[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+		setsockopt(sock[1], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+		bytes = calls = 0;
+		t = bench_now();
+		if (mode == 0)
+			single(sock, messages, &bytes, &calls);
+		else
+			batched(sock, messages, mode == 2, &bytes, &calls);
+		t = bench_now() - t;
+		printf("%-24s %6.1f ms %6ld bytes/msg %7ld syscalls\n", names[mode], t / 1e6, bytes / messages, calls);
+		close(sock[0]);
+		close(sock[1]);
+	}
+
+	return TEST_RESULT();
+}
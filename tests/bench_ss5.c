@@ -0,0 +1,202 @@
+/*****************************************************************************\
+**                                                                           **
+** Linux Call Router                                                         **
+**                                                                           **
+**---------------------------------------------------------------------------**
+** Copyright: Andreas Eversberg                                              **
+**                                                                           **
+** benchmark of SS5 tone detection                                           **
+**                                                                           **
+** the decoder with one fixed point goertzel loop per frequency, as it was   **
+** before goertzel.c, is compared with ss5_decode(). both get chunks of a    **
+** single tone sweep and of all tone pairs at different levels with noise.   **
+** results may only differ at the edge of a threshold, clear tones must be   **
+** decoded correctly. usage: bench_ss5 [chunks]                              **
+**                                                                           **
+\*****************************************************************************/
+
+#include "main.h"
+#include "ss5_decode.h"
+#include "tests/tests.h"
+
+#define NCOEFF		8
+
+#define TONE_MIN_DB	0.01995262
+#define TONE_DIFF_DB	0.2
+#define NOISE_MIN_DB	(TONE_MIN_DB / 2)
+#define SNR		1.3
+
+static int frequency[NCOEFF] = { 700, 900, 1100, 1300, 1500, 1700, 2400, 2600 };
+
+/* k = 2*cos(2*PI*f/8000), k << 15 */
+static signed long long cos2pik[NCOEFF] =
+{
+	55879, 49834, 42562, 34242, 25080, 15299, -20252, -29753
+};
+
+static char decode_two[8][8] =
+{
+	{' ', '1', '2', '4', '7', '*', ' ', ' '},
+	{'1', ' ', '3', '5', '8', '#', ' ', ' '},
+	{'2', '3', ' ', '6', '9', 'a', ' ', ' '},
+	{'4', '5', '6', ' ', '0', 'b', ' ', ' '},
+	{'7', '8', '9', '0', ' ', 'c', ' ', ' '},
+	{'*', '#', 'a', 'b', 'c', ' ', ' ', ' '},
+	{' ', ' ', ' ', ' ', ' ', ' ', ' ', 'C'},
+	{' ', ' ', ' ', ' ', ' ', ' ', 'C', ' '}
+};
+
+static char decode_one[8] =
+	{' ', ' ', ' ', ' ', ' ', ' ', 'A', 'B'};
+
+/* the decoder as it was before goertzel.c */
+static char ss5_decode_old(unsigned char *data, int len)
+{
+	signed short buf[len];
+	signed long sk, sk1, sk2, low, high;
+	int k, n, i;
+	int f1 = 0, f2 = 0;
+	double result[NCOEFF], power, noise;
+	signed long long cos2pik_;
+	char digit = ' ';
+
+	for (i = 0; i < len; i++)
+		buf[i] = audio_law_to_s32[*data++];
+
+	low = 32767;
+	high = -32768;
+	for (n = 0; n < len; n++) {
+		sk = buf[n];
+		if (sk < low)
+			low = sk;
+		if (sk > high)
+			high = sk;
+	}
+	noise = ((double)(high-low) / 65536.0);
+	if (noise < NOISE_MIN_DB)
+		return digit;
+
+	for (k = 0; k < NCOEFF; k++) {
+		sk = 0;
+		sk1 = 0;
+		sk2 = 0;
+		cos2pik_ = cos2pik[k];
+		for (n = 0; n < len; n++) {
+			sk = ((cos2pik_*sk1)>>15) - sk2 + buf[n];
+			sk2 = sk1;
+			sk1 = sk;
+		}
+		sk >>= 8;
+		sk2 >>= 8;
+		result[k] = sqrt (
+				(sk * sk) -
+				(((cos2pik[k] * sk) >> 15) * sk2) +
+				(sk2 * sk2)
+			) / len / 62;
+	}
+
+	power = 0.0;
+	for (i = 0; i < NCOEFF; i++) {
+		if (result[i] > power) {
+			power = result[i];
+			f1 = i;
+		}
+	}
+	power = 0.0;
+	for (i = 0; i < NCOEFF; i++) {
+		if (i != f1 && result[i] > power) {
+			power = result[i];
+			f2 = i;
+		}
+	}
+
+	if (result[f1] > TONE_MIN_DB
+	 && result[f1]*SNR > noise)
+		digit = decode_one[f1];
+	if (result[f1] > TONE_MIN_DB && result[f2] > TONE_MIN_DB
+	 && result[f1]*TONE_DIFF_DB <= result[f2]
+	 && (result[f1]+result[f2])*SNR > noise)
+		digit = decode_two[f1][f2];
+
+	return digit;
+}
+
+static void make_chunk(unsigned char *chunk, int f1, double a1, int f2, double a2, int noise, unsigned int *seed)
+{
+	int i, sample;
+
+	for (i = 0; i < SS5_DECODER_NPOINTS; i++) {
+		sample = (int)(sin(2 * M_PI * f1 * i / 8000.0) * a1 + sin(2 * M_PI * f2 * i / 8000.0 + 1) * a2);
+		if (noise) {
+			*seed = *seed * 1103515245 + 12345;
+			sample += (int)((*seed >> 16) % (2 * noise)) - noise;
+		}
+		if (sample > 32767)
+			sample = 32767;
+		if (sample < -32768)
+			sample = -32768;
+		chunk[i] = audio_s16_to_law[sample & 0xffff];
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	int chunks = (argc > 1) ? atoi(argv[1]) : 200000;
+	unsigned char chunk[SS5_DECODER_NPOINTS];
+	unsigned int seed = 1;
+	int f, x, y, r, i, cases = 0, detected = 0, differ = 0;
+	double a, t, t_old, t_new;
+	char old, now;
+	volatile char sink;
+
+	generate_tables('a');
+
+	/* single tone sweep */
+	for (f = 0; f < 4000; f += 5) {
+		for (a = 100; a < 30000; a *= 1.4) {
+			make_chunk(chunk, f, a, 0, 0, 0, &seed);
+			old = ss5_decode_old(chunk, SS5_DECODER_NPOINTS);
+			now = ss5_decode(chunk, SS5_DECODER_NPOINTS);
+			cases++;
+			detected += (old != ' ');
+			differ += (old != now);
+		}
+	}
+	/* all pairs at different levels with noise */
+	for (x = 0; x < NCOEFF; x++) {
+		for (y = 0; y < NCOEFF; y++) {
+			for (a = 100; a < 16000; a *= 1.3) {
+				for (r = 0; r < 8; r++) {
+					make_chunk(chunk, frequency[x], a, frequency[y], a * (0.2 + r * 0.15), 100, &seed);
+					old = ss5_decode_old(chunk, SS5_DECODER_NPOINTS);
+					now = ss5_decode(chunk, SS5_DECODER_NPOINTS);
+					cases++;
+					detected += (old != ' ');
+					differ += (old != now);
+				}
+			}
+			/* a clear pair must be decoded */
+			if (x != y) {
+				make_chunk(chunk, frequency[x], 4000, frequency[y], 4000, 0, &seed);
+				CHECK(ss5_decode(chunk, SS5_DECODER_NPOINTS) == decode_two[x][y]);
+			}
+		}
+	}
+	/* results may only differ at the edge of thresholds */
+	CHECK(differ * 100 < cases);
+	printf("%d chunks, %d detected, %d differ\n", cases, detected, differ);
+
+	make_chunk(chunk, 2400, 8000, 2600, 8000, 0, &seed);
+	t = bench_now();
+	for (i = 0; i < chunks; i++)
+		sink = ss5_decode_old(chunk, SS5_DECODER_NPOINTS);
+	t_old = (bench_now() - t) / chunks;
+	t = bench_now();
+	for (i = 0; i < chunks; i++)
+		sink = ss5_decode(chunk, SS5_DECODER_NPOINTS);
+	t_new = (bench_now() - t) / chunks;
+	(void)sink;
+	printf("per chunk of %d samples: old %.0f ns  goertzel.c %.0f ns\n", SS5_DECODER_NPOINTS, t_old, t_new);
+
+	return TEST_RESULT();
+}
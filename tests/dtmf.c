@@ -0,0 +1,168 @@
+/*****************************************************************************\
+**                                                                           **
+** Linux Call Router                                                         **
+**                                                                           **
+**---------------------------------------------------------------------------**
+** Copyright: Andreas Eversberg                                              **
+**                                                                           **
+** test of the software DTMF detector                                        **
+**                                                                           **
+** all digits are generated at levels from -10 dB down to 3 dB above the     **
+** default level of 'dtmf-detect', with different length, twist and noise.   **
+** each digit must be detected once and in order. digits 6 dB below the      **
+** level, single tones and a speech-like signal must not be detected.        **
+**                                                                           **
+\*****************************************************************************/
+
+#include "main.h"
+#include "tests/tests.h"
+
+static const char digits[] = "123A456B789C*0#D";
+
+static int row_frequency[4] = { 697, 770, 852, 941 };
+static int col_frequency[4] = { 1209, 1336, 1477, 1633 };
+
+static unsigned int seed = 1;
+
+static int noise(int level)
+{
+	seed = seed * 1103515245 + 12345;
+	return (int)((seed >> 16) % (2 * level + 1)) - level;
+}
+
+static unsigned char to_law(double sample)
+{
+	if (sample > 32767)
+		sample = 32767;
+	if (sample < -32768)
+		sample = -32768;
+	return audio_s16_to_law[(int)sample & 0xffff];
+}
+
+/* amplitude of a sine at level dB below full scale */
+static double amplitude(double level)
+{
+	return 32767.0 * pow(10.0, level / 20.0);
+}
+
+/* write digit (or pause, if digit is ' ') of ms milliseconds, return samples */
+static int make_digit(unsigned char *data, char digit, double level, double twist, int ms, int noise_level)
+{
+	int i, n = ms * 8, row = 0, col = 0;
+	double a_row = 0.0, a_col = 0.0;
+	const char *p;
+
+	if (digit != ' ') {
+		p = strchr(digits, digit);
+		row = (p - digits) / 4;
+		col = (p - digits) % 4;
+		/* twist is the level of column above row */
+		a_row = amplitude(level - twist / 2);
+		a_col = amplitude(level + twist / 2);
+	}
+	for (i = 0; i < n; i++) {
+		data[i] = to_law(a_row * sin(2 * M_PI * row_frequency[row] * i / 8000.0)
+			+ a_col * sin(2 * M_PI * col_frequency[col] * i / 8000.0)
+			+ noise(noise_level));
+	}
+
+	return n;
+}
+
+/* feed data in chunks of odd size, return the detected digits */
+static int detect(struct dtmf_detector *d, unsigned char *data, int len, char *result, int size)
+{
+	int n, num = 0;
+
+	while (len) {
+		n = (len < 37) ? len : 37;
+		num += dtmf_detector_process(d, data, n, result + num, size - num);
+		data += n;
+		len -= n;
+	}
+	result[num] = '\0';
+
+	return num;
+}
+
+int main(void)
+{
+	static unsigned char data[8000 * 20];
+	static const double twists[] = { 0.0, 4.0, -2.0 };
+	static const int lengths[] = { 40, 90 };
+	struct dtmf_detector d;
+	char result[64];
+	double level;
+	int len, i, t, l, f, h;
+
+	generate_tables('a');
+
+	/* all digits at each level, length and twist, with some noise */
+	for (level = -10; level >= DTMF_LEVEL_DEFAULT + 3; level -= 3) {
+		for (t = 0; t < (int)(sizeof(twists) / sizeof(twists[0])); t++) {
+			for (l = 0; l < (int)(sizeof(lengths) / sizeof(lengths[0])); l++) {
+				dtmf_detector_init(&d, DTMF_LEVEL_DEFAULT);
+				len = 0;
+				for (i = 0; digits[i]; i++) {
+					len += make_digit(data + len, digits[i], level, twists[t], lengths[l], 50);
+					len += make_digit(data + len, ' ', 0, 0, 50, 50);
+				}
+				detect(&d, data, len, result, sizeof(result) - 1);
+				if (strcmp(result, digits))
+					fprintf(stderr, "level %.0f dB, twist %.0f dB, %d ms: detected '%s'\n", level, twists[t], lengths[l], result);
+				CHECK(!strcmp(result, digits));
+			}
+		}
+	}
+
+	/* digits 6 dB below the level */
+	dtmf_detector_init(&d, DTMF_LEVEL_DEFAULT);
+	len = 0;
+	for (i = 0; digits[i]; i++) {
+		len += make_digit(data + len, digits[i], DTMF_LEVEL_DEFAULT - 6, 0, 90, 0);
+		len += make_digit(data + len, ' ', 0, 0, 50, 0);
+	}
+	CHECK(detect(&d, data, len, result, sizeof(result) - 1) == 0);
+
+	/* a level that is configured higher refuses a digit at the default level */
+	dtmf_detector_init(&d, DTMF_LEVEL_DEFAULT + 10);
+	len = make_digit(data, '5', DTMF_LEVEL_DEFAULT + 3, 0, 90, 0);
+	CHECK(detect(&d, data, len, result, sizeof(result) - 1) == 0);
+
+	/* single tones of each group */
+	dtmf_detector_init(&d, DTMF_LEVEL_DEFAULT);
+	len = 0;
+	for (i = 0; i < 4; i++) {
+		for (h = 0; h < 720; h++, len++)
+			data[len] = to_law(amplitude(-10) * sin(2 * M_PI * row_frequency[i] * h / 8000.0));
+		for (h = 0; h < 720; h++, len++)
+			data[len] = to_law(amplitude(-10) * sin(2 * M_PI * col_frequency[i] * h / 8000.0));
+	}
+	CHECK(detect(&d, data, len, result, sizeof(result) - 1) == 0);
+
+	/* speech-like: harmonics of a varying pitch with a moving formant,
+	 * 20 seconds */
+	dtmf_detector_init(&d, DTMF_LEVEL_DEFAULT);
+	{
+		double phase = 0.0, pitch, formant, sample, a;
+
+		for (i = 0; i < (int)sizeof(data); i++) {
+			pitch = 150 + 60 * sin(2 * M_PI * 0.7 * i / 8000.0) + 20 * sin(2 * M_PI * 3.1 * i / 8000.0);
+			formant = 900 + 500 * sin(2 * M_PI * 1.3 * i / 8000.0);
+			phase += 2 * M_PI * pitch / 8000.0;
+			sample = 0.0;
+			for (h = 1; h * pitch < 3400; h++) {
+				f = h * pitch;
+				a = 1.0 / (1.0 + ((f - formant) / 300.0) * ((f - formant) / 300.0));
+				sample += a * sin(h * phase);
+			}
+			data[i] = to_law(sample * amplitude(-12) + noise(100));
+		}
+	}
+	len = detect(&d, data, sizeof(data), result, sizeof(result) - 1);
+	if (len)
+		fprintf(stderr, "speech-like signal: detected '%s'\n", result);
+	CHECK(len == 0);
+
+	return TEST_RESULT();
+}
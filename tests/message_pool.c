@@ -0,0 +1,134 @@
+/*****************************************************************************\
+**                                                                           **
+** Linux Call Router                                                         **
+**                                                                           **
+**---------------------------------------------------------------------------**
+** Copyright: Andreas Eversberg                                              **
+**                                                                           **
+** test of message pool                                                      **
+**                                                                           **
+** DTMF and BRIDGE messages are taken from small blocks. they are created,   **
+** forwarded and freed like apppbx.cpp and joinpbx.cpp do. run it with       **
+** address sanitizer to check that no copy writes beyond a block:           **
+**   make check CXXFLAGS="-g -fsanitize=address"                             **
+**                                                                           **
+\*****************************************************************************/
+
+/* the pool is tested with the flags of this test, so it is included here */
+#include "../message.c"
+
+#include "tests/tests.h"
+
+/* what message.c needs from select.c and the object lists */
+int _add_work(struct lcr_work *work, int (*cb)(struct lcr_work *work, void *instance, int index), void *instance, int index, const char *func) { return 0; }
+void _del_work(struct lcr_work *work, const char *func) {}
+void _trigger_work(struct lcr_work *work, const char *func) {}
+class Port *find_port_id(unsigned int port_id) { return NULL; }
+class Endpoint *find_epoint_id(unsigned int epoint_id) { return NULL; }
+class Join *find_join_id(unsigned int join_id) { return NULL; }
+
+/* forward a message like EndpointAppPBX::join_dtmf() and friends do */
+static struct lcr_msg *forward(struct lcr_msg *from)
+{
+	struct lcr_msg *message;
+
+	message = message_create(from->id_to, from->id_from + 1, EPOINT_TO_PORT, from->type);
+	memcpy(&message->param, &from->param, message_param_size(message->type));
+	message_put(message);
+	return message;
+}
+
+static void test_small(void)
+{
+	struct lcr_msg *message, *fwd;
+	int i;
+
+	CHECK(message_param_size(MESSAGE_DTMF) < (int)sizeof(union parameter));
+	CHECK(message_param_size(MESSAGE_BRIDGE) < (int)sizeof(union parameter));
+
+	for (i = 0; i < 1000; i++) {
+		/* DTMF */
+		message = message_create(1, 2, PORT_TO_EPOINT, MESSAGE_DTMF);
+		message->param.dtmf = '0' + (i % 10);
+		message_put(message);
+		CHECK(message_get() == message);
+		fwd = forward(message);
+		message_free(message);
+		CHECK(message_get() == fwd);
+		CHECK(fwd->type == MESSAGE_DTMF);
+		CHECK(fwd->param.dtmf == '0' + (i % 10));
+#if defined(__SANITIZE_ADDRESS__)
+		/* the copy that used to overflow must be reported */
+		CHECK(__asan_region_is_poisoned(&fwd->param, sizeof(union parameter)) != NULL);
+#endif
+		message_free(fwd);
+
+		/* BRIDGE */
+		message = message_create(3, 4, EPOINT_TO_JOIN, MESSAGE_BRIDGE);
+		message->param.bridge_id = 0x10000 + i;
+		message_put(message);
+		CHECK(message_get() == message);
+		fwd = forward(message);
+		message_free(message);
+		CHECK(message_get() == fwd);
+		CHECK(fwd->type == MESSAGE_BRIDGE);
+		CHECK(fwd->param.bridge_id == (unsigned int)(0x10000 + i));
+		message_free(fwd);
+	}
+}
+
+static void test_full(void)
+{
+	struct lcr_msg *message, *fwd;
+
+	message = message_create(1, 2, PORT_TO_EPOINT, MESSAGE_SETUP);
+	SCPY(message->param.setup.dialinginfo.id, "0123456789");
+	message_put(message);
+	CHECK(message_get() == message);
+	fwd = forward(message);
+	message_free(message);
+	CHECK(message_get() == fwd);
+	CHECK(!strcmp(fwd->param.setup.dialinginfo.id, "0123456789"));
+#if defined(__SANITIZE_ADDRESS__)
+	CHECK(__asan_region_is_poisoned(&fwd->param, sizeof(union parameter)) == NULL);
+#endif
+	message_free(fwd);
+}
+
+/* many messages in use at the same time, so slabs are shared */
+static void test_interleaved(void)
+{
+	struct lcr_msg *message[200];
+	int i;
+
+	for (i = 0; i < 200; i++) {
+		message[i] = message_create(1, 2, PORT_TO_EPOINT, (i & 1) ? MESSAGE_BRIDGE : MESSAGE_DTMF);
+		if ((i & 1))
+			message[i]->param.bridge_id = i;
+		else
+			message[i]->param.dtmf = i;
+	}
+	for (i = 0; i < 200; i++) {
+		if ((i & 1))
+			CHECK(message[i]->param.bridge_id == (unsigned int)i);
+		else
+			CHECK(message[i]->param.dtmf == (char)i);
+		message_free(message[i]);
+	}
+}
+
+int main(void)
+{
+	init_message();
+
+	test_small();
+	test_full();
+	test_interleaved();
+
+	CHECK(mmemuse == 0);
+	CHECK(message_reused > 0);
+	printf("message pool: %u slabs allocated, %u messages reused\n", message_slabs, message_reused);
+	cleanup_message();
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,66 @@
+/*****************************************************************************\
+**                                                                           **
+** Linux Call Router                                                         **
+**                                                                           **
+**---------------------------------------------------------------------------**
+** Copyright: Andreas Eversberg                                              **
+**                                                                           **
+** globals of main.c for tests and benchmarks                                **
+**                                                                           **
+** tests link single modules of LCR. this file gives them the counters,      **
+** options and debug output that main.c gives to LCR. errors are printed to  **
+** stderr, debug output is dropped.                                          **
+**                                                                           **
+\*****************************************************************************/
+
+#include "main.h"
+#include "tests/tests.h"
+
+struct options options;
+
+FILE *debug_fp = NULL;
+int quit = 0;
+
+int memuse = 0;
+int mmemuse = 0;
+int cmemuse = 0;
+int ememuse = 0;
+int pmemuse = 0;
+int amemuse = 0;
+int rmemuse = 0;
+int classuse = 0;
+int fduse = 0;
+int fhuse = 0;
+
+void debug(const char *file, const char *function, int line, const char *prefix, char *buffer)
+{
+	fprintf(stderr, "%s: %s", prefix, buffer);
+}
+
+void _printdebug(const char *file, const char *function, int line, unsigned int mask, const char *fmt, ...)
+{
+}
+
+void _printerror(const char *file, const char *function, int line, const char *fmt, ...)
+{
+	char buffer[4096];
+	va_list args;
+
+	va_start(args, fmt);
+	VUNPRINT(buffer, sizeof(buffer) - 1, fmt, args);
+	buffer[sizeof(buffer) - 1] = 0;
+	va_end(args);
+
+	debug(file, function, line, "ERROR", buffer);
+}
+
+int test_errors = 0;
+
+/* time in nanoseconds for benchmarks */
+double bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e9 + ts.tv_nsec;
+}
@@ -0,0 +1,25 @@
+/*****************************************************************************\
+**                                                                           **
+** Linux Call Router                                                         **
+**                                                                           **
+**---------------------------------------------------------------------------**
+** Copyright: Andreas Eversberg                                              **
+**                                                                           **
+** helpers for tests and benchmarks (see stubs.c)                            **
+**                                                                           **
+\*****************************************************************************/
+
+extern int test_errors;
+
+/* count and report a failed check, but continue */
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: check '%s' failed\n", __FILE__, __LINE__, #cond); \
+		test_errors++; \
+	} \
+} while(0)
+
+/* returns 0 or 1 as exit code of a test */
+#define TEST_RESULT() (test_errors ? (fprintf(stderr, "%d check(s) failed\n", test_errors), 1) : 0)
+
+double bench_now(void);
@@ -0,0 +1,117 @@
+/*****************************************************************************\
+**                                                                           **
+** Linux Call Router                                                         **
+**                                                                           **
+**---------------------------------------------------------------------------**
+** Copyright: Andreas Eversberg                                              **
+**                                                                           **
+** test of tone pack checking                                                **
+**                                                                           **
+** a pack is built from a directory of tones, then it is damaged in          **
+** different ways. tonepack_check() must accept the pack as built and refuse **
+** every damaged one, so a mapped pack never refers outside of the file.     **
+**                                                                           **
+\*****************************************************************************/
+
+/* the pack functions are static, so tones.c is included here. GSM tones are
+ * not needed to check packs. */
+#undef WITH_GSMFR
+#include "../tones.c"
+
+#include "tests/tests.h"
+
+static char dir[] = "/tmp/lcr-tone-pack-XXXXXX";
+
+/* write a tone as raw law file */
+static void write_tone(const char *name, int samples)
+{
+	char filename[512];
+	unsigned char data[4000];
+	int fh, ret;
+
+	memset(data, 0x55, samples);
+	SPRINT(filename, "%s/%s.isdn", dir, name);
+	fh = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	CHECK(fh >= 0);
+	ret = write(fh, data, samples);
+	CHECK(ret == samples);
+	close(fh);
+}
+
+static void remove_tone(const char *name)
+{
+	char filename[512];
+
+	SPRINT(filename, "%s/%s.isdn", dir, name);
+	unlink(filename);
+}
+
+int main(void)
+{
+	static const char *names[] = { "dialtone", "ringing", "busy", "cause_10", "cause_1f" };
+	struct tonepack_header *header;
+	struct tonepack_entry *entry;
+	unsigned int *index;
+	unsigned char *image, *copy;
+	unsigned int size, i;
+
+	options.law = 'a';
+	generate_tables(options.law);
+	CHECK(mkdtemp(dir) != NULL);
+	for (i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+		write_tone(names[i], 800 + i * 100);
+
+	image = tonepack_build(dir, &size);
+	CHECK(image != NULL);
+	if (!image)
+		return TEST_RESULT();
+	header = (struct tonepack_header *)image;
+	index = (unsigned int *)(header + 1);
+	entry = (struct tonepack_entry *)(index + header->index_size);
+	CHECK(header->entries == sizeof(names) / sizeof(names[0]));
+	CHECK(tonepack_check(header, size) == (int)size);
+
+	copy = (unsigned char *)MALLOC(size);
+
+#define DAMAGED(what) \
+	memcpy(copy, image, size); \
+	header = (struct tonepack_header *)copy; \
+	index = (unsigned int *)(header + 1); \
+	entry = (struct tonepack_entry *)(index + header->index_size); \
+	what; \
+	CHECK(tonepack_check(header, size) < 0);
+
+	/* header */
+	DAMAGED(header->magic[0] = 'X');
+	DAMAGED(header->law = 'u');
+	DAMAGED(header->size = size + 8);
+	DAMAGED(header->index_size = 12);
+	DAMAGED(header->entries = header->index_size);
+	DAMAGED(header->index_size = 1 << 28);
+	DAMAGED(header->entries = 0);
+	/* index slots */
+	for (i = 0; i < header->index_size && index[i]; i++)
+		;
+	DAMAGED(index[i] = header->entries + 1);
+	DAMAGED(index[i] = 1);
+	DAMAGED(memset(index, 0, header->index_size * sizeof(unsigned int)));
+	/* entries */
+	DAMAGED(memset(entry[2].name, 'x', sizeof(entry[2].name)));
+	DAMAGED(entry[3].offset = 0);
+	DAMAGED(entry[3].offset = size + 8);
+	DAMAGED(entry[4].size = size);
+	DAMAGED(entry[4].offset = size - 8);
+	DAMAGED(entry[0].size = 0xffffffff);
+
+	/* a pack that is cut is refused by its size */
+	CHECK(tonepack_check((struct tonepack_header *)image, size - 8) < 0);
+	CHECK(tonepack_check((struct tonepack_header *)image, sizeof(struct tonepack_header) - 1) < 0);
+
+	FREE(copy, size);
+	FREE(image, size);
+	for (i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+		remove_tone(names[i]);
+	rmdir(dir);
+
+	return TEST_RESULT();
+}
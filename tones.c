@@ -10,6 +10,12 @@
 \*****************************************************************************/ 
 
 #include "main.h"
+#include <stddef.h>
+#ifdef WITH_GSMFR
+extern "C" {
+#include "gsm_audio.h"
+}
+#endif
 
 /* 
 notes about codecs:
@@ -43,7 +49,7 @@ int open_tone(char *file, int *codec, signed int *length, signed int *left)
 	struct fmt *fmt;
 	int channels = 0, bytes = 0;
 	unsigned int size, chunk;
-	int gotfmt = 0;
+	int gotfmt = 0, gsm = 0;
 	struct stat _stat;
 	int linksize;
 	int l;
@@ -160,6 +166,14 @@ int open_tone(char *file, int *codec, signed int *length, signed int *left)
 					PERROR("Warning: File %s has sample rate of %ld.\n", filename, fmt->sample_rate);
 				}
 //				printf("Sample Rate: %ld\n", fmt->sample_rate);
+#ifdef WITH_GSMFR
+				if (fmt->stereo == 0x31 && channels == 1) {
+					/* GSM 6.10, two frames in 65 bytes */
+					gsm = 1;
+					gotfmt = 1;
+					continue;
+				}
+#endif
 				if (fmt->bits_sample!=8 && fmt->bits_sample!=16) {
 					close(fh);
 					errno = 0;
@@ -178,6 +192,14 @@ int open_tone(char *file, int *codec, signed int *length, signed int *left)
 					return(-1);
 				}
 //				printf("Length: %ld samples (%ld.%03ld seconds)\n", chunk/bytes/channels, chunk/bytes/channels/8000, ((chunk/bytes/channels)%8000)*1000/8000);
+				if (gsm) {
+					if (codec)
+						*codec = CODEC_GSM;
+					if (length)
+						*length = (signed int)(chunk / 65 * 320);
+					if (left)
+						*left = (signed int)(chunk / 65 * 320);
+				} else
 				if (bytes==2 && channels==1) {
 					if (codec)
 						*codec = CODEC_MONO;
@@ -236,12 +258,56 @@ int open_tone(char *file, int *codec, signed int *length, signed int *left)
 }
 
 
+#ifdef WITH_GSMFR
+/* decode GSM 6.10 wave data to law, two frames (65 bytes, 320 samples) are
+ * decoded at a time, samples that are not returned are kept in the state */
+static int read_tone_gsm(int fh, unsigned char *buffer, int len, struct tone_gsm *gsm)
+{
+	unsigned char frame[65];
+	int l = 0, n;
+
+	if (!gsm->gsm && !(gsm->gsm = gsm_fr_create_wav()))
+		return(0);
+	while(l < len) {
+		if (gsm->pos == gsm->num) {
+			if (read(fh, frame, 65) != 65)
+				break;
+			gsm_fr_decode(gsm->gsm, frame, gsm->sample);
+			gsm_fr_decode(gsm->gsm, frame + 33, gsm->sample + 160);
+			gsm->pos = 0;
+			gsm->num = 320;
+		}
+		n = gsm->num - gsm->pos;
+		if (n > len - l)
+			n = len - l;
+		l += n;
+		while(n--)
+			*buffer++ = audio_s16_to_law[gsm->sample[gsm->pos++] & 0xffff];
+	}
+
+	return(l);
+}
+#endif
+
+/* release decoder of a GSM tone, the state can be used for the next tone */
+void free_tone_gsm(struct tone_gsm *gsm)
+{
+#ifdef WITH_GSMFR
+	if (gsm->gsm)
+		gsm_fr_destroy(gsm->gsm);
+#endif
+	gsm->gsm = NULL;
+	gsm->pos = gsm->num = 0;
+}
+
 /*
  * read from tone, check size
  * the len must be the number of samples, NOT for the bytes to read!!
  * the data returned is law-code
+ * a GSM tone requires a state, which must be released by free_tone_gsm(),
+ * when the file is closed
  */
-int read_tone(int fh, unsigned char *buffer, int codec, int len, signed int size, signed int *left, int speed)
+int read_tone(int fh, unsigned char *buffer, int codec, int len, signed int size, signed int *left, int speed, struct tone_gsm *gsm)
 {
 	int l = 0;
 	int offset;
@@ -258,6 +324,13 @@ int read_tone(int fh, unsigned char *buffer, int codec, int len, signed int size
 
 	if (speed!=1) {
 		offset = ((len&(~4)) * (speed-1));
+		if (codec == CODEC_GSM) {
+			/* step whole frames, decoded samples are dropped */
+			offset = offset / 320 * 320;
+			lseek(fh, offset / 320 * 65, SEEK_CUR);
+			if (gsm)
+				gsm->pos = gsm->num = 0;
+		} else
 		lseek(fh, offset, SEEK_CUR); /* step fowards, backwards (len must be round to 4 bytes, to be sure, that 16bit stereo will not drift out of sync)*/
 		*left -= offset; /* correct the current bytes left */
 		if (*left < 0) {
@@ -316,6 +389,13 @@ int read_tone(int fh, unsigned char *buffer, int codec, int len, signed int size
 		}
 		break;
 
+		case CODEC_GSM:
+#ifdef WITH_GSMFR
+		if (gsm)
+			l = read_tone_gsm(fh, buffer, len, gsm);
+#endif
+		break;
+
 		case CODEC_8BIT:
 		l = read(fh, buf8, len);
 		if (l>0) {
@@ -336,57 +416,312 @@ int read_tone(int fh, unsigned char *buffer, int codec, int len, signed int size
 }
 
 
-struct toneset *toneset_first = NULL;
+struct tonepack *tonepack_first = NULL;
 
-/*
- * free fetched tones
- */
-void free_tones(void)
+#define TONEPACK_ALIGN(x)	(((x) + 7) & ~7)
+
+static unsigned int tonepack_hash(const char *name)
 {
-	struct toneset *toneset_temp;
-	struct tonesettone *tonesettone_temp;
-	void *temp;
-
-	toneset_temp = toneset_first;
-	while(toneset_temp) {
-		tonesettone_temp = toneset_temp->first;
-		while(tonesettone_temp) {
-			temp = tonesettone_temp;
-			tonesettone_temp = tonesettone_temp->next;
-			FREE(temp, sizeof(struct tonesettone));
-			memuse--;
+	unsigned int key = 0;
+
+	while(*name)
+		key = key * 31 + (unsigned char)*name++;
+	return key;
+}
+
+/* find tone in the pack's index */
+static struct tonepack_entry *tonepack_find(struct tonepack *pack, const char *name)
+{
+	unsigned int mask = pack->header->index_size - 1;
+	unsigned int slot = tonepack_hash(name) & mask;
+	struct tonepack_entry *entry;
+
+	while(pack->index[slot]) {
+		entry = &pack->entry[pack->index[slot] - 1];
+		if (!strcmp(entry->name, name))
+			return(entry);
+		slot = (slot + 1) & mask;
+	}
+	return(NULL);
+}
+
+/* check pack before it is used, return size or -1 if it cannot be used
+ * the file may be damaged or written by someone else, so every index slot,
+ * every entry and every tone must be inside the file */
+static int tonepack_check(struct tonepack_header *header, unsigned int size)
+{
+	unsigned int *index = (unsigned int *)(header + 1);
+	struct tonepack_entry *entry;
+	unsigned long long tables;
+	unsigned int i, used = 0;
+
+	if (size < sizeof(struct tonepack_header)
+	 || !!memcmp(header->magic, TONEPACK_MAGIC, 8)
+	 || header->law != (unsigned int)options.law
+	 || header->size != size
+	 || !header->index_size
+	 || (header->index_size & (header->index_size - 1))
+	 || header->entries >= header->index_size)
+		return(-1);
+	tables = TONEPACK_ALIGN(sizeof(struct tonepack_header) + (unsigned long long)header->index_size * sizeof(unsigned int) + (unsigned long long)header->entries * sizeof(struct tonepack_entry));
+	if (tables > size)
+		return(-1);
+
+	/* each slot is free or refers to an entry, there must be free slots */
+	for (i = 0; i < header->index_size; i++) {
+		if (!index[i])
+			continue;
+		if (index[i] > header->entries)
+			return(-1);
+		used++;
+	}
+	if (used != header->entries)
+		return(-1);
+
+	/* each entry has a terminated name and its samples are inside the file */
+	entry = (struct tonepack_entry *)(index + header->index_size);
+	for (i = 0; i < header->entries; i++, entry++) {
+		if (!memchr(entry->name, '\0', sizeof(entry->name))
+		 || entry->offset < tables
+		 || entry->offset > size
+		 || entry->size > size - entry->offset)
+			return(-1);
+	}
+	return(size);
+}
+
+/* pack is valid, if it is not older than the directory and its files */
+static int tonepack_uptodate(const char *path, struct stat *pack_stat)
+{
+	DIR *dir;
+	struct dirent *dirent;
+	char filename[512];
+	struct stat _stat;
+	int uptodate = 1;
+
+	if (stat(path, &_stat) < 0 || _stat.st_mtime > pack_stat->st_mtime)
+		return(0);
+	dir = opendir(path);
+	if (dir == NULL)
+		return(0);
+	while((dirent=readdir(dir))) {
+		if (dirent->d_name[0] == '.')
+			continue;
+		SPRINT(filename, "%s/%s", path, dirent->d_name);
+		/* follows links, so changed link targets are found */
+		if (stat(filename, &_stat) < 0 || _stat.st_mtime > pack_stat->st_mtime) {
+			uptodate = 0;
+			break;
 		}
-		temp = toneset_temp;
-		toneset_temp = toneset_temp->next;
-		FREE(temp, sizeof(struct toneset));
-		memuse--;
 	}
-	toneset_first = NULL;
+	closedir(dir);
+	return(uptodate);
 }
 
 /*
- * fetch tones as specified in options.conf
+ * read and convert all tones of a directory and create the pack in memory
  */
-int fetch_tones(void)
+struct tonepack_tone {
+	struct tonepack_tone *next;
+	char name[128];
+	int size;
+	unsigned char data[0];
+};
+
+static unsigned char *tonepack_build(const char *path, unsigned int *packsize)
 {
 	DIR *dir;
 	struct dirent *dirent;
-	struct toneset **toneset_nextpointer;
-	struct tonesettone **tonesettone_nextpointer;
-	char *p, *p_next;
-	char path[256];
+	struct tonepack_tone *tone, *tone_first = NULL, **tone_nextpointer = &tone_first;
+	struct tonepack_header *header;
+	struct tonepack_entry *entry;
+	unsigned int *index;
+	unsigned char *image;
 	char filename[256], name[256];
 	int fh;
 	int tone_codec;
 	signed int tone_size, tone_left;
-	unsigned int memory = 0;
-	int samples = 0;
+	struct tone_gsm gsm;
+	unsigned int entries = 0, index_size = 16, size, offset, slot, i;
+
+	dir = opendir(path);
+	if (dir == NULL) {
+		PERROR("Tone set not found: '%s'\n", path);
+		return(NULL);
+	}
+
+	while((dirent=readdir(dir))) {
+		SPRINT(name, "%s", dirent->d_name);
+
+		/* remove .isdn and .wave */
+		if (strlen(name) >= 4) {
+			if (!strcmp(name+strlen(name)-4, ".wav"))
+				name[strlen(name)-4] = '\0';
+		}
+		if (strlen(name) >= 5) {
+			if (!strcmp(name+strlen(name)-5, ".isdn"))
+				name[strlen(name)-5] = '\0';
+		}
+
+		SPRINT(filename, "%s/%s", path, name);
+
+		/* skip . / .. */
+		if (!strcmp(dirent->d_name, "."))
+			continue;
+		if (!strcmp(dirent->d_name, ".."))
+			continue;
+
+		/* open file */
+		fh = open_tone(filename, &tone_codec, &tone_size, &tone_left);
+		if (fh < 0) {
+			PERROR("Cannot open file: '%s'\n", filename);
+			continue;
+		}
+		fduse++;
+
+		if (tone_size < 0) {
+			PERROR("File has 0-length: '%s'\n", filename);
+			close(fh);
+			fduse--;
+			continue;
+		}
+
+		/* load tone, all codecs are converted to law */
+		tone = (struct tonepack_tone *)MALLOC(sizeof(struct tonepack_tone)+tone_size);
+		memuse++;
+		memset(&gsm, 0, sizeof(gsm));
+		tone->size = read_tone(fh, tone->data, tone_codec, tone_size, tone_size, &tone_left, 1, &gsm);
+		free_tone_gsm(&gsm);
+		if (tone->size < 0)
+			tone->size = 0;
+		SCPY(tone->name, name);
+		*tone_nextpointer = tone;
+		tone_nextpointer = &tone->next;
+		entries++;
+
+		close(fh);
+		fduse--;
+	}
+	closedir(dir);
+
+	/* layout: header, index, entries, samples */
+	while(index_size < entries * 2)
+		index_size <<= 1;
+	size = TONEPACK_ALIGN(sizeof(struct tonepack_header) + index_size * sizeof(unsigned int) + entries * sizeof(struct tonepack_entry));
+	for (tone = tone_first; tone; tone = tone->next)
+		size += TONEPACK_ALIGN(tone->size);
+
+	image = (unsigned char *)MALLOC(size);
+	memuse++;
+	header = (struct tonepack_header *)image;
+	index = (unsigned int *)(header + 1);
+	entry = (struct tonepack_entry *)(index + index_size);
+	memcpy(header->magic, TONEPACK_MAGIC, 8);
+	header->law = options.law;
+	header->entries = entries;
+	header->index_size = index_size;
+	header->size = size;
+	offset = TONEPACK_ALIGN(sizeof(struct tonepack_header) + index_size * sizeof(unsigned int) + entries * sizeof(struct tonepack_entry));
+	i = 0;
+	while((tone = tone_first)) {
+		SCPY(entry[i].name, tone->name);
+		entry[i].offset = offset;
+		entry[i].size = tone->size;
+		memcpy(image + offset, tone->data, tone->size);
+		offset += TONEPACK_ALIGN(tone->size);
+		slot = tonepack_hash(tone->name) & (index_size - 1);
+		while(index[slot])
+			slot = (slot + 1) & (index_size - 1);
+		index[slot] = ++i;
+		tone_first = tone->next;
+		FREE(tone, sizeof(struct tonepack_tone)+tone->size);
+		memuse--;
+	}
+
+	*packsize = size;
+	return(image);
+}
+
+/* map pack file, returns 0 on success */
+static int tonepack_map(struct tonepack *pack, const char *pack_name)
+{
+	struct stat _stat;
+	void *map;
+	int fh;
+
+	if ((fh = open(pack_name, O_RDONLY)) < 0)
+		return(-1);
+	if (fstat(fh, &_stat) < 0 || _stat.st_size < (off_t)sizeof(struct tonepack_header)) {
+		close(fh);
+		return(-1);
+	}
+	map = mmap(NULL, _stat.st_size, PROT_READ, MAP_SHARED, fh, 0);
+	close(fh);
+	if (map == MAP_FAILED)
+		return(-1);
+	if (tonepack_check((struct tonepack_header *)map, _stat.st_size) < 0) {
+		munmap(map, _stat.st_size);
+		return(-1);
+	}
+	pack->map = (unsigned char *)map;
+	return(0);
+}
+
+/* write pack file, so it can be mapped, returns 0 on success */
+static int tonepack_write(const char *pack_name, unsigned char *image, unsigned int size)
+{
+	char tmp_name[512];
+	int fh, ret;
+
+	SPRINT(tmp_name, "%s.tmp", pack_name);
+	if ((fh = open(tmp_name, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+		return(-1);
+	ret = write(fh, image, size);
+	close(fh);
+	if (ret != (int)size || rename(tmp_name, pack_name) < 0) {
+		unlink(tmp_name);
+		return(-1);
+	}
+	return(0);
+}
+
+/*
+ * free fetched tones
+ */
+void free_tones(void)
+{
+	struct tonepack *pack;
+
+	while((pack = tonepack_first)) {
+		tonepack_first = pack->next;
+		munmap(pack->map, pack->header->size);
+		FREE(pack, sizeof(struct tonepack));
+		memuse--;
+	}
+}
+
+/*
+ * fetch tones as specified in options.conf
+ * the pack of each directory is mapped. if it does not exist, if it is
+ * older than the tone files, if the law changed or if it is damaged, it is
+ * created. if it cannot be written, the tone set is not fetched.
+ */
+int fetch_tones(void)
+{
+	struct tonepack **tonepack_nextpointer, *pack;
+	struct stat _stat;
+	char *p, *p_next, *p_pack;
+	char path[256], pack_name[256];
+	unsigned char *image;
+	unsigned int size;
+	unsigned int mapped = 0;
+	int samples = 0, ret;
 
 	/* if disabled */
 	if (!options.fetch_tones)
 		return(1);
 
-	toneset_nextpointer = &toneset_first;
+	tonepack_nextpointer = &tonepack_first;
 	p = options.fetch_tones;
 	if (*p == '\0')
 		return(1);
@@ -409,80 +744,53 @@ int fetch_tones(void)
 		printf("PBX: Fetching tones '%s'\n", p);
 		PDEBUG(DEBUG_PORT, "fetching tones directory '%s'\n", p);
 
-		*toneset_nextpointer = (struct toneset *)MALLOC(sizeof(struct toneset));
+		pack = (struct tonepack *)MALLOC(sizeof(struct tonepack));
 		memuse++;
-		memory += sizeof(struct toneset);
-		SCPY((*toneset_nextpointer)->directory, p);
-		tonesettone_nextpointer = &(*toneset_nextpointer)->first;
+		SCPY(pack->directory, p);
 
 		SPRINT(path, "%s/%s", SHARE_DATA, p);
-		dir = opendir(path);
-		if (dir == NULL) {
-			PERROR("Tone set not found: '%s'\n", path);
-			return(0);
+		/* the pack is written to the cache directory, because the
+		 * tone sets may be read-only */
+		SPRINT(pack_name, "%s/%s.pack", CACHE_DIR, p);
+		for (p_pack = pack_name + strlen(CACHE_DIR) + 1; *p_pack; p_pack++) {
+			if (*p_pack == '/')
+				*p_pack = '_';
 		}
-
-		while((dirent=readdir(dir))) {
-			SPRINT(name, "%s", dirent->d_name);
-
-			/* remove .isdn and .wave */
-			if (strlen(name) >= 4) {
-				if (!strcmp(name+strlen(name)-4, ".wav"))
-					name[strlen(name)-4] = '\0';
-			}
-			if (strlen(name) >= 5) {
-				if (!strcmp(name+strlen(name)-5, ".isdn"))
-					name[strlen(name)-5] = '\0';
-			}
-
-			SPRINT(filename, "%s/%s", path, name);
-
-			/* skip . / .. */
-			if (!strcmp(dirent->d_name, "."))
-				continue;
-			if (!strcmp(dirent->d_name, ".."))
-				continue;
-
-			/* open file */
-			fh = open_tone(filename, &tone_codec, &tone_size, &tone_left);
-			if (fh < 0) {
-				PERROR("Cannot open file: '%s'\n", filename);
-				continue;
+		if (stat(pack_name, &_stat) < 0
+		 || !tonepack_uptodate(path, &_stat)
+		 || tonepack_map(pack, pack_name) < 0) {
+			PDEBUG(DEBUG_PORT, "creating tone pack '%s'\n", pack_name);
+			image = tonepack_build(path, &size);
+			if (!image) {
+				FREE(pack, sizeof(struct tonepack));
+				memuse--;
+				return(0);
 			}
-			fduse++;
-
-			if (tone_size < 0) {
-				PERROR("File has 0-length: '%s'\n", filename);
-				close(fh);
-				fduse--;
+			ret = tonepack_write(pack_name, image, size);
+			FREE(image, size);
+			memuse--;
+			if (ret < 0 || tonepack_map(pack, pack_name) < 0) {
+				/* the tones of this set are read from their files */
+				PERROR("Cannot write tone pack '%s', tone set '%s' is not fetched.\n", pack_name, p);
+				FREE(pack, sizeof(struct tonepack));
+				memuse--;
+				p = p_next;
 				continue;
 			}
-
-			/* Allocate tone */
-			*tonesettone_nextpointer = (struct tonesettone *)MALLOC(sizeof(struct tonesettone)+tone_size);
-			memuse++;
-//printf("tone:%s, %ld bytes\n", name, tone_size);
-			memory += sizeof(struct tonesettone)+tone_size;
-			samples ++;
-
-			/* load tone */
-			read_tone(fh, (*tonesettone_nextpointer)->data, tone_codec, tone_size, tone_size, &tone_left, 1);
-			(*tonesettone_nextpointer)->size = tone_size;
-			(*tonesettone_nextpointer)->codec = (tone_codec==CODEC_LAW)?CODEC_LAW:CODEC_MONO;
-			SCPY((*tonesettone_nextpointer)->name, name);
-
-			close(fh);
-			fduse--;
-				 
-			tonesettone_nextpointer = &((*tonesettone_nextpointer)->next);
 		}
+		pack->header = (struct tonepack_header *)pack->map;
+		pack->index = (unsigned int *)(pack->header + 1);
+		pack->entry = (struct tonepack_entry *)(pack->index + pack->header->index_size);
+		mapped += pack->header->size;
+		samples += pack->header->entries;
 
-		toneset_nextpointer = &((*toneset_nextpointer)->next);
+		*tonepack_nextpointer = pack;
+		tonepack_nextpointer = &pack->next;
 		p = p_next;
 	}
 
-	printf("PBX: Memory used for tones: %d bytes (%d samples)\n", memory, samples);
-	PDEBUG(DEBUG_PORT, "Memory used for tones: %ld bytes (%d samples)\n", memory, samples);
+	printf("PBX: Memory used for tones: %d bytes mapped (%d samples)\n", mapped, samples);
+	PDEBUG(DEBUG_PORT, "Memory used for tones: %d bytes mapped (%d samples)\n", mapped, samples);
 
 	return(1);
 } 
@@ -490,63 +798,270 @@ int fetch_tones(void)
 
 /*
  * opens the fetched tone (if available)
+ * the directory selects the pack, the name is found by the pack's hash index
  */
 void *open_tone_fetched(char *dir, char *file, int *codec, signed int *length, signed int *left)
 {
-	struct toneset *toneset;
-	struct tonesettone *tonesettone;
-
-	/* if anything fetched */
-	if (!toneset_first)
-		return(NULL);
+	struct tonepack *pack;
+	struct tonepack_entry *entry;
 
 	/* find set */
-	toneset = toneset_first;
-	while(toneset) {
-//printf("1. comparing '%s' with '%s'\n", toneset->directory, dir);
-		if (!strcmp(toneset->directory, dir))
+	pack = tonepack_first;
+	while(pack) {
+		if (!strcmp(pack->directory, dir))
 			break;
-		toneset = toneset->next;
+		pack = pack->next;
 	}
-	if (!toneset)
+	if (!pack)
 		return(NULL);
 
 	/* find tone */
-	tonesettone = toneset->first;
-	while(tonesettone) {
-//printf("2. comparing '%s' with '%s'\n", tonesettone->name, file);
-		if (!strcmp(tonesettone->name, file))
+	entry = tonepack_find(pack, file);
+	if (!entry)
+		return(NULL);
+
+	/* return information */
+	if (length)
+		*length = entry->size;
+	if (left)
+		*left = entry->size;
+	if (codec)
+		*codec = CODEC_LAW;
+	return(pack->map + entry->offset);
+}
+
+
+/*
+ * cache of converted tones
+ * tones that are not fetched are converted to law when they are opened the
+ * first time. the data is shared by all ports that play the file. entries
+ * are found by the file name, and are valid as long as the file is not
+ * changed. entries that are not used are removed in least recently used
+ * order, if options.tone_cache is exceeded.
+ */
+#define TONE_CACHE_HASH		64
+
+struct tone_cache {
+	struct tone_cache *next;	/* next entry in hash bucket */
+	struct tone_cache *lru_prev, *lru_next; /* list of unused entries */
+	char file[256];			/* name as given to open_tone() */
+	dev_t dev;			/* file that was converted */
+	ino_t ino;
+	off_t size;
+	time_t mtime;
+	int refs;			/* number of ports playing it */
+	int stale;			/* file has changed, free when unused */
+	signed int samples;
+	unsigned char data[0];
+};
+
+static struct tone_cache *tone_cache_hash[TONE_CACHE_HASH];
+static struct tone_cache *tone_cache_lru_first, *tone_cache_lru_last;
+unsigned int tone_cache_hit = 0; /* tones taken from cache */
+unsigned int tone_cache_miss = 0; /* tones converted */
+unsigned int tone_cache_evict = 0; /* tones removed to get space */
+unsigned int tone_cache_bytes = 0; /* bytes of all entries */
+
+static void tone_cache_lru_remove(struct tone_cache *entry)
+{
+	if (entry->lru_prev)
+		entry->lru_prev->lru_next = entry->lru_next;
+	else
+		tone_cache_lru_first = entry->lru_next;
+	if (entry->lru_next)
+		entry->lru_next->lru_prev = entry->lru_prev;
+	else
+		tone_cache_lru_last = entry->lru_prev;
+	entry->lru_prev = entry->lru_next = NULL;
+}
+
+/* remove entry from hash and free it, it must not be used */
+static void tone_cache_free(struct tone_cache *entry)
+{
+	struct tone_cache **entryp;
+
+	if (!entry->stale) {
+		entryp = &tone_cache_hash[tonepack_hash(entry->file) % TONE_CACHE_HASH];
+		while(*entryp != entry)
+			entryp = &(*entryp)->next;
+		*entryp = entry->next;
+	}
+	tone_cache_bytes -= sizeof(struct tone_cache) + entry->samples;
+	FREE(entry, sizeof(struct tone_cache) + entry->samples);
+	memuse--;
+}
+
+/* find the file, as open_tone() does */
+static int tone_cache_stat(const char *file, struct stat *_stat)
+{
+	char filename[256];
+
+	SPRINT(filename, "%s.isdn", file);
+	if (!stat(filename, _stat))
+		return(0);
+	SPRINT(filename, "%s.wav", file);
+	if (!stat(filename, _stat))
+		return(0);
+	return(-1);
+}
+
+/*
+ * open tone from cache, convert it if not cached
+ * returns pointer to law data, or NULL, if the tone cannot be cached. then
+ * it must be opened by open_tone(). close_tone_cached() must be called, when
+ * the tone is not used anymore.
+ */
+void *open_tone_cached(const char *file, int *codec, signed int *length, signed int *left)
+{
+	struct tone_cache *entry, **entryp;
+	struct stat _stat;
+	unsigned int key, limit;
+	int fh, tone_codec;
+	signed int tone_size, tone_left;
+	struct tone_gsm gsm;
+
+	limit = (unsigned int)options.tone_cache * 1024;
+	if (!limit)
+		return(NULL);
+	if (tone_cache_stat(file, &_stat) < 0)
+		return(NULL);
+
+	key = tonepack_hash(file) % TONE_CACHE_HASH;
+	entryp = &tone_cache_hash[key];
+	while((entry = *entryp)) {
+		if (!strcmp(entry->file, file))
 			break;
-		tonesettone = tonesettone->next;
+		entryp = &entry->next;
+	}
+	if (entry && (entry->dev != _stat.st_dev || entry->ino != _stat.st_ino
+	 || entry->size != _stat.st_size || entry->mtime != _stat.st_mtime)) {
+		/* file has changed, remove old entry */
+		*entryp = entry->next;
+		entry->stale = 1;
+		if (!entry->refs) {
+			tone_cache_lru_remove(entry);
+			tone_cache_free(entry);
+		}
+		entry = NULL;
+	}
+	if (entry) {
+		tone_cache_hit++;
+		if (!entry->refs++)
+			tone_cache_lru_remove(entry);
+		goto found;
 	}
-	if (!tonesettone)
+
+	/* convert tone */
+	if ((fh = open_tone((char *)file, &tone_codec, &tone_size, &tone_left)) < 0)
+		return(NULL);
+	if (tone_size < 0 || sizeof(struct tone_cache) + tone_size > limit) {
+		close(fh);
+		return(NULL);
+	}
+	/* remove unused entries to get space */
+	while(tone_cache_bytes + sizeof(struct tone_cache) + tone_size > limit && tone_cache_lru_first) {
+		entry = tone_cache_lru_first;
+		tone_cache_lru_remove(entry);
+		tone_cache_free(entry);
+		tone_cache_evict++;
+	}
+	if (tone_cache_bytes + sizeof(struct tone_cache) + tone_size > limit) {
+		/* all entries are used */
+		close(fh);
 		return(NULL);
+	}
+	entry = (struct tone_cache *)MALLOC(sizeof(struct tone_cache) + tone_size);
+	memuse++;
+	memset(&gsm, 0, sizeof(gsm));
+	entry->samples = read_tone(fh, entry->data, tone_codec, tone_size, tone_size, &tone_left, 1, &gsm);
+	free_tone_gsm(&gsm);
+	close(fh);
+	if (entry->samples < 0)
+		entry->samples = 0;
+	tone_cache_bytes += sizeof(struct tone_cache) + entry->samples;
+	SCPY(entry->file, file);
+	entry->dev = _stat.st_dev;
+	entry->ino = _stat.st_ino;
+	entry->size = _stat.st_size;
+	entry->mtime = _stat.st_mtime;
+	entry->refs = 1;
+	entry->next = tone_cache_hash[key];
+	tone_cache_hash[key] = entry;
+	tone_cache_miss++;
 
-	/* return information */
+	found:
 	if (length)
-		*length = tonesettone->size;
+		*length = entry->samples;
 	if (left)
-		*left = tonesettone->size;
+		*left = entry->samples;
 	if (codec)
-		*codec = tonesettone->codec;
-//printf("size=%ld, data=%08x\n", tonesettone->size, tonesettone->data);
-	return(tonesettone->data);
+		*codec = CODEC_LAW;
+	return(entry->data);
+}
+
+/* release a tone that was opened by open_tone_cached() */
+void close_tone_cached(void *data)
+{
+	struct tone_cache *entry = (struct tone_cache *)((unsigned char *)data - offsetof(struct tone_cache, data));
+
+	if (--entry->refs)
+		return;
+	if (entry->stale) {
+		tone_cache_free(entry);
+		return;
+	}
+	/* append to list of unused entries */
+	entry->lru_prev = tone_cache_lru_last;
+	if (tone_cache_lru_last)
+		tone_cache_lru_last->lru_next = entry;
+	else
+		tone_cache_lru_first = entry;
+	tone_cache_lru_last = entry;
+}
+
+/* free unused entries, used ones are freed when the ports are destroyed */
+void free_tone_cache(void)
+{
+	struct tone_cache *entry;
+
+	while((entry = tone_cache_lru_first)) {
+		tone_cache_lru_remove(entry);
+		tone_cache_free(entry);
+	}
 }
 
 
 /*
- * read from fetched tone, check size
+ * read from fetched or cached tone, check size
  * the len must be the number of samples, NOT for the bytes to read!!
  */
 int read_tone_fetched(void **fetched, void *buffer, int len, signed int size, signed int *left, int speed)
 {
 	int l;
+	int offset;
 //printf("left=%ld\n",*left);
 
 	/* if no *left is given (law has unknown length) */
 	if (!left)
 		return(0);
 
+	if (speed!=1) {
+		/* step forwards, backwards */
+		offset = len * (speed-1);
+		*left -= offset; /* correct the current bytes left */
+		if (*left < 0) {
+			/* eof */
+			*left = 0;
+			return(0);
+		}
+		if (*left >= size) {
+			/* eof */
+			*left = size;
+			return(0);
+		}
+		*((char **)fetched) += offset;
+	}
+
 	if (*left == 0)
 		return(0);
 
@@ -9,28 +9,56 @@
 **                                                                           **
 \*****************************************************************************/ 
 
+/* state of a GSM tone that is decoded while it is played */
+struct tone_gsm {
+	void *gsm;			/* decoder instance, or NULL */
+	signed short sample[320];	/* decoded samples of two frames */
+	int pos, num;			/* next sample, number of decoded samples */
+};
+
 int open_tone(char *file, int *codec, signed int *length, signed int *left);
-int read_tone(int fh, unsigned char *buffer, int codec, int len, signed int size, signed int *left, int speed);
+int read_tone(int fh, unsigned char *buffer, int codec, int len, signed int size, signed int *left, int speed, struct tone_gsm *gsm);
+void free_tone_gsm(struct tone_gsm *gsm);
 int fetch_tones(void);
 void free_tones(void);
 void *open_tone_fetched(char *dir, char *file, int *codec, signed int *length, signed int *left);
 int read_tone_fetched(void **fetched, void *buffer, int len, signed int size, signed int *left, int speed);
+void *open_tone_cached(const char *file, int *codec, signed int *length, signed int *left);
+void close_tone_cached(void *data);
+void free_tone_cache(void);
+extern unsigned int tone_cache_hit, tone_cache_miss, tone_cache_evict, tone_cache_bytes;
+
+/* tone packs
+ * each fetched tone directory is stored in a pack file, the tones are law
+ * encoded. the pack is mapped read-only, so it is shared by all processes.
+ */
+#define TONEPACK_MAGIC		"LCRTONE1"
+
+struct tonepack_header {
+	char magic[8];
+	unsigned int law;		/* law of samples ('a' or 'u') */
+	unsigned int entries;		/* number of tones */
+	unsigned int index_size;	/* number of index slots (power of two) */
+	unsigned int size;		/* size of file */
+	};
 
-/* tone sets */
-struct tonesettone {
-	struct tonesettone *next;
+struct tonepack_entry {
 	char name[128];
-	int codec;
-	int size;
-	unsigned char data[0];
+	unsigned int offset;		/* offset of samples in file */
+	unsigned int size;		/* number of samples */
 	};
 
-struct toneset {
-	struct toneset *next;
+/* the header is followed by the index (entry number + 1 for each slot,
+ * 0 = free), then by the entries, then by the samples */
+
+struct tonepack {
+	struct tonepack *next;
 	char directory[128];
-	struct tonesettone *first;
+	unsigned char *map;		/* file that is mapped */
+	struct tonepack_header *header;
+	unsigned int *index;
+	struct tonepack_entry *entry;
 	};
 
-extern struct toneset *toneset_first;
-
+extern struct tonepack *tonepack_first;
 
@@ -11,11 +11,93 @@
 
 #include "main.h"
 
-struct trace trace;
+/*
+ * traces are recorded as compact binary records into a ring buffer. they are
+ * rendered to text later by work_trace(), once for debug/log and once for
+ * every admin listener. a trace is only recorded, if one of these consumers
+ * would show it, so start_trace() filters the same way as print_trace() does.
+ * add_trace() is a macro that does not even evaluate its arguments, if the
+ * current trace is not recorded.
+ */
+
+#define TRACE_RING	65536	/* bytes of ring buffer, must be a power of two */
+#define TRACE_ALIGN(x)	(((x) + 7) & ~7)
+
+struct trace_record {
+	unsigned short	len;		/* aligned length of record, 0 = skip to start of ring */
+	unsigned char	elements;
+	unsigned char	category;
+	int		port;
+	int		direction;
+	unsigned int	serial;
+	unsigned int	sec, usec;
+	char		data[0];	/* interface, caller, dialing, name, then name, sub and value of each element */
+};
+
+#define TRACE_RECORD_MAX TRACE_ALIGN(sizeof(struct trace_record) + 32 + 64 + 64 + 64 + MAX_TRACE_ELEMENTS * (11 + 11 + 64))
+
+static unsigned char trace_ring[TRACE_RING] __attribute__((aligned(8)));
+static unsigned int trace_head = 0, trace_tail = 0; /* written by producer / consumer only */
+static unsigned int trace_dropped = 0, trace_dropped_reported = 0;
+static unsigned int trace_truncated = 0, trace_truncated_reported = 0;
+
+static union {
+	struct trace_record r;
+	unsigned char b[TRACE_RECORD_MAX];
+} trace_current;
+static int trace_current_len; /* bytes used in trace_current */
+static int trace_started = 0;
+int trace_recording = 0; /* current trace is recorded */
+
+struct trace trace_render;
 char trace_string[MAX_TRACE_ELEMENTS * 100 + 400];
 
+struct lcr_work trace_work;
+
 static const char *spaces = "          ";
 
+/*
+ * checks if a trace matches the filter of a consumer
+ * empty filter values and empty trace values always match
+ */
+static int trace_match(int port, const char *interface, const char *caller, const char *dialing, int category, int t_port, const char *t_interface, const char *t_caller, const char *t_dialing, int t_category)
+{
+	if (port >= 0 && t_port >= 0)
+		if (port != t_port) return(0);
+	if (interface) if (interface[0] && t_interface[0])
+		if (!!strcasecmp(interface, t_interface)) return(0);
+	if (caller) if (caller[0] && t_caller[0])
+		if (!!strncasecmp(caller, t_caller, strlen(t_caller))) return(0);
+	if (dialing) if (dialing[0] && t_dialing[0])
+		if (!!strncasecmp(dialing, t_dialing, strlen(t_dialing))) return(0);
+	if (category && t_category)
+		if (!(category & t_category)) return(0);
+	return(1);
+}
+
+/* append string to current record, truncated to given size */
+static void trace_put(const char *string, int size)
+{
+	int len = 0;
+
+	if (string) {
+		while(string[len] && len < size-1)
+			len++;
+		memcpy(trace_current.b + trace_current_len, string, len);
+	}
+	trace_current.b[trace_current_len + len] = '\0';
+	trace_current_len += len + 1;
+}
+
+/* take string from record */
+static const char *trace_get(const char **p)
+{
+	const char *string = *p;
+
+	*p += strlen(string) + 1;
+	return(string);
+}
+
 /*
  * initializes a new trace
  * all values will be reset
@@ -23,27 +105,37 @@ static const char *spaces = "          ";
 void _start_trace(const char *__file, int __line, int port, struct interface *interface, const char *caller, const char *dialing, int direction, int category, int serial, const char *name)
 {
 	struct timeval current_time;
+	struct admin_list *admin;
+	const char *interface_name = (interface) ? interface->name : "";
+
+	if (trace_started)
+		PERROR("trace already started in file %s line %d\n", __file, __line);
+	trace_started = 1;
+
+	/* only record, if anybody would see the trace */
+	trace_recording = (options.deb || options.log[0]);
+	admin = admin_first;
+	while(admin && !trace_recording) {
+		if (admin->trace.detail && trace_match(admin->trace.port, admin->trace.interface, admin->trace.caller, admin->trace.dialing, admin->trace.category, port, interface_name, (caller) ? caller : "", (dialing) ? dialing : "", category))
+			trace_recording = 1;
+		admin = admin->next;
+	}
+	if (!trace_recording)
+		return;
 
-	if (trace.name[0])
-		PERROR("trace already started (name=%s) in file %s line %d\n", trace.name, __file, __line);
-	memset(&trace, 0, sizeof(struct trace));
-	trace.port = port;
-	if (interface)
-		SCPY(trace.interface, interface->name);
-	if (caller) if (caller[0])
-		SCPY(trace.caller, caller);
-	if (dialing) if (dialing[0])
-		SCPY(trace.dialing, dialing);
-	trace.direction = direction;
-	trace.category = category;
-	trace.serial = serial;
-	if (name) if (name[0])
-		SCPY(trace.name, name);
-	if (!trace.name[0])
-		SCPY(trace.name, "<unknown>");
+	trace_current.r.elements = 0;
+	trace_current.r.category = category;
+	trace_current.r.port = port;
+	trace_current.r.direction = direction;
+	trace_current.r.serial = serial;
 	gettimeofday(&current_time, NULL);
-	trace.sec = current_time.tv_sec;
-	trace.usec = current_time.tv_usec;
+	trace_current.r.sec = current_time.tv_sec;
+	trace_current.r.usec = current_time.tv_usec;
+	trace_current_len = sizeof(struct trace_record);
+	trace_put(interface_name, sizeof(trace_render.interface));
+	trace_put(caller, sizeof(trace_render.caller));
+	trace_put(dialing, sizeof(trace_render.dialing));
+	trace_put((name && name[0]) ? name : "<unknown>", sizeof(trace_render.name));
 }
 
 
@@ -55,8 +147,9 @@ void _start_trace(const char *__file, int __line, int port, struct interface *in
 void _add_trace(const char *__file, int __line, const char *name, const char *sub, const char *fmt, ...)
 {
 	va_list args;
+	int len = 0;
 
-	if (!trace.name[0])
+	if (!trace_started)
 		PERROR("trace not started in file %s line %d\n", __file, __line);
 	
 	/* check for required name value */
@@ -64,22 +157,35 @@ void _add_trace(const char *__file, int __line, const char *name, const char *su
 		goto nostring;
 	if (!name[0]) {
 		nostring:
-		PERROR("trace with name=%s gets element with no string\n", trace.name);
+		PERROR("trace gets element with no string in file %s line %d\n", __file, __line);
+		return;
+	}
+	if (trace_current.r.elements == MAX_TRACE_ELEMENTS) {
+		PERROR("trace has too many elements in file %s line %d\n", __file, __line);
 		return;
 	}
 	
 	/* write name, sub and value */
-	SCPY(trace.element[trace.elements].name, name);
-	if (sub) if (sub[0])
-		SCPY(trace.element[trace.elements].sub, sub);
+	trace_put(name, sizeof(trace_render.element[0].name));
+	trace_put(sub, sizeof(trace_render.element[0].sub));
 	if (fmt) if (fmt[0]) {
 		va_start(args, fmt);
-		VUNPRINT(trace.element[trace.elements].value, sizeof(trace.element[trace.elements].value)-1, fmt, args);
+		len = VUNPRINT((char *)trace_current.b + trace_current_len, sizeof(trace_render.element[0].value), fmt, args);
 		va_end(args);
+		if (len < 0)
+			len = 0;
+		/* the value is cut to the size of the element value, this is
+		 * reported by trace_flush() */
+		if (len > (int)sizeof(trace_render.element[0].value) - 1) {
+			trace_truncated++;
+			len = sizeof(trace_render.element[0].value) - 1;
+		}
 	}
+	trace_current.b[trace_current_len + len] = '\0';
+	trace_current_len += len + 1;
 
 	/* increment elements */
-	trace.elements++;
+	trace_current.r.elements++;
 }
 
 
@@ -87,10 +193,10 @@ void _add_trace(const char *__file, int __line, const char *name, const char *su
  * prints trace to socket or log
  * detail: 1 = brief, 2=short, 3=long
  */
-static char *print_trace(int detail, int port, char *interface, char *caller, char *dialing, int category)
+static char *print_trace(struct trace *t, int detail, int port, char *interface, char *caller, char *dialing, int category)
 {
 	char buffer[256];
-	time_t ti = trace.sec;
+	time_t ti = t->sec;
 	struct tm *tm;
 #ifdef WITH_MISDN
 	struct mISDNport *mISDNport;
@@ -103,70 +209,62 @@ static char *print_trace(int detail, int port, char *interface, char *caller, ch
 		return(NULL);
 
 	/* filter trace */
-	if (port >= 0 && trace.port >= 0)
-		if (port != trace.port) return(NULL);
-	if (interface) if (interface[0] && trace.interface[0])
-		if (!!strcasecmp(interface, trace.interface)) return(NULL);
-	if (caller) if (caller[0] && trace.caller[0])
-		if (!!strncasecmp(caller, trace.caller, strlen(trace.caller))) return(NULL);
-	if (dialing) if (dialing[0] && trace.dialing[0])
-		if (!!strncasecmp(dialing, trace.dialing, strlen(trace.dialing))) return(NULL);
-	if (category && trace.category)
-		if (!(category & trace.category)) return(NULL);
+	if (!trace_match(port, interface, caller, dialing, category, t->port, t->interface, t->caller, t->dialing, t->category))
+		return(NULL);
 
 	/* head */
 	if (detail >= 3) {
 		SCAT(trace_string, "------------------------------------------------------------------------------\n");
 #ifdef WITH_MISDN
 		/* "Port: 1 (BRI PTMP TE)" */
-		if (trace.port >= 0) {
+		if (t->port >= 0) {
 			mISDNport = mISDNport_first;
 			while(mISDNport) {
-				if (mISDNport->portnum == trace.port)
+				if (mISDNport->portnum == t->port)
 					break;
 				mISDNport = mISDNport->next;
 			}
 			if (mISDNport) {
-				SPRINT(buffer, "Port: %d (%s %s %s)", trace.port, (mISDNport->pri)?"PRI":"BRI", (mISDNport->ptp)?"PTP":"PTMP", (mISDNport->ntmode)?"NT":"TE");
+				SPRINT(buffer, "Port: %d (%s %s %s)", t->port, (mISDNport->pri)?"PRI":"BRI", (mISDNport->ptp)?"PTP":"PTMP", (mISDNport->ntmode)?"NT":"TE");
 				/* copy interface, if we have a port */
 				if (mISDNport->ifport) if (mISDNport->ifport->interface)
-				SCPY(trace.interface, mISDNport->ifport->interface->name);
+				SCPY(t->interface, mISDNport->ifport->interface->name);
 			} else
-				SPRINT(buffer, "Port: %d (does not exist)\n", trace.port);
+				SPRINT(buffer, "Port: %d (does not exist)\n", t->port);
 			SCAT(trace_string, buffer);
 		} else
 #endif
 			SCAT(trace_string, "Port: ---");
 
-		if (trace.interface[0]) {
+		if (t->interface[0]) {
 			/* "  Interface: 'Ext'" */
-			SPRINT(buffer, "  Interface: '%s'", trace.interface);
+			SPRINT(buffer, "  Interface: '%s'", t->interface);
 			SCAT(trace_string, buffer);
 		} else
 			SCAT(trace_string, "  Interface: ---");
 			
-		if (trace.caller[0]) {
+		if (t->caller[0]) {
 			/* "  Caller: '021256493'" */
-			SPRINT(buffer, "  Caller: '%s'\n", trace.caller);
+			SPRINT(buffer, "  Caller: '%s'\n", t->caller);
 			SCAT(trace_string, buffer);
 		} else
 			SCAT(trace_string, "  Caller: ---\n");
 
 		/* "Time: 25.08.73 05:14:39.282" */
 		tm = localtime(&ti);
-		SPRINT(buffer, "Time: %02d.%02d.%02d %02d:%02d:%02d.%03d", tm->tm_mday, tm->tm_mon+1, tm->tm_year%100, tm->tm_hour, tm->tm_min, tm->tm_sec, trace.usec/1000);
+		SPRINT(buffer, "Time: %02d.%02d.%02d %02d:%02d:%02d.%03d", tm->tm_mday, tm->tm_mon+1, tm->tm_year%100, tm->tm_hour, tm->tm_min, tm->tm_sec, t->usec/1000);
 		SCAT(trace_string, buffer);
 
-		if (trace.direction) {
+		if (t->direction) {
 			/* "  Direction: out" */
-			SPRINT(buffer, "  Direction: %s", (trace.direction==DIRECTION_OUT)?"OUT":"IN");
+			SPRINT(buffer, "  Direction: %s", (t->direction==DIRECTION_OUT)?"OUT":"IN");
 			SCAT(trace_string, buffer);
 		} else
 			SCAT(trace_string, "  Direction: ---");
 
-		if (trace.dialing[0]) {
+		if (t->dialing[0]) {
 			/* "  Dialing: '57077'" */
-			SPRINT(buffer, "  Dialing: '%s'\n", trace.dialing);
+			SPRINT(buffer, "  Dialing: '%s'\n", t->dialing);
 			SCAT(trace_string, buffer);
 		} else
 			SCAT(trace_string, "  Dialing: ---\n");
@@ -176,12 +274,12 @@ static char *print_trace(int detail, int port, char *interface, char *caller, ch
 
 	if (detail < 3) {
 		tm = localtime(&ti);
-		SPRINT(buffer, "%02d.%02d.%02d %02d:%02d:%02d.%03d ", tm->tm_mday, tm->tm_mon+1, tm->tm_year%100, tm->tm_hour, tm->tm_min, tm->tm_sec, trace.usec/1000);
+		SPRINT(buffer, "%02d.%02d.%02d %02d:%02d:%02d.%03d ", tm->tm_mday, tm->tm_mon+1, tm->tm_year%100, tm->tm_hour, tm->tm_min, tm->tm_sec, t->usec/1000);
 		SCAT(trace_string, buffer);
 	}
 
 	/* "CH(45): CC_SETUP (net->user)" */
-	switch (trace.category) {
+	switch (t->category) {
 		case CATEGORY_CH:
 		SCAT(trace_string, "CH");
 		break;
@@ -193,34 +291,34 @@ static char *print_trace(int detail, int port, char *interface, char *caller, ch
 		default:
 		SCAT(trace_string, "--");
 	}
-	if (trace.serial)
-		SPRINT(buffer, "(%lu): %s", trace.serial, trace.name[0]?trace.name:"<unknown>");
+	if (t->serial)
+		SPRINT(buffer, "(%lu): %s", t->serial, t->name[0]?t->name:"<unknown>");
 	else
-		SPRINT(buffer, ": %s", trace.name[0]?trace.name:"<unknown>");
+		SPRINT(buffer, ": %s", t->name[0]?t->name:"<unknown>");
 	SCAT(trace_string, buffer);
 
 	/* elements */
 	switch(detail) {
 		case 1: /* brief */
-		if (trace.port >= 0) {
-			SPRINT(buffer, "  port %d", trace.port);
+		if (t->port >= 0) {
+			SPRINT(buffer, "  port %d", t->port);
 			SCAT(trace_string, buffer);
 		}
 		i = 0;
-		while(i < trace.elements) {
-			SPRINT(buffer, "  %s", trace.element[i].name);
-			if (i) if (!strcmp(trace.element[i].name, trace.element[i-1].name))
+		while(i < t->elements) {
+			SPRINT(buffer, "  %s", t->element[i].name);
+			if (i) if (!strcmp(t->element[i].name, t->element[i-1].name))
 				buffer[0] = '\0';
 			SCAT(trace_string, buffer);
-			if (trace.element[i].sub[0])
-				SPRINT(buffer, " %s=", trace.element[i].sub);
+			if (t->element[i].sub[0])
+				SPRINT(buffer, " %s=", t->element[i].sub);
 			else
 				SPRINT(buffer, " ");
 			SCAT(trace_string, buffer);
-			if (strchr(trace.element[i].value, ' '))
-				SPRINT(buffer, "'%s'", trace.element[i].value);
+			if (strchr(t->element[i].value, ' '))
+				SPRINT(buffer, "'%s'", t->element[i].value);
 			else
-				SPRINT(buffer, "%s", trace.element[i].value);
+				SPRINT(buffer, "%s", t->element[i].value);
 			SCAT(trace_string, buffer);
 			i++;
 		}
@@ -231,20 +329,20 @@ static char *print_trace(int detail, int port, char *interface, char *caller, ch
 		case 3: /* long */
 		SCAT(trace_string, "\n");
 		i = 0;
-		while(i < trace.elements) {
-			SPRINT(buffer, " %s%s", trace.element[i].name, &spaces[strlen(trace.element[i].name)]);
-			if (i) if (!strcmp(trace.element[i].name, trace.element[i-1].name))
+		while(i < t->elements) {
+			SPRINT(buffer, " %s%s", t->element[i].name, &spaces[strlen(t->element[i].name)]);
+			if (i) if (!strcmp(t->element[i].name, t->element[i-1].name))
 				SPRINT(buffer, "           ");
 			SCAT(trace_string, buffer);
-			if (trace.element[i].sub[0])
-				SPRINT(buffer, " : %s%s = ", trace.element[i].sub, &spaces[strlen(trace.element[i].sub)]);
+			if (t->element[i].sub[0])
+				SPRINT(buffer, " : %s%s = ", t->element[i].sub, &spaces[strlen(t->element[i].sub)]);
 			else
 				SPRINT(buffer, " :              ");
 			SCAT(trace_string, buffer);
-			if (strchr(trace.element[i].value, ' '))
-				SPRINT(buffer, "'%s'\n", trace.element[i].value);
+			if (strchr(t->element[i].value, ' '))
+				SPRINT(buffer, "'%s'\n", t->element[i].value);
 			else
-				SPRINT(buffer, "%s\n", trace.element[i].value);
+				SPRINT(buffer, "%s\n", t->element[i].value);
 			SCAT(trace_string, buffer);
 			i++;
 		}
@@ -259,34 +357,42 @@ static char *print_trace(int detail, int port, char *interface, char *caller, ch
 
 
 /*
- * trace ends
- * this function will put the trace to sockets and logfile, if requested
+ * renders a record from the ring buffer to debug, log and admin listeners
  */
-void _end_trace(const char *__file, int __line)
+static void trace_output(struct trace_record *record)
 {
+	const char *p = record->data;
 	char *string;
-	FILE *fp;
 	struct admin_list	*admin;
 	struct admin_queue	*response, **responsep;	/* response pointer */
-	int ret;
+	int i;
+
+	trace_render.port = record->port;
+	trace_render.direction = record->direction;
+	trace_render.sec = record->sec;
+	trace_render.usec = record->usec;
+	trace_render.category = record->category;
+	trace_render.serial = record->serial;
+	SCPY(trace_render.interface, trace_get(&p));
+	SCPY(trace_render.caller, trace_get(&p));
+	SCPY(trace_render.dialing, trace_get(&p));
+	SCPY(trace_render.name, trace_get(&p));
+	trace_render.elements = record->elements;
+	for (i = 0; i < record->elements; i++) {
+		SCPY(trace_render.element[i].name, trace_get(&p));
+		SCPY(trace_render.element[i].sub, trace_get(&p));
+		SCPY(trace_render.element[i].value, trace_get(&p));
+	}
 
-	if (!trace.name[0])
-		PERROR("trace not started in file %s line %d\n", __file, __line);
-	
 	if (options.deb || options.log[0]) {
-		string = print_trace(1, -1, NULL, NULL, NULL, 0);
+		string = print_trace(&trace_render, 1, -1, NULL, NULL, NULL, 0);
 		if (string) {
 			/* process debug */
 			if (options.deb)
 				debug(NULL, NULL, 0, "TRACE", string);
 			/* process log */
-			if (options.log[0]) {
-				fp = fopen(options.log, "a");
-				if (fp) {
-					ret = fwrite(string, strlen(string), 1, fp);
-					fclose(fp);
-				}
-			}
+			if (options.log[0])
+				log_write(options.log, string, strlen(string));
 		}
 	}
 
@@ -294,7 +400,7 @@ void _end_trace(const char *__file, int __line)
 	admin = admin_first;
 	while(admin) {
 		if (admin->trace.detail) {
-			string = print_trace(admin->trace.detail, admin->trace.port, admin->trace.interface, admin->trace.caller, admin->trace.dialing, admin->trace.category);
+			string = print_trace(&trace_render, admin->trace.detail, admin->trace.port, admin->trace.interface, admin->trace.caller, admin->trace.dialing, admin->trace.category);
 			if (string) {
 				/* seek to end of response list */
 				response = admin->response;
@@ -315,16 +421,98 @@ void _end_trace(const char *__file, int __line)
 				/* attach to response chain */
 				*responsep = response;
 				responsep = &response->next;
-				admin->fd.when |= LCR_FD_WRITE;
+				update_fd(&admin->fd, admin->fd.when | LCR_FD_WRITE);
 			}
 		}
 		admin = admin->next;
 	}
-//	fwrite(string, strlen(string), 1, fp);
+}
+
+/* render all records in the ring buffer */
+static void trace_flush(void)
+{
+	unsigned int head = __atomic_load_n(&trace_head, __ATOMIC_ACQUIRE);
+	unsigned int pos;
+	struct trace_record *record;
+
+	while (trace_tail != head) {
+		pos = trace_tail & (TRACE_RING - 1);
+		record = (struct trace_record *)(trace_ring + pos);
+		if (!record->len) {
+			/* rest of ring was too small for the record */
+			trace_tail += TRACE_RING - pos;
+			continue;
+		}
+		trace_output(record);
+		__atomic_store_n(&trace_tail, trace_tail + record->len, __ATOMIC_RELEASE);
+	}
+
+	if (trace_dropped != trace_dropped_reported) {
+		PERROR("%u trace(s) dropped, because trace buffer was full\n", trace_dropped - trace_dropped_reported);
+		trace_dropped_reported = trace_dropped;
+	}
+	if (trace_truncated != trace_truncated_reported) {
+		PDEBUG(DEBUG_LOG, "%u trace value(s) cut to %d characters\n", trace_truncated - trace_truncated_reported, (int)sizeof(trace_render.element[0].value) - 1);
+		trace_truncated_reported = trace_truncated;
+	}
+}
+
+static int work_trace(struct lcr_work *work, void *instance, int index)
+{
+	trace_flush();
 
-	memset(&trace, 0, sizeof(struct trace));
+	return 0;
 }
 
 
+/*
+ * trace ends
+ * the record is put into the ring buffer and rendered by work_trace()
+ */
+void _end_trace(const char *__file, int __line)
+{
+	unsigned int pos, skip, len;
+
+	if (!trace_started)
+		PERROR("trace not started in file %s line %d\n", __file, __line);
+	trace_started = 0;
+
+	if (!trace_recording)
+		return;
+	trace_recording = 0;
+
+	/* the record must be contiguous, skip the rest of the ring if too small */
+	len = TRACE_ALIGN(trace_current_len);
+	trace_current.r.len = len;
+	pos = trace_head & (TRACE_RING - 1);
+	skip = (pos + len > TRACE_RING) ? TRACE_RING - pos : 0;
+	if (trace_head + skip + len - __atomic_load_n(&trace_tail, __ATOMIC_ACQUIRE) > TRACE_RING) {
+		trace_dropped++;
+		return;
+	}
+	if (skip) {
+		((struct trace_record *)(trace_ring + pos))->len = 0;
+		pos = 0;
+	}
+	memcpy(trace_ring + pos, trace_current.b, trace_current_len);
+	__atomic_store_n(&trace_head, trace_head + skip + len, __ATOMIC_RELEASE);
+
+	/* before the main loop runs, traces are rendered at once */
+	if (trace_work.inuse) {
+		trigger_work(&trace_work);
+	} else
+		trace_flush();
+}
 
+void init_trace(void)
+{
+	memset(&trace_work, 0, sizeof(trace_work));
+	add_work(&trace_work, work_trace, NULL, 0);
+}
 
+void cleanup_trace(void)
+{
+	trace_flush();
+	if (trace_work.inuse)
+		del_work(&trace_work);
+}
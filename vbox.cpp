@@ -27,6 +27,8 @@ VBoxPort::VBoxPort(int type, struct port_settings *settings) : Port(type, "vbox"
 {
 	p_vbox_timeout = 0;
 	p_vbox_announce_fh = -1;
+	p_vbox_announce_cached = NULL;
+	memset(&p_vbox_announce_gsm, 0, sizeof(p_vbox_announce_gsm));
 	p_vbox_audio_start = 0;
 	p_vbox_audio_transferred = 0;
 	p_vbox_record_limit = 0;
@@ -49,6 +51,11 @@ VBoxPort::~VBoxPort()
 		p_vbox_announce_fh = -1;
 		fhuse--;
 	}
+	free_tone_gsm(&p_vbox_announce_gsm);
+	if (p_vbox_announce_cached) {
+		close_tone_cached(p_vbox_announce_cached);
+		p_vbox_announce_cached = NULL;
+	}
 }
 
 
@@ -110,10 +117,10 @@ void VBoxPort::send_announcement(void)
 	long long	now;  /* Time in samples */
 
 	/* don't restart timer, if announcement is played */
-	if (p_vbox_announce_fh < 0)
+	if (p_vbox_announce_fh < 0 && !p_vbox_announce_cached)
 		return;
 
-	gettimeofday(&current_time, NULL);
+	get_monotonic(&current_time);
 	now = (current_time.tv_sec * MICRO_SECONDS + current_time.tv_usec)/125;
 
 	/* set time the first time */
@@ -135,12 +142,21 @@ void VBoxPort::send_announcement(void)
 	p_vbox_audio_transferred += tosend;
 
 	/* if announcement is currently played, send audio data */
-	tosend = read_tone(p_vbox_announce_fh, buffer, p_vbox_announce_codec, tosend, p_vbox_announce_size, &p_vbox_announce_left, 1);
+	if (p_vbox_announce_cached)
+		tosend = read_tone_fetched(&p_vbox_announce_data, buffer, tosend, p_vbox_announce_size, &p_vbox_announce_left, 1);
+	else
+		tosend = read_tone(p_vbox_announce_fh, buffer, p_vbox_announce_codec, tosend, p_vbox_announce_size, &p_vbox_announce_left, 1, &p_vbox_announce_gsm);
 	if (tosend <= 0) {
 		/* end of file */
-		close(p_vbox_announce_fh);
-		p_vbox_announce_fh = -1;
-		fhuse--;
+		if (p_vbox_announce_cached) {
+			close_tone_cached(p_vbox_announce_cached);
+			p_vbox_announce_cached = NULL;
+		} else {
+			close(p_vbox_announce_fh);
+			p_vbox_announce_fh = -1;
+			fhuse--;
+			free_tone_gsm(&p_vbox_announce_gsm);
+		}
 
 		if (p_vbox_record_limit)
 			schedule_timer(&p_vbox_record_timeout, p_vbox_record_limit, 0);
@@ -303,18 +319,24 @@ int VBoxPort::message_epoint(unsigned int epoint_id, int message_id, union param
 		}
 
 		/* play the announcement */
+		if ((p_vbox_announce_cached = open_tone_cached(filename, &p_vbox_announce_codec, &p_vbox_announce_size, &p_vbox_announce_left))) {
+			p_vbox_announce_data = p_vbox_announce_cached;
+			schedule_timer(&p_vbox_announce_timer, 0, 300000);
+		} else
 		if ((p_vbox_announce_fh = open_tone(filename, &p_vbox_announce_codec, &p_vbox_announce_size, &p_vbox_announce_left)) >= 0) {
 			fhuse++;
 			schedule_timer(&p_vbox_announce_timer, 0, 300000);
 		} 
 		vbox_trace_header(this, "ANNOUNCEMENT", DIRECTION_OUT);
 		add_trace("file", "name", "%s", filename);
-		add_trace("file", "exists", "%s", (p_vbox_announce_fh>=0)?"yes":"no");
+		add_trace("file", "exists", "%s", (p_vbox_announce_fh>=0 || p_vbox_announce_cached)?"yes":"no");
+		if (p_vbox_announce_cached)
+			add_trace("file", "cached", "yes");
 		end_trace();
 		/* start recording if desired */
 		p_vbox_mode = p_vbox_ext.vbox_mode;
 		p_vbox_record_limit = p_vbox_ext.vbox_time;
-		if (p_vbox_announce_fh<0 || p_vbox_mode==VBOX_MODE_PARALLEL) {
+		if ((p_vbox_announce_fh<0 && !p_vbox_announce_cached) || p_vbox_mode==VBOX_MODE_PARALLEL) {
 			/* recording start */
 			open_record(p_vbox_ext.vbox_codec, 2, 0, p_vbox_ext.number, p_vbox_ext.anon_ignore, p_vbox_ext.vbox_email, p_vbox_ext.vbox_email_file);
 			vbox_trace_header(this, "RECORDING", DIRECTION_IN);
@@ -27,7 +27,10 @@ class VBoxPort : public Port
 
 //	int p_vbox_recording;				/* if currently recording */
 	int p_vbox_announce_fh;				/* the announcement filehandler */
+	void *p_vbox_announce_cached;			/* the announcement from tone cache, or NULL */
+	void *p_vbox_announce_data;			/* current position in cached announcement */
 	int p_vbox_announce_codec;			/* the announcement codec */
+	struct tone_gsm p_vbox_announce_gsm;		/* decoder state, if the announcement is GSM */
 	signed int p_vbox_announce_left;		/* the number of bytes left of announcement sample */
 	signed int p_vbox_announce_size;		/* size of current announcement (in bytes) */
 	int p_vbox_mode;				/* type of recording VBOX_MODE_* */